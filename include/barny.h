@@ -13,9 +13,23 @@
 #define BARNY_DEFAULT_HEIGHT 48
 #define BARNY_BORDER_RADIUS  28
 #define BARNY_BLUR_RADIUS    2
+#define BARNY_BLUR_QUALITY_MIN 1
+#define BARNY_BLUR_QUALITY_MAX 3
 #define BARNY_MAX_MODULES    32
+/* one-shot deadlines next to the modules' (the sway reconnect) */
+#define BARNY_MAX_TIMERS     4
+#define BARNY_COLLECT_THREADS 2
 #define BARNY_BAR_OVERRUN    6
 
+/* sway IPC message types we use; events have the high bit set */
+#define BARNY_SWAY_IPC_COMMAND        0
+#define BARNY_SWAY_IPC_GET_WORKSPACES 1
+#define BARNY_SWAY_IPC_SUBSCRIBE      2
+#define BARNY_SWAY_IPC_GET_TREE       4
+#define BARNY_SWAY_IPC_EVENT          0x80000000u
+#define BARNY_SWAY_EVENT_WORKSPACE    (BARNY_SWAY_IPC_EVENT | 0)
+#define BARNY_SWAY_EVENT_WINDOW       (BARNY_SWAY_IPC_EVENT | 3)
+
 /* Analytic split of the glass frame lighting: the broad part is painted by
    barny_draw_broad_frame, the edge part is re-derived along the (possibly
    deformed) contour; broad + edge must sum to the gradients painted by
@@ -24,11 +38,17 @@
 #define BARNY_FRAME_EDGE_TOP_STOP 0.14
 #define BARNY_FRAME_EDGE_BOT_A    0.16
 
-typedef struct barny_config barny_config_t;
-typedef struct barny_state  barny_state_t;
-typedef struct barny_output barny_output_t;
-typedef struct barny_module barny_module_t;
-typedef struct barny_menu   barny_menu_t;
+typedef struct barny_config     barny_config_t;
+typedef struct barny_state      barny_state_t;
+typedef struct barny_output     barny_output_t;
+typedef struct barny_module     barny_module_t;
+typedef struct barny_menu       barny_menu_t;
+typedef struct barny_pool       barny_pool_t;
+typedef struct barny_shm_arena  barny_shm_arena_t;
+typedef struct barny_executor   barny_executor_t;
+typedef struct barny_feed       barny_feed_t;
+typedef struct barny_icon_theme barny_icon_theme_t;
+typedef struct barny_dbusmenu   barny_dbusmenu_t;
 
 typedef enum {
 	BARNY_POS_LEFT,
@@ -42,6 +62,10 @@ struct barny_module {
 	int              (*init)(barny_module_t *self, barny_state_t *state);
 	void             (*destroy)(barny_module_t *self);
 	void             (*update)(barny_module_t *self);
+	/* optional blocking half of update: runs on an executor thread and may
+	   only fill the module's own sample; update then runs on the main
+	   thread to publish it */
+	void             (*collect)(barny_module_t *self);
 	void             (*render)(barny_module_t *self, cairo_t *cr, int x, int y, int w,
 	                           int h);
 	void             (*on_click)(barny_module_t *self, int button, int x, int y);
@@ -52,8 +76,18 @@ struct barny_module {
 	bool             dirty;
 	int              update_interval_ms;
 	uint64_t         last_update_ms;
+	/* submitted to the executor and not yet published */
+	bool             collecting;
 };
 
+/* full: stack blur at wallpaper resolution. pyramid: downsample, blur the
+   small copy, upsample -- for large radii, where the full pass is most of
+   startup and the result is smooth enough that nobody can tell. */
+typedef enum {
+	BARNY_BLUR_FULL,
+	BARNY_BLUR_PYRAMID,
+} barny_blur_mode_t;
+
 typedef enum {
 	BARNY_REFRACT_NONE,
 	BARNY_REFRACT_LENS,
@@ -71,6 +105,9 @@ struct barny_config {
 	char                   *font;
 	char                   *wallpaper_path;
 	double                  blur_radius;
+	barny_blur_mode_t       blur_mode;
+	int                     blur_quality;
+	bool                    wallpaper_cache;
 	double                  brightness;
 
 	char                   *text_color;
@@ -115,6 +152,7 @@ struct barny_config {
 	int                     tray_icon_size;
 	int                     tray_icon_spacing;
 	char                   *tray_icon_shape;
+	char                   *tray_icon_theme;
 	int                     tray_icon_corner_radius;
 	double                  tray_icon_bg_r;
 	double                  tray_icon_bg_g;
@@ -127,6 +165,7 @@ struct barny_config {
 	double                  glass_gleam;
 	double                  glass_bulge;
 	double                  glass_prism;
+	int                     glass_threads;
 	bool                    popup_animations;
 
 	barny_refraction_mode_t refraction_mode;
@@ -197,16 +236,45 @@ typedef struct barny_module_layout {
 	int   right_count;
 } barny_module_layout_t;
 
+/* Bars keep a few buffers in flight so a frame is never drawn into pixels
+   the compositor may still be reading. */
+#define BARNY_OUTPUT_BUFFERS 3
+
+typedef struct barny_buffer {
+	struct wl_buffer  *wl_buffer;
+	cairo_surface_t   *cairo_surface;
+	cairo_t           *cr;
+	uint8_t           *data;
+	barny_shm_arena_t *arena;
+	size_t             offset;
+	int                width;
+	int                height;
+	int                stride;
+
+	/* attached and not yet released by the compositor */
+	bool               busy;
+
+	/* what later frames changed that this buffer has not seen yet, in
+	   buffer pixels; empty (w == 0) when it holds the newest frame */
+	int                stale_x;
+	int                stale_y;
+	int                stale_w;
+	int                stale_h;
+
+	void               (*release)(void *data);
+	void              *release_data;
+} barny_buffer_t;
+
 struct barny_output {
 	struct wl_output             *wl_output;
 	struct wl_surface            *surface;
 	struct zwlr_layer_surface_v1 *layer_surface;
 
-	struct wl_buffer             *buffer;
-	cairo_surface_t              *cairo_surface;
-	cairo_t                      *cr;
-	void                         *shm_data;
-	int                           shm_size;
+	barny_buffer_t                buffers[BARNY_OUTPUT_BUFFERS];
+	/* the buffer holding the last committed frame */
+	barny_buffer_t               *front;
+	/* backs the bar and any popup or menu opened on this output */
+	barny_shm_arena_t            *arena;
 
 	int32_t                       width;
 	int32_t                       height;
@@ -238,7 +306,8 @@ struct barny_output {
 
 	/* droplet scratch, reused across frames: the patch geometry is fixed
 	   for a given bar, so allocating a surface and the distance-field
-	   buffers per frame was pure churn */
+	   buffers per frame was pure churn. lens_field holds both fields plus
+	   float copies of the pinch/prism column tables for the SIMD kernels */
 	cairo_surface_t              *lens_patch;
 	int                           lens_patch_w;
 	int                           lens_patch_h;
@@ -263,6 +332,38 @@ struct barny_output {
 	struct barny_output          *next;
 };
 
+/* when a periodic module is next due, in CLOCK_REALTIME ms; with fire set
+   instead of mod, a one-shot timer that leaves the heap when it runs */
+typedef struct {
+	uint64_t        due_ms;
+	barny_module_t *mod;
+	void            (*fire)(barny_state_t *state);
+} barny_deadline_t;
+
+/* Requests a connection can have in flight before it waits for replies. */
+#define BARNY_SWAY_IPC_PIPELINE 32
+
+/* One sway IPC connection. Incoming bytes collect in buf and are framed in
+   place: a message is handed out once all of it has arrived, so reading
+   never waits on a half-sent message. The buffer only grows for a message
+   larger than it; otherwise consumed bytes are reclaimed by shifting the
+   unparsed tail to the front. */
+typedef struct {
+	int      fd;
+	char    *buf;
+	size_t   cap;
+	size_t   start;
+	size_t   end;
+	/* the byte the last payload's terminating NUL replaced */
+	size_t   held_at;
+	char     held;
+	bool     holding;
+	/* types of the requests whose replies are still due, oldest first */
+	uint32_t waiting[BARNY_SWAY_IPC_PIPELINE];
+	int      waiting_head;
+	int      waiting_count;
+} barny_sway_conn_t;
+
 struct barny_state {
 	struct wl_display          *display;
 	struct wl_registry         *registry;
@@ -287,6 +388,9 @@ struct barny_state {
 	uint64_t                    lens_prev_us;
 	bool                        lens_animating;
 
+	/* band-split workers for the droplet; NULL renders it inline */
+	barny_pool_t               *render_pool;
+
 	barny_menu_t               *menu;
 
 	struct wl_keyboard         *keyboard;
@@ -301,19 +405,55 @@ struct barny_state {
 
 	barny_config_t              config;
 
+	/* process start, cleared once the first frame is committed */
+	uint64_t                    start_us;
+
 	cairo_surface_t            *wallpaper;
 	cairo_surface_t            *blurred_wallpaper;
 	cairo_surface_t
-	                *displaced_wallpaper;
-	cairo_surface_t *displacement_map;
-
-	int              epoll_fd;
-	bool             running;
-
-	int              sway_ipc_fd;
-
-	sd_bus          *dbus;
-	int              dbus_fd;
+	                 *displaced_wallpaper;
+	cairo_surface_t  *displacement_map;
+
+	int               epoll_fd;
+	bool              running;
+
+	/* subscriptions arrive on one connection, requests and their replies
+	   use the other, so neither can be mistaken for the other */
+	barny_sway_conn_t sway_events;
+	barny_sway_conn_t sway_cmds;
+
+	sd_bus           *dbus;
+	int               dbus_fd;
+
+	/* the bus's own deadline (call timeouts) on a timerfd, and what
+	   dbus_fd is watched for and dbus_timer_fd armed at (UINT64_MAX:
+	   disarmed), so barny_dbus_prepare only touches them on a change */
+	int               dbus_timer_fd;
+	uint32_t          dbus_events;
+	uint64_t          dbus_timer_us;
+
+	/* periodic module updates as a min-heap on due time; the soonest one
+	   arms timer_fd */
+	barny_deadline_t  deadlines[BARNY_MAX_MODULES + BARNY_MAX_TIMERS];
+	int               deadline_count;
+	int               timer_fd;
+
+	/* runs collect() for modules that have one; NULL collects inline */
+	barny_executor_t *executor;
+
+	/* looks up and decodes tray icons by theme name */
+	barny_icon_theme_t *icon_theme;
+
+	/* helper feeds the modules opened, and the socket helpers ping */
+	barny_feed_t     *feeds;
+	int               feed_fd;
+
+	/* BARNY_DEFER_* work waiting for the next frame callback, whether one
+	   has been asked for, and how many notifications folded into one
+	   that already had */
+	uint32_t          deferred;
+	bool              repaint_scheduled;
+	uint64_t          coalesced_events;
 };
 
 int
@@ -327,9 +467,57 @@ void
 barny_output_destroy_surface(barny_output_t *output);
 int
 barny_output_create_buffer(barny_output_t *output);
+
+barny_shm_arena_t *
+barny_shm_arena_create(struct wl_shm *shm, const char *name);
+barny_shm_arena_t *
+barny_shm_arena_ref(barny_shm_arena_t *arena);
+void
+barny_shm_arena_unref(barny_shm_arena_t *arena);
+uint8_t *
+barny_shm_arena_alloc(barny_shm_arena_t *arena, size_t size, size_t *offset);
+/* released: the compositor is done with whatever buffer used the block, so
+   its pages can be handed back to the kernel and the block reused. If not,
+   the block is kept as it is until it is freed again with released set. */
+void
+barny_shm_arena_free(barny_shm_arena_t *arena, size_t offset, bool released);
+struct wl_buffer *
+barny_shm_arena_buffer(barny_shm_arena_t *arena, size_t offset, int width,
+                       int height, int stride);
+void
+barny_shm_arena_stats(const barny_shm_arena_t *arena, size_t *size,
+                      size_t *used);
+barny_shm_arena_t *
+barny_output_arena(barny_output_t *output);
+
+int
+barny_buffers_create(barny_buffer_t *bufs, int count, barny_shm_arena_t *arena,
+                     int width, int height, int scale);
+void
+barny_buffers_destroy(barny_buffer_t *bufs, int count);
+barny_buffer_t *
+barny_buffers_acquire(barny_buffer_t *bufs, int count);
+void
+barny_buffers_commit(barny_buffer_t *bufs, int count, barny_buffer_t *buf,
+                     int x, int y, int w, int h);
+void
+barny_buffer_copy_forward(barny_buffer_t *dst, const barny_buffer_t *src);
 void
 barny_output_request_frame(barny_output_t *output);
 
+/* Work a change can leave for the next frame; 0 asks for the repaint
+   alone. */
+#define BARNY_DEFER_TRAY (1u << 0)
+
+/* Notes a change: the repaint of every output, and whatever what names,
+   happen at the next frame callback, once however many changes come
+   before it. */
+void
+barny_defer(barny_state_t *state, uint32_t what);
+/* Runs the deferred work; the first frame callback after barny_defer. */
+void
+barny_deferred_flush(barny_state_t *state);
+
 void
 barny_render_frame(barny_output_t *output);
 void
@@ -341,6 +529,17 @@ bool
 barny_lens_rect(barny_output_t *output, int *x, int *y, int *w, int *h);
 void
 barny_output_free_lens_cache(barny_output_t *output);
+
+/* Persistent workers that split a row range into bands. barny_pool_run
+   returns once every band is drawn; with a NULL pool it calls fn once over
+   all rows on the caller's thread. */
+typedef void (*barny_band_fn)(void *ctx, int y0, int y1);
+barny_pool_t *
+barny_pool_create(int threads);
+void
+barny_pool_destroy(barny_pool_t *pool);
+void
+barny_pool_run(barny_pool_t *pool, barny_band_fn fn, void *ctx, int rows);
 void
 barny_render_modules(barny_output_t *output, cairo_t *cr);
 /* rect the module occupies on this output, false when it is not drawn there */
@@ -451,6 +650,10 @@ barny_sample_bilinear(uint8_t *data, int stride, int width, int height,
 void
 barny_blur_surface(cairo_surface_t *surface, int radius);
 void
+barny_blur_surface_pyramid(cairo_surface_t *surface, int radius, int quality);
+int
+barny_blur_pyramid_levels(int radius, int quality);
+void
 barny_apply_brightness(cairo_surface_t *surface, double factor);
 void
 barny_apply_vibrancy(cairo_surface_t *surface, double saturation,
@@ -458,8 +661,23 @@ barny_apply_vibrancy(cairo_surface_t *surface, double saturation,
 cairo_surface_t *
 barny_create_edge_lens_map(int w, int h, int radius, double edge_w,
                            double max_disp);
+/* What the bars will sample from the wallpaper, so the loader can decode no
+   more than that. The wallpaper is drawn scaled to each output's width and
+   anchored at the bar's screen edge: it never needs more columns than the
+   widest output, nor more rows than the tallest output's share of them plus
+   the margin the blur and displacement reach past the screen edge. */
+typedef struct {
+	int    min_width;   /* widest output; 0 decodes at full size */
+	double max_aspect;  /* largest mode_height / width over the outputs */
+	int    margin;      /* rows kept past the screen edge */
+	bool   from_bottom; /* bars at the bottom keep the bottom rows */
+	double scale;       /* out: decoded width / file width */
+} barny_wallpaper_geom_t;
+
 cairo_surface_t *
-barny_load_wallpaper(const char *path);
+barny_load_wallpaper(const char *path, barny_wallpaper_geom_t *geom);
+void
+barny_wallpaper_prepare(barny_state_t *state);
 
 cairo_surface_t *
 barny_create_displacement_map(int width, int height, barny_refraction_mode_t mode,
@@ -486,6 +704,60 @@ barny_module_find(barny_state_t *state, const char *name);
 
 bool
 barny_modules_any_dirty(const barny_state_t *state);
+void
+barny_module_refresh(barny_state_t *state, barny_module_t *mod);
+
+/* Worker threads for blocking collectors. Finished modules are announced on
+   barny_executor_fd; barny_executor_dispatch drains them and runs their
+   update on the calling thread. Destroy gives up on workers still busy
+   after a short deadline and returns false; their modules must then be
+   left alone. */
+barny_executor_t *
+barny_executor_create(int threads);
+bool
+barny_executor_destroy(barny_executor_t *ex);
+int
+barny_executor_fd(const barny_executor_t *ex);
+bool
+barny_executor_submit(barny_executor_t *ex, barny_module_t *mod);
+int
+barny_executor_dispatch(barny_executor_t *ex);
+
+/* Values published by the helpers (see barny_feed.h). barny_feed_read
+   copies the latest text from the helper's shm record, or failing that
+   from its file, and returns its length or -1. A ping on feed_fd refreshes
+   the module that opened the feed. Once barny_feed_live says so, those
+   pings are all a module needs to stay current. */
+barny_feed_t *
+barny_feed_open(barny_state_t *state, const char *name, barny_module_t *mod);
+void
+barny_feed_close(barny_feed_t *feed);
+int
+barny_feed_read(barny_feed_t *feed, char *buf, size_t size);
+bool
+barny_feed_live(const barny_feed_t *feed);
+int
+barny_feed_listen(barny_state_t *state);
+void
+barny_feed_dispatch(barny_state_t *state);
+void
+barny_feed_cleanup(barny_state_t *state);
+
+int
+barny_sched_init(barny_state_t *state);
+void
+barny_sched_reset(barny_state_t *state, uint64_t now_ms);
+uint64_t
+barny_sched_run(barny_state_t *state, uint64_t now_ms);
+void
+barny_sched_dispatch(barny_state_t *state);
+/* Runs fire once, delay_ms from now, off the same timer as the modules.
+   Returns -1 when BARNY_MAX_TIMERS are already pending. */
+int
+barny_sched_after(barny_state_t *state, uint64_t delay_ms,
+                  void (*fire)(barny_state_t *state));
+void
+barny_sched_cleanup(barny_state_t *state);
 
 int
 barny_module_render_text(cairo_t *cr, PangoFontDescription *font,
@@ -499,6 +771,8 @@ barny_module_t *
 barny_module_workspace_create(void);
 void
 barny_workspace_refresh(barny_module_t *mod);
+void
+barny_workspace_event(barny_module_t *mod, uint32_t type, const char *payload);
 barny_module_t *
 barny_module_weather_create(void);
 barny_module_t *
@@ -513,14 +787,25 @@ barny_module_t *
 barny_module_ram_create(void);
 barny_module_t *
 barny_module_network_create(void);
+int
+barny_network_fd(barny_module_t *mod);
+void
+barny_network_dispatch(barny_module_t *mod);
 barny_module_t *
 barny_module_fileread_create(void);
 barny_module_t *
 barny_module_battery_create(void);
+int
+barny_battery_fd(barny_module_t *mod);
+void
+barny_battery_dispatch(barny_module_t *mod);
 barny_module_t *
 barny_module_windowtitle_create(void);
 void
 barny_windowtitle_refresh(barny_module_t *mod);
+void
+barny_windowtitle_event(barny_module_t *mod, uint32_t type,
+                        const char *payload);
 
 void
 barny_module_layout_init(barny_module_layout_t *layout);
@@ -557,6 +842,8 @@ void
 barny_dbus_cleanup(barny_state_t *state);
 int
 barny_dbus_dispatch(barny_state_t *state);
+void
+barny_dbus_prepare(barny_state_t *state);
 
 int
 barny_sni_watcher_init(barny_state_t *state);
@@ -565,17 +852,77 @@ barny_sni_watcher_set_host_registered(bool registered);
 void
 barny_sni_watcher_cleanup(barny_state_t *state);
 
+/* Pre-scaled tray icons, shared by every item; see icon_cache.c. */
+#define BARNY_ICON_CACHE_SIZE 64
+
+uint64_t
+barny_icon_hash(const void *pixels, size_t len, int width, int height);
+/* A new surface no bigger than size either way; src itself when it already
+   fits exactly. */
+cairo_surface_t *
+barny_icon_scale_to_fit(cairo_surface_t *src, int size);
+/* icon scaled to fit size device pixels, or NULL when hash is 0. Borrowed:
+   valid until the next call. */
+cairo_surface_t *
+barny_icon_cache_get(cairo_surface_t *icon, uint64_t hash, int size);
+uint64_t
+barny_icon_cache_misses(void);
+void
+barny_icon_cache_clear(void);
+/* Draws icon centred in the box x, y, box wide and high. */
+void
+barny_icon_paint(cairo_t *cr, cairo_surface_t *icon, uint64_t hash, double x,
+                 double y, double box, double alpha);
+
+/* Icons by theme name, looked up and decoded on a loader thread (see
+   icon_theme.c). done runs from barny_icon_theme_dispatch with a surface
+   the callee owns, or NULL when nothing was found; cancel drops every
+   callback still due for userdata. */
+typedef void (*barny_icon_done_fn)(void *userdata, cairo_surface_t *icon);
+
+barny_icon_theme_t *
+barny_icon_theme_create(const char *theme);
+void
+barny_icon_theme_destroy(barny_icon_theme_t *t);
+int
+barny_icon_theme_fd(const barny_icon_theme_t *t);
+bool
+barny_icon_theme_load(barny_icon_theme_t *t, const char *name,
+                      const char *extra_dir, int size,
+                      barny_icon_done_fn done, void *userdata);
+void
+barny_icon_theme_cancel(barny_icon_theme_t *t, void *userdata);
+int
+barny_icon_theme_dispatch(barny_icon_theme_t *t);
+
 typedef struct sni_item sni_item_t;
 
 struct sni_item {
-	char            *service;
-	char            *object_path;
-	char            *id;
-	char            *title;
-	char            *status;
-	char            *icon_name;
-	cairo_surface_t *icon;
-	sni_item_t      *next;
+	char             *service;
+	char             *object_path;
+	char             *id;
+	char             *title;
+	char             *status;
+	char             *icon_name;
+	char             *icon_theme_path;
+	/* unscaled, premultiplied; drawn through the icon cache */
+	cairo_surface_t  *icon;
+	/* barny_icon_hash of the pixels, 0 for a placeholder */
+	uint64_t          icon_hash;
+	/* drawn from icon_name through the theme, not from a pixmap */
+	bool              icon_named;
+	/* from the same GetAll, so a click needs no round trip */
+	char             *menu_path;
+	bool              is_menu;
+	bool              props_loaded;
+	/* the menu's layout, once hovered or clicked; kept current after */
+	barny_dbusmenu_t *dbusmenu;
+	/* NewIcon arrived; refetched at the next frame */
+	bool              icon_stale;
+	/* calls in flight; unref'ing one drops its reply */
+	sd_bus_slot      *props_call;
+	sd_bus_slot      *icon_call;
+	sni_item_t       *next;
 };
 
 int
@@ -584,6 +931,9 @@ void
 barny_sni_host_cleanup(barny_state_t *state);
 sni_item_t *
 barny_sni_host_get_items(barny_state_t *state);
+/* Refetches stale icons and updates the tray; BARNY_DEFER_TRAY. */
+void
+barny_sni_host_flush(barny_state_t *state);
 void
 barny_sni_item_activate(barny_state_t *state, sni_item_t *item, int x, int y);
 void
@@ -608,11 +958,24 @@ char *
 barny_sni_item_menu_path(barny_state_t *state, sni_item_t *item);
 bool
 barny_sni_item_is_menu(barny_state_t *state, sni_item_t *item);
+/* The item's menu, its layout cached and kept up to date from the
+   application's LayoutUpdated and ItemsPropertiesUpdated signals; NULL
+   when it has none. Owned by the item. */
+barny_dbusmenu_t *
+barny_sni_item_dbusmenu(barny_state_t *state, sni_item_t *item);
+/* Starts fetching the layout in the background if it isn't cached yet, so
+   that a click shortly after finds it there. */
+void
+barny_sni_item_prefetch_menu(barny_state_t *state, sni_item_t *item);
+/* The cached layout, or NULL while none has arrived. The tree is updated
+   in place: the root stays put, nodes under a changed one do not. */
 barny_menu_item_t *
-barny_dbusmenu_get_layout(barny_state_t *state, const char *service,
-                          const char *menu_path);
+barny_dbusmenu_cached(barny_dbusmenu_t *menu);
+/* The cached layout, or, when there is none yet, fetched there and then. */
+barny_menu_item_t *
+barny_dbusmenu_layout(barny_dbusmenu_t *menu);
 void
-barny_dbusmenu_free(barny_menu_item_t *root);
+barny_dbusmenu_destroy(barny_dbusmenu_t *menu);
 void
 barny_dbusmenu_about_to_show(barny_state_t *state, const char *service,
                              const char *menu_path, int id);
@@ -641,19 +1004,50 @@ barny_menu_pointer_button(barny_state_t *state, uint32_t button,
                           uint32_t button_state);
 void
 barny_menu_key_escape(barny_state_t *state);
+/* menu's cached layout changed, or went away; an open menu showing it
+   follows along. */
+void
+barny_menu_dbusmenu_changed(barny_state_t *state, barny_dbusmenu_t *menu);
 
+/* Opens the event and command connections; both fds are -1 on failure. */
 int
 barny_sway_ipc_init(barny_state_t *state);
 void
 barny_sway_ipc_cleanup(barny_state_t *state);
 int
+barny_sway_ipc_reconnect(barny_state_t *state);
+int
 barny_sway_ipc_subscribe(barny_state_t *state, const char *events);
+/* Queues a command without waiting; its reply is read and dropped by
+   barny_sway_ipc_drain_replies. */
 int
-barny_sway_ipc_send(barny_state_t *state, uint32_t type, const char *payload);
-char *
-barny_sway_ipc_recv(barny_state_t *state, uint32_t *type);
+barny_sway_ipc_command(barny_state_t *state, const char *command);
+/* Sends a request behind any still in flight and waits for its reply;
+   NULL on timeout or when the connection drops. */
 char *
-barny_sway_ipc_recv_sync(barny_state_t *state, uint32_t *type, int timeout_ms);
+barny_sway_ipc_request(barny_state_t *state, uint32_t type, const char *payload,
+                       int timeout_ms);
+/* Reads the command connection's pending replies; -1 when it is gone. */
+int
+barny_sway_ipc_drain_replies(barny_state_t *state);
+
+void
+barny_sway_conn_init(barny_sway_conn_t *conn);
+void
+barny_sway_conn_close(barny_sway_conn_t *conn);
+int
+barny_sway_ipc_send(barny_sway_conn_t *conn, uint32_t type,
+                    const char *payload);
+/* Reads what the socket has without blocking: 1 if bytes arrived, 0 when
+   there was nothing, -1 when the connection is gone. */
+int
+barny_sway_ipc_fill(barny_sway_conn_t *conn);
+/* The next whole message already read, without touching the socket: 1 with
+   *payload NUL-terminated and valid until the next fill or next call, 0 when
+   none is complete yet, -1 when the stream is not sway IPC. */
+int
+barny_sway_ipc_next(barny_sway_conn_t *conn, uint32_t *type, char **payload,
+                    uint32_t *len);
 
 int
 barny_config_load(barny_config_t *config, const char *path);
@@ -665,6 +1059,11 @@ void
 barny_config_validate_font(const barny_config_t *config);
 int
 barny_config_exclusive_zone(const barny_config_t *config);
+/* Writes a key's current value the way barny.conf spells it: 0 on
+   success, -1 for an unknown key, an unset string or a short buffer. */
+int
+barny_config_format_key(const barny_config_t *config, const char *key,
+                        char *out, size_t out_len);
 int
 barny_config_write_module_layout(const char *path,
                                  const char *modules_left,
@@ -0,0 +1,82 @@
+#ifndef BARNY_FEED_H
+#define BARNY_FEED_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* The helper -> bar wire format, shared by both sides. Each helper owns one
+   record per value it publishes, in its own POSIX shm object named after
+   the file it used to write (cpu_freq, weather, btc_price, ...). The text is
+   exactly what goes into that file, so the bar parses either source the
+   same way and the files stay valid for scripts.
+
+   The record is a seqlock: the writer makes seq odd, copies, then makes it
+   even again; a reader that sees the same even seq before and after its copy
+   has a consistent snapshot. seq 0 means nothing was ever published. After
+   a write that changed the text the helper sends the record's name as one
+   datagram to the bar's abstract unix socket, so an idle helper costs the
+   bar nothing. */
+
+#define BARNY_FEED_MAGIC    0x62666431u /* "bfd1" */
+#define BARNY_FEED_VERSION  1
+#define BARNY_FEED_NAME_MAX 48
+#define BARNY_FEED_TEXT_MAX 1024
+#define BARNY_FEED_FILE_DIR "/opt/barny/modules"
+
+typedef struct {
+	uint32_t         magic;
+	uint32_t         version;
+	_Atomic uint32_t seq;
+	uint32_t         len;
+	char             text[BARNY_FEED_TEXT_MAX];
+} barny_feed_record_t;
+
+/* per user, so two sessions on one machine do not see each other */
+static inline void
+barny_feed_shm_name(char *buf, size_t size, const char *name)
+{
+	snprintf(buf, size, "/barny-%u-%s", (unsigned)getuid(), name);
+}
+
+/* where the plain-file copy lives; $BARNY_FEED_DIR moves it (tests) */
+static inline void
+barny_feed_file_path(char *buf, size_t size, const char *name)
+{
+	const char *dir = getenv("BARNY_FEED_DIR");
+
+	snprintf(buf, size, "%s/%s", dir && *dir ? dir : BARNY_FEED_FILE_DIR,
+	         name);
+}
+
+/* $BARNY_FEED_SOCKET overrides the name, for a second bar or the tests */
+static inline socklen_t
+barny_feed_socket_addr(struct sockaddr_un *addr)
+{
+	const char *env = getenv("BARNY_FEED_SOCKET");
+	int         n;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (env && *env)
+		n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+		             "%s", env);
+	else
+		n = snprintf(addr->sun_path + 1, sizeof(addr->sun_path) - 1,
+		             "barny-feed-%u", (unsigned)getuid());
+	if (n < 0)
+		n = 0;
+	if ((size_t)n > sizeof(addr->sun_path) - 2)
+		n = (int)sizeof(addr->sun_path) - 2;
+
+	return (socklen_t)(offsetof(struct sockaddr_un, sun_path) + 1
+	                   + (size_t)n);
+}
+
+#endif
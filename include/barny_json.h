@@ -0,0 +1,90 @@
+#ifndef BARNY_JSON_H
+#define BARNY_JSON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An allocation-free reader for sway's IPC replies. Nothing is parsed up
+   front: a value is a span of the NUL-terminated text it came from, and
+   looking inside an object or array walks its members, stepping over the
+   ones nobody asked for by bracket depth. Reading five fields out of a
+   megabyte GET_TREE reply then costs a scan of the text instead of a node
+   allocation for every key in it.
+
+   Spans point into the caller's buffer (the reply, or an event payload
+   still sitting in the receive buffer), so they live as long as it does.
+   Only the parts that are walked get checked; garbage inside a subtree
+   that is skipped over goes unnoticed, as long as its brackets balance. */
+
+/* how deep barny_json_find follows nesting before giving up */
+#define BARNY_JSON_MAX_DEPTH 128
+
+typedef struct {
+	/* first byte of the value, NULL when there is none */
+	const char *start;
+	/* one past its last byte */
+	const char *end;
+} barny_json_t;
+
+typedef struct {
+	const char *p;
+	char        close;
+	bool        first;
+} barny_json_iter_t;
+
+/* The document's top-level value. False when text ends before it does. */
+bool
+barny_json_parse(const char *text, barny_json_t *out);
+
+/* Walks an object's members or an array's elements; key is only set for
+   objects and may be NULL. Anything else yields nothing. next returns false
+   at the end, or on the first malformed member. */
+void
+barny_json_iter(barny_json_iter_t *it, const barny_json_t *container);
+
+bool
+barny_json_next(barny_json_iter_t *it, barny_json_t *key, barny_json_t *val);
+
+/* A dotted path of object keys and array indices: "current.id",
+   "nodes.0.name". False (and out cleared) when any step is missing. */
+bool
+barny_json_path(const barny_json_t *root, const char *path, barny_json_t *out);
+
+/* The first object, at any depth under root, with a member key whose value
+   starts with the text raw ("true", "\"con\"") -- in one pass that stops
+   there, instead of a walk that skips each subtree at every level above it.
+   This is how the one focused node is found in a GET_TREE reply. */
+bool
+barny_json_find(const barny_json_t *root, const char *key, const char *raw,
+                barny_json_t *out);
+
+bool
+barny_json_is_object(const barny_json_t *v);
+
+bool
+barny_json_is_array(const barny_json_t *v);
+
+bool
+barny_json_is_string(const barny_json_t *v);
+
+bool
+barny_json_is_number(const barny_json_t *v);
+
+bool
+barny_json_is_true(const barny_json_t *v);
+
+/* Whether a string (or an object key) is exactly s. Compares the raw text,
+   which is all sway's keys and enum values ever need. */
+bool
+barny_json_streq(const barny_json_t *v, const char *s);
+
+/* A number's integer part, or fallback for anything else. */
+long
+barny_json_long(const barny_json_t *v, long fallback);
+
+/* Unescapes a string into buf, truncating to size - 1 bytes. False (and
+   buf set to "") when v is not a string. */
+bool
+barny_json_string(const barny_json_t *v, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef BARNY_SYSFS_H
+#define BARNY_SYSFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Cached fds for the procfs/sysfs files the modules poll. Both regenerate
+   their contents on every read from offset 0, so a file stays open for the
+   life of the module and an update is one pread instead of
+   fopen/fscanf/fclose. A file whose device went away (ENODEV, a battery or
+   a cpu unplugged) is reopened once on the next read.
+
+   Only for kernel files: a regular file replaced by rename keeps its old
+   inode behind a cached fd, so fileread and the feed files open per read. */
+
+#define BARNY_SYSFS_PATH_MAX 256
+
+typedef struct {
+	char path[BARNY_SYSFS_PATH_MAX];
+	int  fd;
+} barny_sysfs_file_t;
+
+/* Sets the path; the file is opened on the first read. */
+void
+barny_sysfs_init(barny_sysfs_file_t *file, const char *fmt, ...)
+        __attribute__((format(printf, 2, 3)));
+
+void
+barny_sysfs_close(barny_sysfs_file_t *file);
+
+/* Reads the whole file (up to size - 1 bytes) and NUL-terminates it.
+   Returns the length, or -1 with buf set to "". */
+ssize_t
+barny_sysfs_read(barny_sysfs_file_t *file, char *buf, size_t size);
+
+bool
+barny_sysfs_read_ll(barny_sysfs_file_t *file, long long *out);
+
+/* open/read/close without keeping the fd, for probing at init */
+ssize_t
+barny_sysfs_read_path(const char *path, char *buf, size_t size);
+
+bool
+barny_sysfs_read_path_ll(const char *path, long long *out);
+
+/* Allocation-free scanners over a read buffer. Each skips leading blanks,
+   returns the position just past what it parsed, or NULL (and leaves *out
+   alone) when there is no number there. */
+const char *
+barny_scan_ll(const char *p, long long *out);
+
+const char *
+barny_scan_ull(const char *p, unsigned long long *out);
+
+/* plain decimal fractions only, as in /proc/uptime and /proc/loadavg */
+const char *
+barny_scan_double(const char *p, double *out);
+
+/* Finds the line starting with key ("MemTotal:", "POWER_SUPPLY_STATUS=")
+   and returns what follows it on that line, or NULL. */
+const char *
+barny_scan_field(const char *buf, const char *key);
+
+/* Copies a field's value up to the end of its line into out. */
+bool
+barny_scan_field_str(const char *buf, const char *key, char *out, size_t size);
+
+#endif
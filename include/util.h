@@ -20,6 +20,10 @@ barny_now_ms(void);
 uint64_t
 barny_now_us(void);
 
+/* printf to stdout with a "barny: " prefix, only when BARNY_DEBUG is set */
+void
+barny_debug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+
 void
 barny_format_bytes(char *buf, size_t buflen, unsigned long long bytes,
                    int decimals, bool unit_space);
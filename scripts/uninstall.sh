@@ -5,6 +5,7 @@ echo "Stopping barny processes..."
 if command -v barny-session >/dev/null 2>&1; then
     barny-session stop 2>/dev/null || true
 fi
+pkill -f barny-helperd 2>/dev/null || true
 pkill -f barny-weather 2>/dev/null || true
 pkill -f barny-crypto-prices 2>/dev/null || true
 pkill -f barny-cpu-freq 2>/dev/null || true
@@ -13,12 +14,14 @@ pkill -x barny 2>/dev/null || true
 
 echo "Removing installed files..."
 rm -f /usr/bin/barny
+rm -f /usr/bin/barny-helperd
 rm -f /usr/bin/barny-weather
 rm -f /usr/bin/barny-crypto-prices
 rm -f /usr/bin/barny-cpu-freq
 rm -f /usr/bin/barny-cpu-power
 rm -f /usr/bin/barny-session
 rm -f /usr/lib/systemd/user/barny.service
+rm -f /usr/lib/systemd/user/barny-helperd.service
 rm -f /usr/lib/systemd/user/barny-weather.service
 rm -f /usr/lib/systemd/user/barny-crypto-prices.service
 rm -f /usr/lib/systemd/user/barny-cpu-freq.service
@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <float.h>
+#include <stddef.h>
 #include <strings.h>
 #include <limits.h>
 #include <errno.h>
@@ -86,137 +88,6 @@ barny_config_validate_font(const barny_config_t *config)
 	pango_font_description_free(desc);
 }
 
-void
-barny_config_defaults(barny_config_t *config)
-{
-	memset(config, 0, sizeof(*config));
-
-	config->height                        = BARNY_DEFAULT_HEIGHT;
-	config->margin_top                    = 0;
-	config->margin_bottom                 = 0;
-	config->margin_left                   = 0;
-	config->margin_right                  = 0;
-	config->border_radius                 = BARNY_BORDER_RADIUS;
-	config->position_top                  = true;
-	config->font                          = NULL;
-	config->wallpaper_path                = NULL;
-	config->blur_radius                   = BARNY_BLUR_RADIUS;
-	config->brightness                    = 1.1;
-
-	config->text_color                    = NULL;
-	config->text_color_r                  = 0.0;
-	config->text_color_g                  = 0.0;
-	config->text_color_b                  = 0.0;
-	config->text_color_set                = false;
-
-	config->workspace_indicator_size      = 30;
-	config->workspace_spacing             = 10;
-	config->workspace_names               = NULL;
-	config->workspace_name_count          = 0;
-	config->workspace_shape               = NULL;
-	config->workspace_corner_radius       = 4;
-
-	config->module_spacing                = 16;
-	config->modules_left                  = NULL;
-	config->modules_center                = NULL;
-	config->modules_right                 = NULL;
-	config->crypto_pairs                  = NULL;
-	config->crypto_pair_count             = 0;
-	config->crypto_popup_gap              = 0;
-	config->crypto_currency_symbol        = strdup("$");
-	config->crypto_symbol_suffix          = false;
-	config->crypto_decimals               = 0;
-
-	config->sysinfo_freq_combined         = true;
-	config->sysinfo_freq_decimals         = 2;
-	config->sysinfo_power_decimals        = 0;
-	config->sysinfo_p_cores               = 0;
-	config->sysinfo_e_cores               = 0;
-	config->sysinfo_item_spacing          = 8;
-	config->sysinfo_freq_show_unit        = true;
-	config->sysinfo_freq_label_space      = true;
-	config->sysinfo_freq_unit_space       = true;
-	config->sysinfo_power_unit_space      = true;
-	config->sysinfo_temp_unit_space       = true;
-	config->sysinfo_popup_gap             = 0;
-	config->sysinfo_popup_per_core        = false;
-
-	config->tray_icon_size                = 24;
-	config->tray_icon_spacing             = 4;
-	config->tray_icon_shape               = NULL;
-	config->tray_icon_corner_radius       = 4;
-	config->tray_icon_bg_r                = 0.0;
-	config->tray_icon_bg_g                = 0.0;
-	config->tray_icon_bg_b                = 0.0;
-	config->tray_icon_bg_opacity          = 0.3;
-	config->tray_menu_gap                 = 8;
-	config->tray_overflow                 = false;
-
-	config->dynamic_glass                 = true;
-	config->glass_gleam                   = 0.24;
-	config->glass_bulge                   = 15.0;
-	config->glass_prism                   = 0.6;
-	config->popup_animations              = true;
-
-	config->refraction_mode               = BARNY_REFRACT_LENS;
-	config->displacement_scale            = 8.0;
-	config->chromatic_aberration          = 1.5;
-	config->edge_refraction               = 1.2;
-	config->noise_scale                   = 0.02;
-	config->noise_octaves                 = 2;
-
-	config->clock_show_time               = true;
-	config->clock_24h_format              = true;
-	config->clock_show_seconds            = true;
-	config->clock_show_date               = false;
-	config->clock_show_year               = true;
-	config->clock_show_month              = true;
-	config->clock_show_day                = true;
-	config->clock_show_weekday            = true;
-	config->clock_date_order              = 0;
-	config->clock_date_separator          = '/';
-
-	config->disk_path                     = NULL;
-	config->disk_mode                     = NULL;
-	config->disk_decimals                 = 0;
-	config->disk_unit_space               = false;
-
-	config->sysinfo_temp_path             = NULL;
-	config->sysinfo_temp_zone             = -1;
-	config->sysinfo_temp_show_unit        = true;
-
-	config->ram_mode                      = NULL;
-	config->ram_decimals                  = 1;
-	config->ram_used_method               = NULL;
-	config->ram_unit_space                = false;
-
-	config->network_interface             = NULL;
-	config->network_show_ip               = true;
-	config->network_show_interface        = false;
-	config->network_prefer_ipv4           = true;
-	config->network_popup_gap             = 0;
-	config->network_popup_show_ssid       = true;
-	config->network_popup_show_ipv6       = false;
-	config->network_popup_show_mac        = false;
-
-	config->fileread_path                 = NULL;
-	config->fileread_title                = NULL;
-	config->fileread_max_chars            = 64;
-
-	config->battery_path                  = NULL;
-	config->battery_show_status           = true;
-	config->battery_unit_space            = false;
-
-	config->windowtitle_max_length        = 64;
-	config->windowtitle_empty_text        = NULL;
-
-	config->weather_popup_gap             = 0;
-	config->weather_popup_show_humidity   = true;
-	config->weather_popup_show_wind       = true;
-	config->weather_popup_show_pressure   = false;
-	config->weather_popup_show_feels_like = true;
-}
-
 static int
 parse_hex_color(const char *str, double *r, double *g, double *b)
 {
@@ -300,269 +171,502 @@ config_replace_string_array(char ***items, int *count, const char *value)
 	}
 }
 
+/* Every key barny.conf knows, where it lands in barny_config_t, how its
+   value is read and what it starts out as. Parsing, the defaults, freeing
+   the strings and writing a value back out all walk this one table, so a
+   new setting is its struct field plus one line here. */
+
+typedef enum {
+	CONFIG_INT,        /* clamped to [min, max] */
+	CONFIG_DOUBLE,     /* clamped to [min, max] */
+	CONFIG_BOOL,
+	CONFIG_WORD,       /* a bool, true only for values[1] */
+	CONFIG_ENUM,       /* one of values[], anything else is ignored */
+	CONFIG_CHAR,       /* the first character, empty is ignored */
+	CONFIG_STRING,
+	CONFIG_LIST,       /* comma-separated, length kept at .count */
+	CONFIG_COLOR,      /* #rrggbb into three doubles from .offset on */
+	CONFIG_TEXT_COLOR, /* the string, its colour and text_color_set */
+} config_type_t;
+
+typedef struct {
+	const char *name;
+	int         value;
+} config_value_t;
+
+typedef struct {
+	const char           *name;
+	config_type_t         type;
+	size_t                offset;
+	size_t                count;
+	double                min;
+	double                max;
+	double                def;
+	const char           *def_str;
+	const config_value_t *values;
+} config_key_t;
+
+/* the offset of a field, refusing to build when it is not of type T */
+#define CONFIG_FIELD(f, T)                                                     \
+	(offsetof(barny_config_t, f)                                           \
+	 + 0 * sizeof((T *)0 == &((barny_config_t *)0)->f))
+
+#define CONFIG_AT(config, off, T) ((T *)((char *)(config) + (off)))
+#define CONFIG_AT_CONST(config, off, T)                                        \
+	((const T *)((const char *)(config) + (off)))
+
+#define KEY_INT(k, f, lo, hi, d)                                               \
+	{ .name = k, .type = CONFIG_INT, .offset = CONFIG_FIELD(f, int),       \
+	  .min = lo, .max = hi, .def = d }
+#define KEY_DOUBLE(k, f, lo, hi, d)                                            \
+	{ .name = k, .type = CONFIG_DOUBLE, .offset = CONFIG_FIELD(f, double), \
+	  .min = lo, .max = hi, .def = d }
+#define KEY_BOOL(k, f, d)                                                      \
+	{ .name = k, .type = CONFIG_BOOL, .offset = CONFIG_FIELD(f, bool),     \
+	  .def = d }
+#define KEY_WORD(k, f, words, d)                                               \
+	{ .name = k, .type = CONFIG_WORD, .offset = CONFIG_FIELD(f, bool),     \
+	  .values = words, .def = d }
+#define KEY_ENUM(k, f, T, names, d)                                            \
+	{ .name = k, .type = CONFIG_ENUM, .offset = CONFIG_FIELD(f, T),        \
+	  .values = names, .def = d }
+#define KEY_CHAR(k, f, d)                                                      \
+	{ .name = k, .type = CONFIG_CHAR, .offset = CONFIG_FIELD(f, char),     \
+	  .def = d }
+#define KEY_STRING(k, f, d)                                                    \
+	{ .name = k, .type = CONFIG_STRING, .offset = CONFIG_FIELD(f, char *), \
+	  .def_str = d }
+#define KEY_LIST(k, f, n)                                                      \
+	{ .name = k, .type = CONFIG_LIST, .offset = CONFIG_FIELD(f, char **),  \
+	  .count = CONFIG_FIELD(n, int) }
+#define KEY_COLOR(k, f)                                                        \
+	{ .name = k, .type = CONFIG_COLOR, .offset = CONFIG_FIELD(f, double) }
+#define KEY_TEXT_COLOR(k, f)                                                   \
+	{ .name = k, .type = CONFIG_TEXT_COLOR,                                \
+	  .offset = CONFIG_FIELD(f, char *) }
+
+/* enums are stored through an int */
+_Static_assert(sizeof(barny_blur_mode_t) == sizeof(int), "blur_mode size");
+_Static_assert(sizeof(barny_refraction_mode_t) == sizeof(int),
+               "refraction_mode size");
+/* a colour key writes r, g and b in a row */
+_Static_assert(offsetof(barny_config_t, tray_icon_bg_b)
+                       - offsetof(barny_config_t, tray_icon_bg_r)
+                       == 2 * sizeof(double),
+               "tray_icon_bg_* layout");
+
+static const config_value_t position_words[] = {
+	{ "bottom", 0 },
+	{ "top",    1 },
+	{ NULL,     0 },
+};
+
+static const config_value_t symbol_words[] = {
+	{ "prefix", 0 },
+	{ "suffix", 1 },
+	{ NULL,     0 },
+};
+
+static const config_value_t blur_modes[] = {
+	{ "full",    BARNY_BLUR_FULL    },
+	{ "pyramid", BARNY_BLUR_PYRAMID },
+	{ NULL,      0                  },
+};
+
+static const config_value_t refraction_modes[] = {
+	{ "none",   BARNY_REFRACT_NONE   },
+	{ "lens",   BARNY_REFRACT_LENS   },
+	{ "liquid", BARNY_REFRACT_LIQUID },
+	{ NULL,     0                    },
+};
+
+static const config_key_t config_keys[] = {
+	KEY_INT("height", height, INT_MIN, INT_MAX, BARNY_DEFAULT_HEIGHT),
+	KEY_INT("margin_top", margin_top, INT_MIN, INT_MAX, 0),
+	KEY_INT("margin_bottom", margin_bottom, INT_MIN, INT_MAX, 0),
+	KEY_INT("margin_left", margin_left, INT_MIN, INT_MAX, 0),
+	KEY_INT("margin_right", margin_right, INT_MIN, INT_MAX, 0),
+	KEY_INT("border_radius", border_radius, INT_MIN, INT_MAX,
+	        BARNY_BORDER_RADIUS),
+	KEY_WORD("position", position_top, position_words, true),
+	KEY_STRING("font", font, NULL),
+	KEY_STRING("wallpaper", wallpaper_path, NULL),
+	KEY_DOUBLE("blur_radius", blur_radius, -DBL_MAX, DBL_MAX,
+	           BARNY_BLUR_RADIUS),
+	KEY_ENUM("blur_mode", blur_mode, barny_blur_mode_t, blur_modes,
+	         BARNY_BLUR_PYRAMID),
+	KEY_INT("blur_quality", blur_quality, BARNY_BLUR_QUALITY_MIN,
+	        BARNY_BLUR_QUALITY_MAX, 2),
+	KEY_BOOL("wallpaper_cache", wallpaper_cache, true),
+	KEY_DOUBLE("brightness", brightness, -DBL_MAX, DBL_MAX, 1.1),
+	KEY_TEXT_COLOR("text_color", text_color),
+
+	KEY_ENUM("refraction", refraction_mode, barny_refraction_mode_t,
+	         refraction_modes, BARNY_REFRACT_LENS),
+	KEY_DOUBLE("displacement_scale", displacement_scale, -DBL_MAX, DBL_MAX,
+	           8.0),
+	KEY_DOUBLE("chromatic_aberration", chromatic_aberration, -DBL_MAX,
+	           DBL_MAX, 1.5),
+	KEY_DOUBLE("edge_refraction", edge_refraction, -DBL_MAX, DBL_MAX, 1.2),
+	KEY_DOUBLE("noise_scale", noise_scale, -DBL_MAX, DBL_MAX, 0.02),
+	KEY_INT("noise_octaves", noise_octaves, INT_MIN, INT_MAX, 2),
+
+	KEY_INT("workspace_indicator_size", workspace_indicator_size, INT_MIN,
+	        INT_MAX, 30),
+	KEY_INT("workspace_spacing", workspace_spacing, INT_MIN, INT_MAX, 10),
+	KEY_LIST("workspace_names", workspace_names, workspace_name_count),
+	KEY_STRING("workspace_shape", workspace_shape, NULL),
+	KEY_INT("workspace_corner_radius", workspace_corner_radius, 0, 32, 4),
+
+	KEY_BOOL("sysinfo_freq_combined", sysinfo_freq_combined, true),
+	KEY_INT("sysinfo_freq_decimals", sysinfo_freq_decimals, 0, 2, 2),
+	KEY_INT("sysinfo_power_decimals", sysinfo_power_decimals, 0, 2, 0),
+	KEY_INT("sysinfo_p_cores", sysinfo_p_cores, 0, INT_MAX, 0),
+	KEY_INT("sysinfo_e_cores", sysinfo_e_cores, 0, INT_MAX, 0),
+	KEY_INT("sysinfo_item_spacing", sysinfo_item_spacing, 0, 32, 8),
+	KEY_BOOL("sysinfo_freq_show_unit", sysinfo_freq_show_unit, true),
+	KEY_BOOL("sysinfo_freq_label_space", sysinfo_freq_label_space, true),
+	KEY_BOOL("sysinfo_freq_unit_space", sysinfo_freq_unit_space, true),
+	KEY_BOOL("sysinfo_power_unit_space", sysinfo_power_unit_space, true),
+	KEY_BOOL("sysinfo_temp_unit_space", sysinfo_temp_unit_space, true),
+	KEY_INT("sysinfo_popup_gap", sysinfo_popup_gap, 0, 64, 0),
+	KEY_BOOL("sysinfo_popup_per_core", sysinfo_popup_per_core, false),
+
+	KEY_INT("module_spacing", module_spacing, 0, 64, 16),
+	KEY_STRING("modules_left", modules_left, NULL),
+	KEY_STRING("modules_center", modules_center, NULL),
+	KEY_STRING("modules_right", modules_right, NULL),
+
+	KEY_LIST("crypto_pairs", crypto_pairs, crypto_pair_count),
+	KEY_INT("crypto_popup_gap", crypto_popup_gap, 0, 64, 0),
+	KEY_STRING("crypto_currency_symbol", crypto_currency_symbol, "$"),
+	KEY_WORD("crypto_symbol_position", crypto_symbol_suffix, symbol_words,
+	         false),
+	KEY_INT("crypto_decimals", crypto_decimals, 0, 6, 0),
+
+	KEY_INT("tray_icon_size", tray_icon_size, 8, 64, 24),
+	KEY_INT("tray_icon_spacing", tray_icon_spacing, 0, 32, 4),
+	KEY_STRING("tray_icon_shape", tray_icon_shape, NULL),
+	KEY_STRING("tray_icon_theme", tray_icon_theme, NULL),
+	KEY_INT("tray_icon_corner_radius", tray_icon_corner_radius, 0, 32, 4),
+	KEY_COLOR("tray_icon_bg_color", tray_icon_bg_r),
+	KEY_DOUBLE("tray_icon_bg_opacity", tray_icon_bg_opacity, 0.0, 1.0, 0.3),
+	KEY_INT("tray_menu_gap", tray_menu_gap, 0, 128, 8),
+	KEY_BOOL("tray_overflow", tray_overflow, false),
+
+	KEY_BOOL("dynamic_glass", dynamic_glass, true),
+	KEY_DOUBLE("glass_gleam", glass_gleam, -DBL_MAX, DBL_MAX, 0.24),
+	KEY_DOUBLE("glass_bulge", glass_bulge, -DBL_MAX, DBL_MAX, 15.0),
+	KEY_DOUBLE("glass_prism", glass_prism, -DBL_MAX, DBL_MAX, 0.6),
+	KEY_INT("glass_threads", glass_threads, 0, 16, 0),
+	KEY_BOOL("popup_animations", popup_animations, true),
+
+	KEY_BOOL("clock_show_time", clock_show_time, true),
+	KEY_BOOL("clock_24h_format", clock_24h_format, true),
+	KEY_BOOL("clock_show_seconds", clock_show_seconds, true),
+	KEY_BOOL("clock_show_date", clock_show_date, false),
+	KEY_BOOL("clock_show_year", clock_show_year, true),
+	KEY_BOOL("clock_show_month", clock_show_month, true),
+	KEY_BOOL("clock_show_day", clock_show_day, true),
+	KEY_BOOL("clock_show_weekday", clock_show_weekday, true),
+	KEY_INT("clock_date_order", clock_date_order, 0, 2, 0),
+	KEY_CHAR("clock_date_separator", clock_date_separator, '/'),
+
+	KEY_STRING("disk_path", disk_path, NULL),
+	KEY_STRING("disk_mode", disk_mode, NULL),
+	KEY_INT("disk_decimals", disk_decimals, 0, 2, 0),
+	KEY_BOOL("disk_unit_space", disk_unit_space, false),
+
+	KEY_STRING("sysinfo_temp_path", sysinfo_temp_path, NULL),
+	KEY_INT("sysinfo_temp_zone", sysinfo_temp_zone, INT_MIN, INT_MAX, -1),
+	KEY_BOOL("sysinfo_temp_show_unit", sysinfo_temp_show_unit, true),
+
+	KEY_STRING("ram_mode", ram_mode, NULL),
+	KEY_INT("ram_decimals", ram_decimals, 0, 2, 1),
+	KEY_BOOL("ram_unit_space", ram_unit_space, false),
+	KEY_STRING("ram_used_method", ram_used_method, NULL),
+
+	KEY_STRING("network_interface", network_interface, NULL),
+	KEY_BOOL("network_show_ip", network_show_ip, true),
+	KEY_BOOL("network_show_interface", network_show_interface, false),
+	KEY_BOOL("network_prefer_ipv4", network_prefer_ipv4, true),
+	KEY_INT("network_popup_gap", network_popup_gap, 0, 64, 0),
+	KEY_BOOL("network_popup_show_ssid", network_popup_show_ssid, true),
+	KEY_BOOL("network_popup_show_ipv6", network_popup_show_ipv6, false),
+	KEY_BOOL("network_popup_show_mac", network_popup_show_mac, false),
+
+	KEY_STRING("fileread_path", fileread_path, NULL),
+	KEY_STRING("fileread_title", fileread_title, NULL),
+	KEY_INT("fileread_max_chars", fileread_max_chars, 1, 256, 64),
+
+	KEY_STRING("battery_path", battery_path, NULL),
+	KEY_BOOL("battery_show_status", battery_show_status, true),
+	KEY_BOOL("battery_unit_space", battery_unit_space, false),
+
+	KEY_INT("windowtitle_max_length", windowtitle_max_length, 0, 256, 64),
+	KEY_STRING("windowtitle_empty_text", windowtitle_empty_text, NULL),
+
+	KEY_INT("weather_popup_gap", weather_popup_gap, 0, 64, 0),
+	KEY_BOOL("weather_popup_show_humidity", weather_popup_show_humidity,
+	         true),
+	KEY_BOOL("weather_popup_show_wind", weather_popup_show_wind, true),
+	KEY_BOOL("weather_popup_show_pressure", weather_popup_show_pressure,
+	         false),
+	KEY_BOOL("weather_popup_show_feels_like", weather_popup_show_feels_like,
+	         true),
+};
+
+#define CONFIG_KEY_COUNT (sizeof(config_keys) / sizeof(config_keys[0]))
+
+/* Keys are found through a perfect hash: a key's hash picks a bucket, the
+   bucket's displacement picks a slot, and no two keys share a slot, so a
+   lookup is one hash and one strcmp. The displacements are searched for
+   once, the first time a key is looked up, rather than generated into the
+   source -- adding a key stays a one-line change. */
+#define CONFIG_HASH_BUCKETS 64
+#define CONFIG_HASH_SLOTS   256
+
+_Static_assert(CONFIG_KEY_COUNT < CONFIG_HASH_SLOTS / 3 * 2,
+               "grow CONFIG_HASH_SLOTS");
+
+static uint16_t config_hash_disp[CONFIG_HASH_BUCKETS];
+static uint8_t  config_hash_slot[CONFIG_HASH_SLOTS]; /* key index + 1 */
+static bool     config_hash_ready;
+
+static uint64_t
+key_hash(const char *key)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+
+	for (; *key; key++)
+		h = (h ^ (unsigned char)*key) * 0x100000001b3ull;
+	return h;
+}
+
+static unsigned
+key_bucket(uint64_t h)
+{
+	return (unsigned)(h >> 32) & (CONFIG_HASH_BUCKETS - 1);
+}
+
+static unsigned
+key_slot(uint64_t h, unsigned disp)
+{
+	h ^= (uint64_t)disp * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 31;
+	h *= 0xbf58476d1ce4e5b9ull;
+	h ^= h >> 29;
+	return (unsigned)h & (CONFIG_HASH_SLOTS - 1);
+}
+
 static void
-parse_line(barny_config_t *config, const char *key, const char *value)
+key_hash_build(void)
 {
-	if (strcmp(key, "height") == 0) {
-		config->height = atoi(value);
-	} else if (strcmp(key, "margin_top") == 0) {
-		config->margin_top = atoi(value);
-	} else if (strcmp(key, "margin_bottom") == 0) {
-		config->margin_bottom = atoi(value);
-	} else if (strcmp(key, "margin_left") == 0) {
-		config->margin_left = atoi(value);
-	} else if (strcmp(key, "margin_right") == 0) {
-		config->margin_right = atoi(value);
-	} else if (strcmp(key, "border_radius") == 0) {
-		config->border_radius = atoi(value);
-	} else if (strcmp(key, "position") == 0) {
-		config->position_top = strcmp(value, "top") == 0;
-	} else if (strcmp(key, "font") == 0) {
-		free(config->font);
-		config->font = strdup(value);
-	} else if (strcmp(key, "wallpaper") == 0) {
-		free(config->wallpaper_path);
-		config->wallpaper_path = strdup(value);
-	} else if (strcmp(key, "blur_radius") == 0) {
-		config->blur_radius = atof(value);
-	} else if (strcmp(key, "brightness") == 0) {
-		config->brightness = atof(value);
-	} else if (strcmp(key, "text_color") == 0) {
-		free(config->text_color);
-		if (strcmp(value, "default") == 0 || strlen(value) == 0) {
-			config->text_color     = NULL;
-			config->text_color_set = false;
-		} else {
-			config->text_color = strdup(value);
-			if (parse_hex_color(value, &config->text_color_r,
-			                    &config->text_color_g,
-			                    &config->text_color_b)
-			    == 0) {
-				config->text_color_set = true;
-			} else {
+	uint64_t hashes[CONFIG_KEY_COUNT];
+	unsigned slots[CONFIG_KEY_COUNT];
+	unsigned sizes[CONFIG_HASH_BUCKETS] = { 0 };
+	unsigned largest                    = 0;
+	unsigned size, b, d, i, j, n;
+
+	for (i = 0; i < CONFIG_KEY_COUNT; i++) {
+		hashes[i] = key_hash(config_keys[i].name);
+		b         = key_bucket(hashes[i]);
+		if (++sizes[b] > largest)
+			largest = sizes[b];
+	}
+
+	/* the fullest buckets are the hardest to fit, so they go first */
+	for (size = largest; size > 0; size--) {
+		for (b = 0; b < CONFIG_HASH_BUCKETS; b++) {
+			if (sizes[b] != size)
+				continue;
+
+			for (d = 0; d < UINT16_MAX; d++) {
+				n = 0;
+				for (i = 0; i < CONFIG_KEY_COUNT; i++) {
+					if (key_bucket(hashes[i]) != b)
+						continue;
+					slots[n] = key_slot(hashes[i], d);
+					if (config_hash_slot[slots[n]])
+						break;
+					for (j = 0; j < n && slots[j] != slots[n]; j++)
+						;
+					if (j < n)
+						break;
+					n++;
+				}
+				if (n == size)
+					break;
+			}
+
+			/* the key table is fixed at build time, so this is
+			   a bug to fix here, not something to limp past:
+			   writing d anyway would land on taken slots */
+			if (d == UINT16_MAX) {
 				fprintf(stderr,
-				        "barny: invalid text_color '%s', using default\n",
-				        value);
-				config->text_color_set = false;
+				        "barny: no displacement fits config "
+				        "key bucket %u (%u keys); grow "
+				        "CONFIG_HASH_SLOTS\n",
+				        b, size);
+				abort();
+			}
+
+			config_hash_disp[b] = (uint16_t)d;
+			for (i = 0; i < CONFIG_KEY_COUNT; i++) {
+				if (key_bucket(hashes[i]) == b)
+					config_hash_slot[key_slot(hashes[i], d)]
+					        = (uint8_t)(i + 1);
 			}
 		}
-	} else if (strcmp(key, "refraction") == 0) {
-		if (strcmp(value, "none") == 0) {
-			config->refraction_mode = BARNY_REFRACT_NONE;
-		} else if (strcmp(value, "lens") == 0) {
-			config->refraction_mode = BARNY_REFRACT_LENS;
-		} else if (strcmp(value, "liquid") == 0) {
-			config->refraction_mode = BARNY_REFRACT_LIQUID;
+	}
+
+	config_hash_ready = true;
+}
+
+static const config_key_t *
+config_key_find(const char *name)
+{
+	uint64_t h;
+	unsigned idx;
+
+	if (!config_hash_ready)
+		key_hash_build();
+
+	h   = key_hash(name);
+	idx = config_hash_slot[key_slot(h, config_hash_disp[key_bucket(h)])];
+	if (!idx || strcmp(config_keys[idx - 1].name, name) != 0)
+		return NULL;
+	return &config_keys[idx - 1];
+}
+
+void
+barny_config_defaults(barny_config_t *config)
+{
+	const config_key_t *k;
+
+	memset(config, 0, sizeof(*config));
+
+	/* lists, colours and the text colour start out empty */
+	for (k = config_keys; k < config_keys + CONFIG_KEY_COUNT; k++) {
+		switch (k->type) {
+		case CONFIG_INT:
+		case CONFIG_ENUM:
+			*CONFIG_AT(config, k->offset, int) = (int)k->def;
+			break;
+		case CONFIG_DOUBLE:
+			*CONFIG_AT(config, k->offset, double) = k->def;
+			break;
+		case CONFIG_BOOL:
+		case CONFIG_WORD:
+			*CONFIG_AT(config, k->offset, bool) = k->def != 0.0;
+			break;
+		case CONFIG_CHAR:
+			*CONFIG_AT(config, k->offset, char) = (char)k->def;
+			break;
+		case CONFIG_STRING:
+			*CONFIG_AT(config, k->offset, char *)
+			        = k->def_str ? strdup(k->def_str) : NULL;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+static void
+set_text_color(barny_config_t *config, const char *value)
+{
+	free(config->text_color);
+	if (strcmp(value, "default") == 0 || strlen(value) == 0) {
+		config->text_color     = NULL;
+		config->text_color_set = false;
+		return;
+	}
+
+	config->text_color = strdup(value);
+	if (parse_hex_color(value, &config->text_color_r, &config->text_color_g,
+	                    &config->text_color_b)
+	    == 0) {
+		config->text_color_set = true;
+	} else {
+		fprintf(stderr, "barny: invalid text_color '%s', using default\n",
+		        value);
+		config->text_color_set = false;
+	}
+}
+
+static void
+config_key_set(barny_config_t *config, const config_key_t *k,
+               const char *value)
+{
+	const config_value_t *v;
+	char                **str;
+	double                d;
+
+	switch (k->type) {
+	case CONFIG_INT:
+		*CONFIG_AT(config, k->offset, int)
+		        = parse_int_clamped(value, (int)k->min, (int)k->max);
+		break;
+	case CONFIG_DOUBLE:
+		d = atof(value);
+		if (d < k->min)
+			d = k->min;
+		if (d > k->max)
+			d = k->max;
+		*CONFIG_AT(config, k->offset, double) = d;
+		break;
+	case CONFIG_BOOL:
+		*CONFIG_AT(config, k->offset, bool) = parse_bool(value);
+		break;
+	case CONFIG_WORD:
+		*CONFIG_AT(config, k->offset, bool)
+		        = strcmp(value, k->values[1].name) == 0;
+		break;
+	case CONFIG_ENUM:
+		for (v = k->values; v->name; v++) {
+			if (strcmp(value, v->name) == 0) {
+				*CONFIG_AT(config, k->offset, int) = v->value;
+				break;
+			}
 		}
-	} else if (strcmp(key, "displacement_scale") == 0) {
-		config->displacement_scale = atof(value);
-	} else if (strcmp(key, "chromatic_aberration") == 0) {
-		config->chromatic_aberration = atof(value);
-	} else if (strcmp(key, "edge_refraction") == 0) {
-		config->edge_refraction = atof(value);
-	} else if (strcmp(key, "noise_scale") == 0) {
-		config->noise_scale = atof(value);
-	} else if (strcmp(key, "noise_octaves") == 0) {
-		config->noise_octaves = atoi(value);
-	} else if (strcmp(key, "workspace_indicator_size") == 0) {
-		config->workspace_indicator_size = atoi(value);
-	} else if (strcmp(key, "workspace_spacing") == 0) {
-		config->workspace_spacing = atoi(value);
-	} else if (strcmp(key, "workspace_names") == 0) {
-		config_replace_string_array(&config->workspace_names,
-		                            &config->workspace_name_count, value);
-	} else if (strcmp(key, "workspace_shape") == 0) {
-		free(config->workspace_shape);
-		config->workspace_shape = strdup(value);
-	} else if (strcmp(key, "workspace_corner_radius") == 0) {
-		config->workspace_corner_radius = parse_int_clamped(value, 0, 32);
-	} else if (strcmp(key, "sysinfo_freq_combined") == 0) {
-		config->sysinfo_freq_combined = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_freq_decimals") == 0) {
-		config->sysinfo_freq_decimals = parse_int_clamped(value, 0, 2);
-	} else if (strcmp(key, "sysinfo_power_decimals") == 0) {
-		config->sysinfo_power_decimals = parse_int_clamped(value, 0, 2);
-	} else if (strcmp(key, "sysinfo_p_cores") == 0) {
-		config->sysinfo_p_cores = parse_int_clamped(value, 0, INT_MAX);
-	} else if (strcmp(key, "sysinfo_e_cores") == 0) {
-		config->sysinfo_e_cores = parse_int_clamped(value, 0, INT_MAX);
-	} else if (strcmp(key, "sysinfo_item_spacing") == 0) {
-		config->sysinfo_item_spacing = parse_int_clamped(value, 0, 32);
-	} else if (strcmp(key, "sysinfo_freq_show_unit") == 0) {
-		config->sysinfo_freq_show_unit = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_freq_label_space") == 0) {
-		config->sysinfo_freq_label_space = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_freq_unit_space") == 0) {
-		config->sysinfo_freq_unit_space = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_power_unit_space") == 0) {
-		config->sysinfo_power_unit_space = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_temp_unit_space") == 0) {
-		config->sysinfo_temp_unit_space = parse_bool(value);
-	} else if (strcmp(key, "sysinfo_popup_gap") == 0) {
-		config->sysinfo_popup_gap = parse_int_clamped(value, 0, 64);
-	} else if (strcmp(key, "sysinfo_popup_per_core") == 0) {
-		config->sysinfo_popup_per_core = parse_bool(value);
-	} else if (strcmp(key, "module_spacing") == 0) {
-		config->module_spacing = parse_int_clamped(value, 0, 64);
-	} else if (strcmp(key, "modules_left") == 0) {
-		free(config->modules_left);
-		config->modules_left = strdup(value);
-	} else if (strcmp(key, "modules_center") == 0) {
-		free(config->modules_center);
-		config->modules_center = strdup(value);
-	} else if (strcmp(key, "modules_right") == 0) {
-		free(config->modules_right);
-		config->modules_right = strdup(value);
-	} else if (strcmp(key, "crypto_pairs") == 0) {
-		config_replace_string_array(&config->crypto_pairs,
-		                            &config->crypto_pair_count, value);
-	} else if (strcmp(key, "crypto_popup_gap") == 0) {
-		config->crypto_popup_gap = parse_int_clamped(value, 0, 64);
-	} else if (strcmp(key, "crypto_currency_symbol") == 0) {
-		free(config->crypto_currency_symbol);
-		config->crypto_currency_symbol = strdup(value);
-	} else if (strcmp(key, "crypto_symbol_position") == 0) {
-		config->crypto_symbol_suffix = (strcmp(value, "suffix") == 0);
-	} else if (strcmp(key, "crypto_decimals") == 0) {
-		config->crypto_decimals = parse_int_clamped(value, 0, 6);
-	} else if (strcmp(key, "tray_icon_size") == 0) {
-		config->tray_icon_size = parse_int_clamped(value, 8, 64);
-	} else if (strcmp(key, "tray_icon_spacing") == 0) {
-		config->tray_icon_spacing = parse_int_clamped(value, 0, 32);
-	} else if (strcmp(key, "tray_icon_shape") == 0) {
-		free(config->tray_icon_shape);
-		config->tray_icon_shape = strdup(value);
-	} else if (strcmp(key, "tray_icon_corner_radius") == 0) {
-		config->tray_icon_corner_radius = parse_int_clamped(value, 0, 32);
-	} else if (strcmp(key, "tray_icon_bg_color") == 0) {
-		parse_hex_color(value, &config->tray_icon_bg_r,
-		                &config->tray_icon_bg_g, &config->tray_icon_bg_b);
-	} else if (strcmp(key, "tray_icon_bg_opacity") == 0) {
-		double v = atof(value);
-		if (v < 0.0)
-			v = 0.0;
-		if (v > 1.0)
-			v = 1.0;
-		config->tray_icon_bg_opacity = v;
-	} else if (strcmp(key, "tray_menu_gap") == 0) {
-		config->tray_menu_gap = parse_int_clamped(value, 0, 128);
-	} else if (strcmp(key, "tray_overflow") == 0) {
-		config->tray_overflow = parse_bool(value);
-	} else if (strcmp(key, "dynamic_glass") == 0) {
-		config->dynamic_glass = parse_bool(value);
-	} else if (strcmp(key, "glass_gleam") == 0) {
-		config->glass_gleam = atof(value);
-	} else if (strcmp(key, "glass_bulge") == 0) {
-		config->glass_bulge = atof(value);
-	} else if (strcmp(key, "glass_prism") == 0) {
-		config->glass_prism = atof(value);
-	} else if (strcmp(key, "popup_animations") == 0) {
-		config->popup_animations = parse_bool(value);
-
-	} else if (strcmp(key, "clock_show_time") == 0) {
-		config->clock_show_time = parse_bool(value);
-	} else if (strcmp(key, "clock_24h_format") == 0) {
-		config->clock_24h_format = parse_bool(value);
-	} else if (strcmp(key, "clock_show_seconds") == 0) {
-		config->clock_show_seconds = parse_bool(value);
-	} else if (strcmp(key, "clock_show_date") == 0) {
-		config->clock_show_date = parse_bool(value);
-	} else if (strcmp(key, "clock_show_year") == 0) {
-		config->clock_show_year = parse_bool(value);
-	} else if (strcmp(key, "clock_show_month") == 0) {
-		config->clock_show_month = parse_bool(value);
-	} else if (strcmp(key, "clock_show_day") == 0) {
-		config->clock_show_day = parse_bool(value);
-	} else if (strcmp(key, "clock_show_weekday") == 0) {
-		config->clock_show_weekday = parse_bool(value);
-	} else if (strcmp(key, "clock_date_order") == 0) {
-		config->clock_date_order = parse_int_clamped(value, 0, 2);
-	} else if (strcmp(key, "clock_date_separator") == 0) {
-		if (strlen(value) > 0)
-			config->clock_date_separator = value[0];
-
-	} else if (strcmp(key, "disk_path") == 0) {
-		free(config->disk_path);
-		config->disk_path = strdup(value);
-	} else if (strcmp(key, "disk_mode") == 0) {
-		free(config->disk_mode);
-		config->disk_mode = strdup(value);
-	} else if (strcmp(key, "disk_decimals") == 0) {
-		config->disk_decimals = parse_int_clamped(value, 0, 2);
-	} else if (strcmp(key, "disk_unit_space") == 0) {
-		config->disk_unit_space = parse_bool(value);
-
-	} else if (strcmp(key, "sysinfo_temp_path") == 0) {
-		free(config->sysinfo_temp_path);
-		config->sysinfo_temp_path = strdup(value);
-	} else if (strcmp(key, "sysinfo_temp_zone") == 0) {
-		config->sysinfo_temp_zone = atoi(value);
-	} else if (strcmp(key, "sysinfo_temp_show_unit") == 0) {
-		config->sysinfo_temp_show_unit = parse_bool(value);
-
-	} else if (strcmp(key, "ram_mode") == 0) {
-		free(config->ram_mode);
-		config->ram_mode = strdup(value);
-	} else if (strcmp(key, "ram_decimals") == 0) {
-		config->ram_decimals = parse_int_clamped(value, 0, 2);
-	} else if (strcmp(key, "ram_unit_space") == 0) {
-		config->ram_unit_space = parse_bool(value);
-	} else if (strcmp(key, "ram_used_method") == 0) {
-		free(config->ram_used_method);
-		config->ram_used_method = strdup(value);
-
-	} else if (strcmp(key, "network_interface") == 0) {
-		free(config->network_interface);
-		config->network_interface = strdup(value);
-	} else if (strcmp(key, "network_show_ip") == 0) {
-		config->network_show_ip = parse_bool(value);
-	} else if (strcmp(key, "network_show_interface") == 0) {
-		config->network_show_interface = parse_bool(value);
-	} else if (strcmp(key, "network_prefer_ipv4") == 0) {
-		config->network_prefer_ipv4 = parse_bool(value);
-	} else if (strcmp(key, "network_popup_gap") == 0) {
-		config->network_popup_gap = parse_int_clamped(value, 0, 64);
-	} else if (strcmp(key, "network_popup_show_ssid") == 0) {
-		config->network_popup_show_ssid = parse_bool(value);
-	} else if (strcmp(key, "network_popup_show_ipv6") == 0) {
-		config->network_popup_show_ipv6 = parse_bool(value);
-	} else if (strcmp(key, "network_popup_show_mac") == 0) {
-		config->network_popup_show_mac = parse_bool(value);
-
-	} else if (strcmp(key, "fileread_path") == 0) {
-		free(config->fileread_path);
-		config->fileread_path = strdup(value);
-	} else if (strcmp(key, "fileread_title") == 0) {
-		free(config->fileread_title);
-		config->fileread_title = strdup(value);
-	} else if (strcmp(key, "fileread_max_chars") == 0) {
-		config->fileread_max_chars = parse_int_clamped(value, 1, 256);
-
-	} else if (strcmp(key, "battery_path") == 0) {
-		free(config->battery_path);
-		config->battery_path = strdup(value);
-	} else if (strcmp(key, "battery_show_status") == 0) {
-		config->battery_show_status = parse_bool(value);
-	} else if (strcmp(key, "battery_unit_space") == 0) {
-		config->battery_unit_space = parse_bool(value);
-	} else if (strcmp(key, "windowtitle_max_length") == 0) {
-		config->windowtitle_max_length = parse_int_clamped(value, 0, 256);
-	} else if (strcmp(key, "windowtitle_empty_text") == 0) {
-		free(config->windowtitle_empty_text);
-		config->windowtitle_empty_text = strdup(value);
-	} else if (strcmp(key, "weather_popup_gap") == 0) {
-		config->weather_popup_gap = parse_int_clamped(value, 0, 64);
-	} else if (strcmp(key, "weather_popup_show_humidity") == 0) {
-		config->weather_popup_show_humidity = parse_bool(value);
-	} else if (strcmp(key, "weather_popup_show_wind") == 0) {
-		config->weather_popup_show_wind = parse_bool(value);
-	} else if (strcmp(key, "weather_popup_show_pressure") == 0) {
-		config->weather_popup_show_pressure = parse_bool(value);
-	} else if (strcmp(key, "weather_popup_show_feels_like") == 0) {
-		config->weather_popup_show_feels_like = parse_bool(value);
+		break;
+	case CONFIG_CHAR:
+		if (*value)
+			*CONFIG_AT(config, k->offset, char) = value[0];
+		break;
+	case CONFIG_STRING:
+		str = CONFIG_AT(config, k->offset, char *);
+		free(*str);
+		*str = strdup(value);
+		break;
+	case CONFIG_LIST:
+		config_replace_string_array(CONFIG_AT(config, k->offset, char **),
+		                            CONFIG_AT(config, k->count, int),
+		                            value);
+		break;
+	case CONFIG_COLOR:
+		parse_hex_color(value, CONFIG_AT(config, k->offset, double),
+		                CONFIG_AT(config, k->offset + sizeof(double),
+		                          double),
+		                CONFIG_AT(config, k->offset + 2 * sizeof(double),
+		                          double));
+		break;
+	case CONFIG_TEXT_COLOR:
+		set_text_color(config, value);
+		break;
 	}
 }
 
+static void
+parse_line(barny_config_t *config, const char *key, const char *value)
+{
+	const config_key_t *k = config_key_find(key);
+
+	if (k)
+		config_key_set(config, k, value);
+}
+
 int
 barny_config_load(barny_config_t *config, const char *path)
 {
@@ -633,43 +737,133 @@ barny_config_load(barny_config_t *config, const char *path)
 void
 barny_config_cleanup(barny_config_t *config)
 {
+	const config_key_t *k;
+	char             ***items;
+	char              **str;
+	int                *count;
+
 	if (!config) {
 		return;
 	}
 
-	free(config->font);
-	free(config->wallpaper_path);
-	free(config->text_color);
-	free(config->workspace_shape);
-	free(config->modules_left);
-	free(config->modules_center);
-	free(config->modules_right);
-	if (config->crypto_pairs) {
-		barny_free_string_array(config->crypto_pairs,
-		                        (size_t)config->crypto_pair_count);
-		config->crypto_pairs      = NULL;
-		config->crypto_pair_count = 0;
+	for (k = config_keys; k < config_keys + CONFIG_KEY_COUNT; k++) {
+		switch (k->type) {
+		case CONFIG_STRING:
+		case CONFIG_TEXT_COLOR:
+			str = CONFIG_AT(config, k->offset, char *);
+			free(*str);
+			*str = NULL;
+			break;
+		case CONFIG_LIST:
+			items = CONFIG_AT(config, k->offset, char **);
+			count = CONFIG_AT(config, k->count, int);
+			if (*items) {
+				barny_free_string_array(*items, (size_t)*count);
+				*items = NULL;
+				*count = 0;
+			}
+			break;
+		default:
+			break;
+		}
 	}
-	free(config->crypto_currency_symbol);
-	config->crypto_currency_symbol = NULL;
-	free(config->tray_icon_shape);
-	free(config->disk_path);
-	free(config->disk_mode);
-	free(config->sysinfo_temp_path);
-	free(config->ram_mode);
-	free(config->ram_used_method);
-	free(config->network_interface);
-	free(config->fileread_path);
-	free(config->fileread_title);
-	free(config->battery_path);
-	free(config->windowtitle_empty_text);
-
-	if (config->workspace_names) {
-		barny_free_string_array(config->workspace_names,
-		                        (size_t)config->workspace_name_count);
-		config->workspace_names      = NULL;
-		config->workspace_name_count = 0;
+}
+
+static unsigned
+color_byte(const barny_config_t *config, size_t offset)
+{
+	double c = *CONFIG_AT_CONST(config, offset, double);
+
+	if (c <= 0.0)
+		return 0;
+	if (c >= 1.0)
+		return 255;
+	return (unsigned)(c * 255.0 + 0.5);
+}
+
+int
+barny_config_format_key(const barny_config_t *config, const char *key,
+                        char *out, size_t out_len)
+{
+	const config_key_t   *k;
+	const config_value_t *v;
+	const char           *s;
+	const char          **items;
+	int                   count;
+	int                   n = -1;
+	size_t                used;
+	int                   i;
+
+	if (!config || !key || !out || out_len == 0)
+		return -1;
+
+	k = config_key_find(key);
+	if (!k)
+		return -1;
+
+	switch (k->type) {
+	case CONFIG_INT:
+		n = snprintf(out, out_len, "%d",
+		             *CONFIG_AT_CONST(config, k->offset, int));
+		break;
+	case CONFIG_DOUBLE:
+		n = snprintf(out, out_len, "%g",
+		             *CONFIG_AT_CONST(config, k->offset, double));
+		break;
+	case CONFIG_BOOL:
+		n = snprintf(out, out_len, "%s",
+		             *CONFIG_AT_CONST(config, k->offset, bool) ? "true"
+		                                                       : "false");
+		break;
+	case CONFIG_WORD:
+		n = snprintf(out, out_len, "%s",
+		             k->values[*CONFIG_AT_CONST(config, k->offset, bool)]
+		                     .name);
+		break;
+	case CONFIG_ENUM:
+		for (v = k->values; v->name; v++) {
+			if (v->value == *CONFIG_AT_CONST(config, k->offset, int)) {
+				n = snprintf(out, out_len, "%s", v->name);
+				break;
+			}
+		}
+		break;
+	case CONFIG_CHAR:
+		if (*CONFIG_AT_CONST(config, k->offset, char))
+			n = snprintf(out, out_len, "%c",
+			             *CONFIG_AT_CONST(config, k->offset, char));
+		break;
+	case CONFIG_STRING:
+	case CONFIG_TEXT_COLOR:
+		s = *CONFIG_AT_CONST(config, k->offset, char *);
+		if (s)
+			n = snprintf(out, out_len, "%s", s);
+		break;
+	case CONFIG_LIST:
+		items = *CONFIG_AT_CONST(config, k->offset, char **);
+		count = *CONFIG_AT_CONST(config, k->count, int);
+		used   = 0;
+		out[0] = '\0';
+		for (i = 0; i < count && items; i++) {
+			n = snprintf(out + used, out_len - used, "%s%s",
+			             i ? ", " : "", items[i]);
+			if (n < 0 || (size_t)n >= out_len - used)
+				return -1;
+			used += (size_t)n;
+		}
+		n = (int)used;
+		break;
+	case CONFIG_COLOR:
+		n = snprintf(out, out_len, "#%02x%02x%02x",
+		             color_byte(config, k->offset),
+		             color_byte(config, k->offset + sizeof(double)),
+		             color_byte(config, k->offset + 2 * sizeof(double)));
+		break;
 	}
+
+	if (n < 0 || (size_t)n >= out_len)
+		return -1;
+	return 0;
 }
 
 int
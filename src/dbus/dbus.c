@@ -1,5 +1,10 @@
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 
 #include "barny.h"
@@ -9,6 +14,10 @@ barny_dbus_init(barny_state_t *state)
 {
 	int r;
 
+	state->dbus_timer_fd = -1;
+	state->dbus_events   = EPOLLIN;
+	state->dbus_timer_us = UINT64_MAX;
+
 	r = sd_bus_open_user(&state->dbus);
 	if (r < 0) {
 		fprintf(stderr, "barny: failed to connect to session bus: %s\n",
@@ -29,6 +38,12 @@ barny_dbus_init(barny_state_t *state)
 
 	printf("barny: connected to D-Bus session bus (fd=%d)\n", state->dbus_fd);
 
+	/* without it a call nobody answers stays pending for good */
+	state->dbus_timer_fd = timerfd_create(CLOCK_MONOTONIC,
+	                                      TFD_NONBLOCK | TFD_CLOEXEC);
+	if (state->dbus_timer_fd < 0)
+		fprintf(stderr, "barny: D-Bus timerfd: %s\n", strerror(errno));
+
 	if (barny_sni_watcher_init(state) < 0) {
 		fprintf(stderr, "barny: failed to initialize SNI watcher\n");
 	}
@@ -53,17 +68,29 @@ barny_dbus_cleanup(barny_state_t *state)
 		state->dbus = NULL;
 	}
 	state->dbus_fd = -1;
+
+	if (state->dbus_timer_fd >= 0) {
+		close(state->dbus_timer_fd);
+		state->dbus_timer_fd = -1;
+	}
 }
 
 int
 barny_dbus_dispatch(barny_state_t *state)
 {
-	int r;
+	uint64_t expirations;
+	int      r;
 
 	if (!state->dbus) {
 		return 0;
 	}
 
+	/* a timerfd that fired is disarmed until prepare says otherwise */
+	if (state->dbus_timer_fd >= 0
+	    && read(state->dbus_timer_fd, &expirations, sizeof(expirations))
+	               == sizeof(expirations))
+		state->dbus_timer_us = UINT64_MAX;
+
 	for (;;) {
 		r = sd_bus_process(state->dbus, NULL);
 		if (r < 0) {
@@ -78,3 +105,49 @@ barny_dbus_dispatch(barny_state_t *state)
 
 	return 0;
 }
+
+/* Before the loop sleeps: anything sent since the last dispatch may have
+   left writes queued (the socket was full) or a reply to time out. sd-bus
+   says what it waits for; the fd is watched for writing only while that
+   includes POLLOUT, and the timerfd carries its deadline, which is on
+   CLOCK_MONOTONIC already. */
+void
+barny_dbus_prepare(barny_state_t *state)
+{
+	struct epoll_event ev = { .data.fd = state->dbus_fd };
+	struct itimerspec  its;
+	uint64_t           usec;
+	int                events;
+
+	if (!state->dbus)
+		return;
+
+	events = sd_bus_get_events(state->dbus);
+	if (events >= 0) {
+		ev.events = EPOLLIN | ((events & POLLOUT) ? EPOLLOUT : 0);
+		if (ev.events != state->dbus_events
+		    && epoll_ctl(state->epoll_fd, EPOLL_CTL_MOD, state->dbus_fd,
+		                 &ev)
+		               == 0)
+			state->dbus_events = ev.events;
+	}
+
+	if (state->dbus_timer_fd < 0)
+		return;
+	if (sd_bus_get_timeout(state->dbus, &usec) < 0)
+		usec = UINT64_MAX;
+	if (usec == state->dbus_timer_us)
+		return;
+
+	/* 0 would disarm; the soonest absolute time fires at once */
+	memset(&its, 0, sizeof(its));
+	if (usec != UINT64_MAX) {
+		its.it_value.tv_sec  = (time_t)(usec / 1000000);
+		its.it_value.tv_nsec = (long)(usec % 1000000) * 1000;
+		if (usec == 0)
+			its.it_value.tv_nsec = 1;
+	}
+	if (timerfd_settime(state->dbus_timer_fd, TFD_TIMER_ABSTIME, &its, NULL)
+	    == 0)
+		state->dbus_timer_us = usec;
+}
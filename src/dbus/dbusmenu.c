@@ -49,6 +49,13 @@ barny_sni_item_menu_path(barny_state_t *state, sni_item_t *item)
 	if (!state || !state->dbus || !item || !item->service)
 		return NULL;
 
+	/* known from the item's GetAll once that has been answered */
+	if (item->props_loaded)
+		return item->menu_path && item->menu_path[0]
+		               && strcmp(item->menu_path, "/") != 0
+		           ? strdup(item->menu_path)
+		           : NULL;
+
 	r = sd_bus_get_property(state->dbus, item->service, item->object_path,
 	                        SNI_ITEM_INTERFACE, "Menu", &error, &reply, "o");
 	if (r >= 0 && sd_bus_message_read(reply, "o", &path) >= 0 && path
@@ -70,6 +77,9 @@ barny_sni_item_is_menu(barny_state_t *state, sni_item_t *item)
 	if (!state || !state->dbus || !item || !item->service)
 		return false;
 
+	if (item->props_loaded)
+		return item->is_menu;
+
 	r = sd_bus_get_property_trivial(state->dbus, item->service,
 	                                item->object_path, SNI_ITEM_INTERFACE,
 	                                "ItemIsMenu", &error, 'b', &is_menu);
@@ -109,14 +119,13 @@ read_property(sd_bus_message *m, const char *key, barny_menu_item_t *item)
 		item->visible = b;
 	} else if (strcmp(key, "type") == 0 && contents[0] == 's') {
 		const char *s = NULL;
-		if (sd_bus_message_read(m, "s", &s) >= 0 && s
-		    && strcmp(s, "separator") == 0)
-			item->separator = true;
+		if (sd_bus_message_read(m, "s", &s) >= 0)
+			item->separator = s && strcmp(s, "separator") == 0;
 	} else if (strcmp(key, "children-display") == 0 && contents[0] == 's') {
 		const char *s = NULL;
-		if (sd_bus_message_read(m, "s", &s) >= 0 && s
-		    && strcmp(s, "submenu") == 0)
-			item->has_submenu = true;
+		if (sd_bus_message_read(m, "s", &s) >= 0)
+			item->has_submenu = (s && strcmp(s, "submenu") == 0)
+			                    || item->child_count > 0;
 	} else if (strcmp(key, "toggle-state") == 0 && contents[0] == 'i') {
 		int v = -1;
 		sd_bus_message_read(m, "i", &v);
@@ -128,6 +137,26 @@ read_property(sd_bus_message *m, const char *key, barny_menu_item_t *item)
 	sd_bus_message_exit_container(m);
 }
 
+/* ItemsPropertiesUpdated lists properties gone back to their default. */
+static void
+reset_property(barny_menu_item_t *item, const char *key)
+{
+	if (strcmp(key, "label") == 0) {
+		free(item->label);
+		item->label = NULL;
+	} else if (strcmp(key, "enabled") == 0) {
+		item->enabled = true;
+	} else if (strcmp(key, "visible") == 0) {
+		item->visible = true;
+	} else if (strcmp(key, "type") == 0) {
+		item->separator = false;
+	} else if (strcmp(key, "children-display") == 0) {
+		item->has_submenu = item->child_count > 0;
+	} else if (strcmp(key, "toggle-state") == 0) {
+		item->toggle_state = -1;
+	}
+}
+
 static int
 parse_node(sd_bus_message *m, barny_menu_item_t *item)
 {
@@ -184,97 +213,507 @@ fail:
 	return -1;
 }
 
-barny_menu_item_t *
-barny_dbusmenu_get_layout(barny_state_t *state, const char *service,
-                          const char *menu_path)
+static void
+free_node_contents(barny_menu_item_t *n)
 {
-	sd_bus_error       error = SD_BUS_ERROR_NULL;
-	sd_bus_message    *call  = NULL;
-	sd_bus_message    *reply = NULL;
-	barny_menu_item_t *root  = NULL;
-	uint32_t           revision;
-	int                r;
+	int i;
 
-	if (!state || !state->dbus || !service || !menu_path)
+	for (i = 0; i < n->child_count; i++)
+		free_node_contents(&n->children[i]);
+
+	free(n->children);
+	free(n->label);
+}
+
+static void
+free_tree(barny_menu_item_t *root)
+{
+	if (!root)
+		return;
+
+	free_node_contents(root);
+	free(root);
+}
+
+/* A GetLayout reply's tree, or NULL. */
+static barny_menu_item_t *
+read_layout(sd_bus_message *reply, uint32_t *revision)
+{
+	barny_menu_item_t *root;
+
+	if (sd_bus_message_read(reply, "u", revision) < 0)
 		return NULL;
 
-	r = sd_bus_message_new_method_call(state->dbus, &call, service, menu_path,
+	root = calloc(1, sizeof(*root));
+	if (!root)
+		return NULL;
+
+	if (parse_node(reply, root) < 0) {
+		free_tree(root);
+		return NULL;
+	}
+
+	return root;
+}
+
+static barny_menu_item_t *
+find_node(barny_menu_item_t *n, int id)
+{
+	barny_menu_item_t *found;
+	int                i;
+
+	if (n->id == id)
+		return n;
+
+	for (i = 0; i < n->child_count; i++) {
+		found = find_node(&n->children[i], id);
+		if (found)
+			return found;
+	}
+
+	return NULL;
+}
+
+/* Puts src's contents in dst's place. dst itself stays where it is, so
+   whatever points at it -- the root, an open submenu -- still does;
+   everything below it is new. */
+static void
+take_node(barny_menu_item_t *dst, barny_menu_item_t *src)
+{
+	free_node_contents(dst);
+	*dst = *src;
+	free(src);
+}
+
+/* --- the per-item cache --- */
+
+/* Menus of big applications run to hundreds of entries, and fetching one
+   whole on every click is a round trip to an application that may be busy
+   doing something else. So each item's layout is fetched once, ideally
+   while the pointer is still on its way to the click, and kept: the
+   application announces every change with LayoutUpdated (naming the node
+   whose children changed) or ItemsPropertiesUpdated (labels, toggles,
+   sensitivity), and only that much is fetched or patched in place. */
+
+typedef struct dbusmenu_fetch dbusmenu_fetch_t;
+
+/* a subtree's GetLayout in flight */
+struct dbusmenu_fetch {
+	barny_dbusmenu_t *menu;
+	int               parent;
+	sd_bus_slot      *slot;
+	dbusmenu_fetch_t *next;
+};
+
+struct barny_dbusmenu {
+	barny_state_t     *state;
+	char              *service;
+	char              *path;
+	/* the whole tree; the root node itself never moves */
+	barny_menu_item_t *root;
+	uint32_t           revision;
+	/* a whole-tree GetLayout in flight */
+	sd_bus_slot       *layout_call;
+	dbusmenu_fetch_t  *fetches;
+	sd_bus_slot       *layout_match;
+	sd_bus_slot       *props_match;
+};
+
+static int
+new_layout_call(barny_dbusmenu_t *menu, int parent, sd_bus_message **call)
+{
+	int r;
+
+	r = sd_bus_message_new_method_call(menu->state->dbus, call,
+	                                   menu->service, menu->path,
 	                                   DBUSMENU_INTERFACE, "GetLayout");
 	if (r < 0)
-		goto out;
+		return r;
 
-	sd_bus_message_append(call, "ii", 0, -1);
-	sd_bus_message_open_container(call, 'a', "s");
-	sd_bus_message_close_container(call);
+	/* every level below parent, every property */
+	sd_bus_message_append(*call, "ii", parent, -1);
+	sd_bus_message_open_container(*call, 'a', "s");
+	return sd_bus_message_close_container(*call);
+}
 
-	r = sd_bus_call(state->dbus, call, 0, &error, &reply);
-	if (r < 0) {
+static void
+store_layout(barny_dbusmenu_t *menu, barny_menu_item_t *root,
+             uint32_t revision)
+{
+	if (menu->root)
+		take_node(menu->root, root);
+	else
+		menu->root = root;
+	menu->revision = revision;
+}
+
+static int
+layout_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	barny_dbusmenu_t   *menu = userdata;
+	barny_menu_item_t  *root;
+	const sd_bus_error *err;
+	uint32_t            revision;
+
+	(void)ret_error;
+
+	menu->layout_call = sd_bus_slot_unref(menu->layout_call);
+
+	err = sd_bus_message_get_error(m);
+	if (err) {
 		fprintf(stderr, "barny: dbusmenu GetLayout failed: %s\n",
-		        error.message ? error.message : strerror(-r));
-		goto out;
+		        err->message ? err->message : err->name);
+		return 0;
 	}
 
-	if (sd_bus_message_read(reply, "u", &revision) < 0)
-		goto out;
-
-	root = calloc(1, sizeof(*root));
+	root = read_layout(m, &revision);
 	if (!root)
-		goto out;
+		return 0;
 
-	if (parse_node(reply, root) < 0) {
-		barny_dbusmenu_free(root);
-		root = NULL;
-	}
+	store_layout(menu, root, revision);
+	barny_menu_dbusmenu_changed(menu->state, menu);
+	return 0;
+}
 
-out:
+static void
+fetch_layout(barny_dbusmenu_t *menu)
+{
+	sd_bus_message *call = NULL;
+	int             r;
+
+	if (menu->layout_call)
+		return;
+
+	r = new_layout_call(menu, 0, &call);
+	if (r >= 0)
+		r = sd_bus_call_async(menu->state->dbus, &menu->layout_call, call,
+		                      layout_reply, menu, 0);
+	if (r < 0)
+		fprintf(stderr, "barny: dbusmenu GetLayout failed: %s\n",
+		        strerror(-r));
 	sd_bus_message_unref(call);
-	sd_bus_message_unref(reply);
-	sd_bus_error_free(&error);
-	return root;
 }
 
 static void
-free_node_contents(barny_menu_item_t *n)
+free_fetch(barny_dbusmenu_t *menu, dbusmenu_fetch_t *fetch)
 {
-	int i;
+	dbusmenu_fetch_t **pp;
 
-	for (i = 0; i < n->child_count; i++)
-		free_node_contents(&n->children[i]);
+	for (pp = &menu->fetches; *pp; pp = &(*pp)->next) {
+		if (*pp == fetch) {
+			*pp = fetch->next;
+			break;
+		}
+	}
 
-	free(n->children);
-	free(n->label);
+	sd_bus_slot_unref(fetch->slot);
+	free(fetch);
+}
+
+static int
+subtree_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	dbusmenu_fetch_t  *fetch = userdata;
+	barny_dbusmenu_t  *menu  = fetch->menu;
+	barny_menu_item_t *node  = NULL;
+	barny_menu_item_t *target;
+	uint32_t           revision;
+	int                parent = fetch->parent;
+
+	(void)ret_error;
+
+	free_fetch(menu, fetch);
+
+	if (!sd_bus_message_is_method_error(m, NULL))
+		node = read_layout(m, &revision);
+	if (!node)
+		return 0;
+
+	/* the parent may have gone in the meantime, taking the answer with it */
+	target = menu->root ? find_node(menu->root, parent) : NULL;
+	if (!target || node->id != parent) {
+		free_tree(node);
+		return 0;
+	}
+
+	/* the revision is the whole menu's: another subtree may have changed
+	   under it and still be announced, so only a whole tree moves it */
+	take_node(target, node);
+	barny_menu_dbusmenu_changed(menu->state, menu);
+	return 0;
+}
+
+static void
+fetch_subtree(barny_dbusmenu_t *menu, int parent)
+{
+	dbusmenu_fetch_t *fetch;
+	sd_bus_message   *call = NULL;
+	int               r;
+
+	/* a newer ask for the same node makes the older one's answer moot */
+	for (fetch = menu->fetches; fetch; fetch = fetch->next) {
+		if (fetch->parent == parent)
+			break;
+	}
+	if (fetch) {
+		fetch->slot = sd_bus_slot_unref(fetch->slot);
+	} else {
+		fetch = calloc(1, sizeof(*fetch));
+		if (!fetch)
+			return;
+		fetch->menu   = menu;
+		fetch->parent = parent;
+		fetch->next   = menu->fetches;
+		menu->fetches = fetch;
+	}
+
+	r = new_layout_call(menu, parent, &call);
+	if (r >= 0)
+		r = sd_bus_call_async(menu->state->dbus, &fetch->slot, call,
+		                      subtree_reply, fetch, 0);
+	sd_bus_message_unref(call);
+	if (r < 0)
+		free_fetch(menu, fetch);
+}
+
+static int
+handle_layout_updated(sd_bus_message *m, void *userdata, sd_bus_error *error)
+{
+	barny_dbusmenu_t *menu     = userdata;
+	uint32_t          revision = 0;
+	int               parent   = 0;
+
+	(void)error;
+
+	/* nothing kept to update yet; or a whole tree on its way, which was
+	   sent after this and so has the change already */
+	if (!menu->root || menu->layout_call)
+		return 0;
+	if (sd_bus_message_read(m, "ui", &revision, &parent) < 0)
+		return 0;
+	if (revision != 0 && revision <= menu->revision)
+		return 0;
+
+	if (parent != 0 && find_node(menu->root, parent))
+		fetch_subtree(menu, parent);
+	else
+		fetch_layout(menu);
+	return 0;
+}
+
+static int
+handle_props_updated(sd_bus_message *m, void *userdata, sd_bus_error *error)
+{
+	barny_dbusmenu_t  *menu = userdata;
+	barny_menu_item_t *node;
+	const char        *key;
+	int                id;
+
+	(void)error;
+
+	if (!menu->root)
+		return 0;
+
+	/* a(ia{sv}): new values */
+	if (sd_bus_message_enter_container(m, 'a', "(ia{sv})") <= 0)
+		return 0;
+	while (sd_bus_message_enter_container(m, 'r', "ia{sv}") > 0) {
+		if (sd_bus_message_read(m, "i", &id) < 0
+		    || sd_bus_message_enter_container(m, 'a', "{sv}") < 0)
+			return 0;
+		node = find_node(menu->root, id);
+		while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+			key = NULL;
+			if (sd_bus_message_read(m, "s", &key) < 0 || !key)
+				return 0;
+			if (node)
+				read_property(m, key, node);
+			else
+				sd_bus_message_skip(m, "v");
+			sd_bus_message_exit_container(m);
+		}
+		sd_bus_message_exit_container(m);
+		sd_bus_message_exit_container(m);
+	}
+	sd_bus_message_exit_container(m);
+
+	/* a(ias): properties back to their defaults */
+	if (sd_bus_message_enter_container(m, 'a', "(ias)") > 0) {
+		while (sd_bus_message_enter_container(m, 'r', "ias") > 0) {
+			if (sd_bus_message_read(m, "i", &id) < 0
+			    || sd_bus_message_enter_container(m, 'a', "s") < 0)
+				break;
+			node = find_node(menu->root, id);
+			while (sd_bus_message_read(m, "s", &key) > 0) {
+				if (node)
+					reset_property(node, key);
+			}
+			sd_bus_message_exit_container(m);
+			sd_bus_message_exit_container(m);
+		}
+		sd_bus_message_exit_container(m);
+	}
+
+	barny_menu_dbusmenu_changed(menu->state, menu);
+	return 0;
+}
+
+static barny_dbusmenu_t *
+dbusmenu_new(barny_state_t *state, const char *service, const char *path)
+{
+	barny_dbusmenu_t *menu;
+
+	menu = calloc(1, sizeof(*menu));
+	if (!menu)
+		return NULL;
+
+	menu->state   = state;
+	menu->service = strdup(service);
+	menu->path    = strdup(path);
+	if (!menu->service || !menu->path) {
+		barny_dbusmenu_destroy(menu);
+		return NULL;
+	}
+
+	/* installed without waiting on the bus daemon; a change that races
+	   the first GetLayout is in its answer anyway */
+	sd_bus_match_signal_async(state->dbus, &menu->layout_match, service,
+	                          path, DBUSMENU_INTERFACE, "LayoutUpdated",
+	                          handle_layout_updated, NULL, menu);
+	sd_bus_match_signal_async(state->dbus, &menu->props_match, service,
+	                          path, DBUSMENU_INTERFACE,
+	                          "ItemsPropertiesUpdated",
+	                          handle_props_updated, NULL, menu);
+	return menu;
+}
+
+barny_dbusmenu_t *
+barny_sni_item_dbusmenu(barny_state_t *state, sni_item_t *item)
+{
+	char *path;
+
+	path = barny_sni_item_menu_path(state, item);
+	if (!path) {
+		barny_dbusmenu_destroy(item->dbusmenu);
+		item->dbusmenu = NULL;
+		return NULL;
+	}
+
+	/* the item may have moved its menu to another object since */
+	if (item->dbusmenu && strcmp(item->dbusmenu->path, path) != 0) {
+		barny_dbusmenu_destroy(item->dbusmenu);
+		item->dbusmenu = NULL;
+	}
+	if (!item->dbusmenu)
+		item->dbusmenu = dbusmenu_new(state, item->service, path);
+
+	free(path);
+	return item->dbusmenu;
 }
 
 void
-barny_dbusmenu_free(barny_menu_item_t *root)
+barny_sni_item_prefetch_menu(barny_state_t *state, sni_item_t *item)
 {
-	if (!root)
+	barny_dbusmenu_t *menu;
+
+	/* before its GetAll is answered, the menu path would take a blocking
+	   call of its own to learn */
+	if (!state || !state->dbus || !item || !item->service
+	    || !item->props_loaded)
 		return;
 
-	free_node_contents(root);
-	free(root);
+	menu = barny_sni_item_dbusmenu(state, item);
+	if (menu && !menu->root)
+		fetch_layout(menu);
+}
+
+barny_menu_item_t *
+barny_dbusmenu_cached(barny_dbusmenu_t *menu)
+{
+	return menu ? menu->root : NULL;
+}
+
+barny_menu_item_t *
+barny_dbusmenu_layout(barny_dbusmenu_t *menu)
+{
+	sd_bus_error       error = SD_BUS_ERROR_NULL;
+	sd_bus_message    *call  = NULL;
+	sd_bus_message    *reply = NULL;
+	barny_menu_item_t *root;
+	uint32_t           revision;
+	int                r;
+
+	if (!menu)
+		return NULL;
+	if (menu->root)
+		return menu->root;
+
+	/* clicked before a prefetch could finish: asked for again, and
+	   waited on, since the menu can't open without it */
+	menu->layout_call = sd_bus_slot_unref(menu->layout_call);
+
+	r = new_layout_call(menu, 0, &call);
+	if (r >= 0)
+		r = sd_bus_call(menu->state->dbus, call, 0, &error, &reply);
+	if (r < 0) {
+		fprintf(stderr, "barny: dbusmenu GetLayout failed: %s\n",
+		        error.message ? error.message : strerror(-r));
+	} else {
+		root = read_layout(reply, &revision);
+		if (root)
+			store_layout(menu, root, revision);
+	}
+
+	sd_bus_message_unref(call);
+	sd_bus_message_unref(reply);
+	sd_bus_error_free(&error);
+	return menu->root;
+}
+
+void
+barny_dbusmenu_destroy(barny_dbusmenu_t *menu)
+{
+	barny_menu_item_t *root;
+
+	if (!menu)
+		return;
+
+	/* an open menu showing this one goes with it */
+	root       = menu->root;
+	menu->root = NULL;
+	if (root)
+		barny_menu_dbusmenu_changed(menu->state, menu);
+
+	while (menu->fetches)
+		free_fetch(menu, menu->fetches);
+	sd_bus_slot_unref(menu->layout_call);
+	sd_bus_slot_unref(menu->layout_match);
+	sd_bus_slot_unref(menu->props_match);
+	free_tree(root);
+	free(menu->service);
+	free(menu->path);
+	free(menu);
 }
 
 void
 barny_dbusmenu_about_to_show(barny_state_t *state, const char *service,
                              const char *menu_path, int id)
 {
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-
 	if (!state || !state->dbus || !service || !menu_path)
 		return;
 
-	sd_bus_call_method(state->dbus, service, menu_path, DBUSMENU_INTERFACE,
-	                   "AboutToShow", &error, NULL, "i", id);
-	sd_bus_error_free(&error);
+	/* whether the menu wants refetching is never looked at, so there is
+	   no reply worth waiting for */
+	sd_bus_call_method_async(state->dbus, NULL, service, menu_path,
+	                         DBUSMENU_INTERFACE, "AboutToShow", NULL, NULL,
+	                         "i", id);
 }
 
 void
 barny_dbusmenu_event_clicked(barny_state_t *state, const char *service,
                              const char *menu_path, int id)
 {
-	sd_bus_error    error = SD_BUS_ERROR_NULL;
-	sd_bus_message *msg   = NULL;
+	sd_bus_message *msg = NULL;
 	struct timespec ts;
 	uint32_t        now;
 	int             r;
@@ -295,9 +734,10 @@ barny_dbusmenu_event_clicked(barny_state_t *state, const char *service,
 	sd_bus_message_append(msg, "v", "i", 0);
 	sd_bus_message_append(msg, "u", now);
 
-	sd_bus_call(state->dbus, msg, 0, &error, NULL);
+	/* Event returns nothing; sent without asking for a reply */
+	sd_bus_message_set_expect_reply(msg, 0);
+	sd_bus_send(state->dbus, msg, NULL);
 
 out:
 	sd_bus_message_unref(msg);
-	sd_bus_error_free(&error);
 }
@@ -7,15 +7,18 @@
 
 #include "barny.h"
 
-#define SNI_WATCHER_INTERFACE "org.kde.StatusNotifierWatcher"
-#define SNI_WATCHER_PATH      "/StatusNotifierWatcher"
-#define SNI_ITEM_INTERFACE    "org.kde.StatusNotifierItem"
+#define SNI_WATCHER_INTERFACE     "org.kde.StatusNotifierWatcher"
+#define SNI_WATCHER_PATH          "/StatusNotifierWatcher"
+#define SNI_ITEM_INTERFACE        "org.kde.StatusNotifierItem"
+#define DBUS_PROPERTIES_INTERFACE "org.freedesktop.DBus.Properties"
 
 typedef struct {
 	barny_state_t *state;
 	char          *host_name;
 	sni_item_t    *items;
 	sd_bus_slot   *watcher_slot;
+	/* the watcher's item list, asked for once at startup */
+	sd_bus_slot   *list_call;
 } sni_host_t;
 
 static sni_host_t *host = NULL;
@@ -38,25 +41,62 @@ parse_service_string(const char *full, char **service, char **path)
 	}
 }
 
+/* SNI pixmaps are ARGB32 in network byte order with straight alpha;
+   cairo wants native order, premultiplied. */
 static cairo_surface_t *
-create_icon_from_pixmap(sd_bus_message *m, int target_size)
+decode_pixmap(const unsigned char *pixels, int width, int height)
+{
+	cairo_surface_t *surface;
+	uint32_t        *dst;
+	uint32_t         px;
+	uint32_t         a;
+	int              i;
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	dst = (uint32_t *)cairo_image_surface_get_data(surface);
+	for (i = 0; i < width * height; i++) {
+		memcpy(&px, pixels + (size_t)i * 4, 4);
+		px = ntohl(px);
+		a  = px >> 24;
+		if (a == 0) {
+			px = 0;
+		} else if (a != 255) {
+			px = a << 24
+			     | ((((px >> 16) & 0xFF) * a + 127) / 255) << 16
+			     | ((((px >> 8) & 0xFF) * a + 127) / 255) << 8
+			     | (((px & 0xFF) * a + 127) / 255);
+		}
+		dst[i] = px;
+	}
+
+	cairo_surface_mark_dirty(surface);
+	return surface;
+}
+
+/* Picks the pixmap closest to target_size and decodes it, unscaled: the
+   icon cache scales it for each size it is drawn at. NULL when there is
+   none, or when it hashes to *hash -- the icon the item already has. */
+static cairo_surface_t *
+create_icon_from_pixmap(sd_bus_message *m, int target_size, uint64_t *hash)
 {
 	int              r;
-	cairo_surface_t *best      = NULL;
+	const void      *best      = NULL;
+	size_t           best_len  = 0;
 	int              best_size = 0;
+	int              best_w    = 0;
+	int              best_h    = 0;
 	int32_t          width, height;
 	const void      *pixels;
 	size_t           pixel_len;
 	size_t           expected;
 	int              size;
-	uint32_t        *dst;
-	const uint32_t  *src;
-	int              i;
-	int              w, h;
-	double           scale;
-	int              new_w, new_h;
-	cairo_surface_t *scaled;
-	cairo_t         *cr;
+	uint64_t         h;
+	cairo_surface_t *icon;
 
 	r = sd_bus_message_enter_container(m, 'a', "(iiay)");
 	if (r < 0) {
@@ -64,95 +104,49 @@ create_icon_from_pixmap(sd_bus_message *m, int target_size)
 	}
 
 	while (sd_bus_message_enter_container(m, 'r', "iiay") > 0) {
+		/* read the struct whole: a half-read one cannot be exited, and
+		   the rest of a GetAll reply comes after it */
 		r = sd_bus_message_read(m, "ii", &width, &height);
-		if (r < 0) {
-			sd_bus_message_exit_container(m);
-			continue;
-		}
+		if (r >= 0)
+			r = sd_bus_message_read_array(m, 'y', &pixels, &pixel_len);
+		sd_bus_message_exit_container(m);
 
-		if (width <= 0 || height <= 0 || width > 1024 || height > 1024) {
-			sd_bus_message_exit_container(m);
+		if (r < 0 || width <= 0 || height <= 0 || width > 1024
+		    || height > 1024)
 			continue;
-		}
 
 		expected = (size_t)width * (size_t)height * 4;
-
-		r        = sd_bus_message_read_array(m, 'y', &pixels, &pixel_len);
-		if (r < 0 || pixel_len != expected) {
-			sd_bus_message_exit_container(m);
+		if (pixel_len != expected)
 			continue;
-		}
 
+		/* the pixels stay in the message; nothing is decoded until
+		   the pick is made */
 		size = (width > height) ? width : height;
 		if (!best
 		    || (size >= target_size && size < best_size)
 		    || (best_size < target_size && size > best_size)) {
-			if (best) {
-				cairo_surface_destroy(best);
-			}
-
-			best = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
-			                                  width, height);
-			if (cairo_surface_status(best) != CAIRO_STATUS_SUCCESS) {
-				cairo_surface_destroy(best);
-				best = NULL;
-				sd_bus_message_exit_container(m);
-				continue;
-			}
-
-			dst = (uint32_t *)cairo_image_surface_get_data(best);
-			src = pixels;
-
-			for (i = 0; i < width * height; i++) {
-				dst[i] = ntohl(src[i]);
-			}
-
-			cairo_surface_mark_dirty(best);
+			best      = pixels;
+			best_len  = pixel_len;
 			best_size = size;
+			best_w    = width;
+			best_h    = height;
 		}
-
-		sd_bus_message_exit_container(m);
 	}
 
 	sd_bus_message_exit_container(m);
 
-	if (best && best_size != target_size) {
-		w = cairo_image_surface_get_width(best);
-		h = cairo_image_surface_get_height(best);
-
-		if (w <= 0 || h <= 0 || best_size <= 0) {
-			cairo_surface_destroy(best);
-			return NULL;
-		}
-
-		scale = (double)target_size / best_size;
-		new_w = (int)(w * scale);
-		new_h = (int)(h * scale);
-
-		if (new_w <= 0 || new_h <= 0) {
-			cairo_surface_destroy(best);
-			return NULL;
-		}
-
-		scaled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, new_w,
-		                                    new_h);
-		if (cairo_surface_status(scaled) != CAIRO_STATUS_SUCCESS) {
-			cairo_surface_destroy(scaled);
-			cairo_surface_destroy(best);
-			return NULL;
-		}
-
-		cr = cairo_create(scaled);
-		cairo_scale(cr, scale, scale);
-		cairo_set_source_surface(cr, best, 0, 0);
-		cairo_paint(cr);
-		cairo_destroy(cr);
+	if (!best)
+		return NULL;
 
-		cairo_surface_destroy(best);
-		best = scaled;
-	}
+	/* applications re-send the same icon all the time */
+	h = barny_icon_hash(best, best_len, best_w, best_h);
+	if (h == *hash)
+		return NULL;
 
-	return best;
+	icon = decode_pixmap(best, best_w, best_h);
+	if (icon)
+		*hash = h;
+	return icon;
 }
 
 static cairo_surface_t *
@@ -212,118 +206,266 @@ create_placeholder_icon(const char *id, int size)
 	return surface;
 }
 
+/* Takes a freshly read icon. Without one, an item keeps the icon it had,
+   or gets a placeholder if it never had any. */
 static void
-fetch_item_icon(sni_item_t *item, int icon_size)
+replace_icon(sni_item_t *item, cairo_surface_t *icon)
 {
-	sd_bus_error    error = SD_BUS_ERROR_NULL;
-	sd_bus_message *reply = NULL;
-	int             r;
+	if (!icon) {
+		if (item->icon)
+			return;
+		icon = create_placeholder_icon(item->id,
+		                               host->state->config.tray_icon_size);
+	}
 
-	if (!host || !host->state->dbus || !item->service) {
+	if (item->icon)
+		cairo_surface_destroy(item->icon);
+	item->icon = icon;
+}
+
+/* Pixmaps are picked for the sharpest output the tray is drawn on. */
+static int
+icon_pixel_size(void)
+{
+	barny_output_t *out;
+	int             scale = 1;
+
+	for (out = host->state->outputs; out; out = out->next) {
+		if (out->scale > scale)
+			scale = out->scale;
+	}
+
+	return host->state->config.tray_icon_size * scale;
+}
+
+/* NULL when unreadable or unchanged; either way, the item keeps its icon. */
+static cairo_surface_t *
+read_pixmap_variant(sni_item_t *item, sd_bus_message *m)
+{
+	cairo_surface_t *icon;
+
+	if (sd_bus_message_enter_container(m, 'v', "a(iiay)") <= 0)
+		return NULL;
+
+	icon = create_icon_from_pixmap(m, icon_pixel_size(), &item->icon_hash);
+	sd_bus_message_exit_container(m);
+	return icon;
+}
+
+static int
+icon_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	sni_item_t      *item = userdata;
+	cairo_surface_t *icon = NULL;
+
+	(void)ret_error;
+
+	item->icon_call = sd_bus_slot_unref(item->icon_call);
+	if (!sd_bus_message_is_method_error(m, NULL))
+		icon = read_pixmap_variant(item, m);
+
+	/* an identical re-send ends at the hash compare: nothing to redraw */
+	if (icon || !item->icon) {
+		replace_icon(item, icon);
+		barny_defer(host->state, BARNY_DEFER_TRAY);
+	}
+	return 0;
+}
+
+/* The old icon stays up until the new one has arrived. */
+static void
+fetch_item_icon(sni_item_t *item)
+{
+	int r;
+
+	/* a newer NewIcon supersedes the fetch still in flight */
+	item->icon_call = sd_bus_slot_unref(item->icon_call);
+
+	r = sd_bus_call_method_async(host->state->dbus, &item->icon_call,
+	                             item->service, item->object_path,
+	                             DBUS_PROPERTIES_INTERFACE, "Get", icon_reply,
+	                             item, "ss", SNI_ITEM_INTERFACE, "IconPixmap");
+	if (r < 0)
+		fprintf(stderr, "barny: failed to fetch icon of %s: %s\n",
+		        item->service, strerror(-r));
+}
+
+/* Reads one GetAll entry's value, which must be consumed whole whether
+   it is wanted or not. */
+static void
+read_item_property(sni_item_t *item, sd_bus_message *m, const char *key,
+                   const char *type, cairo_surface_t **icon)
+{
+	char      **dst = NULL;
+	const char *str;
+	int         b;
+
+	if (strcmp(key, "Id") == 0)
+		dst = &item->id;
+	else if (strcmp(key, "Title") == 0)
+		dst = &item->title;
+	else if (strcmp(key, "Status") == 0)
+		dst = &item->status;
+	else if (strcmp(key, "IconName") == 0)
+		dst = &item->icon_name;
+	else if (strcmp(key, "IconThemePath") == 0)
+		dst = &item->icon_theme_path;
+	else if (strcmp(key, "Menu") == 0)
+		dst = &item->menu_path;
+
+	if (dst && (strcmp(type, "s") == 0 || strcmp(type, "o") == 0)) {
+		if (sd_bus_message_read(m, "v", type, &str) >= 0) {
+			free(*dst);
+			*dst = strdup(str);
+		}
+	} else if (strcmp(key, "ItemIsMenu") == 0 && strcmp(type, "b") == 0) {
+		if (sd_bus_message_read(m, "v", "b", &b) >= 0)
+			item->is_menu = b;
+	} else if (strcmp(key, "IconPixmap") == 0
+	           && strcmp(type, "a(iiay)") == 0) {
+		*icon = read_pixmap_variant(item, m);
+	} else {
+		sd_bus_message_skip(m, "v");
+	}
+}
+
+static void
+theme_icon_loaded(void *userdata, cairo_surface_t *icon)
+{
+	sni_item_t *item = userdata;
+	uint64_t    hash;
+
+	if (!icon)
+		return;
+
+	cairo_surface_flush(icon);
+	hash = barny_icon_hash(cairo_image_surface_get_data(icon),
+	                       (size_t)cairo_image_surface_get_stride(icon)
+	                               * cairo_image_surface_get_height(icon),
+	                       cairo_image_surface_get_width(icon),
+	                       cairo_image_surface_get_height(icon));
+	if (hash == item->icon_hash) {
+		cairo_surface_destroy(icon);
 		return;
 	}
 
-	r = sd_bus_get_property(host->state->dbus,
-	                        item->service,
-	                        item->object_path,
-	                        SNI_ITEM_INTERFACE,
-	                        "IconPixmap",
-	                        &error,
-	                        &reply,
-	                        "a(iiay)");
-
-	if (r >= 0) {
-		item->icon = create_icon_from_pixmap(reply, icon_size);
-		sd_bus_message_unref(reply);
-		reply = NULL;
-		if (item->icon) {
-			sd_bus_error_free(&error);
-			return;
+	replace_icon(item, icon);
+	item->icon_hash = hash;
+	barny_defer(host->state, BARNY_DEFER_TRAY);
+}
+
+/* The placeholder stands in until the loader thread has found and decoded
+   the named icon, if the theme has it at all. */
+static void
+fetch_theme_icon(sni_item_t *item)
+{
+	item->icon_named = true;
+	barny_icon_theme_cancel(host->state->icon_theme, item);
+	barny_icon_theme_load(host->state->icon_theme, item->icon_name,
+	                      item->icon_theme_path, icon_pixel_size(),
+	                      theme_icon_loaded, item);
+}
+
+static int
+props_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	sni_item_t         *item  = userdata;
+	cairo_surface_t    *icon  = NULL;
+	bool                first = !item->props_loaded;
+	const sd_bus_error *err;
+	const char         *key;
+	const char         *type;
+	char                kind;
+
+	(void)ret_error;
+
+	item->props_call   = sd_bus_slot_unref(item->props_call);
+	item->props_loaded = true;
+
+	err = sd_bus_message_get_error(m);
+	if (err) {
+		fprintf(stderr, "barny: SNI item %s: %s\n", item->service,
+		        err->message ? err->message : err->name);
+	} else if (sd_bus_message_enter_container(m, 'a', "{sv}") > 0) {
+		while (sd_bus_message_enter_container(m, 'e', "sv") > 0) {
+			if (sd_bus_message_read(m, "s", &key) < 0
+			    || sd_bus_message_peek_type(m, &kind, &type) < 0)
+				break;
+			read_item_property(item, m, key, type, &icon);
+			if (sd_bus_message_exit_container(m) < 0)
+				break;
 		}
 	}
-	sd_bus_error_free(&error);
-	sd_bus_message_unref(reply);
-	reply      = NULL;
 
-	item->icon = create_placeholder_icon(item->id, icon_size);
+	/* a pixmap, when there is one, wins over the name */
+	if (icon) {
+		item->icon_named = false;
+		barny_icon_theme_cancel(host->state->icon_theme, item);
+	} else if ((!item->icon_hash || item->icon_named) && item->icon_name
+	           && item->icon_name[0]) {
+		fetch_theme_icon(item);
+	}
+
+	replace_icon(item, icon);
+
+	if (first)
+		printf("barny: SNI host added item: %s (%s)\n",
+		       item->id ? item->id : "unknown",
+		       item->service);
+
+	barny_defer(host->state, BARNY_DEFER_TRAY);
+	return 0;
 }
 
+/* One GetAll per item, answered whenever the item gets round to it: a
+   slow or hung application costs its own slot in the tray, not a frame. */
 static void
-fetch_item_properties(sni_item_t *item, int icon_size)
+fetch_item_properties(sni_item_t *item)
 {
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-	char        *str   = NULL;
-	int          r;
+	int r;
 
-	if (!host || !host->state->dbus || !item->service) {
-		return;
+	item->props_call = sd_bus_slot_unref(item->props_call);
+	r = sd_bus_call_method_async(host->state->dbus, &item->props_call,
+	                             item->service, item->object_path,
+	                             DBUS_PROPERTIES_INTERFACE, "GetAll",
+	                             props_reply, item, "s", SNI_ITEM_INTERFACE);
+	if (r < 0) {
+		fprintf(stderr, "barny: failed to query SNI item %s: %s\n",
+		        item->service, strerror(-r));
+		item->props_loaded = true;
+		replace_icon(item, NULL);
 	}
+}
 
-	r = sd_bus_get_property_string(host->state->dbus,
-	                               item->service,
-	                               item->object_path,
-	                               SNI_ITEM_INTERFACE,
-	                               "Id",
-	                               &error,
-	                               &str);
-	if (r >= 0 && str) {
-		free(item->id);
-		item->id = str;
-		str      = NULL;
-	}
-	sd_bus_error_free(&error);
-
-	r = sd_bus_get_property_string(host->state->dbus,
-	                               item->service,
-	                               item->object_path,
-	                               SNI_ITEM_INTERFACE,
-	                               "Title",
-	                               &error,
-	                               &str);
-	if (r >= 0 && str) {
-		free(item->title);
-		item->title = str;
-		str         = NULL;
-	}
-	sd_bus_error_free(&error);
-
-	r = sd_bus_get_property_string(host->state->dbus,
-	                               item->service,
-	                               item->object_path,
-	                               SNI_ITEM_INTERFACE,
-	                               "Status",
-	                               &error,
-	                               &str);
-	if (r >= 0 && str) {
-		free(item->status);
-		item->status = str;
-		str          = NULL;
-	}
-	sd_bus_error_free(&error);
-
-	r = sd_bus_get_property_string(host->state->dbus,
-	                               item->service,
-	                               item->object_path,
-	                               SNI_ITEM_INTERFACE,
-	                               "IconName",
-	                               &error,
-	                               &str);
-	if (r >= 0 && str) {
-		free(item->icon_name);
-		item->icon_name = str;
-		str             = NULL;
-	}
-	sd_bus_error_free(&error);
-
-	fetch_item_icon(item, icon_size);
+static void
+free_item(sni_item_t *item)
+{
+	/* dropping a pending call's slot cancels its reply callback */
+	sd_bus_slot_unref(item->props_call);
+	sd_bus_slot_unref(item->icon_call);
+	barny_icon_theme_cancel(host->state->icon_theme, item);
+	barny_dbusmenu_destroy(item->dbusmenu);
+	free(item->service);
+	free(item->object_path);
+	free(item->id);
+	free(item->title);
+	free(item->status);
+	free(item->icon_name);
+	free(item->icon_theme_path);
+	free(item->menu_path);
+	if (item->icon) {
+		cairo_surface_destroy(item->icon);
+	}
+	free(item);
 }
 
 static sni_item_t *
-add_item(const char *service_string, int icon_size)
+add_item(const char *service_string)
 {
 	sni_item_t *item;
 
-	if (!host || !service_string || !service_string[0]) {
+	if (!host || !host->state->dbus || !service_string
+	    || !service_string[0]) {
 		return NULL;
 	}
 
@@ -346,14 +488,12 @@ add_item(const char *service_string, int icon_size)
 		return NULL;
 	}
 
-	fetch_item_properties(item, icon_size);
-
+	/* listed straight away; it draws as an empty slot until its
+	   properties come in */
 	item->next  = host->items;
 	host->items = item;
 
-	printf("barny: SNI host added item: %s (%s)\n",
-	       item->id ? item->id : "unknown",
-	       item->service);
+	fetch_item_properties(item);
 
 	return item;
 }
@@ -385,17 +525,7 @@ remove_item(const char *service)
 			*pp = item->next;
 			printf("barny: SNI host removed item: %s\n",
 			       item->id ? item->id : item->service);
-
-			free(item->service);
-			free(item->object_path);
-			free(item->id);
-			free(item->title);
-			free(item->status);
-			free(item->icon_name);
-			if (item->icon) {
-				cairo_surface_destroy(item->icon);
-			}
-			free(item);
+			free_item(item);
 			return;
 		}
 		pp = &item->next;
@@ -422,7 +552,6 @@ static int
 handle_new_icon(sd_bus_message *m, void *userdata, sd_bus_error *error)
 {
 	const char *sender;
-	int         icon_size;
 	sni_item_t *item;
 
 	(void)userdata;
@@ -436,16 +565,12 @@ handle_new_icon(sd_bus_message *m, void *userdata, sd_bus_error *error)
 	if (!sender)
 		return 0;
 
-	icon_size = host->state->config.tray_icon_size;
-
+	/* animated icons send these by the dozen; only the last one before
+	   the frame gets fetched */
 	for (item = host->items; item; item = item->next) {
 		if (item->service && strstr(item->service, sender)) {
-			if (item->icon) {
-				cairo_surface_destroy(item->icon);
-				item->icon = NULL;
-			}
-			fetch_item_icon(item, icon_size);
-			notify_tray_module();
+			item->icon_stale = true;
+			barny_defer(host->state, BARNY_DEFER_TRAY);
 			break;
 		}
 	}
@@ -468,8 +593,8 @@ handle_item_registered(sd_bus_message *m, void *userdata, sd_bus_error *error)
 	}
 
 	if (host && host->state) {
-		add_item(service, host->state->config.tray_icon_size);
-		notify_tray_module();
+		add_item(service);
+		barny_defer(host->state, BARNY_DEFER_TRAY);
 	}
 
 	return 0;
@@ -490,50 +615,50 @@ handle_item_unregistered(sd_bus_message *m, void *userdata, sd_bus_error *error)
 	}
 
 	remove_item(service);
-	notify_tray_module();
+	if (host && host->state)
+		barny_defer(host->state, BARNY_DEFER_TRAY);
 
 	return 0;
 }
 
-static void
-fetch_existing_items(int icon_size)
+static int
+existing_items_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
 {
-	sd_bus_error    error = SD_BUS_ERROR_NULL;
-	sd_bus_message *reply = NULL;
-	int             r;
-	const char     *service;
+	const char *service;
 
-	if (!host || !host->state->dbus) {
-		return;
-	}
+	(void)userdata;
+	(void)ret_error;
 
-	r = sd_bus_get_property(host->state->dbus,
-	                        SNI_WATCHER_INTERFACE,
-	                        SNI_WATCHER_PATH,
-	                        SNI_WATCHER_INTERFACE,
-	                        "RegisteredStatusNotifierItems",
-	                        &error,
-	                        &reply,
-	                        "as");
+	host->list_call = sd_bus_slot_unref(host->list_call);
+	if (sd_bus_message_is_method_error(m, NULL)
+	    || sd_bus_message_enter_container(m, 'v', "as") <= 0
+	    || sd_bus_message_enter_container(m, 'a', "s") <= 0)
+		return 0;
 
-	if (r < 0) {
-		sd_bus_error_free(&error);
-		return;
+	while (sd_bus_message_read(m, "s", &service) > 0) {
+		add_item(service);
 	}
 
-	r = sd_bus_message_enter_container(reply, 'a', "s");
-	if (r < 0) {
-		sd_bus_message_unref(reply);
-		sd_bus_error_free(&error);
-		return;
-	}
+	barny_defer(host->state, BARNY_DEFER_TRAY);
+	return 0;
+}
 
-	while (sd_bus_message_read(reply, "s", &service) > 0) {
-		add_item(service, icon_size);
-	}
+/* Asked without waiting: the watcher may well be our own, in this very
+   process, and could not answer a blocking call. */
+static void
+fetch_existing_items(void)
+{
+	int r;
 
-	sd_bus_message_unref(reply);
-	sd_bus_error_free(&error);
+	r = sd_bus_call_method_async(host->state->dbus, &host->list_call,
+	                             SNI_WATCHER_INTERFACE, SNI_WATCHER_PATH,
+	                             DBUS_PROPERTIES_INTERFACE, "Get",
+	                             existing_items_reply, NULL, "ss",
+	                             SNI_WATCHER_INTERFACE,
+	                             "RegisteredStatusNotifierItems");
+	if (r < 0)
+		fprintf(stderr, "barny: failed to list SNI items: %s\n",
+		        strerror(-r));
 }
 
 int
@@ -607,7 +732,7 @@ barny_sni_host_init(barny_state_t *state)
 		        strerror(-r));
 	}
 
-	fetch_existing_items(state->config.tray_icon_size);
+	fetch_existing_items();
 
 	return 0;
 }
@@ -625,27 +750,21 @@ barny_sni_host_cleanup(barny_state_t *state)
 	item = host->items;
 	while (item) {
 		next = item->next;
-		free(item->service);
-		free(item->object_path);
-		free(item->id);
-		free(item->title);
-		free(item->status);
-		free(item->icon_name);
-		if (item->icon) {
-			cairo_surface_destroy(item->icon);
-		}
-		free(item);
+		free_item(item);
 		item = next;
 	}
 
 	if (host->watcher_slot) {
 		sd_bus_slot_unref(host->watcher_slot);
 	}
+	sd_bus_slot_unref(host->list_call);
 
 	if (state->dbus && host->host_name) {
 		sd_bus_release_name(state->dbus, host->host_name);
 	}
 
+	barny_icon_cache_clear();
+
 	free(host->host_name);
 	free(host);
 	host = NULL;
@@ -659,51 +778,113 @@ barny_sni_host_get_items(barny_state_t *state)
 }
 
 void
-barny_sni_item_activate(barny_state_t *state, sni_item_t *item, int x, int y)
+barny_sni_host_flush(barny_state_t *state)
 {
-	sd_bus_error error = SD_BUS_ERROR_NULL;
-	int          r;
+	sni_item_t *item;
 
-	if (!state->dbus || !item || !item->service) {
+	(void)state;
+
+	if (!host)
 		return;
+
+	for (item = host->items; item; item = item->next) {
+		if (!item->icon_stale)
+			continue;
+		item->icon_stale = false;
+		/* a GetAll still in flight brings the icon with it; a named
+		   icon may have been renamed, which takes another one */
+		if (item->props_call)
+			continue;
+		if (item->icon_named)
+			fetch_item_properties(item);
+		else
+			fetch_item_icon(item);
 	}
 
-	r = sd_bus_call_method(state->dbus, item->service, item->object_path,
-	                       SNI_ITEM_INTERFACE, "Activate", &error, NULL, "ii",
-	                       x, y);
+	notify_tray_module();
+}
 
-	if (r < 0) {
-		sd_bus_error_free(&error);
+/* Clicks don't wait for an answer either; ContextMenu's is only needed to
+   fall back to SecondaryActivate, and that is sent from its reply. */
+typedef struct {
+	char *service;
+	char *object_path;
+	int   x, y;
+} sni_click_t;
+
+static void
+free_click(void *userdata)
+{
+	sni_click_t *click = userdata;
+
+	free(click->service);
+	free(click->object_path);
+	free(click);
+}
+
+static int
+context_menu_reply(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	sni_click_t *click = userdata;
+
+	(void)ret_error;
+
+	if (sd_bus_message_is_method_error(m, NULL))
+		sd_bus_call_method_async(sd_bus_message_get_bus(m), NULL,
+		                         click->service, click->object_path,
+		                         SNI_ITEM_INTERFACE, "SecondaryActivate",
+		                         NULL, NULL, "ii", click->x, click->y);
+	return 0;
+}
+
+void
+barny_sni_item_activate(barny_state_t *state, sni_item_t *item, int x, int y)
+{
+	if (!state->dbus || !item || !item->service) {
+		return;
 	}
-	sd_bus_error_free(&error);
+
+	sd_bus_call_method_async(state->dbus, NULL, item->service,
+	                         item->object_path, SNI_ITEM_INTERFACE, "Activate",
+	                         NULL, NULL, "ii", x, y);
 }
 
 void
 barny_sni_item_secondary_activate(barny_state_t *state, sni_item_t *item, int x,
                                   int y)
 {
-	sd_bus_error error = SD_BUS_ERROR_NULL;
+	sni_click_t *click;
+	sd_bus_slot *slot = NULL;
 	int          r;
 
 	if (!state->dbus || !item || !item->service) {
 		return;
 	}
 
-	r = sd_bus_call_method(state->dbus, item->service, item->object_path,
-	                       SNI_ITEM_INTERFACE, "ContextMenu", &error, NULL,
-	                       "ii", x, y);
-
-	if (r >= 0) {
-		sd_bus_error_free(&error);
+	click = calloc(1, sizeof(*click));
+	if (!click) {
+		return;
+	}
+	click->service     = strdup(item->service);
+	click->object_path = strdup(item->object_path);
+	click->x           = x;
+	click->y           = y;
+	if (!click->service || !click->object_path) {
+		free_click(click);
 		return;
 	}
 
-	sd_bus_error_free(&error);
-	error = SD_BUS_ERROR_NULL;
-
-	sd_bus_call_method(state->dbus, item->service, item->object_path,
-	                   SNI_ITEM_INTERFACE, "SecondaryActivate", &error, NULL,
-	                   "ii", x, y);
+	r = sd_bus_call_method_async(state->dbus, &slot, item->service,
+	                             item->object_path, SNI_ITEM_INTERFACE,
+	                             "ContextMenu", context_menu_reply, click, "ii",
+	                             x, y);
+	if (r < 0) {
+		free_click(click);
+		return;
+	}
 
-	sd_bus_error_free(&error);
+	/* the bus owns the call from here, and frees click with it */
+	sd_bus_slot_set_destroy_callback(slot, free_click);
+	sd_bus_slot_set_floating(slot, 1);
+	sd_bus_slot_unref(slot);
 }
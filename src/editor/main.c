@@ -128,13 +128,14 @@ typedef struct {
 } detail_field_t;
 
 typedef struct {
-	bool           open;
-	char           module[32];
-	detail_field_t fields[MAX_DETAIL_FIELDS];
-	int            field_count;
-	SDL_FRect      panel_rect;
-	SDL_FRect      save_rect;
-	SDL_FRect      close_rect;
+	bool                  open;
+	char                  module[32];
+	const barny_config_t *config;
+	detail_field_t        fields[MAX_DETAIL_FIELDS];
+	int                   field_count;
+	SDL_FRect             panel_rect;
+	SDL_FRect             save_rect;
+	SDL_FRect             close_rect;
 } module_details_t;
 
 typedef enum {
@@ -392,6 +393,21 @@ detail_field_write_value(const detail_field_t *field, char *out, size_t out_len)
 	return -1;
 }
 
+/* config.c knows how every key is spelled; a field's own options only
+   matter for a string that is still unset and shows its default. */
+static int
+detail_field_format(const module_details_t *details,
+                    const detail_field_t *field, char *out, size_t out_len)
+{
+	if (details->config
+	    && barny_config_format_key(details->config, field->key, out,
+	                               out_len)
+	               == 0) {
+		return 0;
+	}
+	return detail_field_write_value(field, out, out_len);
+}
+
 static void
 module_details_close_dropdowns(module_details_t *details)
 {
@@ -490,9 +506,8 @@ save_module_config_fields(const char *path, const module_details_t *details)
 				if (strcmp(details->fields[i].key, key) != 0) {
 					continue;
 				}
-				if (detail_field_write_value(&details->fields[i],
-				                             valuebuf,
-				                             sizeof(valuebuf))
+				if (detail_field_format(details, &details->fields[i],
+				                        valuebuf, sizeof(valuebuf))
 				    == 0) {
 					fprintf(out, "%s=%s\n",
 					        details->fields[i].key, valuebuf);
@@ -515,8 +530,8 @@ save_module_config_fields(const char *path, const module_details_t *details)
 		if (seen[i]) {
 			continue;
 		}
-		if (detail_field_write_value(&details->fields[i], valuebuf,
-		                             sizeof(valuebuf))
+		if (detail_field_format(details, &details->fields[i], valuebuf,
+		                        sizeof(valuebuf))
 		    == 0) {
 			fprintf(out, "%s=%s\n", details->fields[i].key, valuebuf);
 		}
@@ -733,7 +748,8 @@ module_details_open(module_details_t *details, barny_config_t *config,
 	}
 
 	module_details_reset(details);
-	details->open = true;
+	details->open   = true;
+	details->config = config;
 	snprintf(details->module, sizeof(details->module), "%s", module_name);
 
 	for (i = 0;
@@ -1,39 +1,52 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <errno.h>
-#include <fcntl.h>
 #include <poll.h>
 
 #include "barny.h"
+#include "util.h"
 
 #define SWAY_IPC_MAGIC       "i3-ipc"
 #define SWAY_IPC_HEADER_SIZE 14
 
-typedef struct {
-	char     magic[6];
-	uint32_t length;
-	uint32_t type;
-} __attribute__((packed)) sway_ipc_header_t;
+#define SWAY_IPC_BUF_INITIAL 65536
+#define SWAY_IPC_READ_MIN    4096
+/* far beyond any real tree: a length like this means the stream is junk */
+#define SWAY_IPC_MAX_PAYLOAD (64u << 20)
 
-int
-barny_sway_ipc_init(barny_state_t *state)
+void
+barny_sway_conn_init(barny_sway_conn_t *conn)
+{
+	memset(conn, 0, sizeof(*conn));
+	conn->fd = -1;
+}
+
+void
+barny_sway_conn_close(barny_sway_conn_t *conn)
+{
+	if (conn->fd >= 0)
+		close(conn->fd);
+	free(conn->buf);
+	barny_sway_conn_init(conn);
+}
+
+/* The socket stays blocking: reads pass MSG_DONTWAIT, and a write only
+   waits if sway stops reading, as the old poll-and-retry did. */
+static int
+sway_connect(barny_sway_conn_t *conn, const char *socket_path)
 {
-	const char        *socket_path = getenv("SWAYSOCK");
 	struct sockaddr_un addr;
-	int                flags;
 
-	if (!socket_path) {
-		fprintf(stderr, "barny: SWAYSOCK not set, sway IPC unavailable\n");
-		state->sway_ipc_fd = -1;
-		return -1;
-	}
+	barny_sway_conn_close(conn);
 
-	state->sway_ipc_fd = socket(AF_UNIX, SOCK_STREAM, 0);
-	if (state->sway_ipc_fd < 0) {
+	conn->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (conn->fd < 0) {
 		fprintf(stderr, "barny: failed to create socket: %s\n",
 		        strerror(errno));
 		return -1;
@@ -42,17 +55,34 @@ barny_sway_ipc_init(barny_state_t *state)
 	addr = (struct sockaddr_un){ .sun_family = AF_UNIX };
 	strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
 
-	if (connect(state->sway_ipc_fd, (struct sockaddr *)&addr, sizeof(addr))
-	    < 0) {
+	if (connect(conn->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
 		fprintf(stderr, "barny: failed to connect to sway: %s\n",
 		        strerror(errno));
-		close(state->sway_ipc_fd);
-		state->sway_ipc_fd = -1;
+		barny_sway_conn_close(conn);
 		return -1;
 	}
 
-	flags = fcntl(state->sway_ipc_fd, F_GETFL, 0);
-	fcntl(state->sway_ipc_fd, F_SETFL, flags | O_NONBLOCK);
+	return 0;
+}
+
+int
+barny_sway_ipc_init(barny_state_t *state)
+{
+	const char *socket_path = getenv("SWAYSOCK");
+
+	barny_sway_conn_init(&state->sway_events);
+	barny_sway_conn_init(&state->sway_cmds);
+
+	if (!socket_path) {
+		fprintf(stderr, "barny: SWAYSOCK not set, sway IPC unavailable\n");
+		return -1;
+	}
+
+	if (sway_connect(&state->sway_events, socket_path) < 0
+	    || sway_connect(&state->sway_cmds, socket_path) < 0) {
+		barny_sway_ipc_cleanup(state);
+		return -1;
+	}
 
 	printf("barny: connected to sway IPC\n");
 	return 0;
@@ -61,157 +91,301 @@ barny_sway_ipc_init(barny_state_t *state)
 void
 barny_sway_ipc_cleanup(barny_state_t *state)
 {
-	if (state->sway_ipc_fd >= 0) {
-		close(state->sway_ipc_fd);
-		state->sway_ipc_fd = -1;
-	}
+	barny_sway_conn_close(&state->sway_events);
+	barny_sway_conn_close(&state->sway_cmds);
 }
 
 int
-barny_sway_ipc_send(barny_state_t *state, uint32_t type, const char *payload)
+barny_sway_ipc_reconnect(barny_state_t *state)
 {
+	barny_sway_ipc_cleanup(state);
+	return barny_sway_ipc_init(state);
+}
+
+int
+barny_sway_ipc_send(barny_sway_conn_t *conn, uint32_t type, const char *payload)
+{
+	char          header[SWAY_IPC_HEADER_SIZE];
+	struct iovec  iov[2];
+	struct msghdr msg;
 	uint32_t      len;
-	size_t        total;
-	char         *buf;
-	ssize_t       offset;
-	ssize_t       remaining;
-	ssize_t       written;
-	struct pollfd pfd;
-
-	if (state->sway_ipc_fd < 0) {
+	ssize_t       n;
+
+	if (conn->fd < 0)
 		return -1;
-	}
 
-	len   = payload ? strlen(payload) : 0;
-	total = SWAY_IPC_HEADER_SIZE + len;
-	buf   = malloc(total);
+	len = payload ? strlen(payload) : 0;
+	memcpy(header, SWAY_IPC_MAGIC, 6);
+	memcpy(header + 6, &len, 4);
+	memcpy(header + 10, &type, 4);
 
-	memcpy(buf, SWAY_IPC_MAGIC, 6);
-	memcpy(buf + 6, &len, 4);
-	memcpy(buf + 10, &type, 4);
-	if (payload && len > 0) {
-		memcpy(buf + 14, payload, len);
-	}
+	iov[0] = (struct iovec){ .iov_base = header, .iov_len = sizeof(header) };
+	iov[1] = (struct iovec){ .iov_base = (void *)payload, .iov_len = len };
+	msg    = (struct msghdr){ .msg_iov = iov, .msg_iovlen = len ? 2 : 1 };
 
-	offset    = 0;
-	remaining = total;
-	while (remaining > 0) {
-		written = write(state->sway_ipc_fd, buf + offset, remaining);
-		if (written < 0) {
-			if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				pfd = (struct pollfd){ .fd     = state->sway_ipc_fd,
-					               .events = POLLOUT };
-				poll(&pfd, 1, 100);
+	while (msg.msg_iovlen > 0) {
+		n = sendmsg(conn->fd, &msg, MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR)
 				continue;
-			}
 			fprintf(stderr, "barny: failed to write to sway IPC: %s\n",
 			        strerror(errno));
-			free(buf);
 			return -1;
 		}
-		offset    += written;
-		remaining -= written;
+
+		while (msg.msg_iovlen > 0 && (size_t)n >= msg.msg_iov->iov_len) {
+			n -= (ssize_t)msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen > 0) {
+			msg.msg_iov->iov_base  = (char *)msg.msg_iov->iov_base + n;
+			msg.msg_iov->iov_len  -= (size_t)n;
+		}
 	}
-	free(buf);
 
 	return 0;
 }
 
-char *
-barny_sway_ipc_recv(barny_state_t *state, uint32_t *type)
+/* Puts back the byte a handed-out payload's NUL was written over. */
+static void
+release_held(barny_sway_conn_t *conn)
+{
+	if (conn->holding) {
+		conn->buf[conn->held_at] = conn->held;
+		conn->holding            = false;
+	}
+}
+
+int
+barny_sway_ipc_fill(barny_sway_conn_t *conn)
 {
-	sway_ipc_header_t header;
-	ssize_t           hdr_offset;
-	char             *payload;
-	ssize_t           remaining;
-	ssize_t           offset;
-	ssize_t           n;
-	struct pollfd     pfd;
+	uint32_t len;
+	size_t   need;
+	size_t   cap;
+	char    *grown;
+	ssize_t  n;
 
-	if (state->sway_ipc_fd < 0) {
-		return NULL;
+	if (conn->fd < 0)
+		return -1;
+
+	release_held(conn);
+	if (conn->start == conn->end)
+		conn->start = conn->end = 0;
+
+	/* room for the whole of the message being read, plus its NUL */
+	need = SWAY_IPC_HEADER_SIZE + 1;
+	if (conn->end - conn->start >= SWAY_IPC_HEADER_SIZE) {
+		memcpy(&len, conn->buf + conn->start + 6, 4);
+		if (len <= SWAY_IPC_MAX_PAYLOAD)
+			need += len;
 	}
 
-	hdr_offset = 0;
-	while (hdr_offset < (ssize_t)sizeof(header)) {
-		n = read(state->sway_ipc_fd,
-		         (char *)&header + hdr_offset,
-		         sizeof(header) - hdr_offset);
-		if (n <= 0) {
-			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				if (hdr_offset == 0) {
-					return NULL;
-				}
-				pfd = (struct pollfd){ .fd     = state->sway_ipc_fd,
-					               .events = POLLIN };
-				poll(&pfd, 1, 100);
-				continue;
-			}
-			if (n < 0) {
-				fprintf(stderr, "barny: sway IPC read error: %s\n",
-				        strerror(errno));
-			}
-			return NULL;
+	if (conn->start > 0
+	    && (conn->cap - conn->end <= SWAY_IPC_READ_MIN
+	        || conn->cap - conn->start < need)) {
+		memmove(conn->buf, conn->buf + conn->start,
+		        conn->end - conn->start);
+		conn->end   -= conn->start;
+		conn->start  = 0;
+	}
+
+	if (conn->cap < need || conn->cap - conn->end <= SWAY_IPC_READ_MIN) {
+		cap = conn->cap ? conn->cap : SWAY_IPC_BUF_INITIAL;
+		while (cap < need || cap - conn->end <= SWAY_IPC_READ_MIN)
+			cap *= 2;
+		grown = realloc(conn->buf, cap);
+		if (!grown)
+			return -1;
+		conn->buf = grown;
+		conn->cap = cap;
+	}
+
+	for (;;) {
+		/* the last byte stays free for the NUL after a payload */
+		n = recv(conn->fd, conn->buf + conn->end,
+		         conn->cap - conn->end - 1, MSG_DONTWAIT);
+		if (n > 0) {
+			conn->end += (size_t)n;
+			return 1;
 		}
-		hdr_offset += n;
+		if (n == 0)
+			return -1;
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+
+		fprintf(stderr, "barny: sway IPC read error: %s\n",
+		        strerror(errno));
+		return -1;
 	}
+}
+
+int
+barny_sway_ipc_next(barny_sway_conn_t *conn, uint32_t *type, char **payload,
+                    uint32_t *len)
+{
+	const char *p;
+	uint32_t    n;
+	size_t      at;
 
-	if (memcmp(header.magic, SWAY_IPC_MAGIC, 6) != 0) {
+	release_held(conn);
+	if (conn->end - conn->start < SWAY_IPC_HEADER_SIZE)
+		return 0;
+
+	p = conn->buf + conn->start;
+	if (memcmp(p, SWAY_IPC_MAGIC, 6) != 0) {
 		fprintf(stderr, "barny: invalid IPC magic\n");
-		return NULL;
+		return -1;
 	}
 
-	*type = header.type;
-
-	if (header.length == 0) {
-		return strdup("");
+	memcpy(&n, p + 6, 4);
+	if (n > SWAY_IPC_MAX_PAYLOAD) {
+		fprintf(stderr, "barny: sway IPC message of %u bytes\n", n);
+		return -1;
 	}
+	if (conn->end - conn->start - SWAY_IPC_HEADER_SIZE < n)
+		return 0;
 
-	payload   = malloc(header.length + 1);
-	remaining = header.length;
-	offset    = 0;
-
-	while (remaining > 0) {
-		n = read(state->sway_ipc_fd, payload + offset, remaining);
-		if (n <= 0) {
-			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
-				pfd = (struct pollfd){ .fd     = state->sway_ipc_fd,
-					               .events = POLLIN };
-				poll(&pfd, 1, 100);
-				continue;
-			}
-			free(payload);
-			return NULL;
+	memcpy(type, p + 10, 4);
+	*payload = conn->buf + conn->start + SWAY_IPC_HEADER_SIZE;
+	*len     = n;
+
+	at            = conn->start + SWAY_IPC_HEADER_SIZE + n;
+	conn->held    = conn->buf[at];
+	conn->held_at = at;
+	conn->holding = true;
+	conn->buf[at] = '\0';
+	conn->start   = at;
+	return 1;
+}
+
+/* sway answers in order, so a reply belongs to the oldest request. */
+static bool
+pop_reply(barny_sway_conn_t *conn, uint32_t type)
+{
+	if (conn->waiting_count == 0 || conn->waiting[conn->waiting_head] != type)
+		return false;
+
+	conn->waiting_head = (conn->waiting_head + 1) % BARNY_SWAY_IPC_PIPELINE;
+	conn->waiting_count--;
+	return true;
+}
+
+/* Takes whatever replies have arrived, dropping them. */
+static int
+read_replies(barny_sway_conn_t *conn)
+{
+	uint32_t type;
+	uint32_t len;
+	char    *body;
+	int      filled;
+	int      r;
+
+	do {
+		filled = barny_sway_ipc_fill(conn);
+		while ((r = barny_sway_ipc_next(conn, &type, &body, &len)) > 0) {
+			if (!pop_reply(conn, type))
+				return -1;
 		}
-		offset    += n;
-		remaining -= n;
+		if (r < 0)
+			return -1;
+	} while (filled > 0);
+
+	return filled;
+}
+
+static int
+send_request(barny_sway_conn_t *conn, uint32_t type, const char *payload)
+{
+	if (conn->waiting_count == BARNY_SWAY_IPC_PIPELINE
+	    && read_replies(conn) < 0)
+		return -1;
+	if (conn->waiting_count == BARNY_SWAY_IPC_PIPELINE) {
+		fprintf(stderr, "barny: sway is not answering IPC requests\n");
+		return -1;
 	}
 
-	payload[header.length] = '\0';
-	return payload;
+	if (barny_sway_ipc_send(conn, type, payload) < 0)
+		return -1;
+
+	conn->waiting[(conn->waiting_head + conn->waiting_count)
+	              % BARNY_SWAY_IPC_PIPELINE] = type;
+	conn->waiting_count++;
+	return 0;
 }
 
-char *
-barny_sway_ipc_recv_sync(barny_state_t *state, uint32_t *type, int timeout_ms)
+int
+barny_sway_ipc_command(barny_state_t *state, const char *command)
 {
-	struct pollfd pfd;
-	int           ret;
+	return send_request(&state->sway_cmds, BARNY_SWAY_IPC_COMMAND, command);
+}
 
-	if (state->sway_ipc_fd < 0) {
-		return NULL;
+int
+barny_sway_ipc_drain_replies(barny_state_t *state)
+{
+	if (state->sway_cmds.fd < 0)
+		return -1;
+
+	if (read_replies(&state->sway_cmds) < 0) {
+		barny_sway_conn_close(&state->sway_cmds);
+		return -1;
 	}
 
-	pfd = (struct pollfd){ .fd = state->sway_ipc_fd, .events = POLLIN };
-	ret = poll(&pfd, 1, timeout_ms);
-	if (ret <= 0) {
+	return 0;
+}
+
+char *
+barny_sway_ipc_request(barny_state_t *state, uint32_t type, const char *payload,
+                       int timeout_ms)
+{
+	barny_sway_conn_t *conn = &state->sway_cmds;
+	struct pollfd      pfd;
+	uint64_t           deadline;
+	uint64_t           now;
+	uint32_t           got;
+	uint32_t           len;
+	char              *body;
+	int                ahead;
+	int                r;
+
+	if (send_request(conn, type, payload) < 0)
 		return NULL;
+
+	/* Commands still in flight are answered first. If we give up, our
+	   reply stays queued and barny_sway_ipc_drain_replies drops it. */
+	ahead    = conn->waiting_count - 1;
+	deadline = barny_now_ms() + (uint64_t)timeout_ms;
+	for (;;) {
+		while ((r = barny_sway_ipc_next(conn, &got, &body, &len)) > 0) {
+			if (!pop_reply(conn, got))
+				goto lost;
+			if (ahead-- == 0)
+				return strdup(body);
+		}
+		if (r < 0)
+			goto lost;
+
+		now = barny_now_ms();
+		if (now >= deadline)
+			return NULL;
+
+		pfd = (struct pollfd){ .fd = conn->fd, .events = POLLIN };
+		if (poll(&pfd, 1, (int)(deadline - now)) <= 0)
+			continue;
+		if (barny_sway_ipc_fill(conn) < 0)
+			goto lost;
 	}
 
-	return barny_sway_ipc_recv(state, type);
+lost:
+	barny_sway_conn_close(conn);
+	return NULL;
 }
 
 int
 barny_sway_ipc_subscribe(barny_state_t *state, const char *events)
 {
-	return barny_sway_ipc_send(state, 2, events);
+	return barny_sway_ipc_send(&state->sway_events, BARNY_SWAY_IPC_SUBSCRIBE,
+	                           events);
 }
@@ -26,10 +26,37 @@ setup_signals(void)
 	sigaction(SIGTERM, &sa, NULL);
 }
 
+#define SWAY_READS_PER_WAKEUP 16
+
+/* a failed reconnect is tried again after this, doubling up to the max */
+#define SWAY_RETRY_MIN_MS 250
+#define SWAY_RETRY_MAX_MS 30000
+
+static uint64_t sway_retry_ms;
+static bool     sway_retry_armed;
+
+static int
+watch_sway(barny_state_t *s)
+{
+	struct epoll_event ev = { .events = EPOLLIN };
+
+	if (s->sway_events.fd < 0)
+		return 0;
+
+	ev.data.fd = s->sway_events.fd;
+	if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0)
+		return -1;
+
+	ev.data.fd = s->sway_cmds.fd;
+	return epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev);
+}
+
 static int
 setup_epoll(barny_state_t *s)
 {
 	struct epoll_event ev;
+	int                network_fd;
+	int                battery_fd;
 
 	s->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
 	if (s->epoll_fd < 0) {
@@ -43,20 +70,81 @@ setup_epoll(barny_state_t *s)
 		return -1;
 	}
 
-	if (s->sway_ipc_fd >= 0) {
-		ev.data.fd = s->sway_ipc_fd;
+	if (watch_sway(s) < 0) {
+		fprintf(stderr, "barny: failed to add sway ipc fds to epoll\n");
+		return -1;
+	}
+
+	if (s->dbus_fd >= 0) {
+		ev.data.fd = s->dbus_fd;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add D-Bus fd to epoll\n");
+			return -1;
+		}
+	}
+
+	if (s->dbus_fd >= 0 && s->dbus_timer_fd >= 0) {
+		ev.data.fd = s->dbus_timer_fd;
 		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
 			fprintf(stderr,
-			        "barny: failed to add sway ipc fd to epoll\n");
+			        "barny: failed to add D-Bus timer to epoll\n");
 			return -1;
 		}
 	}
 
-	if (s->dbus_fd >= 0) {
-		ev.data.fd = s->dbus_fd;
+	if (s->feed_fd >= 0) {
+		ev.data.fd = s->feed_fd;
 		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
 			fprintf(stderr,
-			        "barny: failed to add D-Bus fd to epoll\n");
+			        "barny: failed to add feed socket to epoll\n");
+			return -1;
+		}
+	}
+
+	if (barny_executor_fd(s->executor) >= 0) {
+		ev.data.fd = barny_executor_fd(s->executor);
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add executor fd to epoll\n");
+			return -1;
+		}
+	}
+
+	if (barny_icon_theme_fd(s->icon_theme) >= 0) {
+		ev.data.fd = barny_icon_theme_fd(s->icon_theme);
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add icon loader fd to epoll\n");
+			return -1;
+		}
+	}
+
+	network_fd = barny_network_fd(barny_module_find(s, "network"));
+	if (network_fd >= 0) {
+		ev.data.fd = network_fd;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add netlink socket to epoll\n");
+			return -1;
+		}
+	}
+
+	battery_fd = barny_battery_fd(barny_module_find(s, "battery"));
+	if (battery_fd >= 0) {
+		ev.data.fd = battery_fd;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add uevent socket to epoll\n");
+			return -1;
+		}
+	}
+
+	if (s->timer_fd >= 0) {
+		ev.data.fd = s->timer_fd;
+		if (epoll_ctl(s->epoll_fd, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			fprintf(stderr,
+			        "barny: failed to add timer fd to epoll\n");
 			return -1;
 		}
 	}
@@ -64,6 +152,97 @@ setup_epoll(barny_state_t *s)
 	return 0;
 }
 
+static void
+retry_sway(barny_state_t *s);
+
+/* sway restarting (or a reload racing us) can leave nothing to connect to
+   for a moment; try again on the scheduler's timer rather than giving up
+   on workspaces for the rest of the session */
+static void
+schedule_sway_retry(barny_state_t *s)
+{
+	sway_retry_ms = sway_retry_ms ? sway_retry_ms * 2 : SWAY_RETRY_MIN_MS;
+	if (sway_retry_ms > SWAY_RETRY_MAX_MS)
+		sway_retry_ms = SWAY_RETRY_MAX_MS;
+
+	barny_debug("sway reconnect failed, retrying in %llu ms\n",
+	            (unsigned long long)sway_retry_ms);
+	sway_retry_armed = barny_sched_after(s, sway_retry_ms, retry_sway) == 0;
+}
+
+/* sway drops clients that fall behind on events. Whatever happened while
+   we were gone is lost, so a new connection starts from full state. */
+static void
+reconnect_sway(barny_state_t *s, barny_module_t *workspace_mod,
+               barny_module_t *windowtitle_mod)
+{
+	if (barny_sway_ipc_reconnect(s) < 0) {
+		schedule_sway_retry(s);
+		return;
+	}
+
+	if (watch_sway(s) < 0) {
+		fprintf(stderr, "barny: failed to add sway ipc fds to epoll\n");
+		barny_sway_ipc_cleanup(s);
+		schedule_sway_retry(s);
+		return;
+	}
+	sway_retry_ms = 0;
+
+	/* state first, then the events after it */
+	barny_workspace_refresh(workspace_mod);
+	barny_windowtitle_refresh(windowtitle_mod);
+	barny_sway_ipc_subscribe(s, "[\"workspace\",\"window\"]");
+}
+
+static void
+retry_sway(barny_state_t *s)
+{
+	sway_retry_armed = false;
+	reconnect_sway(s, barny_module_find(s, "workspace"),
+	               barny_module_find(s, "windowtitle"));
+}
+
+/* Frames what the event connection has, a bounded number of reads per
+   wakeup so a flood cannot keep the bar from drawing; the rest stays in
+   the socket for the next one. Returns -1 when the connection is gone. */
+static int
+dispatch_sway_events(barny_state_t *s, barny_module_t *workspace_mod,
+                     barny_module_t *windowtitle_mod)
+{
+	uint32_t type;
+	uint32_t len;
+	char    *payload;
+	int      filled;
+	int      reads;
+	int      r;
+
+	for (reads = 0; reads < SWAY_READS_PER_WAKEUP; reads++) {
+		filled = barny_sway_ipc_fill(&s->sway_events);
+		if (filled < 0)
+			return -1;
+
+		/* the subscribe reply comes through here too; the modules
+		   only look at events. Each change only asks for a frame, so
+		   a burst of them draws once. */
+		while ((r = barny_sway_ipc_next(&s->sway_events, &type, &payload,
+		                                &len))
+		       > 0) {
+			barny_workspace_event(workspace_mod, type, payload);
+			barny_windowtitle_event(windowtitle_mod, type, payload);
+			if ((workspace_mod && workspace_mod->dirty)
+			    || (windowtitle_mod && windowtitle_mod->dirty))
+				barny_defer(s, 0);
+		}
+		if (r < 0)
+			return -1;
+		if (filled == 0)
+			break;
+	}
+
+	return 0;
+}
+
 static void
 run_event_loop(barny_state_t *s)
 {
@@ -71,29 +250,47 @@ run_event_loop(barny_state_t *s)
 	int                wayland_fd;
 	barny_module_t    *workspace_mod;
 	barny_module_t    *windowtitle_mod;
-	uint64_t           last_update;
+	barny_module_t    *network_mod;
+	barny_module_t    *battery_mod;
+	uint64_t           wakeups;
+	uint64_t           wakeups_since;
 	uint64_t           now;
 	int                nfds;
 	bool               wayland_readable;
-	bool               need_workspace_refresh;
-	bool               dbus_readable;
+	bool               sway_connected;
+	bool               sway_events_ready;
+	bool               sway_replies_ready;
+	bool               dbus_ready;
+	bool               timer_expired;
+	bool               collected;
+	bool               icons_loaded;
+	bool               fed;
+	bool               netlinked;
+	bool               uevented;
+	int                executor_fd;
+	int                icon_fd;
+	int                network_fd;
+	int                battery_fd;
 	int                i;
-	uint32_t           type;
-	char              *payload;
-	barny_output_t    *out;
 
 	wayland_fd      = wl_display_get_fd(s->display);
 	workspace_mod   = barny_module_find(s, "workspace");
 	windowtitle_mod = barny_module_find(s, "windowtitle");
-	last_update     = 0;
+	network_mod     = barny_module_find(s, "network");
+	battery_mod     = barny_module_find(s, "battery");
+	executor_fd     = barny_executor_fd(s->executor);
+	icon_fd         = barny_icon_theme_fd(s->icon_theme);
+	network_fd      = barny_network_fd(network_mod);
+	battery_fd      = barny_battery_fd(battery_mod);
+	sway_connected  = s->sway_events.fd >= 0;
+	wakeups         = 0;
+	wakeups_since   = barny_now_ms();
+
+	/* everything once; from here on periodic modules run off the timer
+	   and the rest off their events */
+	barny_modules_update(s);
 
 	while (s->running) {
-		now = barny_now_ms();
-		if (now - last_update >= 500) {
-			barny_modules_update(s);
-			last_update = now;
-		}
-
 		while (wl_display_prepare_read(s->display) != 0) {
 			wl_display_dispatch_pending(s->display);
 		}
@@ -104,7 +301,26 @@ run_event_loop(barny_state_t *s)
 			break;
 		}
 
-		nfds = epoll_wait(s->epoll_fd, events, 16, 200);
+		/* queued D-Bus writes and call timeouts, as the sends since
+		   the last dispatch left them */
+		barny_dbus_prepare(s);
+
+		/* no timeout: the timerfds carry every deadline there is */
+		nfds = epoll_wait(s->epoll_fd, events, 16, -1);
+		wakeups++;
+
+		now = barny_now_ms();
+		if (now - wakeups_since >= 60000) {
+			barny_debug("%.2f wakeups/s over the last %llu s, "
+			            "%llu events coalesced so far\n",
+			            (double)wakeups * 1000.0
+			                    / (double)(now - wakeups_since),
+			            (unsigned long long)(now - wakeups_since)
+			                    / 1000,
+			            (unsigned long long)s->coalesced_events);
+			wakeups       = 0;
+			wakeups_since = now;
+		}
 
 		if (nfds < 0) {
 			wl_display_cancel_read(s->display);
@@ -117,22 +333,38 @@ run_event_loop(barny_state_t *s)
 		}
 
 		wayland_readable       = false;
-		need_workspace_refresh = false;
-		dbus_readable          = false;
+		sway_events_ready      = false;
+		sway_replies_ready     = false;
+		dbus_ready             = false;
+		timer_expired          = false;
+		collected              = false;
+		icons_loaded           = false;
+		fed                    = false;
+		netlinked              = false;
+		uevented               = false;
 
 		for (i = 0; i < nfds; i++) {
 			if (events[i].data.fd == wayland_fd) {
 				wayland_readable = true;
-			} else if (events[i].data.fd == s->sway_ipc_fd) {
-				for (;;) {
-					payload = barny_sway_ipc_recv(s, &type);
-					if (!payload)
-						break;
-					free(payload);
-					need_workspace_refresh = true;
-				}
-			} else if (events[i].data.fd == s->dbus_fd) {
-				dbus_readable = true;
+			} else if (events[i].data.fd == s->sway_events.fd) {
+				sway_events_ready = true;
+			} else if (events[i].data.fd == s->sway_cmds.fd) {
+				sway_replies_ready = true;
+			} else if (events[i].data.fd == s->dbus_fd
+			           || events[i].data.fd == s->dbus_timer_fd) {
+				dbus_ready = true;
+			} else if (events[i].data.fd == s->timer_fd) {
+				timer_expired = true;
+			} else if (events[i].data.fd == executor_fd) {
+				collected = true;
+			} else if (events[i].data.fd == icon_fd) {
+				icons_loaded = true;
+			} else if (events[i].data.fd == s->feed_fd) {
+				fed = true;
+			} else if (events[i].data.fd == network_fd) {
+				netlinked = true;
+			} else if (events[i].data.fd == battery_fd) {
+				uevented = true;
 			}
 		}
 
@@ -147,22 +379,55 @@ run_event_loop(barny_state_t *s)
 
 		wl_display_dispatch_pending(s->display);
 
-		if (dbus_readable) {
+		if (dbus_ready) {
 			barny_dbus_dispatch(s);
 		}
 
-		if (need_workspace_refresh && workspace_mod) {
-			barny_workspace_refresh(workspace_mod);
+		if (timer_expired) {
+			barny_sched_dispatch(s);
 		}
-		if (need_workspace_refresh && windowtitle_mod) {
-			barny_windowtitle_refresh(windowtitle_mod);
+
+		if (collected) {
+			barny_executor_dispatch(s->executor);
 		}
 
-		if (nfds > 0 && barny_modules_any_dirty(s)) {
-			for (out = s->outputs; out; out = out->next) {
-				if (out->configured)
-					barny_render_frame(out);
-			}
+		if (icons_loaded) {
+			barny_icon_theme_dispatch(s->icon_theme);
+		}
+
+		if (fed) {
+			barny_feed_dispatch(s);
+		}
+
+		if (netlinked) {
+			barny_network_dispatch(network_mod);
+		}
+
+		if (uevented) {
+			barny_battery_dispatch(battery_mod);
+		}
+
+		if (sway_events_ready) {
+			if (dispatch_sway_events(s, workspace_mod, windowtitle_mod)
+			    < 0)
+				barny_sway_ipc_cleanup(s);
+		}
+		if (sway_replies_ready) {
+			barny_sway_ipc_drain_replies(s);
+		}
+
+		/* either connection gone (a request can drop the command one
+		   too) means starting over on both; a failed attempt is
+		   retried off the timer */
+		if (sway_connected && !sway_retry_armed
+		    && (s->sway_events.fd < 0 || s->sway_cmds.fd < 0))
+			reconnect_sway(s, workspace_mod, windowtitle_mod);
+
+		/* module changes draw at the next frame callback, with
+		   whatever else lands before it */
+		if (nfds > 0 && !s->repaint_scheduled
+		    && barny_modules_any_dirty(s)) {
+			barny_defer(s, 0);
 			s->dyn_dirty = false;
 		} else if (s->dyn_dirty) {
 			if (s->dyn_output && s->dyn_output->configured)
@@ -177,23 +442,13 @@ main(int argc, char *argv[])
 {
 	char                  config_path[512];
 	const char           *home;
-	int                   w;
-	int                   h;
-	int                   max_needed_height;
-	int                   crop_y_offset;
-	barny_output_t       *out;
-	double                scale_x;
-	double                scale_y;
-	double                scale;
-	int                   needed;
-	cairo_surface_t      *cropped;
-	cairo_t              *cr;
 	barny_module_layout_t layout;
 
 	(void)argc;
 	(void)argv;
 
 	setvbuf(stdout, NULL, _IOLBF, 0);
+	state.start_us = barny_now_us();
 
 	printf("barny %s - liquid glass status bar\n", BARNY_VERSION);
 
@@ -209,109 +464,39 @@ main(int argc, char *argv[])
 
 	barny_config_validate_font(&state.config);
 
+	state.render_pool = barny_pool_create(state.config.glass_threads);
+
 	if (barny_wayland_init(&state) < 0) {
 		fprintf(stderr, "barny: failed to initialize wayland\n");
 		return 1;
 	}
 
-	if (state.config.wallpaper_path) {
-		state.wallpaper
-		        = barny_load_wallpaper(state.config.wallpaper_path);
-		if (state.wallpaper) {
-			w                 = cairo_image_surface_get_width(state.wallpaper);
-			h                 = cairo_image_surface_get_height(state.wallpaper);
-			max_needed_height = 0;
-			crop_y_offset     = 0;
-
-			if (state.outputs) {
-				for (out = state.outputs; out; out = out->next) {
-					if (out->width > 0 && out->mode_height > 0) {
-						scale_x = (double)w / out->width;
-						scale_y = (double)h / out->mode_height;
-						scale   = scale_x < scale_y ? scale_x : scale_y;
-						needed  = (int)(out->mode_height * scale) + (int)state.config.blur_radius * 2 + (int)state.config.displacement_scale * 2 + 64;
-						if (needed > max_needed_height) {
-							max_needed_height = needed;
-						}
-					}
-				}
-
-				if (max_needed_height > 0 && max_needed_height < h) {
-					if (!state.config.position_top) {
-						crop_y_offset = h - max_needed_height;
-					}
-					h       = max_needed_height;
-					cropped = cairo_image_surface_create(
-					        CAIRO_FORMAT_ARGB32, w, h);
-					cr = cairo_create(cropped);
-					cairo_set_source_surface(cr, state.wallpaper, 0, -crop_y_offset);
-					cairo_paint(cr);
-					cairo_destroy(cr);
-
-					cairo_surface_destroy(state.wallpaper);
-					state.wallpaper = cropped;
-					printf("barny: cropped wallpaper from %dx%d to %dx%d (y-offset=%d) for startup optimization\n",
-					       w, h + crop_y_offset, w, h, crop_y_offset);
-				}
-			}
-
-			state.blurred_wallpaper = cairo_image_surface_create(
-			        CAIRO_FORMAT_ARGB32, w, h);
-			cr = cairo_create(state.blurred_wallpaper);
-			cairo_set_source_surface(cr, state.wallpaper, 0, 0);
-			cairo_paint(cr);
-			cairo_destroy(cr);
-			barny_blur_surface(state.blurred_wallpaper,
-			                   (int)state.config.blur_radius);
-			barny_apply_vibrancy(state.blurred_wallpaper, 1.35,
-			                     state.config.brightness);
-
-			if (state.config.refraction_mode != BARNY_REFRACT_NONE) {
-				printf("barny: creating liquid glass displacement map...\n");
-				state.displacement_map
-				        = barny_create_displacement_map(
-				                w, h, state.config.refraction_mode,
-				                state.config.border_radius,
-				                state.config.edge_refraction,
-				                state.config.noise_scale,
-				                state.config.noise_octaves);
-
-				if (state.displacement_map) {
-					state.displaced_wallpaper
-					        = cairo_image_surface_create(
-					                CAIRO_FORMAT_ARGB32, w, h);
-					barny_apply_displacement(
-					        state.blurred_wallpaper,
-					        state.displaced_wallpaper,
-					        state.displacement_map,
-					        state.config.displacement_scale,
-					        state.config.chromatic_aberration);
-					printf("barny: liquid glass effect applied (mode=%s, scale=%.1f, chromatic=%.1f)\n",
-					       state.config.refraction_mode
-					                       == BARNY_REFRACT_LENS ?
-					               "lens" :
-					               "liquid",
-					       state.config.displacement_scale,
-					       state.config.chromatic_aberration);
-				}
-			}
-		}
-	}
+	barny_wallpaper_prepare(&state);
 
-	state.sway_ipc_fd = -1;
 	barny_sway_ipc_init(&state);
 
+	/* the tray's first replies can name theme icons */
+	state.icon_theme = barny_icon_theme_create(state.config.tray_icon_theme);
+
 	state.dbus_fd = -1;
 	if (barny_dbus_init(&state) < 0) {
 		fprintf(stderr, "barny: D-Bus init failed, tray disabled\n");
 	}
 
+	state.feed_fd = -1;
+	barny_feed_listen(&state);
+
 	barny_module_layout_init(&layout);
 	barny_module_layout_load_from_config(&state.config, &layout);
 	barny_module_layout_apply_to_state(&layout, &state);
 	barny_module_layout_destroy(&layout);
 	barny_modules_init(&state);
 
+	state.executor = barny_executor_create(BARNY_COLLECT_THREADS);
+
+	state.timer_fd = -1;
+	barny_sched_init(&state);
+
 	setup_signals();
 	state.running = true;
 
@@ -322,10 +507,17 @@ main(int argc, char *argv[])
 
 	run_event_loop(&state);
 
-	barny_modules_destroy(&state);
+	barny_sched_cleanup(&state);
+	/* a collector that never came back may still be writing into its
+	   module; the process is about to exit anyway */
+	if (barny_executor_destroy(state.executor))
+		barny_modules_destroy(&state);
+	barny_feed_cleanup(&state);
 	barny_dbus_cleanup(&state);
+	barny_icon_theme_destroy(state.icon_theme);
 	barny_sway_ipc_cleanup(&state);
 	barny_wayland_cleanup(&state);
+	barny_pool_destroy(state.render_pool);
 
 	if (state.wallpaper) {
 		cairo_surface_destroy(state.wallpaper);
@@ -2,8 +2,17 @@
 #include <stdlib.h>
 #include <string.h>
 #include <dirent.h>
+#include <unistd.h>
 
 #include "barny.h"
+#include "barny_sysfs.h"
+#include "uevent.h"
+
+/* With uevents the kernel tells us about plugging, unplugging and status
+   changes as they happen; the poll only catches capacity drift on drivers
+   that do not announce it. Without the socket we are back to polling. */
+#define BATTERY_FALLBACK_MS 60000
+#define BATTERY_POLL_MS     5000
 
 typedef struct {
 	barny_state_t        *state;
@@ -11,33 +20,27 @@ typedef struct {
 	int                   capacity;
 	char                  status[16];
 	char                  device_path[256];
+	char                  supply[64];
+	barny_sysfs_file_t    uevent;
+	int                   uevent_fd;
 	PangoFontDescription *font_desc;
 } battery_data_t;
 
 static bool
 read_ps_attr(const char *supply, const char *attr, char *buf, size_t buflen)
 {
-	char  attr_path[512];
-	FILE *f;
-	char *nl;
-	int   n;
+	char attr_path[512];
+	int  n;
 
 	n = snprintf(attr_path, sizeof(attr_path),
 	             "/sys/class/power_supply/%s/%s", supply, attr);
 	if (n < 0 || (size_t)n >= sizeof(attr_path))
 		return false;
 
-	f = fopen(attr_path, "r");
-	if (!f)
+	if (barny_sysfs_read_path(attr_path, buf, buflen) < 0)
 		return false;
 
-	buf[0] = '\0';
-	if (fgets(buf, buflen, f)) {
-		nl = strchr(buf, '\n');
-		if (nl)
-			*nl = '\0';
-	}
-	fclose(f);
+	buf[strcspn(buf, "\n")] = '\0';
 	return true;
 }
 
@@ -81,6 +84,24 @@ detect_battery(char *path_buf, size_t path_len)
 	return -1;
 }
 
+/* ".../power_supply/BAT0/uevent" -> "BAT0", what POWER_SUPPLY_NAME says */
+static void
+supply_name(const char *uevent_path, char *buf, size_t size)
+{
+	const char *end;
+	const char *start;
+
+	end = strrchr(uevent_path, '/');
+	if (!end || strcmp(end, "/uevent") != 0)
+		end = uevent_path + strlen(uevent_path);
+
+	start = end;
+	while (start > uevent_path && start[-1] != '/')
+		start--;
+
+	snprintf(buf, size, "%.*s", (int)(end - start), start);
+}
+
 static int
 battery_init(barny_module_t *self, barny_state_t *state)
 {
@@ -100,6 +121,12 @@ battery_init(barny_module_t *self, barny_state_t *state)
 		snprintf(data->device_path, sizeof(data->device_path),
 		         "/sys/class/power_supply/BAT0/uevent");
 	}
+	barny_sysfs_init(&data->uevent, "%s", data->device_path);
+	supply_name(data->device_path, data->supply, sizeof(data->supply));
+
+	data->uevent_fd          = barny_uevent_open("power_supply");
+	self->update_interval_ms = data->uevent_fd >= 0 ? BATTERY_FALLBACK_MS
+	                                                : BATTERY_POLL_MS;
 
 	strcpy(data->display_str, "BAT --");
 
@@ -115,22 +142,19 @@ battery_destroy(barny_module_t *self)
 
 	if (data->font_desc)
 		pango_font_description_free(data->font_desc);
+	barny_sysfs_close(&data->uevent);
+	if (data->uevent_fd >= 0)
+		close(data->uevent_fd);
 
 	free(data);
 	self->data = NULL;
 }
 
 static void
-battery_update(barny_module_t *self)
+battery_apply(barny_module_t *self, const char *new_status, int new_capacity)
 {
 	battery_data_t *data;
 	barny_config_t *cfg;
-	FILE           *f;
-	char            new_status[16];
-	int             new_capacity;
-	char            line[256];
-	char           *val;
-	char           *nl;
 	const char     *sp;
 	char            pct_str[16];
 	const char     *prefix;
@@ -138,27 +162,6 @@ battery_update(barny_module_t *self)
 	data = self->data;
 	cfg  = &data->state->config;
 
-	f    = fopen(data->device_path, "r");
-	if (!f)
-		return;
-
-	new_status[0] = '\0';
-	new_capacity  = -1;
-
-	while (fgets(line, sizeof(line), f)) {
-		if (strncmp(line, "POWER_SUPPLY_STATUS=", 20) == 0) {
-			val = line + 20;
-			nl  = strchr(val, '\n');
-			if (nl)
-				*nl = '\0';
-			strncpy(new_status, val, sizeof(new_status) - 1);
-			new_status[sizeof(new_status) - 1] = '\0';
-		} else if (strncmp(line, "POWER_SUPPLY_CAPACITY=", 22) == 0) {
-			new_capacity = atoi(line + 22);
-		}
-	}
-	fclose(f);
-
 	if (new_capacity < 0)
 		return;
 
@@ -194,6 +197,86 @@ battery_update(barny_module_t *self)
 	self->dirty = true;
 }
 
+static void
+battery_update(barny_module_t *self)
+{
+	battery_data_t *data = self->data;
+	char            new_status[16];
+	long long       capacity;
+	char            buf[2048];
+	const char     *v;
+
+	if (barny_sysfs_read(&data->uevent, buf, sizeof(buf)) <= 0)
+		return;
+
+	new_status[0] = '\0';
+	barny_scan_field_str(buf, "POWER_SUPPLY_STATUS=", new_status,
+	                     sizeof(new_status));
+	v = barny_scan_field(buf, "POWER_SUPPLY_CAPACITY=");
+	if (v && barny_scan_ll(v, &capacity))
+		battery_apply(self, new_status, (int)capacity);
+}
+
+int
+barny_battery_fd(barny_module_t *mod)
+{
+	battery_data_t *data;
+
+	if (!mod || strcmp(mod->name, "battery") != 0)
+		return -1;
+
+	data = mod->data;
+	return data->uevent_fd;
+}
+
+/* Our battery's own events carry its status and capacity, so they are
+   applied as they come. Anything else on power_supply (the AC adapter
+   mostly) moves the battery too, but its event may lag behind or never
+   come, so those reread the battery's uevent file once the queue is
+   drained. */
+void
+barny_battery_dispatch(barny_module_t *mod)
+{
+	battery_data_t *data;
+	barny_uevent_t  ev;
+	char            buf[BARNY_UEVENT_BUF_SIZE];
+	const char     *name;
+	const char     *status;
+	const char     *v;
+	long long       capacity;
+	bool            reread;
+	int             r;
+
+	if (!mod || strcmp(mod->name, "battery") != 0)
+		return;
+
+	data   = mod->data;
+	reread = false;
+	while ((r = barny_uevent_recv(data->uevent_fd, buf, sizeof(buf), &ev))
+	       != 0) {
+		if (r < 0) {
+			reread = true;
+			continue;
+		}
+		if (strcmp(ev.subsystem, "power_supply") != 0)
+			continue;
+
+		name   = barny_uevent_get(&ev, "POWER_SUPPLY_NAME");
+		status = barny_uevent_get(&ev, "POWER_SUPPLY_STATUS");
+		v      = barny_uevent_get(&ev, "POWER_SUPPLY_CAPACITY");
+		if (name && strcmp(name, data->supply) == 0 && status && v
+		    && barny_scan_ll(v, &capacity)) {
+			battery_apply(mod, status, (int)capacity);
+			continue;
+		}
+
+		reread = true;
+	}
+
+	if (reread)
+		battery_update(mod);
+}
+
 static void
 battery_render(barny_module_t *self, cairo_t *cr, int x, int y, int w, int h)
 {
@@ -221,12 +304,15 @@ barny_module_battery_create(void)
 		return NULL;
 	}
 
+	barny_sysfs_init(&data->uevent, "%s", "");
+	data->uevent_fd = -1;
+
 	mod->name               = "battery";
 	mod->position           = BARNY_POS_RIGHT;
 	mod->init               = battery_init;
 	mod->destroy            = battery_destroy;
 	mod->update             = battery_update;
-	mod->update_interval_ms = 5000;
+	mod->update_interval_ms = BATTERY_POLL_MS;
 	mod->render             = battery_render;
 	mod->data               = data;
 	mod->width              = 80;
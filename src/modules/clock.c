@@ -147,6 +147,11 @@ clock_init(barny_module_t *self, barny_state_t *state)
 	data->font_desc    = pango_font_description_from_string(
 	        state->config.font ? state->config.font : "Sans 12");
 
+	/* the scheduler lands these on the second or minute boundary, so the
+	   text flips with the wall clock rather than up to a tick late */
+	self->update_interval_ms = state->config.clock_show_seconds ? 1000
+	                                                            : 60000;
+
 	return 0;
 }
 
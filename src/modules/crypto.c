@@ -8,9 +8,12 @@
 
 #define POPUP_LINE_H         26
 #define CRYPTO_NAME_LEN      24
-#define CRYPTO_FILE_PATH_LEN 128
+#define CRYPTO_FEED_NAME_LEN 64
 #define CRYPTO_PRICE_LEN     32
 
+/* only while some pair is still read from its file */
+#define CRYPTO_POLL_MS 1000
+
 static const char *default_crypto_pairs[] = {
 	"BTC-USDT-SWAP",
 	"ETH-USDT-SWAP",
@@ -22,10 +25,11 @@ static const char *default_crypto_pairs[] = {
 };
 
 typedef struct {
-	char   name[CRYPTO_NAME_LEN];
-	char   file_path[CRYPTO_FILE_PATH_LEN];
-	char   price_str[CRYPTO_PRICE_LEN];
-	double price;
+	char          name[CRYPTO_NAME_LEN];
+	char          feed_name[CRYPTO_FEED_NAME_LEN];
+	char          price_str[CRYPTO_PRICE_LEN];
+	double        price;
+	barny_feed_t *feed;
 } crypto_pair_t;
 
 typedef struct {
@@ -76,8 +80,9 @@ pair_name_from_market(const char *market, char *buf, size_t buf_size)
 	buf[out] = '\0';
 }
 
+/* matches the helper's naming: "btc_price" for BTC-USDT-SWAP */
 static void
-pair_file_from_market(const char *market, char *buf, size_t buf_size)
+pair_feed_from_market(const char *market, char *buf, size_t buf_size)
 {
 	char   slug[64];
 	size_t out = 0;
@@ -94,12 +99,12 @@ pair_file_from_market(const char *market, char *buf, size_t buf_size)
 	}
 
 	if (out == 0) {
-		snprintf(buf, buf_size, "/opt/barny/modules/crypto_price");
+		snprintf(buf, buf_size, "crypto_price");
 		return;
 	}
 
 	slug[out] = '\0';
-	snprintf(buf, buf_size, "/opt/barny/modules/%s_price", slug);
+	snprintf(buf, buf_size, "%s_price", slug);
 }
 
 static void
@@ -127,24 +132,16 @@ format_pair_price(const barny_config_t *cfg, char *buf, size_t buf_size,
 }
 
 static bool
-read_pair_price(const char *path, double *price_out)
+read_pair_price(barny_feed_t *feed, double *price_out)
 {
-	FILE *f;
 	char  line[64];
 	char *end = NULL;
 
-	if (!path || !price_out)
-		return false;
-
-	f = fopen(path, "r");
-	if (!f)
+	if (!feed || !price_out)
 		return false;
 
-	if (!fgets(line, sizeof(line), f)) {
-		fclose(f);
+	if (barny_feed_read(feed, line, sizeof(line)) <= 0)
 		return false;
-	}
-	fclose(f);
 
 	*price_out = strtod(line, &end);
 	return end != line;
@@ -285,10 +282,12 @@ crypto_init(barny_module_t *self, barny_state_t *state)
 
 		pair_name_from_market(market, data->pairs[i].name,
 		                      sizeof(data->pairs[i].name));
-		pair_file_from_market(market, data->pairs[i].file_path,
-		                      sizeof(data->pairs[i].file_path));
+		pair_feed_from_market(market, data->pairs[i].feed_name,
+		                      sizeof(data->pairs[i].feed_name));
 		snprintf(data->pairs[i].price_str,
 		         sizeof(data->pairs[i].price_str), "--");
+		data->pairs[i].feed = barny_feed_open(
+		        state, data->pairs[i].feed_name, self);
 	}
 
 	snprintf(data->price_str, sizeof(data->price_str), "%s --",
@@ -301,6 +300,7 @@ static void
 crypto_destroy(barny_module_t *self)
 {
 	crypto_data_t *data = self->data;
+	int            i;
 
 	if (!data)
 		return;
@@ -316,6 +316,8 @@ crypto_destroy(barny_module_t *self)
 	if (data->popup_font_desc)
 		pango_font_description_free(data->popup_font_desc);
 
+	for (i = 0; data->pairs && i < data->pair_count; i++)
+		barny_feed_close(data->pairs[i].feed);
 	free(data->pairs);
 	free(data);
 	self->data = NULL;
@@ -332,7 +334,7 @@ crypto_update(barny_module_t *self)
 		double price;
 		char   formatted[CRYPTO_PRICE_LEN];
 
-		if (!read_pair_price(data->pairs[i].file_path, &price))
+		if (!read_pair_price(data->pairs[i].feed, &price))
 			continue;
 
 		if (price != data->pairs[i].price) {
@@ -355,6 +357,14 @@ crypto_update(barny_module_t *self)
 
 	if (popup_changed && barny_popup_visible(data->popup))
 		barny_popup_redraw(data->popup);
+
+	/* once every pair pings on change, the timer has nothing to catch and
+	   the module leaves the schedule */
+	for (i = 0; i < data->pair_count; i++) {
+		if (!barny_feed_live(data->pairs[i].feed))
+			break;
+	}
+	self->update_interval_ms = i == data->pair_count ? 0 : CRYPTO_POLL_MS;
 }
 
 static void
@@ -387,7 +397,7 @@ barny_module_crypto_create(void)
 	mod->init               = crypto_init;
 	mod->destroy            = crypto_destroy;
 	mod->update             = crypto_update;
-	mod->update_interval_ms = 1000;
+	mod->update_interval_ms = CRYPTO_POLL_MS;
 	mod->render             = crypto_render;
 	mod->on_hover           = crypto_on_hover;
 	mod->data               = data;
@@ -12,6 +12,11 @@ typedef struct {
 	unsigned long long    total_bytes;
 	unsigned long long    used_bytes;
 	PangoFontDescription *font_desc;
+
+	/* written by disk_collect, read by disk_update once it is done */
+	bool                  sample_ok;
+	unsigned long long    sample_total;
+	unsigned long long    sample_avail;
 } disk_data_t;
 
 static void
@@ -54,13 +59,30 @@ disk_destroy(barny_module_t *self)
 	self->data = NULL;
 }
 
+/* statvfs can block for as long as the filesystem likes -- seconds on an
+   NFS or FUSE mount whose server went away -- so it runs off the main
+   thread. */
+static void
+disk_collect(barny_module_t *self)
+{
+	disk_data_t    *data = self->data;
+	barny_config_t *cfg  = &data->state->config;
+	const char     *path = cfg->disk_path ? cfg->disk_path : "/";
+	struct statvfs  st;
+
+	data->sample_ok = statvfs(path, &st) == 0;
+	if (!data->sample_ok)
+		return;
+
+	data->sample_total = (unsigned long long)st.f_blocks * st.f_frsize;
+	data->sample_avail = (unsigned long long)st.f_bavail * st.f_frsize;
+}
+
 static void
 disk_update(barny_module_t *self)
 {
 	disk_data_t       *data;
 	barny_config_t    *cfg;
-	const char        *path;
-	struct statvfs     st;
 	unsigned long long total;
 	unsigned long long avail;
 	unsigned long long used;
@@ -72,13 +94,12 @@ disk_update(barny_module_t *self)
 
 	data = self->data;
 	cfg  = &data->state->config;
-	path = cfg->disk_path ? cfg->disk_path : "/";
 
-	if (statvfs(path, &st) != 0)
+	if (!data->sample_ok)
 		return;
 
-	total = (unsigned long long)st.f_blocks * st.f_frsize;
-	avail = (unsigned long long)st.f_bavail * st.f_frsize;
+	total = data->sample_total;
+	avail = data->sample_avail;
 	used  = total - avail;
 
 	if (used != data->used_bytes || total != data->total_bytes) {
@@ -142,6 +163,7 @@ barny_module_disk_create(void)
 	mod->init               = disk_init;
 	mod->destroy            = disk_destroy;
 	mod->update             = disk_update;
+	mod->collect            = disk_collect;
 	mod->update_interval_ms = 5000;
 	mod->render             = disk_render;
 	mod->data               = data;
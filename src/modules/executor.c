@@ -0,0 +1,224 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barny.h"
+#include "util.h"
+
+#define EXEC_MAX_THREADS 4
+
+/* how long shutdown waits for collects still in progress */
+#define EXEC_JOIN_MS     500
+
+/* Runs modules' collect() off the Wayland thread. A module is submitted when
+   it comes due and is never queued twice: until the main loop has seen its
+   collect finish, further deadlines for it are dropped. That bounds both
+   rings by the module count and makes the mutex the only handoff the module
+   data needs -- collect writes its sample, the worker takes the lock to post
+   it, the main thread takes the lock to drain it, and only then does update
+   read the sample. A collector that hangs (statvfs on a dead NFS mount)
+   pins one worker and its own module; the other workers keep serving the
+   rest. */
+struct barny_executor {
+	pthread_t        threads[EXEC_MAX_THREADS];
+	int              nthreads;
+	int              event_fd;
+
+	pthread_mutex_t  lock;
+	pthread_cond_t   cond;
+	bool             quit;
+
+	barny_module_t  *todo[BARNY_MAX_MODULES];
+	int              todo_head;
+	int              todo_count;
+
+	barny_module_t  *done[BARNY_MAX_MODULES];
+	int              done_count;
+};
+
+static void *
+executor_worker(void *arg)
+{
+	barny_executor_t *ex = arg;
+	barny_module_t   *mod;
+	uint64_t          one = 1;
+
+	pthread_mutex_lock(&ex->lock);
+	for (;;) {
+		while (!ex->quit && ex->todo_count == 0)
+			pthread_cond_wait(&ex->cond, &ex->lock);
+		if (ex->quit)
+			break;
+
+		mod           = ex->todo[ex->todo_head];
+		ex->todo_head = (ex->todo_head + 1) % BARNY_MAX_MODULES;
+		ex->todo_count--;
+		pthread_mutex_unlock(&ex->lock);
+
+		mod->collect(mod);
+
+		pthread_mutex_lock(&ex->lock);
+		ex->done[ex->done_count++] = mod;
+		if (write(ex->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			fprintf(stderr, "barny: executor eventfd write: %s\n",
+			        strerror(errno));
+	}
+	pthread_mutex_unlock(&ex->lock);
+
+	return NULL;
+}
+
+barny_executor_t *
+barny_executor_create(int threads)
+{
+	barny_executor_t *ex;
+	char              name[16];
+	int               i;
+	int               err;
+
+	if (threads <= 0)
+		return NULL;
+	if (threads > EXEC_MAX_THREADS)
+		threads = EXEC_MAX_THREADS;
+
+	ex = calloc(1, sizeof(*ex));
+	if (!ex)
+		return NULL;
+
+	ex->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (ex->event_fd < 0) {
+		fprintf(stderr, "barny: executor eventfd: %s\n", strerror(errno));
+		free(ex);
+		return NULL;
+	}
+	pthread_mutex_init(&ex->lock, NULL);
+	pthread_cond_init(&ex->cond, NULL);
+
+	for (i = 0; i < threads; i++) {
+		err = pthread_create(&ex->threads[i], NULL, executor_worker, ex);
+		if (err != 0) {
+			fprintf(stderr, "barny: collector worker %d: %s\n", i,
+			        strerror(err));
+			break;
+		}
+		snprintf(name, sizeof(name), "barny-collect%d", i);
+		pthread_setname_np(ex->threads[i], name);
+		ex->nthreads++;
+	}
+
+	if (ex->nthreads == 0) {
+		barny_executor_destroy(ex);
+		return NULL;
+	}
+
+	return ex;
+}
+
+/* Joins the workers, so a collect still in progress finishes before the
+   caller goes on to free module data under it -- but only for so long: a
+   collector stuck in statvfs on a dead NFS mount would otherwise hold up
+   shutdown forever. Workers still busy at the deadline are detached and
+   the executor is left to them; false tells the caller that some module's
+   data may still be in use and must not be freed. */
+bool
+barny_executor_destroy(barny_executor_t *ex)
+{
+	struct timespec deadline;
+	int             abandoned = 0;
+	int             i;
+
+	if (!ex)
+		return true;
+
+	pthread_mutex_lock(&ex->lock);
+	ex->quit = true;
+	pthread_cond_broadcast(&ex->cond);
+	pthread_mutex_unlock(&ex->lock);
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec  += EXEC_JOIN_MS / 1000;
+	deadline.tv_nsec += (long)(EXEC_JOIN_MS % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+
+	for (i = 0; i < ex->nthreads; i++) {
+		if (pthread_timedjoin_np(ex->threads[i], NULL, &deadline) != 0) {
+			pthread_detach(ex->threads[i]);
+			abandoned++;
+		}
+	}
+
+	if (abandoned > 0) {
+		/* the lock, the rings and the eventfd stay valid for them */
+		fprintf(stderr,
+		        "barny: %d collector(s) still busy at shutdown, "
+		        "not waiting for them\n",
+		        abandoned);
+		return false;
+	}
+
+	pthread_cond_destroy(&ex->cond);
+	pthread_mutex_destroy(&ex->lock);
+	close(ex->event_fd);
+	free(ex);
+	return true;
+}
+
+int
+barny_executor_fd(const barny_executor_t *ex)
+{
+	return ex ? ex->event_fd : -1;
+}
+
+bool
+barny_executor_submit(barny_executor_t *ex, barny_module_t *mod)
+{
+	if (mod->collecting) {
+		barny_debug("%s: collect still running, skipping\n", mod->name);
+		return false;
+	}
+	mod->collecting = true;
+
+	pthread_mutex_lock(&ex->lock);
+	ex->todo[(ex->todo_head + ex->todo_count) % BARNY_MAX_MODULES] = mod;
+	ex->todo_count++;
+	pthread_cond_signal(&ex->cond);
+	pthread_mutex_unlock(&ex->lock);
+
+	return true;
+}
+
+int
+barny_executor_dispatch(barny_executor_t *ex)
+{
+	barny_module_t *done[BARNY_MAX_MODULES];
+	uint64_t        count;
+	int             n;
+	int             i;
+
+	if (read(ex->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return 0;
+
+	pthread_mutex_lock(&ex->lock);
+	n = ex->done_count;
+	memcpy(done, ex->done, sizeof(*done) * (size_t)n);
+	ex->done_count = 0;
+	pthread_mutex_unlock(&ex->lock);
+
+	/* publish on this thread: update reads the fresh sample, sets dirty
+	   and may redraw a popup, all of which is Wayland-side state */
+	for (i = 0; i < n; i++) {
+		done[i]->collecting = false;
+		done[i]->update(done[i]);
+	}
+
+	return n;
+}
@@ -0,0 +1,325 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "barny.h"
+#include "barny_feed.h"
+#include "util.h"
+
+/* How often a feed without a record looks for one again. A helper that
+   starts after the bar pings it anyway; this only covers a bar that could
+   not bind its socket. */
+#define FEED_RETRY_MS 10000
+
+struct barny_feed {
+	barny_state_t             *state;
+	barny_module_t            *mod;
+	char                       name[BARNY_FEED_NAME_MAX];
+	const barny_feed_record_t *rec;
+	uint64_t                   retry_ms;
+	bool                       notified;
+	barny_feed_t              *next;
+};
+
+static void
+feed_map(barny_feed_t *feed)
+{
+	char                 shm_name[BARNY_FEED_NAME_MAX + 32];
+	barny_feed_record_t *rec;
+	struct stat          st;
+	int                  fd;
+
+	barny_feed_shm_name(shm_name, sizeof(shm_name), feed->name);
+	fd = shm_open(shm_name, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(*rec)) {
+		close(fd);
+		return;
+	}
+
+	/* anyone can create a name first; only our own helpers' records count */
+	if (st.st_uid != getuid()) {
+		fprintf(stderr, "barny: feed %s: %s belongs to uid %u, ignored\n",
+		        feed->name, shm_name, (unsigned)st.st_uid);
+		close(fd);
+		return;
+	}
+
+	rec = mmap(NULL, sizeof(*rec), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (rec == MAP_FAILED)
+		return;
+
+	if (rec->magic != BARNY_FEED_MAGIC || rec->version != BARNY_FEED_VERSION) {
+		fprintf(stderr, "barny: feed %s: unknown record format\n",
+		        feed->name);
+		munmap(rec, sizeof(*rec));
+		return;
+	}
+
+	barny_debug("feed %s: reading from shm\n", feed->name);
+	feed->rec = rec;
+}
+
+barny_feed_t *
+barny_feed_open(barny_state_t *state, const char *name, barny_module_t *mod)
+{
+	barny_feed_t *feed;
+
+	feed = calloc(1, sizeof(*feed));
+	if (!feed)
+		return NULL;
+
+	snprintf(feed->name, sizeof(feed->name), "%s", name);
+	feed->state = state;
+	feed->mod   = mod;
+	feed_map(feed);
+	feed->retry_ms = barny_now_ms() + FEED_RETRY_MS;
+
+	if (state) {
+		feed->next   = state->feeds;
+		state->feeds = feed;
+	}
+
+	return feed;
+}
+
+void
+barny_feed_close(barny_feed_t *feed)
+{
+	barny_feed_t **link;
+
+	if (!feed)
+		return;
+
+	if (feed->state) {
+		for (link = &feed->state->feeds; *link; link = &(*link)->next) {
+			if (*link == feed) {
+				*link = feed->next;
+				break;
+			}
+		}
+	}
+
+	if (feed->rec)
+		munmap((void *)feed->rec, sizeof(*feed->rec));
+	free(feed);
+}
+
+/* The copy may race the helper's next write; the seq check afterwards is
+   what says whether it did. The helper writes once a second at most, so a
+   retry practically never happens, and when it does the writer is mid-copy
+   on another CPU or was preempted there: give it the CPU rather than spin. */
+static int
+read_record(const barny_feed_record_t *rec, char *buf, size_t size)
+{
+	uint32_t seq;
+	size_t   len;
+	int      tries;
+
+	for (tries = 0; tries < 8; tries++) {
+		if (tries > 0)
+			sched_yield();
+
+		seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+		if (seq == 0)
+			return -1;
+		if (seq & 1)
+			continue;
+
+		len = rec->len;
+		if (len > BARNY_FEED_TEXT_MAX - 1)
+			len = BARNY_FEED_TEXT_MAX - 1;
+		if (len > size - 1)
+			len = size - 1;
+		memcpy(buf, rec->text, len);
+
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&rec->seq, memory_order_relaxed) == seq) {
+			buf[len] = '\0';
+			return (int)len;
+		}
+	}
+
+	return -1;
+}
+
+static int
+read_file(const char *name, char *buf, size_t size)
+{
+	char    path[256];
+	ssize_t n;
+	int     fd;
+
+	barny_feed_file_path(path, sizeof(path), name);
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+
+	buf[n] = '\0';
+	return (int)n;
+}
+
+int
+barny_feed_read(barny_feed_t *feed, char *buf, size_t size)
+{
+	uint64_t now;
+	int      len;
+
+	if (!feed || !buf || size == 0)
+		return -1;
+
+	if (!feed->rec) {
+		now = barny_now_ms();
+		if (feed->notified || now >= feed->retry_ms) {
+			feed_map(feed);
+			feed->retry_ms = now + FEED_RETRY_MS;
+		}
+	}
+	feed->notified = false;
+
+	if (feed->rec) {
+		len = read_record(feed->rec, buf, size);
+		if (len >= 0)
+			return len;
+	}
+
+	/* no helper publishing through shm: a script writing the file, or a
+	   helper from before the feeds */
+	return read_file(feed->name, buf, size);
+}
+
+/* The helper's record is mapped and its pings can reach us: every change
+   arrives as a refresh, and nothing is left for a poll to catch. */
+bool
+barny_feed_live(const barny_feed_t *feed)
+{
+	return feed && feed->rec && feed->state && feed->state->feed_fd >= 0;
+}
+
+int
+barny_feed_listen(barny_state_t *state)
+{
+	struct sockaddr_un addr;
+	socklen_t          len;
+	int                one = 1;
+
+	state->feed_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	                        0);
+	if (state->feed_fd < 0) {
+		fprintf(stderr, "barny: feed socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* pings carry the sender's credentials; see barny_feed_dispatch */
+	setsockopt(state->feed_fd, SOL_SOCKET, SO_PASSCRED, &one, sizeof(one));
+
+	len = barny_feed_socket_addr(&addr);
+	if (bind(state->feed_fd, (struct sockaddr *)&addr, len) < 0) {
+		fprintf(stderr, "barny: feed socket @%s: %s, polling helpers\n",
+		        addr.sun_path + 1, strerror(errno));
+		close(state->feed_fd);
+		state->feed_fd = -1;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* One ping, or -1 when there are none left. The socket's name can be
+   guessed, so a ping from another user's process is read and dropped (0):
+   it would only make the bar re-read a record, but it has no business
+   waking it. */
+static ssize_t
+recv_ping(int fd, char *name, size_t size)
+{
+	union {
+		struct cmsghdr hdr;
+		char           buf[CMSG_SPACE(sizeof(struct ucred))];
+	} control;
+	struct iovec    iov = { .iov_base = name, .iov_len = size };
+	struct msghdr   msg = {
+		.msg_iov        = &iov,
+		.msg_iovlen     = 1,
+		.msg_control    = control.buf,
+		.msg_controllen = sizeof(control.buf),
+	};
+	struct cmsghdr *cmsg;
+	struct ucred    cred;
+	ssize_t         n;
+
+	n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+	if (n < 0)
+		return -1;
+
+	for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET
+		    && cmsg->cmsg_type == SCM_CREDENTIALS) {
+			memcpy(&cred, CMSG_DATA(cmsg), sizeof(cred));
+			return cred.uid == getuid() ? n : 0;
+		}
+	}
+
+	return 0;
+}
+
+void
+barny_feed_dispatch(barny_state_t *state)
+{
+	barny_module_t *mods[BARNY_MAX_MODULES];
+	char            name[BARNY_FEED_NAME_MAX];
+	barny_feed_t   *feed;
+	ssize_t         n;
+	int             count = 0;
+	int             i;
+
+	while ((n = recv_ping(state->feed_fd, name, sizeof(name) - 1)) >= 0) {
+		if (n == 0)
+			continue;
+		name[n] = '\0';
+		for (feed = state->feeds; feed; feed = feed->next) {
+			if (strcmp(feed->name, name) == 0)
+				feed->notified = true;
+		}
+	}
+
+	/* a burst of pings (every crypto pair ticking at once) is one update
+	   per module */
+	for (feed = state->feeds; feed; feed = feed->next) {
+		if (!feed->notified || !feed->mod || !feed->mod->update)
+			continue;
+		for (i = 0; i < count; i++) {
+			if (mods[i] == feed->mod)
+				break;
+		}
+		if (i == count && count < BARNY_MAX_MODULES)
+			mods[count++] = feed->mod;
+	}
+
+	for (i = 0; i < count; i++)
+		barny_module_refresh(state, mods[i]);
+}
+
+void
+barny_feed_cleanup(barny_state_t *state)
+{
+	if (state->feed_fd >= 0) {
+		close(state->feed_fd);
+		state->feed_fd = -1;
+	}
+}
@@ -0,0 +1,111 @@
+#define _DEFAULT_SOURCE
+#include "helper_config.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helper_util.h"
+
+#define CONFIG_PATH "/etc/barny/barny.conf"
+
+/* drops a trailing " # comment" outside quotes, then the quotes */
+static char *
+unquote(char *value)
+{
+	size_t len;
+	bool   in_quotes = false;
+	char  *p;
+	char  *end;
+
+	for (p = value; *p; p++) {
+		if (*p == '"') {
+			in_quotes = !in_quotes;
+		} else if (*p == '#' && !in_quotes && p > value
+		           && isspace((unsigned char)*(p - 1))) {
+			end = p - 1;
+			while (end > value && isspace((unsigned char)*end))
+				end--;
+			end[1] = '\0';
+			break;
+		}
+	}
+
+	len = strlen(value);
+	if (len >= 2 && value[0] == '"' && value[len - 1] == '"') {
+		value[len - 1] = '\0';
+		value++;
+	}
+
+	return value;
+}
+
+static int
+non_negative(const char *value)
+{
+	int n = atoi(value);
+
+	return n < 0 ? 0 : n;
+}
+
+static void
+load_file(helper_config_t *config, const char *path)
+{
+	FILE *f;
+	char  line[1024];
+	char *trimmed;
+	char *eq;
+	char *key;
+	char *value;
+
+	f = fopen(path, "r");
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		trimmed = helper_trim(line);
+
+		if (*trimmed == '#' || *trimmed == '\0')
+			continue;
+
+		eq = strchr(trimmed, '=');
+		if (!eq)
+			continue;
+
+		*eq   = '\0';
+		key   = helper_trim(trimmed);
+		value = unquote(helper_trim(eq + 1));
+
+		if (strcmp(key, "sysinfo_p_cores") == 0)
+			config->sysinfo_p_cores = non_negative(value);
+		else if (strcmp(key, "sysinfo_e_cores") == 0)
+			config->sysinfo_e_cores = non_negative(value);
+		else if (strcmp(key, "crypto_pairs") == 0)
+			snprintf(config->crypto_pairs, sizeof(config->crypto_pairs),
+			         "%s", value);
+		else if (strcmp(key, "helper_feed_files") == 0)
+			config->feed_files = strcmp(value, "true") == 0
+			                     || strcmp(value, "1") == 0;
+	}
+
+	fclose(f);
+}
+
+void
+helper_config_load(helper_config_t *config)
+{
+	char        user_path[512];
+	const char *home;
+
+	memset(config, 0, sizeof(*config));
+	load_file(config, CONFIG_PATH);
+
+	home = getenv("HOME");
+	if (home) {
+		snprintf(user_path, sizeof(user_path),
+		         "%s/.config/barny/barny.conf", home);
+		load_file(config, user_path);
+	}
+}
@@ -0,0 +1,18 @@
+#ifndef BARNY_HELPER_CONFIG_H
+#define BARNY_HELPER_CONFIG_H
+
+#include <stdbool.h>
+
+/* The few barny.conf keys the helpers care about, read once per process
+   with the same layering as the bar: /etc first, the user file on top. */
+typedef struct {
+	int  sysinfo_p_cores;
+	int  sysinfo_e_cores;
+	char crypto_pairs[512]; /* comma-separated markets, "" when unset */
+	bool feed_files;        /* also write the plain data files */
+} helper_config_t;
+
+void
+helper_config_load(helper_config_t *config);
+
+#endif
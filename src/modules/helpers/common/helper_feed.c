@@ -0,0 +1,190 @@
+#define _DEFAULT_SOURCE
+#include "helper_feed.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "barny_feed.h"
+
+struct helper_feed {
+	char                 name[BARNY_FEED_NAME_MAX];
+	barny_feed_record_t *rec;
+	int                  sock;
+	char                 last[BARNY_FEED_TEXT_MAX];
+	bool                 have_last;
+};
+
+static bool write_files;
+
+void
+helper_feed_set_files(bool on)
+{
+	write_files = on;
+}
+
+static barny_feed_record_t *
+map_record(const char *name)
+{
+	char                 shm_name[BARNY_FEED_NAME_MAX + 32];
+	barny_feed_record_t *rec;
+	struct stat          st;
+	int                  fd;
+
+	barny_feed_shm_name(shm_name, sizeof(shm_name), name);
+	fd = shm_open(shm_name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (fd < 0) {
+		fprintf(stderr, "shm_open %s: %s\n", shm_name, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "fstat %s: %s\n", shm_name, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	/* the name is predictable; whoever created it first owns it, and a
+	   record another user can write is one they can feed the bar from */
+	if (st.st_uid != geteuid()) {
+		fprintf(stderr, "%s belongs to uid %u, not using it\n", shm_name,
+		        (unsigned)st.st_uid);
+		close(fd);
+		return NULL;
+	}
+
+	if (((size_t)st.st_size < sizeof(*rec)
+	        && ftruncate(fd, (off_t)sizeof(*rec)) < 0)) {
+		fprintf(stderr, "sizing %s: %s\n", shm_name, strerror(errno));
+		close(fd);
+		return NULL;
+	}
+
+	rec = mmap(NULL, sizeof(*rec), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+	           0);
+	close(fd);
+	if (rec == MAP_FAILED)
+		return NULL;
+
+	/* a fresh object, or one left by an incompatible build: start over.
+	   A restarted helper keeps the record and its seq. */
+	if (rec->magic != BARNY_FEED_MAGIC || rec->version != BARNY_FEED_VERSION) {
+		memset(rec, 0, sizeof(*rec));
+		rec->version = BARNY_FEED_VERSION;
+		atomic_thread_fence(memory_order_release);
+		rec->magic = BARNY_FEED_MAGIC;
+	}
+
+	return rec;
+}
+
+helper_feed_t *
+helper_feed_open(const char *name)
+{
+	helper_feed_t *feed;
+
+	feed = calloc(1, sizeof(*feed));
+	if (!feed)
+		return NULL;
+
+	snprintf(feed->name, sizeof(feed->name), "%s", name);
+	feed->rec  = map_record(feed->name);
+	feed->sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	                    0);
+
+	return feed;
+}
+
+void
+helper_feed_close(helper_feed_t *feed)
+{
+	if (!feed)
+		return;
+
+	if (feed->rec)
+		munmap(feed->rec, sizeof(*feed->rec));
+	if (feed->sock >= 0)
+		close(feed->sock);
+	free(feed);
+}
+
+static void
+write_file(const char *name, const char *text)
+{
+	char  path[256];
+	char  tmp_path[264];
+	FILE *f;
+
+	barny_feed_file_path(path, sizeof(path), name);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+	f = fopen(tmp_path, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to open output file\n");
+		return;
+	}
+	fputs(text, f);
+	fclose(f);
+
+	if (rename(tmp_path, path) != 0)
+		fprintf(stderr, "Failed to rename output file\n");
+}
+
+static void
+write_record(barny_feed_record_t *rec, const char *text, size_t len)
+{
+	uint32_t seq = atomic_load_explicit(&rec->seq, memory_order_relaxed);
+
+	atomic_store_explicit(&rec->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	memcpy(rec->text, text, len);
+	rec->text[len] = '\0';
+	rec->len       = (uint32_t)len;
+
+	atomic_store_explicit(&rec->seq, seq + 2, memory_order_release);
+}
+
+bool
+helper_feed_publish(helper_feed_t *feed, const char *text)
+{
+	struct sockaddr_un addr;
+	socklen_t          addr_len;
+	size_t             len;
+
+	if (!feed || !text)
+		return false;
+
+	len = strlen(text);
+	if (len >= BARNY_FEED_TEXT_MAX)
+		len = BARNY_FEED_TEXT_MAX - 1;
+
+	if (feed->have_last && strncmp(feed->last, text, len) == 0
+	    && feed->last[len] == '\0')
+		return false;
+
+	memcpy(feed->last, text, len);
+	feed->last[len] = '\0';
+	feed->have_last = true;
+
+	if (feed->rec)
+		write_record(feed->rec, feed->last, len);
+	if (write_files || !feed->rec)
+		write_file(feed->name, feed->last);
+
+	/* nobody listening (bar not running) is fine: it reads the record
+	   when it starts */
+	if (feed->sock >= 0) {
+		addr_len = barny_feed_socket_addr(&addr);
+		sendto(feed->sock, feed->name, strlen(feed->name), MSG_DONTWAIT,
+		       (struct sockaddr *)&addr, addr_len);
+	}
+
+	return true;
+}
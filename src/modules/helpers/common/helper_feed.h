@@ -0,0 +1,29 @@
+#ifndef BARNY_HELPER_FEED_H
+#define BARNY_HELPER_FEED_H
+
+#include <stdbool.h>
+
+typedef struct helper_feed helper_feed_t;
+
+/* Whether publishes also rewrite the plain data file. Off by default: the
+   shm record is what the bar reads, the files are only for scripts. A feed
+   without a record (no /dev/shm, or one taken by another user) writes the
+   file regardless. */
+void
+helper_feed_set_files(bool on);
+
+/* Opens (creating if needed) the shm record for name. Without shm the feed
+   still works, file-only. NULL only when out of memory. */
+helper_feed_t *
+helper_feed_open(const char *name);
+
+void
+helper_feed_close(helper_feed_t *feed);
+
+/* Publishes text to the record (and the plain file, see above), then
+   pings the bar -- but only when text differs from the last publish.
+   Returns true if it did. */
+bool
+helper_feed_publish(helper_feed_t *feed, const char *text);
+
+#endif
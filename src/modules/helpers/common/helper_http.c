@@ -0,0 +1,290 @@
+#define _DEFAULT_SOURCE
+#include "helper_http.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+typedef struct http_request http_request_t;
+
+struct http_request {
+	CURL              *easy;
+	helper_fetch_cb_t  fetch_cb;
+	helper_attach_cb_t attach_cb;
+	void              *data;
+	char              *body;
+	size_t             size;
+	http_request_t    *next;
+};
+
+struct helper_http {
+	helper_loop_t  *loop;
+	CURLM          *multi;
+	int             timer;
+	http_request_t *requests;
+};
+
+static void
+process_done(helper_http_t *http)
+{
+	CURLMsg        *msg;
+	http_request_t *req;
+	CURL           *easy;
+	CURLcode        result;
+	int             left;
+
+	while ((msg = curl_multi_info_read(http->multi, &left))) {
+		if (msg->msg != CURLMSG_DONE)
+			continue;
+
+		easy   = msg->easy_handle;
+		result = msg->data.result;
+		req    = NULL;
+		curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&req);
+		if (!req)
+			continue;
+
+		if (req->attach_cb) {
+			req->attach_cb(easy, result, req->data);
+			continue;
+		}
+
+		if (result != CURLE_OK)
+			fprintf(stderr, "curl failed: %s\n",
+			        curl_easy_strerror(result));
+		req->fetch_cb(result != CURLE_OK ? NULL
+		              : req->body        ? req->body
+		                                 : "",
+		              req->data);
+		helper_http_detach(http, easy);
+		curl_easy_cleanup(easy);
+	}
+}
+
+static void
+on_socket(int fd, uint32_t events, void *data)
+{
+	helper_http_t *http  = data;
+	int            flags = 0;
+	int            running;
+
+	if (events & EPOLLIN)
+		flags |= CURL_CSELECT_IN;
+	if (events & EPOLLOUT)
+		flags |= CURL_CSELECT_OUT;
+	if (events & (EPOLLERR | EPOLLHUP))
+		flags |= CURL_CSELECT_ERR;
+
+	curl_multi_socket_action(http->multi, fd, flags, &running);
+	process_done(http);
+}
+
+static void
+on_timeout(void *data)
+{
+	helper_http_t *http = data;
+	int            running;
+
+	curl_multi_socket_action(http->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+	process_done(http);
+}
+
+static int
+socket_cb(CURL *easy, curl_socket_t s, int what, void *userp, void *socketp)
+{
+	helper_http_t *http   = userp;
+	uint32_t       events = 0;
+
+	(void)easy;
+	(void)socketp;
+
+	if (what == CURL_POLL_REMOVE) {
+		helper_loop_unwatch(http->loop, s);
+		return 0;
+	}
+
+	if (what & CURL_POLL_IN)
+		events |= EPOLLIN;
+	if (what & CURL_POLL_OUT)
+		events |= EPOLLOUT;
+
+	return helper_loop_watch(http->loop, s, events, on_socket, http) < 0
+	               ? -1
+	               : 0;
+}
+
+static int
+timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+	helper_http_t *http = userp;
+
+	(void)multi;
+
+	if (timeout_ms < 0)
+		helper_loop_cancel(http->loop, http->timer);
+	else
+		helper_loop_after(http->loop, http->timer, timeout_ms);
+
+	return 0;
+}
+
+static size_t
+write_cb(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	size_t          realsize = size * nmemb;
+	http_request_t *req      = userdata;
+	char           *new_body;
+
+	new_body = realloc(req->body, req->size + realsize + 1);
+	if (!new_body)
+		return 0;
+
+	req->body = new_body;
+	memcpy(req->body + req->size, ptr, realsize);
+	req->size            += realsize;
+	req->body[req->size]  = '\0';
+	return realsize;
+}
+
+helper_http_t *
+helper_http_create(helper_loop_t *loop)
+{
+	helper_http_t *http;
+
+	http = calloc(1, sizeof(*http));
+	if (!http)
+		return NULL;
+
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	http->loop  = loop;
+	http->multi = curl_multi_init();
+	http->timer = helper_loop_timer(loop, on_timeout, http);
+	if (!http->multi || http->timer < 0) {
+		helper_http_destroy(http);
+		return NULL;
+	}
+
+	curl_multi_setopt(http->multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+	curl_multi_setopt(http->multi, CURLMOPT_SOCKETDATA, http);
+	curl_multi_setopt(http->multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+	curl_multi_setopt(http->multi, CURLMOPT_TIMERDATA, http);
+
+	return http;
+}
+
+void
+helper_http_destroy(helper_http_t *http)
+{
+	http_request_t *req;
+	CURL           *easy;
+	bool            ours;
+
+	if (!http)
+		return;
+
+	/* attached handles are their owners' to clean up; fetches are ours */
+	while ((req = http->requests)) {
+		easy = req->easy;
+		ours = req->fetch_cb != NULL;
+		helper_http_detach(http, easy);
+		if (ours)
+			curl_easy_cleanup(easy);
+	}
+
+	if (http->multi)
+		curl_multi_cleanup(http->multi);
+	helper_loop_cancel(http->loop, http->timer);
+	curl_global_cleanup();
+	free(http);
+}
+
+static bool
+add_request(helper_http_t *http, CURL *easy, http_request_t *req)
+{
+	req->easy = easy;
+	curl_easy_setopt(easy, CURLOPT_PRIVATE, req);
+
+	if (curl_multi_add_handle(http->multi, easy) != CURLM_OK) {
+		free(req);
+		return false;
+	}
+
+	req->next      = http->requests;
+	http->requests = req;
+	return true;
+}
+
+bool
+helper_http_fetch(helper_http_t *http, const char *url, long timeout_seconds,
+                  helper_fetch_cb_t cb, void *data)
+{
+	http_request_t *req;
+	CURL           *easy;
+
+	if (!http || !url)
+		return false;
+
+	req  = calloc(1, sizeof(*req));
+	easy = curl_easy_init();
+	if (!req || !easy) {
+		free(req);
+		if (easy)
+			curl_easy_cleanup(easy);
+		return false;
+	}
+
+	req->fetch_cb = cb;
+	req->data     = data;
+
+	curl_easy_setopt(easy, CURLOPT_URL, url);
+	curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_cb);
+	curl_easy_setopt(easy, CURLOPT_WRITEDATA, req);
+	if (timeout_seconds > 0)
+		curl_easy_setopt(easy, CURLOPT_TIMEOUT, timeout_seconds);
+
+	if (!add_request(http, easy, req)) {
+		curl_easy_cleanup(easy);
+		return false;
+	}
+
+	return true;
+}
+
+bool
+helper_http_attach(helper_http_t *http, CURL *easy, helper_attach_cb_t cb,
+                   void *data)
+{
+	http_request_t *req;
+
+	if (!http || !easy)
+		return false;
+
+	req = calloc(1, sizeof(*req));
+	if (!req)
+		return false;
+
+	req->attach_cb = cb;
+	req->data      = data;
+
+	return add_request(http, easy, req);
+}
+
+void
+helper_http_detach(helper_http_t *http, CURL *easy)
+{
+	http_request_t **link;
+	http_request_t  *req;
+
+	for (link = &http->requests; *link; link = &(*link)->next) {
+		if ((*link)->easy == easy) {
+			req   = *link;
+			*link = req->next;
+			curl_multi_remove_handle(http->multi, easy);
+			free(req->body);
+			free(req);
+			return;
+		}
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef BARNY_HELPER_HTTP_H
+#define BARNY_HELPER_HTTP_H
+
+#include <stdbool.h>
+#include <curl/curl.h>
+
+#include "helper_loop.h"
+
+/* A curl multi handle driven by a helper loop: its sockets and its timeout
+   are ordinary watches and a timer there, so transfers never block the
+   other sources. One per process. */
+typedef struct helper_http helper_http_t;
+
+/* body is NULL when the transfer failed, and only valid for the call */
+typedef void (*helper_fetch_cb_t)(const char *body, void *data);
+
+/* for transfers the caller set up itself; the handle stays the caller's */
+typedef void (*helper_attach_cb_t)(CURL *easy, CURLcode result, void *data);
+
+helper_http_t *
+helper_http_create(helper_loop_t *loop);
+
+void
+helper_http_destroy(helper_http_t *http);
+
+bool
+helper_http_fetch(helper_http_t *http, const char *url, long timeout_seconds,
+                  helper_fetch_cb_t cb, void *data);
+
+/* Runs easy on the multi handle and calls cb once it is done. A
+   CONNECT_ONLY handle stays attached after that so the connection lives on;
+   helper_http_detach it before cleaning it up. */
+bool
+helper_http_attach(helper_http_t *http, CURL *easy, helper_attach_cb_t cb,
+                   void *data);
+
+void
+helper_http_detach(helper_http_t *http, CURL *easy);
+
+#endif
@@ -0,0 +1,359 @@
+#define _GNU_SOURCE
+#include "helper_loop.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HELPER_MAX_TIMERS  16
+#define HELPER_MAX_WATCHES 32
+#define HELPER_MAX_EVENTS  16
+#define WAKEUP_REPORT_MS   60000
+
+typedef struct {
+	int            fd;
+	helper_io_cb_t cb;
+	void          *data;
+} helper_watch_t;
+
+typedef struct {
+	bool              used;
+	bool              armed;
+	uint64_t          due_ms;
+	int               interval_ms;
+	helper_timer_cb_t cb;
+	void             *data;
+} helper_timer_t;
+
+struct helper_loop {
+	int            epoll_fd;
+	int            timer_fd;
+	int            signal_fd;
+	bool           quit;
+	bool           debug;
+
+	helper_timer_t timers[HELPER_MAX_TIMERS];
+	helper_watch_t watches[HELPER_MAX_WATCHES];
+
+	uint64_t       wakeups;
+	uint64_t       report_ms;
+};
+
+static uint64_t
+mono_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+/* the timerfd always holds the soonest deadline, or nothing */
+static void
+loop_rearm(helper_loop_t *loop)
+{
+	struct itimerspec its;
+	uint64_t          due = 0;
+	int               i;
+
+	for (i = 0; i < HELPER_MAX_TIMERS; i++) {
+		if (loop->timers[i].armed
+		    && (due == 0 || loop->timers[i].due_ms < due))
+			due = loop->timers[i].due_ms;
+	}
+
+	memset(&its, 0, sizeof(its));
+	if (due) {
+		its.it_value.tv_sec  = (time_t)(due / 1000);
+		its.it_value.tv_nsec = (long)(due % 1000) * 1000000;
+	}
+
+	if (timerfd_settime(loop->timer_fd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+		fprintf(stderr, "timerfd_settime: %s\n", strerror(errno));
+}
+
+static void
+on_timerfd(int fd, uint32_t events, void *data)
+{
+	helper_loop_t  *loop = data;
+	helper_timer_t *t;
+	uint64_t        expirations;
+	uint64_t        now;
+	int             i;
+
+	(void)events;
+	if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		return;
+
+	now = mono_ms();
+	for (i = 0; i < HELPER_MAX_TIMERS; i++) {
+		t = &loop->timers[i];
+		if (!t->armed || t->due_ms > now)
+			continue;
+
+		/* reschedule first: the callback may re-arm or cancel */
+		if (t->interval_ms > 0)
+			t->due_ms = (now / (uint64_t)t->interval_ms + 1)
+			            * (uint64_t)t->interval_ms;
+		else
+			t->armed = false;
+		t->cb(t->data);
+	}
+
+	loop_rearm(loop);
+}
+
+static void
+on_signalfd(int fd, uint32_t events, void *data)
+{
+	struct signalfd_siginfo si;
+	helper_loop_t          *loop = data;
+
+	(void)events;
+	if (read(fd, &si, sizeof(si)) == (ssize_t)sizeof(si))
+		loop->quit = true;
+}
+
+helper_loop_t *
+helper_loop_create(void)
+{
+	helper_loop_t *loop;
+	sigset_t       mask;
+	const char    *debug;
+	int            i;
+
+	loop = calloc(1, sizeof(*loop));
+	if (!loop)
+		return NULL;
+
+	for (i = 0; i < HELPER_MAX_WATCHES; i++)
+		loop->watches[i].fd = -1;
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+
+	loop->epoll_fd  = epoll_create1(EPOLL_CLOEXEC);
+	loop->timer_fd  = timerfd_create(CLOCK_MONOTONIC,
+	                                 TFD_CLOEXEC | TFD_NONBLOCK);
+	loop->signal_fd = signalfd(-1, &mask, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->signal_fd < 0
+	    || helper_loop_watch(loop, loop->timer_fd, EPOLLIN, on_timerfd, loop)
+	               < 0
+	    || helper_loop_watch(loop, loop->signal_fd, EPOLLIN, on_signalfd,
+	                         loop)
+	               < 0) {
+		fprintf(stderr, "Failed to set up event loop: %s\n",
+		        strerror(errno));
+		helper_loop_destroy(loop);
+		return NULL;
+	}
+
+	debug       = getenv("BARNY_DEBUG");
+	loop->debug = debug && *debug && strcmp(debug, "0") != 0;
+
+	return loop;
+}
+
+void
+helper_loop_destroy(helper_loop_t *loop)
+{
+	if (!loop)
+		return;
+
+	if (loop->signal_fd >= 0)
+		close(loop->signal_fd);
+	if (loop->timer_fd >= 0)
+		close(loop->timer_fd);
+	if (loop->epoll_fd >= 0)
+		close(loop->epoll_fd);
+	free(loop);
+}
+
+int
+helper_loop_timer(helper_loop_t *loop, helper_timer_cb_t cb, void *data)
+{
+	int i;
+
+	for (i = 0; i < HELPER_MAX_TIMERS; i++) {
+		if (!loop->timers[i].used) {
+			loop->timers[i] = (helper_timer_t){
+				.used = true,
+				.cb   = cb,
+				.data = data,
+			};
+			return i;
+		}
+	}
+
+	fprintf(stderr, "Out of timers\n");
+	return -1;
+}
+
+void
+helper_loop_every(helper_loop_t *loop, int timer, int interval_ms)
+{
+	helper_timer_t *t;
+
+	if (timer < 0 || interval_ms <= 0)
+		return;
+
+	t              = &loop->timers[timer];
+	t->interval_ms = interval_ms;
+	t->due_ms      = (mono_ms() / (uint64_t)interval_ms + 1)
+	                 * (uint64_t)interval_ms;
+	t->armed       = true;
+	loop_rearm(loop);
+}
+
+void
+helper_loop_after(helper_loop_t *loop, int timer, long delay_ms)
+{
+	helper_timer_t *t;
+
+	if (timer < 0)
+		return;
+
+	t              = &loop->timers[timer];
+	t->interval_ms = 0;
+	t->due_ms      = mono_ms() + (uint64_t)(delay_ms > 0 ? delay_ms : 0);
+	t->armed       = true;
+	loop_rearm(loop);
+}
+
+void
+helper_loop_cancel(helper_loop_t *loop, int timer)
+{
+	if (timer < 0 || !loop->timers[timer].armed)
+		return;
+
+	loop->timers[timer].armed = false;
+	loop_rearm(loop);
+}
+
+int
+helper_loop_watch(helper_loop_t *loop, int fd, uint32_t events,
+                  helper_io_cb_t cb, void *data)
+{
+	struct epoll_event ev;
+	helper_watch_t    *w         = NULL;
+	helper_watch_t    *free_slot = NULL;
+	int                i;
+
+	for (i = 0; i < HELPER_MAX_WATCHES; i++) {
+		if (loop->watches[i].fd == fd) {
+			w = &loop->watches[i];
+			break;
+		}
+		if (!free_slot && loop->watches[i].fd < 0)
+			free_slot = &loop->watches[i];
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+
+	if (w) {
+		/* curl re-watches its sockets to change direction; anyone else
+		   landing on a watched fd would silently steal its events */
+		if (w->cb != cb || w->data != data) {
+			fprintf(stderr, "fd %d is already watched\n", fd);
+			return -EEXIST;
+		}
+		ev.data.ptr = w;
+		return epoll_ctl(loop->epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+	}
+
+	if (!free_slot) {
+		fprintf(stderr, "Out of fd watches\n");
+		return -1;
+	}
+
+	ev.data.ptr = free_slot;
+	if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		return -1;
+
+	free_slot->fd   = fd;
+	free_slot->cb   = cb;
+	free_slot->data = data;
+
+	return 0;
+}
+
+void
+helper_loop_unwatch(helper_loop_t *loop, int fd)
+{
+	int i;
+
+	for (i = 0; i < HELPER_MAX_WATCHES; i++) {
+		if (loop->watches[i].fd == fd) {
+			/* the fd may already be closed, which removed it */
+			epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+			loop->watches[i].fd = -1;
+			loop->watches[i].cb = NULL;
+			return;
+		}
+	}
+}
+
+static void
+report_wakeups(helper_loop_t *loop)
+{
+	uint64_t now = mono_ms();
+
+	if (loop->report_ms == 0) {
+		loop->report_ms = now;
+		loop->wakeups   = 0;
+		return;
+	}
+	if (now - loop->report_ms < WAKEUP_REPORT_MS)
+		return;
+
+	fprintf(stderr, "%.1f wakeups/min\n",
+	        (double)loop->wakeups * 60000.0 / (double)(now - loop->report_ms));
+	loop->report_ms = now;
+	loop->wakeups   = 0;
+}
+
+void
+helper_loop_run(helper_loop_t *loop)
+{
+	struct epoll_event events[HELPER_MAX_EVENTS];
+	helper_watch_t    *w;
+	int                n;
+	int                i;
+
+	while (!loop->quit) {
+		n = epoll_wait(loop->epoll_fd, events, HELPER_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "epoll_wait: %s\n", strerror(errno));
+			break;
+		}
+
+		loop->wakeups++;
+		for (i = 0; i < n; i++) {
+			w = events[i].data.ptr;
+			if (w->cb)
+				w->cb(w->fd, events[i].events, w->data);
+		}
+
+		if (loop->debug)
+			report_wakeups(loop);
+	}
+}
+
+void
+helper_loop_quit(helper_loop_t *loop)
+{
+	loop->quit = true;
+}
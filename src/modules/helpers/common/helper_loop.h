@@ -0,0 +1,53 @@
+#ifndef BARNY_HELPER_LOOP_H
+#define BARNY_HELPER_LOOP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* One epoll loop with one timerfd behind every timer, shared by whatever
+   sources run in the process: a single helper binary runs one, barny-helperd
+   runs them all. SIGINT/SIGTERM end the loop through a signalfd. */
+typedef struct helper_loop helper_loop_t;
+
+typedef void (*helper_timer_cb_t)(void *data);
+typedef void (*helper_io_cb_t)(int fd, uint32_t events, void *data);
+
+helper_loop_t *
+helper_loop_create(void);
+
+void
+helper_loop_destroy(helper_loop_t *loop);
+
+/* Returns a disarmed timer id, or -1 when the table is full. */
+int
+helper_loop_timer(helper_loop_t *loop, helper_timer_cb_t cb, void *data);
+
+/* Fires on every multiple of interval_ms of the monotonic clock, so timers
+   with the same (or dividing) intervals share a wakeup. */
+void
+helper_loop_every(helper_loop_t *loop, int timer, int interval_ms);
+
+/* One-shot, delay_ms from now; re-arming replaces the previous deadline. */
+void
+helper_loop_after(helper_loop_t *loop, int timer, long delay_ms);
+
+void
+helper_loop_cancel(helper_loop_t *loop, int timer);
+
+/* Watching an fd again with the same callback and data updates its events;
+   an fd already watched by another callback is refused with -EEXIST. */
+int
+helper_loop_watch(helper_loop_t *loop, int fd, uint32_t events,
+                  helper_io_cb_t cb, void *data);
+
+void
+helper_loop_unwatch(helper_loop_t *loop, int fd);
+
+/* Runs until a termination signal or helper_loop_quit. */
+void
+helper_loop_run(helper_loop_t *loop);
+
+void
+helper_loop_quit(helper_loop_t *loop);
+
+#endif
@@ -0,0 +1,43 @@
+#include "helper_source.h"
+
+#include <stdio.h>
+
+#include "helper_feed.h"
+
+#define HELPER_MAX_SOURCES 8
+
+int
+helper_run(const helper_env_t *env, const helper_source_t *const *sources,
+           int count)
+{
+	bool started[HELPER_MAX_SOURCES];
+	int  running = 0;
+	int  i;
+
+	if (count > HELPER_MAX_SOURCES)
+		count = HELPER_MAX_SOURCES;
+
+	helper_feed_set_files(env->config && env->config->feed_files);
+
+	for (i = 0; i < count; i++) {
+		started[i] = sources[i]->start(env) == 0;
+		if (started[i])
+			running++;
+		else
+			fprintf(stderr, "%s: not available, skipped\n",
+			        sources[i]->name);
+	}
+
+	if (running == 0)
+		return 1;
+
+	helper_loop_run(env->loop);
+
+	for (i = count - 1; i >= 0; i--) {
+		if (started[i])
+			sources[i]->stop();
+	}
+
+	fprintf(stderr, "Shutdown complete\n");
+	return 0;
+}
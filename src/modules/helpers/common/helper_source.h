@@ -0,0 +1,37 @@
+#ifndef BARNY_HELPER_SOURCE_H
+#define BARNY_HELPER_SOURCE_H
+
+#include "helper_config.h"
+#include "helper_loop.h"
+
+typedef struct helper_http helper_http_t;
+
+typedef struct {
+	helper_loop_t         *loop;
+	helper_http_t         *http; /* NULL in the sysfs-only binaries */
+	const helper_config_t *config;
+} helper_env_t;
+
+/* One data provider. start() sets up its timers and watches on env->loop
+   and returns < 0 when there is nothing to provide on this machine (no
+   RAPL, no API key); stop() releases what start() took. Sources keep their
+   state in file statics: there is only ever one of each per process. */
+typedef struct {
+	const char *name;
+	int (*start)(const helper_env_t *env);
+	void (*stop)(void);
+} helper_source_t;
+
+extern const helper_source_t cpu_freq_source;
+extern const helper_source_t cpu_power_source;
+extern const helper_source_t crypto_prices_source;
+extern const helper_source_t weather_source;
+
+/* Starts the sources, runs the loop until SIGINT/SIGTERM and stops them
+   again. Sources that fail to start are skipped; returns 1 if none
+   started, so a single-source binary still exits for its supervisor. */
+int
+helper_run(const helper_env_t *env, const helper_source_t *const *sources,
+           int count);
+
+#endif
@@ -6,8 +6,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <curl/curl.h>
-
 char *
 helper_trim(char *s)
 {
@@ -106,80 +104,3 @@ helper_parse_csv(const char *input, size_t *out_count)
 		*out_count = count;
 	return result;
 }
-
-struct helper_response_buf {
-	char  *data;
-	size_t size;
-};
-
-static size_t
-helper_write_callback(char *ptr, size_t size, size_t nmemb, void *userdata)
-{
-	size_t                      realsize = size * nmemb;
-	struct helper_response_buf *buf      = userdata;
-	char                       *new_data;
-
-	new_data = realloc(buf->data, buf->size + realsize + 1);
-	if (!new_data)
-		return 0;
-
-	buf->data = new_data;
-	memcpy(buf->data + buf->size, ptr, realsize);
-	buf->size            += realsize;
-	buf->data[buf->size]  = '\0';
-	return realsize;
-}
-
-char *
-helper_http_fetch(const char *url, long timeout_seconds)
-{
-	CURL                      *curl;
-	struct helper_response_buf buf;
-	CURLcode                   res;
-
-	if (!url)
-		return NULL;
-
-	curl = curl_easy_init();
-	if (!curl)
-		return NULL;
-
-	buf.data = NULL;
-	buf.size = 0;
-
-	curl_easy_setopt(curl, CURLOPT_URL, url);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, helper_write_callback);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buf);
-	if (timeout_seconds > 0)
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout_seconds);
-
-	res = curl_easy_perform(curl);
-	curl_easy_cleanup(curl);
-
-	if (res != CURLE_OK) {
-		fprintf(stderr, "curl failed: %s\n", curl_easy_strerror(res));
-		free(buf.data);
-		return NULL;
-	}
-
-	if (!buf.data) {
-		buf.data = calloc(1, 1);
-	}
-
-	return buf.data;
-}
-
-cJSON *
-helper_fetch_json(const char *url, long timeout_seconds)
-{
-	char  *body;
-	cJSON *json;
-
-	body = helper_http_fetch(url, timeout_seconds);
-	if (!body)
-		return NULL;
-
-	json = cJSON_Parse(body);
-	free(body);
-	return json;
-}
@@ -0,0 +1,544 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#ifdef CPU_FREQ_IO_URING
+#include <liburing.h>
+#endif
+
+#include "cpu_freq.h"
+#include "helper_feed.h"
+#include "helper_source.h"
+
+#define UPDATE_INTERVAL_MS 2000
+#define FEED_NAME          "cpu_freq"
+#define MAX_CPUS           256
+
+struct cpu_info {
+	int id;
+	int is_p_core;
+	int fd;
+};
+
+static struct cpu_info cpus[MAX_CPUS];
+static int             cpu_count    = 0;
+static int             p_core_count = 0;
+static int             e_core_count = 0;
+
+static helper_feed_t  *feed;
+
+/* Every scaling_cur_freq stays open from detection on and is re-read at
+   offset 0 each tick: one pread per CPU instead of open, fstat, read and
+   close behind a FILE*. With io_uring built in, the whole tick is one
+   submission. */
+static char            read_buf[32];
+
+#ifdef CPU_FREQ_IO_URING
+static struct io_uring ring;
+static bool            ring_ready;
+static bool            ring_fixed;
+static char            ring_bufs[MAX_CPUS][32];
+#endif
+
+/* a sysfs integer: digits, then a newline */
+static int
+parse_int(const char *buf, ssize_t len, int *out)
+{
+	ssize_t i;
+	int     val = 0;
+
+	if (len <= 0 || buf[0] < '0' || buf[0] > '9')
+		return -1;
+
+	for (i = 0; i < len && buf[i] >= '0' && buf[i] <= '9'; i++)
+		val = val * 10 + (buf[i] - '0');
+
+	*out = val;
+	return 0;
+}
+
+static int
+read_int_fd(int fd, int *out)
+{
+	ssize_t n;
+
+	n = pread(fd, read_buf, sizeof(read_buf), 0);
+	return parse_int(read_buf, n, out);
+}
+
+static int
+read_int_file(const char *path, int *out)
+{
+	int fd;
+	int rc;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	rc = read_int_fd(fd, out);
+	close(fd);
+
+	return rc;
+}
+
+static int
+open_cur_freq(int cpu_id)
+{
+	char path[256];
+
+	snprintf(path, sizeof(path),
+	         "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq", cpu_id);
+
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void
+detect_cpus(const helper_config_t *config)
+{
+	DIR           *dir;
+	int            max_freqs[MAX_CPUS];
+	int            cpu_ids[MAX_CPUS];
+	int            highest_freq;
+	struct dirent *entry;
+	int            cpu_id;
+	char           path[256];
+	int            max_freq;
+	int            i;
+	int            j;
+	int            tmp_id;
+	int            tmp_freq;
+	int            configured_p;
+	int            configured_e;
+	int            lowest_freq;
+	int            gap;
+	int            threshold;
+
+	dir = opendir("/sys/devices/system/cpu");
+	if (!dir)
+		return;
+
+	highest_freq = 0;
+
+	while ((entry = readdir(dir)) != NULL && cpu_count < MAX_CPUS) {
+		if (strncmp(entry->d_name, "cpu", 3) != 0)
+			continue;
+		if (!isdigit(entry->d_name[3]))
+			continue;
+
+		cpu_id = atoi(entry->d_name + 3);
+
+		snprintf(path, sizeof(path),
+		         "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+		         cpu_id);
+
+		if (access(path, R_OK) != 0)
+			continue;
+
+		snprintf(path, sizeof(path),
+		         "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
+		         cpu_id);
+		max_freq = -1;
+		if (read_int_file(path, &max_freq) != 0)
+			max_freq = -1;
+
+		cpu_ids[cpu_count]   = cpu_id;
+		max_freqs[cpu_count] = max_freq;
+
+		if (max_freq > highest_freq)
+			highest_freq = max_freq;
+
+		cpu_count++;
+	}
+
+	closedir(dir);
+
+	for (i = 0; i < cpu_count - 1; i++) {
+		for (j = i + 1; j < cpu_count; j++) {
+			if (cpu_ids[j] < cpu_ids[i]) {
+				tmp_id       = cpu_ids[i];
+				cpu_ids[i]   = cpu_ids[j];
+				cpu_ids[j]   = tmp_id;
+
+				tmp_freq     = max_freqs[i];
+				max_freqs[i] = max_freqs[j];
+				max_freqs[j] = tmp_freq;
+			}
+		}
+	}
+
+	for (i = 0; i < cpu_count; i++) {
+		cpus[i].id = cpu_ids[i];
+		cpus[i].fd = open_cur_freq(cpu_ids[i]);
+	}
+
+	if (config->sysinfo_p_cores > 0 || config->sysinfo_e_cores > 0) {
+		configured_p = config->sysinfo_p_cores;
+		configured_e = config->sysinfo_e_cores;
+
+		if (configured_p + configured_e > cpu_count) {
+			fprintf(stderr,
+			        "Warning: configured P+E cores (%d+%d) exceeds detected CPUs (%d)\n",
+			        configured_p, configured_e, cpu_count);
+
+			configured_p = 0;
+			configured_e = 0;
+		}
+
+		if (configured_p > 0 || configured_e > 0) {
+			for (i = 0; i < cpu_count; i++) {
+				cpus[i].is_p_core = (i < configured_p) ? 1 : 0;
+				if (cpus[i].is_p_core)
+					p_core_count++;
+				else
+					e_core_count++;
+			}
+			return;
+		}
+	}
+
+	lowest_freq = highest_freq;
+	for (i = 0; i < cpu_count; i++) {
+		if (max_freqs[i] < lowest_freq)
+			lowest_freq = max_freqs[i];
+	}
+
+	gap = highest_freq - lowest_freq;
+
+	if (gap > 100000) {
+		threshold = lowest_freq + 100000;
+	} else {
+		threshold = 0;
+	}
+
+	for (i = 0; i < cpu_count; i++) {
+		cpus[i].is_p_core = (max_freqs[i] >= threshold) ? 1 : 0;
+
+		if (cpus[i].is_p_core)
+			p_core_count++;
+		else
+			e_core_count++;
+	}
+}
+
+/* A CPU that went offline and came back has a new cpufreq policy behind
+   the path; the old fd then fails (ENODEV) and is reopened once. */
+static int
+read_cpu_khz(struct cpu_info *cpu)
+{
+	int khz;
+
+	if (cpu->fd >= 0 && read_int_fd(cpu->fd, &khz) == 0)
+		return khz;
+
+	if (cpu->fd >= 0)
+		close(cpu->fd);
+	cpu->fd = open_cur_freq(cpu->id);
+	if (cpu->fd >= 0 && read_int_fd(cpu->fd, &khz) == 0)
+		return khz;
+
+	return 0;
+}
+
+static void
+read_khz_pread(int n, int *khz)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		khz[i] = read_cpu_khz(&cpus[i]);
+}
+
+#ifdef CPU_FREQ_IO_URING
+static void
+ring_init(void)
+{
+	int fds[MAX_CPUS];
+	int err;
+	int i;
+
+	err = io_uring_queue_init((unsigned)cpu_count, &ring, 0);
+	if (err < 0) {
+		fprintf(stderr, "io_uring unavailable (%s), using pread\n",
+		        strerror(-err));
+		return;
+	}
+
+	/* fixed files: no fd table lookup per read. Without them (old kernel,
+	   RLIMIT_MEMLOCK) the reads still go through the ring on plain fds. */
+	for (i = 0; i < cpu_count; i++)
+		fds[i] = cpus[i].fd;
+	err = io_uring_register_files(&ring, fds, (unsigned)cpu_count);
+	if (err < 0)
+		fprintf(stderr, "io_uring fixed files unavailable (%s)\n",
+		        strerror(-err));
+	ring_fixed = err == 0;
+	ring_ready = true;
+}
+
+static void
+ring_exit(void)
+{
+	if (ring_ready)
+		io_uring_queue_exit(&ring);
+	ring_ready = false;
+	ring_fixed = false;
+}
+
+static bool
+read_khz_uring(int n, int *khz)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned             head;
+	unsigned             seen = 0;
+	int                  queued;
+	int                  i;
+
+	/* the ring has an entry per CPU, but should it ever run short the
+	   reads already prepared still go out and the rest use pread */
+	for (queued = 0; queued < n; queued++) {
+		sqe = io_uring_get_sqe(&ring);
+		if (!sqe)
+			break;
+		if (ring_fixed) {
+			io_uring_prep_read(sqe, queued, ring_bufs[queued],
+			                   sizeof(ring_bufs[queued]), 0);
+			sqe->flags |= IOSQE_FIXED_FILE;
+		} else {
+			io_uring_prep_read(sqe, cpus[queued].fd, ring_bufs[queued],
+			                   sizeof(ring_bufs[queued]), 0);
+		}
+		io_uring_sqe_set_data64(sqe, (uint64_t)queued);
+	}
+
+	if (queued == 0)
+		return false;
+	if (io_uring_submit_and_wait(&ring, (unsigned)queued) < 0)
+		return false;
+
+	io_uring_for_each_cqe(&ring, head, cqe) {
+		i = (int)cqe->user_data;
+		if (parse_int(ring_bufs[i], cqe->res, &khz[i]) != 0) {
+			/* reopened: point the fixed slot at the new file */
+			khz[i] = read_cpu_khz(&cpus[i]);
+			if (ring_fixed)
+				io_uring_register_files_update(&ring, (unsigned)i,
+				                               &cpus[i].fd, 1);
+		}
+		seen++;
+	}
+	io_uring_cq_advance(&ring, seen);
+
+	for (i = queued; i < n; i++)
+		khz[i] = read_cpu_khz(&cpus[i]);
+
+	return seen == (unsigned)queued;
+}
+#endif
+
+static void
+read_khz(int n, int *khz)
+{
+#ifdef CPU_FREQ_IO_URING
+	if (ring_ready && read_khz_uring(n, khz))
+		return;
+#endif
+	read_khz_pread(n, khz);
+}
+
+static void
+write_output(double p_avg, double e_avg)
+{
+	char   text[64];
+	double avg;
+
+	if (e_core_count > 0 && p_core_count > 0) {
+		snprintf(text, sizeof(text), "P: %.2f E: %.2f\n", p_avg, e_avg);
+	} else {
+		avg = (p_core_count > 0) ? p_avg : e_avg;
+		snprintf(text, sizeof(text), "%.2f\n", avg);
+	}
+
+	helper_feed_publish(feed, text);
+}
+
+static void
+sample(void *data)
+{
+	int    khz[MAX_CPUS];
+	double p_sum = 0.0;
+	double e_sum = 0.0;
+	double freq;
+	double p_avg;
+	double e_avg;
+	int    i;
+
+	(void)data;
+
+	read_khz(cpu_count, khz);
+	for (i = 0; i < cpu_count; i++) {
+		freq = khz[i] / 1000000.0;
+		if (cpus[i].is_p_core)
+			p_sum += freq;
+		else
+			e_sum += freq;
+	}
+
+	p_avg = (p_core_count > 0) ? p_sum / p_core_count : 0.0;
+	e_avg = (e_core_count > 0) ? e_sum / e_core_count : 0.0;
+
+	write_output(p_avg, e_avg);
+}
+
+static int
+cpu_freq_start(const helper_env_t *env)
+{
+	int timer;
+
+	detect_cpus(env->config);
+
+	if (cpu_count == 0) {
+		fprintf(stderr, "No CPUs with frequency scaling found\n");
+		return -1;
+	}
+
+	fprintf(stderr, "Detected %d CPUs (%d P-cores, %d E-cores)\n", cpu_count,
+	        p_core_count, e_core_count);
+
+	timer = helper_loop_timer(env->loop, sample, NULL);
+	if (timer < 0)
+		return -1;
+
+#ifdef CPU_FREQ_IO_URING
+	ring_init();
+#endif
+	feed = helper_feed_open(FEED_NAME);
+	sample(NULL);
+	helper_loop_every(env->loop, timer, UPDATE_INTERVAL_MS);
+
+	return 0;
+}
+
+static void
+close_cpus(void)
+{
+	int i;
+
+#ifdef CPU_FREQ_IO_URING
+	ring_exit();
+#endif
+	for (i = 0; i < cpu_count; i++) {
+		if (cpus[i].fd >= 0)
+			close(cpus[i].fd);
+		cpus[i].fd = -1;
+	}
+}
+
+static void
+cpu_freq_stop(void)
+{
+	close_cpus();
+	helper_feed_close(feed);
+	feed = NULL;
+}
+
+const helper_source_t cpu_freq_source = {
+	.name  = "cpu_freq",
+	.start = cpu_freq_start,
+	.stop  = cpu_freq_stop,
+};
+
+/* the old path, kept only to compare against */
+static void
+read_khz_stdio(int n, int *khz)
+{
+	char  path[256];
+	FILE *f;
+	int   i;
+
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof(path),
+		         "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+		         cpus[i].id);
+		khz[i] = 0;
+		f      = fopen(path, "r");
+		if (!f)
+			continue;
+		if (fscanf(f, "%d", &khz[i]) != 1)
+			khz[i] = 0;
+		fclose(f);
+	}
+}
+
+static double
+bench_us(void (*read_fn)(int, int *), int n, int iterations)
+{
+	struct timespec start;
+	struct timespec end;
+	int             khz[MAX_CPUS];
+	int             i;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		read_fn(n, khz);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return ((double)(end.tv_sec - start.tv_sec) * 1e6
+	        + (double)(end.tv_nsec - start.tv_nsec) / 1e3)
+	       / iterations;
+}
+
+#ifdef CPU_FREQ_IO_URING
+static void
+read_khz_uring_only(int n, int *khz)
+{
+	if (!read_khz_uring(n, khz))
+		read_khz_pread(n, khz);
+}
+#endif
+
+int
+cpu_freq_bench(const helper_config_t *config, int iterations)
+{
+	int n;
+
+	detect_cpus(config);
+	if (cpu_count == 0) {
+		fprintf(stderr, "No CPUs with frequency scaling found\n");
+		return 1;
+	}
+#ifdef CPU_FREQ_IO_URING
+	ring_init();
+#endif
+
+	printf("%6s %12s %12s", "cpus", "stdio us", "pread us");
+#ifdef CPU_FREQ_IO_URING
+	printf(" %12s", "io_uring us");
+#endif
+	printf("\n");
+
+	for (n = 1;; n = n * 2 < cpu_count ? n * 2 : cpu_count) {
+		printf("%6d %12.1f %12.1f", n,
+		       bench_us(read_khz_stdio, n, iterations),
+		       bench_us(read_khz_pread, n, iterations));
+#ifdef CPU_FREQ_IO_URING
+		if (ring_ready)
+			printf(" %12.1f",
+			       bench_us(read_khz_uring_only, n, iterations));
+#endif
+		printf("\n");
+		if (n == cpu_count)
+			break;
+	}
+
+	close_cpus();
+	return 0;
+}
@@ -0,0 +1,11 @@
+#ifndef BARNY_CPU_FREQ_H
+#define BARNY_CPU_FREQ_H
+
+#include "helper_config.h"
+
+/* Times one full sample over 1, 2, 4, ... CPUs with each read path and
+   prints microseconds per sample; barny-cpu-freq --bench [iterations]. */
+int
+cpu_freq_bench(const helper_config_t *config, int iterations);
+
+#endif
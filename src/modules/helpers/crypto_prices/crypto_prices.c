@@ -0,0 +1,404 @@
+#define _DEFAULT_SOURCE
+#include <ctype.h>
+#include <cjson/cJSON.h>
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+
+#include "helper_feed.h"
+#include "helper_http.h"
+#include "helper_source.h"
+#include "helper_util.h"
+
+#define WS_URL             "wss://ws.okx.com:8443/ws/v5/public"
+#define RECONNECT_DELAY_MS 5000
+#define MARKET_LEN         64
+#define FILE_LEN           64
+
+static const char *default_crypto_pairs[] = {
+	"BTC-USDT-SWAP",
+	"ETH-USDT-SWAP",
+	"SOL-USDT-SWAP",
+	"XRP-USDT-SWAP",
+	"ADA-USDT-SWAP",
+	"DOGE-USDT-SWAP",
+	"DOT-USDT-SWAP",
+};
+
+typedef struct {
+	char           inst_id[MARKET_LEN];
+	char           file_name[FILE_LEN];
+	helper_feed_t *feed;
+} tracked_pair_t;
+
+static tracked_pair_t *pairs      = NULL;
+static int             pair_count = 0;
+
+static helper_loop_t  *loop;
+static helper_http_t  *http;
+static CURL           *ws;
+static curl_socket_t   ws_fd      = CURL_SOCKET_BAD;
+static int             reconnect_timer;
+
+static void
+pair_file_from_market(const char *market, char *buf, size_t buf_size)
+{
+	char   slug[FILE_LEN];
+	size_t out;
+
+	if (!buf || buf_size == 0)
+		return;
+
+	out    = 0;
+	buf[0] = '\0';
+
+	while (*market && *market != '-' && out + 1 < sizeof(slug)) {
+		if (isalnum((unsigned char)*market))
+			slug[out++] = (char)tolower((unsigned char)*market);
+		market++;
+	}
+
+	if (out == 0) {
+		snprintf(buf, buf_size, "crypto_price");
+		return;
+	}
+
+	slug[out] = '\0';
+	snprintf(buf, buf_size, "%s_price", slug);
+}
+
+static void
+clear_pairs(void)
+{
+	int i;
+
+	for (i = 0; i < pair_count; i++)
+		helper_feed_close(pairs[i].feed);
+	free(pairs);
+	pairs      = NULL;
+	pair_count = 0;
+}
+
+static void
+set_pairs_from_csv(const char *value)
+{
+	size_t token_count;
+	char **tokens;
+	size_t i;
+
+	clear_pairs();
+
+	token_count = 0;
+	tokens      = helper_parse_csv(value, &token_count);
+	if (!tokens || token_count == 0) {
+		helper_free_string_array(tokens, token_count);
+		return;
+	}
+
+	if (token_count > 64)
+		token_count = 64;
+
+	pairs = calloc(token_count, sizeof(*pairs));
+	if (!pairs) {
+		helper_free_string_array(tokens, token_count);
+		return;
+	}
+
+	for (i = 0; i < token_count; i++) {
+		snprintf(pairs[pair_count].inst_id,
+		         sizeof(pairs[pair_count].inst_id), "%s", tokens[i]);
+		pair_file_from_market(
+		        tokens[i], pairs[pair_count].file_name,
+		        sizeof(pairs[pair_count].file_name));
+		pair_count++;
+	}
+
+	helper_free_string_array(tokens, token_count);
+
+	if (pair_count == 0)
+		clear_pairs();
+}
+
+static void
+set_default_pairs(void)
+{
+	size_t count = sizeof(default_crypto_pairs)
+	               / sizeof(default_crypto_pairs[0]);
+	size_t i;
+
+	clear_pairs();
+	pairs = calloc(count, sizeof(*pairs));
+	if (!pairs)
+		return;
+
+	for (i = 0; i < count; i++) {
+		snprintf(pairs[i].inst_id, sizeof(pairs[i].inst_id), "%s",
+		         default_crypto_pairs[i]);
+		pair_file_from_market(default_crypto_pairs[i], pairs[i].file_name,
+		                      sizeof(pairs[i].file_name));
+	}
+	pair_count = (int)count;
+}
+
+/* mark prices arrive several times a second and mostly repeat; the feed
+   drops the repeats before they reach the bar */
+static void
+write_price(tracked_pair_t *pair, double price)
+{
+	char text[64];
+
+	if (!pair->feed)
+		pair->feed = helper_feed_open(pair->file_name);
+
+	snprintf(text, sizeof(text), "%lg\n", price);
+	helper_feed_publish(pair->feed, text);
+}
+
+static void
+process_message(const char *data, size_t len)
+{
+	cJSON *json;
+	cJSON *data_arr;
+	cJSON *first;
+	cJSON *inst_id;
+	cJSON *mark_px;
+	double price;
+	int    i;
+
+	json = cJSON_ParseWithLength(data, len);
+	if (!json)
+		return;
+
+	data_arr = cJSON_GetObjectItem(json, "data");
+	if (!data_arr || !cJSON_IsArray(data_arr) || cJSON_GetArraySize(data_arr) < 1) {
+		cJSON_Delete(json);
+		return;
+	}
+
+	first = cJSON_GetArrayItem(data_arr, 0);
+	if (!cJSON_IsObject(first)) {
+		cJSON_Delete(json);
+		return;
+	}
+
+	inst_id = cJSON_GetObjectItem(first, "instId");
+	mark_px = cJSON_GetObjectItem(first, "markPx");
+	if (!inst_id || !inst_id->valuestring || !mark_px || !mark_px->valuestring) {
+		cJSON_Delete(json);
+		return;
+	}
+
+	price = strtod(mark_px->valuestring, NULL);
+	for (i = 0; i < pair_count; i++) {
+		if (strcmp(inst_id->valuestring, pairs[i].inst_id) == 0) {
+			write_price(&pairs[i], price);
+			break;
+		}
+	}
+
+	cJSON_Delete(json);
+}
+
+static int
+subscribe(void)
+{
+	cJSON   *msg;
+	cJSON   *args;
+	char    *sub_str;
+	size_t   sent;
+	CURLcode res;
+	int      i;
+
+	msg = cJSON_CreateObject();
+	if (!msg)
+		return -1;
+
+	args = cJSON_CreateArray();
+	if (!args) {
+		cJSON_Delete(msg);
+		return -1;
+	}
+
+	cJSON_AddStringToObject(msg, "op", "subscribe");
+	for (i = 0; i < pair_count; i++) {
+		cJSON *arg = cJSON_CreateObject();
+		if (!arg)
+			continue;
+		cJSON_AddStringToObject(arg, "channel", "mark-price");
+		cJSON_AddStringToObject(arg, "instId", pairs[i].inst_id);
+		cJSON_AddItemToArray(args, arg);
+	}
+	cJSON_AddItemToObject(msg, "args", args);
+
+	sub_str = cJSON_PrintUnformatted(msg);
+	cJSON_Delete(msg);
+	if (!sub_str)
+		return -1;
+
+	res = curl_ws_send(ws, sub_str, strlen(sub_str), &sent, 0, CURLWS_TEXT);
+	free(sub_str);
+	if (res != CURLE_OK) {
+		fprintf(stderr, "Failed to subscribe: %s\n",
+		        curl_easy_strerror(res));
+		return -1;
+	}
+
+	fprintf(stderr, "Subscribed to %d crypto pairs\n", pair_count);
+	return 0;
+}
+
+static void
+disconnect(void)
+{
+	if (ws_fd != CURL_SOCKET_BAD) {
+		helper_loop_unwatch(loop, ws_fd);
+		ws_fd = CURL_SOCKET_BAD;
+	}
+	if (ws) {
+		helper_http_detach(http, ws);
+		curl_easy_cleanup(ws);
+		ws = NULL;
+	}
+}
+
+static void
+reconnect_later(void)
+{
+	disconnect();
+	fprintf(stderr, "Reconnecting in %d seconds...\n",
+	        RECONNECT_DELAY_MS / 1000);
+	helper_loop_after(loop, reconnect_timer, RECONNECT_DELAY_MS);
+}
+
+/* drains whatever frames the socket has; curl answers pings in here too */
+static void
+on_readable(int fd, uint32_t events, void *data)
+{
+	char                        buffer[4096];
+	size_t                      rlen;
+	const struct curl_ws_frame *frame;
+	CURLcode                    res;
+
+	(void)fd;
+	(void)events;
+	(void)data;
+
+	for (;;) {
+		res = curl_ws_recv(ws, buffer, sizeof(buffer) - 1, &rlen, &frame);
+		if (res == CURLE_AGAIN)
+			return;
+		if (res != CURLE_OK) {
+			fprintf(stderr, "WebSocket recv error: %s\n",
+			        curl_easy_strerror(res));
+			reconnect_later();
+			return;
+		}
+		if (frame->flags & CURLWS_TEXT) {
+			buffer[rlen] = '\0';
+			process_message(buffer, rlen);
+		} else if (frame->flags & CURLWS_CLOSE) {
+			fprintf(stderr, "Server closed connection\n");
+			reconnect_later();
+			return;
+		}
+	}
+}
+
+static void
+on_connected(CURL *easy, CURLcode result, void *data)
+{
+	(void)easy;
+	(void)data;
+
+	if (result != CURLE_OK) {
+		fprintf(stderr, "WebSocket connect failed: %s\n",
+		        curl_easy_strerror(result));
+		reconnect_later();
+		return;
+	}
+
+	fprintf(stderr, "Connected to OKX WebSocket\n");
+
+	if (subscribe() != 0
+	    || curl_easy_getinfo(ws, CURLINFO_ACTIVESOCKET, &ws_fd) != CURLE_OK
+	    || ws_fd == CURL_SOCKET_BAD
+	    || helper_loop_watch(loop, ws_fd, EPOLLIN, on_readable, NULL) < 0) {
+		ws_fd = CURL_SOCKET_BAD;
+		reconnect_later();
+		return;
+	}
+
+	/* frames that arrived with the handshake are already buffered */
+	on_readable(ws_fd, EPOLLIN, NULL);
+}
+
+/* The handshake runs on the shared multi handle like any other transfer;
+   once it is done the socket is watched directly and frames are read with
+   curl_ws_recv as they come. */
+static void
+connect_ws(void *data)
+{
+	(void)data;
+
+	ws = curl_easy_init();
+	if (!ws) {
+		reconnect_later();
+		return;
+	}
+
+	curl_easy_setopt(ws, CURLOPT_URL, WS_URL);
+	curl_easy_setopt(ws, CURLOPT_CONNECT_ONLY, 2L);
+	curl_easy_setopt(ws, CURLOPT_SSL_VERIFYPEER, 1L);
+	curl_easy_setopt(ws, CURLOPT_SSL_VERIFYHOST, 2L);
+	curl_easy_setopt(ws, CURLOPT_CONNECTTIMEOUT, 10L);
+	curl_easy_setopt(ws, CURLOPT_TIMEOUT, 30L);
+#ifdef CURLOPT_PROTOCOLS_STR
+	curl_easy_setopt(ws, CURLOPT_PROTOCOLS_STR, "wss");
+#endif
+
+	if (!helper_http_attach(http, ws, on_connected, NULL)) {
+		curl_easy_cleanup(ws);
+		ws = NULL;
+		reconnect_later();
+	}
+}
+
+static int
+crypto_prices_start(const helper_env_t *env)
+{
+	if (!env->http)
+		return -1;
+
+	loop = env->loop;
+	http = env->http;
+
+	set_default_pairs();
+	if (env->config->crypto_pairs[0])
+		set_pairs_from_csv(env->config->crypto_pairs);
+	if (pair_count == 0)
+		set_default_pairs();
+
+	reconnect_timer = helper_loop_timer(loop, connect_ws, NULL);
+	if (reconnect_timer < 0)
+		return -1;
+
+	connect_ws(NULL);
+	return 0;
+}
+
+static void
+crypto_prices_stop(void)
+{
+	helper_loop_cancel(loop, reconnect_timer);
+	disconnect();
+	clear_pairs();
+}
+
+const helper_source_t crypto_prices_source = {
+	.name  = "crypto_prices",
+	.start = crypto_prices_start,
+	.stop  = crypto_prices_stop,
+};
@@ -0,0 +1,35 @@
+#include "helper_http.h"
+#include "helper_loop.h"
+#include "helper_source.h"
+
+/* Every helper in one process: one config parse, one epoll loop whose
+   timerfd carries all the periodic sampling (cpu_freq and cpu_power share
+   their two-second tick), and one curl multi handle for the weather fetches
+   and the price websocket. A source with nothing to read on this machine is
+   skipped and the rest carry on. */
+int
+main(void)
+{
+	static const helper_source_t *const sources[] = {
+		&cpu_freq_source,
+		&cpu_power_source,
+		&crypto_prices_source,
+		&weather_source,
+	};
+	helper_config_t config;
+	helper_env_t    env;
+	int             rc;
+
+	helper_config_load(&config);
+	env = (helper_env_t){ .loop = helper_loop_create(), .config = &config };
+	if (!env.loop)
+		return 1;
+	env.http = helper_http_create(env.loop);
+
+	rc = helper_run(&env, sources,
+	                (int)(sizeof(sources) / sizeof(sources[0])));
+	helper_http_destroy(env.http);
+	helper_loop_destroy(env.loop);
+
+	return rc;
+}
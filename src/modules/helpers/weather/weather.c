@@ -0,0 +1,332 @@
+#define _DEFAULT_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cjson/cJSON.h>
+
+#include "helper_feed.h"
+#include "helper_http.h"
+#include "helper_source.h"
+
+#define UPDATE_INTERVAL_MS 600000
+#define RETRY_INTERVAL_MS  60000
+#define FEED_NAME          "weather"
+#define API_KEY_PATH       "/opt/barny/modules/weather_api_key"
+#define LOCATION_URL       "https://ipinfo.io/json"
+#define HTTP_TIMEOUT       30L
+
+typedef struct {
+	double temp;
+	double feels_like;
+	int    humidity;
+	int    pressure;
+	double wind_speed;
+	int    wind_deg;
+	char   condition[64];
+	char   description[128];
+	char   location[64];
+	bool   have_feels_like;
+	bool   have_humidity;
+	bool   have_pressure;
+	bool   have_wind;
+	bool   have_location;
+	bool   have_description;
+} weather_t;
+
+static helper_loop_t *loop;
+static helper_http_t *http;
+static helper_feed_t *feed;
+static int            timer = -1;
+static char           api_key[100];
+static double         lat;
+static double         lon;
+static bool           have_location;
+
+static int
+parse_location(const char *body)
+{
+	cJSON *json;
+	cJSON *loc;
+	char   locbuf[64];
+	char  *comma;
+
+	json = cJSON_Parse(body);
+	if (!json)
+		return -1;
+
+	loc = cJSON_GetObjectItemCaseSensitive(json, "loc");
+	if (!cJSON_IsString(loc) || !loc->valuestring) {
+		cJSON_Delete(json);
+		return -1;
+	}
+
+	snprintf(locbuf, sizeof(locbuf), "%s", loc->valuestring);
+
+	comma = strchr(locbuf, ',');
+	if (!comma) {
+		cJSON_Delete(json);
+		return -1;
+	}
+
+	*comma = '\0';
+	lat    = strtod(locbuf, NULL);
+	lon    = strtod(comma + 1, NULL);
+
+	cJSON_Delete(json);
+	return 0;
+}
+
+static const char *
+deg_to_compass(int deg)
+{
+	static const char *dirs[] = { "N", "NE", "E", "SE",
+		                      "S", "SW", "W", "NW" };
+	int                idx    = (int)((deg + 22) / 45) & 7;
+	return dirs[idx];
+}
+
+static int
+parse_weather(const char *body, weather_t *out)
+{
+	cJSON *json;
+	cJSON *main_obj;
+	cJSON *temp_obj;
+	cJSON *fl;
+	cJSON *h;
+	cJSON *p;
+	cJSON *wind;
+	cJSON *ws;
+	cJSON *wd;
+	cJSON *name;
+	cJSON *weather_arr;
+	cJSON *first;
+	cJSON *main_str;
+	cJSON *desc;
+
+	json = cJSON_Parse(body);
+	if (!json)
+		return -1;
+
+	memset(out, 0, sizeof(*out));
+
+	main_obj = cJSON_GetObjectItem(json, "main");
+	temp_obj = main_obj ? cJSON_GetObjectItem(main_obj, "temp") : NULL;
+	if (!temp_obj || !cJSON_IsNumber(temp_obj)) {
+		fprintf(stderr, "Failed to get temperature\n");
+		cJSON_Delete(json);
+		return -1;
+	}
+	out->temp = temp_obj->valuedouble;
+
+	if (main_obj) {
+		fl = cJSON_GetObjectItem(main_obj, "feels_like");
+		if (cJSON_IsNumber(fl)) {
+			out->feels_like      = fl->valuedouble;
+			out->have_feels_like = true;
+		}
+
+		h = cJSON_GetObjectItem(main_obj, "humidity");
+		if (cJSON_IsNumber(h)) {
+			out->humidity      = (int)h->valuedouble;
+			out->have_humidity = true;
+		}
+
+		p = cJSON_GetObjectItem(main_obj, "pressure");
+		if (cJSON_IsNumber(p)) {
+			out->pressure      = (int)p->valuedouble;
+			out->have_pressure = true;
+		}
+	}
+
+	wind = cJSON_GetObjectItem(json, "wind");
+	if (wind) {
+		ws = cJSON_GetObjectItem(wind, "speed");
+		wd = cJSON_GetObjectItem(wind, "deg");
+		if (cJSON_IsNumber(ws)) {
+			out->wind_speed = ws->valuedouble;
+			out->wind_deg   = cJSON_IsNumber(wd) ? (int)wd->valuedouble : 0;
+			out->have_wind  = true;
+		}
+	}
+
+	name = cJSON_GetObjectItem(json, "name");
+	if (cJSON_IsString(name) && name->valuestring && *name->valuestring) {
+		snprintf(out->location, sizeof(out->location), "%s",
+		         name->valuestring);
+		out->have_location = true;
+	}
+
+	weather_arr = cJSON_GetObjectItem(json, "weather");
+	if (cJSON_IsArray(weather_arr) && cJSON_GetArraySize(weather_arr) > 0) {
+		first    = cJSON_GetArrayItem(weather_arr, 0);
+		main_str = cJSON_GetObjectItem(first, "main");
+		desc     = cJSON_GetObjectItem(first, "description");
+		if (main_str && cJSON_IsString(main_str) && main_str->valuestring) {
+			snprintf(out->condition, sizeof(out->condition), "%s",
+			         main_str->valuestring);
+		} else {
+			snprintf(out->condition, sizeof(out->condition),
+			         "Unknown");
+		}
+		if (desc && cJSON_IsString(desc) && desc->valuestring && *desc->valuestring) {
+			snprintf(out->description, sizeof(out->description),
+			         "%s", desc->valuestring);
+			out->have_description = true;
+		}
+	} else {
+		snprintf(out->condition, sizeof(out->condition), "Unknown");
+	}
+
+	cJSON_Delete(json);
+	return 0;
+}
+
+static void
+write_output(const weather_t *w)
+{
+	FILE  *f;
+	char  *text = NULL;
+	size_t size = 0;
+
+	f = open_memstream(&text, &size);
+	if (!f) {
+		fprintf(stderr, "Failed to format output\n");
+		return;
+	}
+
+	fprintf(f, "temp=%lg\n", w->temp);
+	fprintf(f, "condition=%s\n", w->condition);
+	if (w->have_description)
+		fprintf(f, "description=%s\n", w->description);
+	if (w->have_location)
+		fprintf(f, "location=%s\n", w->location);
+	if (w->have_feels_like)
+		fprintf(f, "feels_like=%lg\n", w->feels_like);
+	if (w->have_humidity)
+		fprintf(f, "humidity=%d\n", w->humidity);
+	if (w->have_wind) {
+		fprintf(f, "wind_speed=%lg\n", w->wind_speed);
+		fprintf(f, "wind_deg=%d\n", w->wind_deg);
+		fprintf(f, "wind_dir=%s\n", deg_to_compass(w->wind_deg));
+	}
+	if (w->have_pressure)
+		fprintf(f, "pressure=%d\n", w->pressure);
+
+	fclose(f);
+
+	helper_feed_publish(feed, text);
+	free(text);
+}
+
+static int
+read_api_key(char *key)
+{
+	FILE *f;
+
+	f = fopen(API_KEY_PATH, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to open API key file: %s\n", API_KEY_PATH);
+		return -1;
+	}
+
+	if (fscanf(f, "%99s", key) != 1) {
+		fprintf(stderr, "Failed to read API key\n");
+		fclose(f);
+		return -1;
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static void refresh(void *data);
+
+static void
+on_weather(const char *body, void *data)
+{
+	weather_t w;
+
+	(void)data;
+
+	if (body && parse_weather(body, &w) == 0) {
+		write_output(&w);
+		fprintf(stderr, "Updated: %.1f C %s\n", w.temp, w.condition);
+	}
+
+	helper_loop_after(loop, timer, UPDATE_INTERVAL_MS);
+}
+
+static void
+on_location(const char *body, void *data)
+{
+	(void)data;
+
+	if (!body || parse_location(body) != 0) {
+		fprintf(stderr, "Failed to get location\n");
+		helper_loop_after(loop, timer, RETRY_INTERVAL_MS);
+		return;
+	}
+
+	fprintf(stderr, "Location: %.4f, %.4f\n", lat, lon);
+	have_location = true;
+	refresh(NULL);
+}
+
+/* The location is looked up once, then the weather every ten minutes. Both
+   are fetches on the shared multi handle; the next one is scheduled when
+   the last completes. */
+static void
+refresh(void *data)
+{
+	char url[512];
+	bool ok;
+
+	(void)data;
+
+	if (!have_location) {
+		ok = helper_http_fetch(http, LOCATION_URL, HTTP_TIMEOUT,
+		                       on_location, NULL);
+	} else {
+		snprintf(
+		        url, sizeof(url),
+		        "https://api.openweathermap.org/data/2.5/weather?lat=%lg&lon=%lg&appid=%s&units=metric",
+		        lat, lon, api_key);
+		ok = helper_http_fetch(http, url, HTTP_TIMEOUT, on_weather, NULL);
+	}
+
+	if (!ok)
+		helper_loop_after(loop, timer, RETRY_INTERVAL_MS);
+}
+
+static int
+weather_start(const helper_env_t *env)
+{
+	if (!env->http || read_api_key(api_key) != 0)
+		return -1;
+
+	loop  = env->loop;
+	http  = env->http;
+	timer = helper_loop_timer(loop, refresh, NULL);
+	if (timer < 0)
+		return -1;
+
+	feed = helper_feed_open(FEED_NAME);
+	refresh(NULL);
+
+	return 0;
+}
+
+static void
+weather_stop(void)
+{
+	helper_loop_cancel(loop, timer);
+	helper_feed_close(feed);
+	feed = NULL;
+}
+
+const helper_source_t weather_source = {
+	.name  = "weather",
+	.start = weather_start,
+	.stop  = weather_stop,
+};
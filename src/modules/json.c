@@ -0,0 +1,463 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "barny_json.h"
+
+static const char *
+skip_ws(const char *p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')
+		p++;
+	return p;
+}
+
+/* Bytes that end a run inside a skipped container (1) or string (2). */
+static const unsigned char stop[256] = {
+	['\0'] = 3, ['"'] = 3, ['\\'] = 2,
+	['{'] = 1,  ['['] = 1, ['}'] = 1, [']'] = 1,
+};
+
+/* Past the closing quote of the string opening at p, or NULL. */
+static const char *
+skip_string(const char *p)
+{
+	for (p++;; p++) {
+		while (!(stop[(unsigned char)*p] & 2))
+			p++;
+		if (*p == '"')
+			return p + 1;
+		if (*p == '\0' || *++p == '\0')
+			return NULL;
+	}
+}
+
+/* Past the value starting at p, or NULL when the text ends first. Inside
+   a container only strings and brackets matter: that is enough to find
+   where it ends, which is all a skipped value has to give. */
+static const char *
+skip_value(const char *p)
+{
+	const char *start = p;
+	int         depth;
+
+	switch (*p) {
+	case '"':
+		return skip_string(p);
+	case '{':
+	case '[':
+		break;
+	default:
+		while (*p && *p != ',' && *p != '}' && *p != ']' && *p != ' '
+		       && *p != '\t' && *p != '\n' && *p != '\r')
+			p++;
+		return p > start ? p : NULL;
+	}
+
+	depth = 0;
+	for (;;) {
+		while (!(stop[(unsigned char)*p] & 1))
+			p++;
+		switch (*p) {
+		case '\0':
+			return NULL;
+		case '"':
+			p = skip_string(p);
+			if (!p)
+				return NULL;
+			continue;
+		case '{':
+		case '[':
+			depth++;
+			break;
+		default:
+			if (--depth == 0)
+				return p + 1;
+			break;
+		}
+		p++;
+	}
+}
+
+bool
+barny_json_parse(const char *text, barny_json_t *out)
+{
+	out->start = skip_ws(text);
+	out->end   = skip_value(out->start);
+	if (!out->end) {
+		out->start = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+void
+barny_json_iter(barny_json_iter_t *it, const barny_json_t *container)
+{
+	it->first = true;
+	it->p     = NULL;
+	if (barny_json_is_object(container) || barny_json_is_array(container)) {
+		it->p     = container->start + 1;
+		it->close = *container->start == '{' ? '}' : ']';
+	}
+}
+
+bool
+barny_json_next(barny_json_iter_t *it, barny_json_t *key, barny_json_t *val)
+{
+	const char *p;
+	const char *k;
+	const char *k_end;
+
+	if (!it->p)
+		return false;
+
+	p = skip_ws(it->p);
+	if (*p == it->close)
+		goto done;
+	if (!it->first) {
+		if (*p != ',')
+			goto done;
+		p = skip_ws(p + 1);
+	}
+
+	k     = NULL;
+	k_end = NULL;
+	if (it->close == '}') {
+		if (*p != '"')
+			goto done;
+		k     = p;
+		k_end = skip_string(p);
+		if (!k_end)
+			goto done;
+		p = skip_ws(k_end);
+		if (*p != ':')
+			goto done;
+		p = skip_ws(p + 1);
+	}
+
+	val->start = p;
+	val->end   = skip_value(p);
+	if (!val->end)
+		goto done;
+	if (key) {
+		key->start = k;
+		key->end   = k_end;
+	}
+
+	it->p     = val->end;
+	it->first = false;
+	return true;
+
+done:
+	it->p = NULL;
+	return false;
+}
+
+static bool
+span_streq(const barny_json_t *v, const char *s, size_t len)
+{
+	return barny_json_is_string(v) && (size_t)(v->end - v->start) == len + 2
+	       && memcmp(v->start + 1, s, len) == 0;
+}
+
+bool
+barny_json_path(const barny_json_t *root, const char *path, barny_json_t *out)
+{
+	barny_json_iter_t it;
+	barny_json_t      cur;
+	barny_json_t      key;
+	barny_json_t      val;
+	const char       *dot;
+	size_t            len;
+	char             *num_end;
+	long              index;
+	bool              found;
+
+	cur = *root;
+	while (cur.start && *path) {
+		dot   = strchr(path, '.');
+		len   = dot ? (size_t)(dot - path) : strlen(path);
+		index = -1;
+		if (barny_json_is_array(&cur)) {
+			index = strtol(path, &num_end, 10);
+			if (num_end != path + len || index < 0)
+				break;
+		}
+
+		found = false;
+		barny_json_iter(&it, &cur);
+		while (!found && barny_json_next(&it, &key, &val)) {
+			if (index >= 0)
+				found = index-- == 0;
+			else
+				found = span_streq(&key, path, len);
+		}
+		if (!found)
+			break;
+
+		cur  = val;
+		path = dot ? dot + 1 : path + len;
+	}
+
+	if (*path || !cur.start) {
+		out->start = NULL;
+		out->end   = NULL;
+		return false;
+	}
+
+	*out = cur;
+	return true;
+}
+
+bool
+barny_json_find(const barny_json_t *root, const char *key, const char *raw,
+                 barny_json_t *out)
+{
+	const char *open[BARNY_JSON_MAX_DEPTH];
+	const char *p;
+	const char *s;
+	size_t      klen;
+	size_t      rlen;
+	int         depth;
+
+	out->start = NULL;
+	out->end   = NULL;
+	if (!barny_json_is_object(root) && !barny_json_is_array(root))
+		return false;
+
+	klen  = strlen(key);
+	rlen  = strlen(raw);
+	depth = 0;
+	p     = root->start;
+	for (;;) {
+		while (!(stop[(unsigned char)*p] & 1))
+			p++;
+
+		switch (*p) {
+		case '\0':
+			return false;
+		case '{':
+		case '[':
+			if (depth == BARNY_JSON_MAX_DEPTH)
+				return false;
+			open[depth++] = p++;
+			break;
+		case '}':
+		case ']':
+			if (--depth == 0)
+				return false;
+			p++;
+			break;
+		default:
+			s = p;
+			p = skip_string(p);
+			if (!p)
+				return false;
+			/* only a key names a member, and keys only live in objects */
+			if (*open[depth - 1] != '{' || (size_t)(p - s) != klen + 2
+			    || memcmp(s + 1, key, klen) != 0)
+				break;
+			s = skip_ws(p);
+			if (*s != ':')
+				break;
+			s = skip_ws(s + 1);
+			if (strncmp(s, raw, rlen) == 0) {
+				out->start = open[depth - 1];
+				out->end   = skip_value(out->start);
+				return out->end != NULL;
+			}
+			break;
+		}
+	}
+}
+
+bool
+barny_json_is_object(const barny_json_t *v)
+{
+	return v->start && *v->start == '{';
+}
+
+bool
+barny_json_is_array(const barny_json_t *v)
+{
+	return v->start && *v->start == '[';
+}
+
+bool
+barny_json_is_string(const barny_json_t *v)
+{
+	return v->start && *v->start == '"';
+}
+
+bool
+barny_json_is_number(const barny_json_t *v)
+{
+	return v->start && (*v->start == '-' || (*v->start >= '0'
+	                                         && *v->start <= '9'));
+}
+
+bool
+barny_json_is_true(const barny_json_t *v)
+{
+	return v->start && v->end - v->start == 4
+	       && memcmp(v->start, "true", 4) == 0;
+}
+
+bool
+barny_json_streq(const barny_json_t *v, const char *s)
+{
+	return span_streq(v, s, strlen(s));
+}
+
+long
+barny_json_long(const barny_json_t *v, long fallback)
+{
+	if (!barny_json_is_number(v))
+		return fallback;
+
+	/* the value is followed by a delimiter, so strtol stops in time */
+	return strtol(v->start, NULL, 10);
+}
+
+static int
+hex4(const char *p)
+{
+	int v = 0;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		v <<= 4;
+		if (p[i] >= '0' && p[i] <= '9')
+			v |= p[i] - '0';
+		else if (p[i] >= 'a' && p[i] <= 'f')
+			v |= p[i] - 'a' + 10;
+		else if (p[i] >= 'A' && p[i] <= 'F')
+			v |= p[i] - 'A' + 10;
+		else
+			return -1;
+	}
+
+	return v;
+}
+
+/* Writes cp as UTF-8 if all of it fits; returns the bytes written. */
+static size_t
+put_utf8(char *out, size_t room, uint32_t cp)
+{
+	size_t n = cp < 0x80 ? 1 : cp < 0x800 ? 2 : cp < 0x10000 ? 3 : 4;
+
+	if (n > room)
+		return 0;
+
+	switch (n) {
+	case 1:
+		out[0] = (char)cp;
+		break;
+	case 2:
+		out[0] = (char)(0xC0 | (cp >> 6));
+		out[1] = (char)(0x80 | (cp & 0x3F));
+		break;
+	case 3:
+		out[0] = (char)(0xE0 | (cp >> 12));
+		out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		out[2] = (char)(0x80 | (cp & 0x3F));
+		break;
+	default:
+		out[0] = (char)(0xF0 | (cp >> 18));
+		out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+		out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+		out[3] = (char)(0x80 | (cp & 0x3F));
+		break;
+	}
+
+	return n;
+}
+
+bool
+barny_json_string(const barny_json_t *v, char *buf, size_t size)
+{
+	const char *p;
+	const char *end;
+	uint32_t    cp;
+	size_t      n;
+	size_t      w;
+	int         lo;
+	int         hi;
+
+	if (size == 0)
+		return false;
+	buf[0] = '\0';
+	if (!barny_json_is_string(v))
+		return false;
+
+	n   = 0;
+	p   = v->start + 1;
+	end = v->end - 1;
+	while (p < end && n < size - 1) {
+		if (*p != '\\') {
+			/* raw UTF-8 passes through; don't cut a character in two */
+			if ((*p & 0xC0) == 0xC0) {
+				w = (*p & 0xE0) == 0xC0 ? 2 : (*p & 0xF0) == 0xE0 ? 3 : 4;
+				if (n + w > size - 1 || p + w > end)
+					break;
+				memcpy(buf + n, p, w);
+				n += w;
+				p += w;
+			} else {
+				buf[n++] = *p++;
+			}
+			continue;
+		}
+
+		p++;
+		switch (*p) {
+		case 'b':
+			cp = '\b';
+			break;
+		case 'f':
+			cp = '\f';
+			break;
+		case 'n':
+			cp = '\n';
+			break;
+		case 'r':
+			cp = '\r';
+			break;
+		case 't':
+			cp = '\t';
+			break;
+		case 'u':
+			if (end - p < 5 || (hi = hex4(p + 1)) < 0)
+				goto out;
+			p  += 4;
+			cp  = (uint32_t)hi;
+			/* a surrogate pair spells one character past the BMP */
+			if (hi >= 0xD800 && hi < 0xDC00 && end - p >= 7 && p[1] == '\\'
+			    && p[2] == 'u' && (lo = hex4(p + 3)) >= 0xDC00
+			    && lo < 0xE000) {
+				cp  = 0x10000 + (((uint32_t)hi - 0xD800) << 10)
+				      + ((uint32_t)lo - 0xDC00);
+				p  += 6;
+			} else if (hi >= 0xD800 && hi < 0xE000) {
+				cp = 0xFFFD;
+			}
+			break;
+		default:
+			/* \" \\ \/ */
+			cp = (uint32_t)(unsigned char)*p;
+			break;
+		}
+
+		w = put_utf8(buf + n, size - 1 - n, cp);
+		if (w == 0)
+			break;
+		n += w;
+		p++;
+	}
+
+out:
+	buf[n] = '\0';
+	return true;
+}
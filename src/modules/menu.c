@@ -1,12 +1,8 @@
 #define _GNU_SOURCE
-#include <fcntl.h>
 #include <linux/input-event-codes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <time.h>
-#include <unistd.h>
 
 #include "barny.h"
 #include "popup.h"
@@ -70,6 +66,8 @@ struct barny_menu {
 	barny_output_t               *out;
 	char                         *service;
 	char                         *menu_path;
+	/* the item's cached layout; root is borrowed from it */
+	barny_dbusmenu_t             *dbusmenu;
 	barny_menu_item_t            *root;
 	enum menu_kind                kind;
 	int                           tray_count;
@@ -77,6 +75,8 @@ struct barny_menu {
 	int                           tray_cell;
 
 	barny_menu_item_t            *stack[MENU_MAX_DEPTH];
+	/* what the stack holds, for finding it again after an update */
+	int                           stack_id[MENU_MAX_DEPTH];
 	int                           depth;
 
 	menu_row_t                   *rows;
@@ -91,11 +91,9 @@ struct barny_menu {
 
 	struct wl_surface            *surface;
 	struct zwlr_layer_surface_v1 *layer_surface;
-	struct wl_buffer             *buffer;
-	cairo_surface_t              *cairo_surface;
-	cairo_t                      *cr;
-	void                         *shm_data;
-	int                           shm_size;
+	/* taken from out's arena on the first configure */
+	barny_shm_arena_t            *arena;
+	barny_buffer_t                buf;
 
 	int                           surf_w;
 	int                           surf_h;
@@ -292,13 +290,8 @@ menu_draw_tray_icon(cairo_t *cr, const barny_config_t *cfg, sni_item_t *item,
 	double half   = size / 2.0 - 1;
 	double cx     = x + size / 2.0;
 	double cy     = y + size / 2.0;
-	int    iw;
-	int    ih;
 	int    pad;
 	int    target;
-	double scale;
-	double dx;
-	double dy;
 
 	if (half < 1)
 		half = 1;
@@ -315,27 +308,12 @@ menu_draw_tray_icon(cairo_t *cr, const barny_config_t *cfg, sni_item_t *item,
 	}
 	cairo_fill(cr);
 
-	if (!item->icon
-	    || cairo_surface_status(item->icon) != CAIRO_STATUS_SUCCESS)
-		return;
-	iw = cairo_image_surface_get_width(item->icon);
-	ih = cairo_image_surface_get_height(item->icon);
-	if (iw <= 0 || ih <= 0)
-		return;
-
 	pad    = 4;
 	target = size - 2 * pad;
 	if (target < 1)
 		target = 1;
-	scale = (double)target / (iw > ih ? iw : ih);
-	dx    = x + pad + (target - iw * scale) / 2.0;
-	dy    = y + pad + (target - ih * scale) / 2.0;
-	cairo_save(cr);
-	cairo_translate(cr, dx, dy);
-	cairo_scale(cr, scale, scale);
-	cairo_set_source_surface(cr, item->icon, 0, 0);
-	cairo_paint_with_alpha(cr, 0.95);
-	cairo_restore(cr);
+	barny_icon_paint(cr, item->icon, item->icon_hash, x + pad, y + pad,
+	                 target, 0.95);
 }
 
 static void
@@ -428,36 +406,6 @@ menu_panel(const barny_menu_t *m, barny_glass_panel_t *panel)
 	panel->position_top = cfg->position_top;
 }
 
-static int
-menu_create_shm(int size)
-{
-	static unsigned counter = 0;
-	char            name[64];
-	struct timespec ts;
-	int             fd;
-
-	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
-		ts.tv_sec  = 0;
-		ts.tv_nsec = 0;
-	}
-
-	snprintf(name, sizeof(name), "/barny-menu-%d-%u-%lu", (int)getpid(),
-	         (unsigned)counter++, (unsigned long)ts.tv_nsec);
-
-	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-	if (fd < 0)
-		return -1;
-
-	if (ftruncate(fd, size) < 0) {
-		shm_unlink(name);
-		close(fd);
-		return -1;
-	}
-
-	shm_unlink(name);
-	return fd;
-}
-
 static void
 menu_draw_label(barny_menu_t *m, cairo_t *cr, PangoLayout *layout,
                 const char *text, int x, int y, int row_h, double alpha)
@@ -769,10 +717,10 @@ static void
 menu_present(barny_menu_t *m)
 {
 	barny_glass_panel_t panel;
-	cairo_t            *cr = m->cr;
+	cairo_t            *cr = m->buf.cr;
 	int                 x0, y0, x1, y1;
 
-	if (!cr || !m->buffer)
+	if (!cr || !m->buf.wl_buffer)
 		return;
 
 	menu_panel(m, &panel);
@@ -818,8 +766,10 @@ menu_present(barny_menu_t *m)
 	}
 	cairo_restore(cr);
 
-	cairo_surface_flush(m->cairo_surface);
-	wl_surface_attach(m->surface, m->buffer, 0, 0);
+	cairo_surface_flush(m->buf.cairo_surface);
+	wl_surface_attach(m->surface, m->buf.wl_buffer, 0, 0);
+	/* the compositor holds it now; see barny_buffers_destroy */
+	m->buf.busy = true;
 	wl_surface_damage_buffer(m->surface, x0, y0, x1 - x0, y1 - y0);
 
 	m->damage_x = m->patch_x;
@@ -901,7 +851,7 @@ menu_schedule_frame(barny_menu_t *m)
 static void
 menu_paint(barny_menu_t *m)
 {
-	if (!m->cr || !m->buffer)
+	if (!m->buf.cr || !m->buf.wl_buffer)
 		return;
 
 	menu_present(m);
@@ -911,32 +861,15 @@ menu_paint(barny_menu_t *m)
 static void
 menu_teardown_buffer(barny_menu_t *m)
 {
-	if (m->cr) {
-		cairo_destroy(m->cr);
-		m->cr = NULL;
-	}
-	if (m->cairo_surface) {
-		cairo_surface_destroy(m->cairo_surface);
-		m->cairo_surface = NULL;
-	}
-	if (m->buffer) {
-		wl_buffer_destroy(m->buffer);
-		m->buffer = NULL;
-	}
-	if (m->shm_data) {
-		munmap(m->shm_data, (size_t)m->shm_size);
-		m->shm_data = NULL;
-	}
-	m->shm_size = 0;
+	barny_buffers_destroy(&m->buf, 1);
 }
 
 static void
 menu_layer_configure(void *userdata, struct zwlr_layer_surface_v1 *surface,
                      uint32_t serial, uint32_t width, uint32_t height)
 {
-	barny_menu_t       *m = userdata;
-	int                 pw, ph, stride, size, fd;
-	struct wl_shm_pool *pool;
+	barny_menu_t *m = userdata;
+	int           pw, ph;
 
 	zwlr_layer_surface_v1_ack_configure(surface, serial);
 
@@ -946,40 +879,27 @@ menu_layer_configure(void *userdata, struct zwlr_layer_surface_v1 *surface,
 	if (pw <= 0 || ph <= 0)
 		return;
 
-	if (m->buffer && pw == m->surf_w && ph == m->surf_h) {
+	if (m->buf.wl_buffer && pw == m->surf_w && ph == m->surf_h) {
 		menu_compute_rect(m);
 		menu_paint(m);
 		return;
 	}
 
-	if (m->buffer)
-		menu_teardown_buffer(m);
-
-	stride = pw * 4;
-	size   = stride * ph;
-
-	fd     = menu_create_shm(size);
-	if (fd < 0)
-		return;
-
-	m->shm_data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE,
-	                   MAP_SHARED, fd, 0);
-	if (m->shm_data == MAP_FAILED) {
-		close(fd);
-		m->shm_data = NULL;
+	/* rebuilding the content of a menu on its way out would read a layout
+	   that may have changed under it since; it just goes */
+	if (m->state->menu != m) {
+		menu_finalize_destroy(m);
 		return;
 	}
-	m->shm_size = size;
 
-	pool      = wl_shm_create_pool(m->state->shm, fd, size);
-	m->buffer = wl_shm_pool_create_buffer(pool, 0, pw, ph, stride,
-	                                      WL_SHM_FORMAT_ARGB8888);
-	wl_shm_pool_destroy(pool);
-	close(fd);
+	if (m->buf.wl_buffer)
+		menu_teardown_buffer(m);
+
+	if (!m->arena)
+		m->arena = barny_shm_arena_ref(barny_output_arena(m->out));
+	if (barny_buffers_create(&m->buf, 1, m->arena, pw, ph, 1) < 0)
+		return;
 
-	m->cairo_surface = cairo_image_surface_create_for_data(
-	        m->shm_data, CAIRO_FORMAT_ARGB32, pw, ph, stride);
-	m->cr         = cairo_create(m->cairo_surface);
 	m->surf_w     = pw;
 	m->surf_h     = ph;
 	m->configured = true;
@@ -1122,9 +1042,10 @@ barny_menu_open(barny_state_t *state, sni_item_t *item, int anchor_x,
 		return;
 	}
 
-	m->root = barny_dbusmenu_get_layout(state, m->service, m->menu_path);
+	/* prefetched on hover, usually, and then there is nothing to wait for */
+	m->dbusmenu = barny_sni_item_dbusmenu(state, item);
+	m->root     = barny_dbusmenu_layout(m->dbusmenu);
 	if (!m->root || m->root->child_count == 0) {
-		barny_dbusmenu_free(m->root);
 		free(m->service);
 		free(m->menu_path);
 		free(m);
@@ -1134,13 +1055,13 @@ barny_menu_open(barny_state_t *state, sni_item_t *item, int anchor_x,
 	barny_dbusmenu_about_to_show(state, m->service, m->menu_path,
 	                             m->root->id);
 
-	m->stack[0] = m->root;
-	m->depth    = 0;
-	m->font     = barny_popup_font_from(state->config.font, "Sans 11");
+	m->stack[0]    = m->root;
+	m->stack_id[0] = m->root->id;
+	m->depth       = 0;
+	m->font        = barny_popup_font_from(state->config.font, "Sans 11");
 
 	m->surface = wl_compositor_create_surface(state->compositor);
 	if (!m->surface) {
-		barny_dbusmenu_free(m->root);
 		if (m->font)
 			pango_font_description_free(m->font);
 		free(m->service);
@@ -1154,7 +1075,6 @@ barny_menu_open(barny_state_t *state, sni_item_t *item, int anchor_x,
 	        ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, "barny-menu");
 	if (!m->layer_surface) {
 		wl_surface_destroy(m->surface);
-		barny_dbusmenu_free(m->root);
 		if (m->font)
 			pango_font_description_free(m->font);
 		free(m->service);
@@ -1256,6 +1176,7 @@ menu_finalize_destroy(barny_menu_t *m)
 	}
 
 	menu_teardown_buffer(m);
+	barny_shm_arena_unref(m->arena);
 
 	if (m->layer_surface)
 		zwlr_layer_surface_v1_destroy(m->layer_surface);
@@ -1265,7 +1186,6 @@ menu_finalize_destroy(barny_menu_t *m)
 	if (m->font)
 		pango_font_description_free(m->font);
 
-	barny_dbusmenu_free(m->root);
 	free(m->rows);
 	free(m->service);
 	free(m->menu_path);
@@ -1288,8 +1208,8 @@ barny_menu_close(barny_state_t *state)
 
 	/* the caches carry the menu through the close morph; nothing else may
 	   reach it once it is off the state, so it also stops swallowing input */
-	if (!state->config.popup_animations || !m->configured || !m->buffer
-	    || !m->glass_src) {
+	if (!state->config.popup_animations || !m->configured
+	    || !m->buf.wl_buffer || !m->glass_src) {
 		menu_finalize_destroy(m);
 		return;
 	}
@@ -1478,7 +1398,9 @@ barny_menu_pointer_button(barny_state_t *state, uint32_t button,
 		if (m->depth + 1 < MENU_MAX_DEPTH) {
 			barny_dbusmenu_about_to_show(state, m->service,
 			                             m->menu_path, it->id);
-			m->stack[++m->depth] = it;
+			m->depth++;
+			m->stack[m->depth]    = it;
+			m->stack_id[m->depth] = it->id;
 			menu_relayout(m);
 		}
 		return;
@@ -1493,3 +1415,43 @@ barny_menu_key_escape(barny_state_t *state)
 {
 	barny_menu_close(state);
 }
+
+void
+barny_menu_dbusmenu_changed(barny_state_t *state, barny_dbusmenu_t *menu)
+{
+	barny_menu_t      *m = state ? state->menu : NULL;
+	barny_menu_item_t *parent;
+	barny_menu_item_t *found;
+	int                d;
+	int                i;
+
+	if (!m || m->kind != MENU_KIND_SNI || m->dbusmenu != menu)
+		return;
+
+	m->root = barny_dbusmenu_cached(menu);
+	if (!m->root || m->root->child_count == 0) {
+		barny_menu_close(state);
+		return;
+	}
+
+	/* whatever sat below a changed node was replaced: the open submenus
+	   are looked up again by id, as deep as they still go */
+	m->stack[0] = m->root;
+	for (d = 1; d <= m->depth; d++) {
+		parent = m->stack[d - 1];
+		found  = NULL;
+		for (i = 0; i < parent->child_count && !found; i++) {
+			if (parent->children[i].id == m->stack_id[d])
+				found = &parent->children[i];
+		}
+		if (!found) {
+			m->depth = d - 1;
+			break;
+		}
+		m->stack[d] = found;
+	}
+
+	/* the rows are rebuilt; relayout finds the one under the pointer */
+	m->hover = -1;
+	menu_relayout(m);
+}
@@ -38,6 +38,22 @@ barny_modules_init(barny_state_t *state)
 	}
 }
 
+/* A module with a collector gets it run on the executor and publishes once
+   that is done; without an executor (tests, or no threads) both halves run
+   here, back to back, the way a plain update does. */
+void
+barny_module_refresh(barny_state_t *state, barny_module_t *mod)
+{
+	if (mod->collect) {
+		if (state->executor) {
+			barny_executor_submit(state->executor, mod);
+			return;
+		}
+		mod->collect(mod);
+	}
+	mod->update(mod);
+}
+
 void
 barny_modules_update(barny_state_t *state)
 {
@@ -58,7 +74,7 @@ barny_modules_update(barny_state_t *state)
 		               < (uint64_t)mod->update_interval_ms) {
 			continue;
 		}
-		mod->update(mod);
+		barny_module_refresh(state, mod);
 		mod->last_update_ms = t;
 	}
 
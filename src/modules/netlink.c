@@ -0,0 +1,820 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <linux/genetlink.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <linux/rtnetlink.h>
+
+#include "netlink.h"
+#include "util.h"
+
+#define NL_BUF_SIZE   32768
+#define NL_SYNC_MS    200
+#define NL_GENL_MS    200
+#define NL_FAMILY_MIN 1000
+#define NL_FAMILY_MAX 60000
+
+#define NL_DUMP_LINKS 0x1
+#define NL_DUMP_ADDRS 0x2
+
+typedef struct {
+	barny_netlink_link_t pub;
+	char                 ipv6_global[INET6_ADDRSTRLEN];
+	char                 ipv6_link[INET6_ADDRSTRLEN];
+
+	/* filled while a dump runs, applied when it is done */
+	bool                 seen;
+	char                 next_ipv4[INET_ADDRSTRLEN];
+	char                 next_ipv6_global[INET6_ADDRSTRLEN];
+	char                 next_ipv6_link[INET6_ADDRSTRLEN];
+} nl_link_t;
+
+struct barny_netlink {
+	int       fd;
+	int       genl_fd;
+	/* both sockets, so the caller polls one fd */
+	int       epoll_fd;
+	uint32_t  seq;
+
+	/* 0 until looked up, -1 when the kernel has no nl80211. A lookup
+	   that failed for any other reason is retried after a backoff. */
+	int       nl80211_id;
+	uint32_t  family_seq;
+	uint64_t  family_retry_ms;
+	uint64_t  family_backoff_ms;
+
+	/* the SSID request in flight, and the last answer */
+	uint32_t  ssid_seq;
+	uint64_t  ssid_sent_ms;
+	int       ssid_want;
+	int       ssid_index;
+	char      ssid[33];
+
+	/* the running dump (0 when none) and the ones queued behind it */
+	uint32_t  dump_seq;
+	int       dumping;
+	int       pending;
+
+	nl_link_t links[BARNY_NETLINK_MAX_LINKS];
+	int       count;
+	int       changes;
+};
+
+typedef union {
+	struct nlmsghdr nh;
+	char            raw[NL_BUF_SIZE];
+} nl_buf_t;
+
+static void
+genl_drain(barny_netlink_t *nl);
+
+static nl_link_t *
+find_index(barny_netlink_t *nl, int index)
+{
+	int i;
+
+	for (i = 0; i < nl->count; i++) {
+		if (nl->links[i].pub.index == index)
+			return &nl->links[i];
+	}
+
+	return NULL;
+}
+
+static void
+remove_link(barny_netlink_t *nl, nl_link_t *link)
+{
+	int i = (int)(link - nl->links);
+
+	memmove(&nl->links[i], &nl->links[i + 1],
+	        (size_t)(nl->count - i - 1) * sizeof(nl->links[0]));
+	nl->count--;
+	nl->changes |= BARNY_NETLINK_LINKS;
+}
+
+static bool
+is_wireless(const char *name)
+{
+	char path[64];
+
+	snprintf(path, sizeof(path), "/sys/class/net/%s/wireless", name);
+
+	return access(path, F_OK) == 0;
+}
+
+static void
+format_mac(const unsigned char *addr, size_t len, char *out, size_t size)
+{
+	size_t used = 0;
+	size_t i;
+
+	out[0] = '\0';
+	for (i = 0; i < len && used + 3 < size; i++)
+		used += (size_t)snprintf(out + used, size - used, i ? ":%02x" : "%02x",
+		                         addr[i]);
+}
+
+static void
+copy_str(char *dst, size_t size, const char *src)
+{
+	snprintf(dst, size, "%s", src);
+}
+
+static void
+handle_link(barny_netlink_t *nl, const struct nlmsghdr *nh, bool in_dump)
+{
+	const struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	const struct rtattr    *rta;
+	const char             *name     = NULL;
+	const unsigned char    *addr     = NULL;
+	size_t                  addr_len = 0;
+	int                     oper     = -1;
+	struct rtnl_link_stats64 stats64;
+	bool                    have_stats = false;
+	nl_link_t              *link;
+	char                    mac[32];
+	bool                    added = false;
+	int                     len;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifi)))
+		return;
+
+	link = find_index(nl, ifi->ifi_index);
+	if (nh->nlmsg_type == RTM_DELLINK) {
+		if (link)
+			remove_link(nl, link);
+		return;
+	}
+
+	len = (int)IFLA_PAYLOAD(nh);
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFLA_IFNAME:
+			name = RTA_DATA(rta);
+			break;
+		case IFLA_OPERSTATE:
+			oper = *(const unsigned char *)RTA_DATA(rta);
+			break;
+		case IFLA_ADDRESS:
+			addr     = RTA_DATA(rta);
+			addr_len = RTA_PAYLOAD(rta);
+			break;
+		case IFLA_STATS64:
+			if (RTA_PAYLOAD(rta) >= sizeof(stats64)) {
+				memcpy(&stats64, RTA_DATA(rta), sizeof(stats64));
+				have_stats = true;
+			}
+			break;
+		}
+	}
+
+	if (!link) {
+		if (!name || nl->count == BARNY_NETLINK_MAX_LINKS)
+			return;
+		link = &nl->links[nl->count++];
+		memset(link, 0, sizeof(*link));
+		link->pub.index = ifi->ifi_index;
+		added           = true;
+	}
+
+	if (in_dump)
+		link->seen = true;
+
+	if (name && (added || strcmp(name, link->pub.name) != 0)) {
+		copy_str(link->pub.name, sizeof(link->pub.name), name);
+		link->pub.wireless = is_wireless(name);
+		nl->changes       |= BARNY_NETLINK_LINKS;
+	}
+	if (oper >= 0 && (oper == IF_OPER_UP) != link->pub.up) {
+		link->pub.up  = oper == IF_OPER_UP;
+		nl->changes  |= BARNY_NETLINK_LINKS;
+	}
+	if (addr) {
+		format_mac(addr, addr_len, mac, sizeof(mac));
+		if (strcmp(mac, link->pub.mac) != 0) {
+			copy_str(link->pub.mac, sizeof(link->pub.mac), mac);
+			nl->changes |= BARNY_NETLINK_LINKS;
+		}
+	}
+
+	if (have_stats) {
+		link->pub.rx_bytes   = stats64.rx_bytes;
+		link->pub.tx_bytes   = stats64.tx_bytes;
+		link->pub.have_stats = true;
+		clock_gettime(CLOCK_MONOTONIC, &link->pub.stats_at);
+		nl->changes |= BARNY_NETLINK_STATS;
+	}
+}
+
+static void
+publish_ipv6(barny_netlink_t *nl, nl_link_t *link)
+{
+	const char *v6 = link->ipv6_global[0] ? link->ipv6_global
+	                                      : link->ipv6_link;
+
+	if (strcmp(v6, link->pub.ipv6) != 0) {
+		copy_str(link->pub.ipv6, sizeof(link->pub.ipv6), v6);
+		nl->changes |= BARNY_NETLINK_ADDRS;
+	}
+}
+
+/* An address arriving fills its slot only when the slot is empty, which
+   keeps the first one, as getifaddrs order did. One going away empties its
+   slot and queues an address dump to refill it from whatever is left. */
+static void
+handle_addr(barny_netlink_t *nl, const struct nlmsghdr *nh, bool in_dump)
+{
+	const struct ifaddrmsg *ifa = NLMSG_DATA(nh);
+	const struct rtattr    *rta;
+	const void             *local   = NULL;
+	const void             *address = NULL;
+	const void             *bin;
+	char                    text[INET6_ADDRSTRLEN];
+	char                   *slot;
+	size_t                  slot_size;
+	nl_link_t              *link;
+	bool                    del = nh->nlmsg_type == RTM_DELADDR;
+	int                     len;
+
+	if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+		return;
+	if (ifa->ifa_family != AF_INET && ifa->ifa_family != AF_INET6)
+		return;
+
+	link = find_index(nl, (int)ifa->ifa_index);
+	if (!link)
+		return;
+
+	len = (int)IFA_PAYLOAD(nh);
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFA_LOCAL)
+			local = RTA_DATA(rta);
+		else if (rta->rta_type == IFA_ADDRESS)
+			address = RTA_DATA(rta);
+	}
+
+	/* IFA_LOCAL is the interface's own end of a point-to-point v4 link */
+	bin = ifa->ifa_family == AF_INET && local ? local : address;
+	if (!bin || !inet_ntop(ifa->ifa_family, bin, text, sizeof(text)))
+		return;
+
+	if (ifa->ifa_family == AF_INET) {
+		slot      = in_dump ? link->next_ipv4 : link->pub.ipv4;
+		slot_size = INET_ADDRSTRLEN;
+	} else if (IN6_IS_ADDR_LINKLOCAL((const struct in6_addr *)bin)) {
+		slot      = in_dump ? link->next_ipv6_link : link->ipv6_link;
+		slot_size = INET6_ADDRSTRLEN;
+	} else {
+		slot      = in_dump ? link->next_ipv6_global : link->ipv6_global;
+		slot_size = INET6_ADDRSTRLEN;
+	}
+
+	if (del) {
+		if (strcmp(slot, text) != 0)
+			return;
+		slot[0]      = '\0';
+		nl->pending |= NL_DUMP_ADDRS;
+	} else {
+		if (slot[0])
+			return;
+		copy_str(slot, slot_size, text);
+	}
+
+	if (in_dump)
+		return;
+	if (ifa->ifa_family == AF_INET)
+		nl->changes |= BARNY_NETLINK_ADDRS;
+	else
+		publish_ipv6(nl, link);
+}
+
+static void
+start_dump(barny_netlink_t *nl)
+{
+	struct {
+		struct nlmsghdr nh;
+		union {
+			struct ifinfomsg ifi;
+			struct ifaddrmsg ifa;
+		};
+	} req;
+	int kind;
+	int i;
+
+	if (nl->dump_seq || !nl->pending)
+		return;
+
+	kind = (nl->pending & NL_DUMP_LINKS) ? NL_DUMP_LINKS : NL_DUMP_ADDRS;
+
+	memset(&req, 0, sizeof(req));
+	req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nh.nlmsg_seq   = ++nl->seq;
+	if (kind == NL_DUMP_LINKS) {
+		req.nh.nlmsg_type  = RTM_GETLINK;
+		req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifi));
+		req.ifi.ifi_family = AF_UNSPEC;
+	} else {
+		req.nh.nlmsg_type  = RTM_GETADDR;
+		req.nh.nlmsg_len   = NLMSG_LENGTH(sizeof(req.ifa));
+		req.ifa.ifa_family = AF_UNSPEC;
+	}
+
+	/* a full socket buffer keeps it queued for the next dispatch */
+	if (send(nl->fd, &req, req.nh.nlmsg_len, 0) < 0)
+		return;
+
+	nl->pending  &= ~kind;
+	nl->dumping   = kind;
+	nl->dump_seq  = req.nh.nlmsg_seq;
+
+	for (i = 0; i < nl->count; i++) {
+		nl->links[i].seen                = false;
+		nl->links[i].next_ipv4[0]        = '\0';
+		nl->links[i].next_ipv6_global[0] = '\0';
+		nl->links[i].next_ipv6_link[0]   = '\0';
+	}
+}
+
+static void
+finish_dump(barny_netlink_t *nl, bool complete)
+{
+	nl_link_t *link;
+	int        i;
+
+	if (!complete) {
+		nl->pending |= nl->dumping;
+	} else if (nl->dumping == NL_DUMP_LINKS) {
+		/* whatever the dump did not mention is gone; only matters after
+		   a lost notification */
+		for (i = nl->count - 1; i >= 0; i--) {
+			if (!nl->links[i].seen)
+				remove_link(nl, &nl->links[i]);
+		}
+	} else {
+		for (i = 0; i < nl->count; i++) {
+			link = &nl->links[i];
+			if (strcmp(link->next_ipv4, link->pub.ipv4) != 0) {
+				copy_str(link->pub.ipv4, sizeof(link->pub.ipv4),
+				         link->next_ipv4);
+				nl->changes |= BARNY_NETLINK_ADDRS;
+			}
+			copy_str(link->ipv6_global, sizeof(link->ipv6_global),
+			         link->next_ipv6_global);
+			copy_str(link->ipv6_link, sizeof(link->ipv6_link),
+			         link->next_ipv6_link);
+			publish_ipv6(nl, link);
+		}
+	}
+
+	nl->dump_seq = 0;
+	nl->dumping  = 0;
+}
+
+static void
+handle_msg(barny_netlink_t *nl, const struct nlmsghdr *nh)
+{
+	bool in_dump = nl->dump_seq && nh->nlmsg_seq == nl->dump_seq;
+
+	switch (nh->nlmsg_type) {
+	case NLMSG_DONE:
+		if (in_dump)
+			finish_dump(nl, !(nh->nlmsg_flags & NLM_F_DUMP_INTR));
+		break;
+	case NLMSG_ERROR:
+		if (in_dump)
+			finish_dump(nl, false);
+		break;
+	case RTM_NEWLINK:
+	case RTM_DELLINK:
+		handle_link(nl, nh, in_dump && nl->dumping == NL_DUMP_LINKS);
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		handle_addr(nl, nh, in_dump && nl->dumping == NL_DUMP_ADDRS);
+		break;
+	}
+}
+
+int
+barny_netlink_dispatch(barny_netlink_t *nl)
+{
+	nl_buf_t               buf;
+	const struct nlmsghdr *nh;
+	ssize_t                n;
+	size_t                 left;
+	int                    changes;
+
+	if (!nl)
+		return 0;
+
+	for (;;) {
+		n = recv(nl->fd, &buf, sizeof(buf), 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			/* notifications were dropped: start over from dumps */
+			if (errno == ENOBUFS) {
+				nl->pending |= NL_DUMP_LINKS | NL_DUMP_ADDRS;
+				continue;
+			}
+			break;
+		}
+		if (n == 0)
+			break;
+
+		left = (size_t)n;
+		for (nh = &buf.nh; NLMSG_OK(nh, left); nh = NLMSG_NEXT(nh, left))
+			handle_msg(nl, nh);
+	}
+
+	genl_drain(nl);
+	start_dump(nl);
+
+	changes     = nl->changes;
+	nl->changes = 0;
+	return changes;
+}
+
+static int
+watch_fd(barny_netlink_t *nl, int fd)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+
+	return epoll_ctl(nl->epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+barny_netlink_t *
+barny_netlink_open(void)
+{
+	barny_netlink_t   *nl;
+	struct sockaddr_nl addr;
+	struct pollfd      pfd;
+	uint64_t           deadline;
+	uint64_t           now;
+
+	nl = calloc(1, sizeof(*nl));
+	if (!nl)
+		return NULL;
+
+	nl->genl_fd  = -1;
+	nl->epoll_fd = -1;
+	nl->fd       = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	                     NETLINK_ROUTE);
+	if (nl->fd < 0) {
+		fprintf(stderr, "barny: rtnetlink socket: %s\n", strerror(errno));
+		free(nl);
+		return NULL;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+	if (bind(nl->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "barny: rtnetlink bind: %s\n", strerror(errno));
+		close(nl->fd);
+		free(nl);
+		return NULL;
+	}
+
+	/* without generic netlink there is no SSID, nothing else is lost */
+	nl->genl_fd  = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	                      NETLINK_GENERIC);
+	nl->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (nl->genl_fd < 0 || nl->epoll_fd < 0 || watch_fd(nl, nl->fd) < 0
+	    || watch_fd(nl, nl->genl_fd) < 0) {
+		if (nl->genl_fd >= 0)
+			close(nl->genl_fd);
+		if (nl->epoll_fd >= 0)
+			close(nl->epoll_fd);
+		nl->genl_fd  = -1;
+		nl->epoll_fd = -1;
+	}
+
+	nl->pending = NL_DUMP_LINKS | NL_DUMP_ADDRS;
+	start_dump(nl);
+
+	deadline = barny_now_ms() + NL_SYNC_MS;
+	pfd      = (struct pollfd){ .fd = nl->fd, .events = POLLIN };
+	while (nl->dump_seq || nl->pending) {
+		now = barny_now_ms();
+		if (now >= deadline || poll(&pfd, 1, (int)(deadline - now)) <= 0)
+			break;
+		barny_netlink_dispatch(nl);
+	}
+	nl->changes = 0;
+
+	return nl;
+}
+
+void
+barny_netlink_close(barny_netlink_t *nl)
+{
+	if (!nl)
+		return;
+
+	if (nl->epoll_fd >= 0)
+		close(nl->epoll_fd);
+	if (nl->genl_fd >= 0)
+		close(nl->genl_fd);
+	close(nl->fd);
+	free(nl);
+}
+
+int
+barny_netlink_fd(const barny_netlink_t *nl)
+{
+	if (!nl)
+		return -1;
+
+	return nl->epoll_fd >= 0 ? nl->epoll_fd : nl->fd;
+}
+
+void
+barny_netlink_request_stats(barny_netlink_t *nl)
+{
+	if (!nl)
+		return;
+
+	nl->pending |= NL_DUMP_LINKS;
+	start_dump(nl);
+}
+
+int
+barny_netlink_link_count(const barny_netlink_t *nl)
+{
+	return nl ? nl->count : 0;
+}
+
+const barny_netlink_link_t *
+barny_netlink_link_at(const barny_netlink_t *nl, int i)
+{
+	if (!nl || i < 0 || i >= nl->count)
+		return NULL;
+
+	return &nl->links[i].pub;
+}
+
+const barny_netlink_link_t *
+barny_netlink_find(const barny_netlink_t *nl, const char *name)
+{
+	int i;
+
+	if (!nl || !name)
+		return NULL;
+
+	for (i = 0; i < nl->count; i++) {
+		if (strcmp(nl->links[i].pub.name, name) == 0)
+			return &nl->links[i].pub;
+	}
+
+	return NULL;
+}
+
+static void
+put_attr(struct nlmsghdr *nh, uint16_t type, const void *data, size_t len)
+{
+	struct nlattr *a = (struct nlattr *)((char *)nh
+	                                     + NLMSG_ALIGN(nh->nlmsg_len));
+
+	a->nla_type = type;
+	a->nla_len  = (uint16_t)(NLA_HDRLEN + len);
+	memcpy((char *)a + NLA_HDRLEN, data, len);
+	nh->nlmsg_len = NLMSG_ALIGN(nh->nlmsg_len) + NLA_ALIGN(a->nla_len);
+}
+
+static const struct nlattr *
+genl_attr(const struct nlmsghdr *nh, uint16_t type)
+{
+	const char          *p   = (const char *)NLMSG_DATA(nh) + GENL_HDRLEN;
+	const char          *end = (const char *)nh + nh->nlmsg_len;
+	const struct nlattr *a;
+
+	while (p + NLA_HDRLEN <= end) {
+		a = (const struct nlattr *)p;
+		if (a->nla_len < NLA_HDRLEN || p + a->nla_len > end)
+			break;
+		if ((a->nla_type & NLA_TYPE_MASK) == type)
+			return a;
+		p += NLA_ALIGN(a->nla_len);
+	}
+
+	return NULL;
+}
+
+static void
+genl_init(struct nlmsghdr *nh, uint16_t family, uint8_t cmd, uint8_t version)
+{
+	struct genlmsghdr *g = NLMSG_DATA(nh);
+
+	nh->nlmsg_len  = NLMSG_LENGTH(GENL_HDRLEN);
+	nh->nlmsg_type = family;
+	g->cmd         = cmd;
+	g->version     = version;
+	g->reserved    = 0;
+}
+
+/* Sends without waiting; the reply is picked up by genl_drain. Returns the
+   request's seq, or 0 when it could not be sent. */
+static uint32_t
+genl_send(barny_netlink_t *nl, struct nlmsghdr *req)
+{
+	if (nl->genl_fd < 0)
+		return 0;
+
+	req->nlmsg_flags = NLM_F_REQUEST;
+	req->nlmsg_seq   = ++nl->seq;
+	if (nl->seq == 0)
+		req->nlmsg_seq = ++nl->seq;
+	if (send(nl->genl_fd, req, req->nlmsg_len, MSG_DONTWAIT) < 0)
+		return 0;
+
+	return req->nlmsg_seq;
+}
+
+static void
+family_failed(barny_netlink_t *nl, int err)
+{
+	nl->family_seq = 0;
+
+	/* not built or not loaded: it will not appear under a running bar */
+	if (err == ENOENT) {
+		nl->nl80211_id = -1;
+		return;
+	}
+
+	nl->family_backoff_ms = nl->family_backoff_ms
+	                                ? nl->family_backoff_ms * 2
+	                                : NL_FAMILY_MIN;
+	if (nl->family_backoff_ms > NL_FAMILY_MAX)
+		nl->family_backoff_ms = NL_FAMILY_MAX;
+	nl->family_retry_ms = barny_now_ms() + nl->family_backoff_ms;
+	barny_debug("nl80211 lookup failed (%s), retrying in %llu ms\n",
+	            strerror(err), (unsigned long long)nl->family_backoff_ms);
+}
+
+static void
+request_family(barny_netlink_t *nl)
+{
+	union {
+		struct nlmsghdr nh;
+		char            raw[256];
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	genl_init(&req.nh, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 1);
+	put_attr(&req.nh, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME,
+	         sizeof(NL80211_GENL_NAME));
+
+	nl->family_seq = genl_send(nl, &req.nh);
+	if (!nl->family_seq)
+		family_failed(nl, errno);
+}
+
+static void
+request_interface(barny_netlink_t *nl)
+{
+	union {
+		struct nlmsghdr nh;
+		char            raw[256];
+	} req;
+	uint32_t index = (uint32_t)nl->ssid_want;
+
+	memset(&req, 0, sizeof(req));
+	genl_init(&req.nh, (uint16_t)nl->nl80211_id, NL80211_CMD_GET_INTERFACE,
+	          0);
+	put_attr(&req.nh, NL80211_ATTR_IFINDEX, &index, sizeof(index));
+
+	nl->ssid_seq     = genl_send(nl, &req.nh);
+	nl->ssid_sent_ms = barny_now_ms();
+}
+
+static void
+set_ssid(barny_netlink_t *nl, int index, const struct nlattr *a)
+{
+	char   ssid[sizeof(nl->ssid)] = "";
+	size_t len;
+
+	if (a) {
+		len = a->nla_len - NLA_HDRLEN;
+		if (len > sizeof(ssid) - 1)
+			len = sizeof(ssid) - 1;
+		memcpy(ssid, (const char *)a + NLA_HDRLEN, len);
+		ssid[len] = '\0';
+	}
+
+	if (index != nl->ssid_index || strcmp(ssid, nl->ssid) != 0)
+		nl->changes |= BARNY_NETLINK_SSID;
+	nl->ssid_index = index;
+	memcpy(nl->ssid, ssid, sizeof(ssid));
+}
+
+static void
+handle_genl(barny_netlink_t *nl, const struct nlmsghdr *nh)
+{
+	const struct nlmsgerr *err = NLMSG_DATA(nh);
+	const struct nlattr   *a;
+	int                    index;
+
+	if (nh->nlmsg_seq == 0)
+		return;
+
+	if (nh->nlmsg_seq == nl->family_seq) {
+		if (nh->nlmsg_type == NLMSG_ERROR) {
+			family_failed(nl, -err->error);
+			return;
+		}
+		a = genl_attr(nh, CTRL_ATTR_FAMILY_ID);
+		if (!a || a->nla_len < NLA_HDRLEN + sizeof(uint16_t)) {
+			family_failed(nl, EPROTO);
+			return;
+		}
+		nl->family_seq        = 0;
+		nl->family_backoff_ms = 0;
+		nl->nl80211_id
+		        = *(const uint16_t *)((const char *)a + NLA_HDRLEN);
+		if (nl->ssid_want)
+			request_interface(nl);
+	} else if (nh->nlmsg_seq == nl->ssid_seq) {
+		index         = nl->ssid_want;
+		nl->ssid_seq  = 0;
+		nl->ssid_want = 0;
+		/* an error is most often a link that is not wireless after all */
+		set_ssid(nl, index,
+		         nh->nlmsg_type == NLMSG_ERROR
+		                 ? NULL
+		                 : genl_attr(nh, NL80211_ATTR_SSID));
+	}
+	/* anything else answers a request that was given up on */
+}
+
+static void
+genl_drain(barny_netlink_t *nl)
+{
+	nl_buf_t               buf;
+	const struct nlmsghdr *nh;
+	ssize_t                n;
+	size_t                 left;
+
+	if (nl->genl_fd < 0)
+		return;
+
+	for (;;) {
+		n = recv(nl->genl_fd, &buf, sizeof(buf), MSG_DONTWAIT);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+
+		left = (size_t)n;
+		for (nh = &buf.nh; NLMSG_OK(nh, left); nh = NLMSG_NEXT(nh, left))
+			handle_genl(nl, nh);
+	}
+}
+
+void
+barny_netlink_request_ssid(barny_netlink_t *nl, int ifindex)
+{
+	if (!nl || nl->genl_fd < 0 || ifindex <= 0)
+		return;
+
+	/* the kernel answers right away; one that did not is given up on */
+	if (nl->ssid_seq && barny_now_ms() - nl->ssid_sent_ms < NL_GENL_MS)
+		return;
+	nl->ssid_seq  = 0;
+	nl->ssid_want = ifindex;
+
+	if (nl->nl80211_id < 0)
+		return;
+	if (nl->nl80211_id > 0) {
+		request_interface(nl);
+		return;
+	}
+	if (!nl->family_seq && barny_now_ms() >= nl->family_retry_ms)
+		request_family(nl);
+}
+
+bool
+barny_netlink_ssid(const barny_netlink_t *nl, int ifindex, char *buf,
+                   size_t size)
+{
+	if (!buf || size == 0)
+		return false;
+	buf[0] = '\0';
+	if (!nl || ifindex <= 0 || nl->ssid_index != ifindex)
+		return false;
+
+	snprintf(buf, size, "%s", nl->ssid);
+	return buf[0] != '\0';
+}
@@ -0,0 +1,79 @@
+#ifndef BARNY_NETLINK_H
+#define BARNY_NETLINK_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <time.h>
+
+#define BARNY_NETLINK_MAX_LINKS 64
+
+/* what a dispatch saw, so the caller repaints only for what moved */
+#define BARNY_NETLINK_LINKS 0x1
+#define BARNY_NETLINK_ADDRS 0x2
+#define BARNY_NETLINK_STATS 0x4
+#define BARNY_NETLINK_SSID  0x8
+
+/* The kernel's view of the network on one rtnetlink socket: link and
+   address notifications keep the table current as they happen, and a link
+   dump per tick refreshes every counter at once (IFLA_STATS64). Only one
+   dump can run on a socket, so requests queue behind the running one. */
+typedef struct barny_netlink barny_netlink_t;
+
+typedef struct {
+	int                index;
+	char               name[IF_NAMESIZE];
+	bool               up;
+	bool               wireless;
+	char               mac[32];
+	/* the first IPv4, the first global IPv6 or else a link-local one */
+	char               ipv4[INET_ADDRSTRLEN];
+	char               ipv6[INET6_ADDRSTRLEN];
+	bool               have_stats;
+	unsigned long long rx_bytes;
+	unsigned long long tx_bytes;
+	struct timespec    stats_at;
+} barny_netlink_link_t;
+
+/* Opens the sockets and waits (briefly) for the first link and address
+   dumps, so the table is filled before the first frame. */
+barny_netlink_t *
+barny_netlink_open(void);
+
+void
+barny_netlink_close(barny_netlink_t *nl);
+
+/* One fd to poll for both the rtnetlink and the nl80211 replies */
+int
+barny_netlink_fd(const barny_netlink_t *nl);
+
+/* Drains the sockets without blocking; returns BARNY_NETLINK_* bits. */
+int
+barny_netlink_dispatch(barny_netlink_t *nl);
+
+/* Queues a link dump; the counters land with a later dispatch. */
+void
+barny_netlink_request_stats(barny_netlink_t *nl);
+
+int
+barny_netlink_link_count(const barny_netlink_t *nl);
+
+const barny_netlink_link_t *
+barny_netlink_link_at(const barny_netlink_t *nl, int i);
+
+const barny_netlink_link_t *
+barny_netlink_find(const barny_netlink_t *nl, const char *name);
+
+/* Asks nl80211 for the SSID the interface is associated with, without
+   waiting: the answer lands with a later dispatch, which reports
+   BARNY_NETLINK_SSID when it changed. The nl80211 family is looked up on
+   the first request; a kernel without it is not asked again. */
+void
+barny_netlink_request_ssid(barny_netlink_t *nl, int ifindex);
+
+/* The last SSID reported for ifindex; empty until one has come in. */
+bool
+barny_netlink_ssid(const barny_netlink_t *nl, int ifindex, char *buf,
+                   size_t size);
+
+#endif
@@ -2,18 +2,33 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <dirent.h>
-#include <ifaddrs.h>
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <netinet/in.h>
 
 #include "barny.h"
+#include "netlink.h"
 #include "popup.h"
 
 #define POPUP_LINE_H    24
 #define POPUP_MIN_WIDTH 260
 
+/* the interface the bar shows, picked out of the netlink table */
+typedef struct {
+	bool               online;
+	char               iface[32];
+	char               ip[64];
+	char               iface_type[16];
+	char               ssid[64];
+	char               ipv4[INET_ADDRSTRLEN];
+	char               ipv6[INET6_ADDRSTRLEN];
+	char               mac[32];
+	bool               have_bytes;
+	unsigned long long rx_bytes;
+	unsigned long long tx_bytes;
+	struct timespec    at;
+} network_sample_t;
+
 typedef struct {
 	barny_state_t        *state;
 	barny_module_t       *self;
@@ -37,36 +52,16 @@ typedef struct {
 	struct timespec       last_sample;
 	bool                  have_last_sample;
 
+	barny_netlink_t      *nl;
 	char                  cached_ssid_iface[32];
-	char                  cached_mac_iface[32];
 	struct timespec       last_ssid_fetch;
+	network_sample_t      sample;
 
 	barny_popup_t        *popup;
 } network_data_t;
 
 #define SSID_REFRESH_MS 30000
 
-static bool
-is_interface_up(const char *iface)
-{
-	char  path[256];
-	FILE *f;
-	char  state[32] = "";
-
-	snprintf(path, sizeof(path), "/sys/class/net/%s/operstate", iface);
-
-	f = fopen(path, "r");
-	if (!f)
-		return false;
-
-	if (fgets(state, sizeof(state), f)) {
-		state[strcspn(state, "\n")] = '\0';
-	}
-	fclose(f);
-
-	return strcmp(state, "up") == 0;
-}
-
 static bool
 is_physical_interface(const char *iface)
 {
@@ -84,187 +79,46 @@ is_physical_interface(const char *iface)
 	return true;
 }
 
-static bool
-find_active_interface(char *iface, size_t iface_len)
+/* a wired link beats a wireless one; anything virtual is ignored */
+static const barny_netlink_link_t *
+find_active_link(const barny_netlink_t *nl)
 {
-	DIR           *dir;
-	char           eth_iface[32]  = "";
-	char           wifi_iface[32] = "";
-	struct dirent *ent;
-	size_t         namelen;
-	size_t         len;
-
-	dir = opendir("/sys/class/net");
-	if (!dir)
-		return false;
-
-	while ((ent = readdir(dir)) != NULL) {
-		if (ent->d_name[0] == '.')
-			continue;
-		if (!is_physical_interface(ent->d_name))
-			continue;
-		if (!is_interface_up(ent->d_name))
-			continue;
-
-		namelen = strlen(ent->d_name);
-		if (namelen >= sizeof(eth_iface))
+	const barny_netlink_link_t *link;
+	const barny_netlink_link_t *eth  = NULL;
+	const barny_netlink_link_t *wifi = NULL;
+	int                         i;
+
+	for (i = 0; i < barny_netlink_link_count(nl); i++) {
+		link = barny_netlink_link_at(nl, i);
+		if (!link->up || !is_physical_interface(link->name))
 			continue;
 
-		if (strncmp(ent->d_name, "eth", 3) == 0
-		    || strncmp(ent->d_name, "en", 2) == 0) {
-			memcpy(eth_iface, ent->d_name, namelen + 1);
-		} else if (strncmp(ent->d_name, "wlan", 4) == 0
-		           || strncmp(ent->d_name, "wl", 2) == 0) {
-			memcpy(wifi_iface, ent->d_name, namelen + 1);
+		if (strncmp(link->name, "eth", 3) == 0
+		    || strncmp(link->name, "en", 2) == 0) {
+			if (!eth)
+				eth = link;
+		} else if (strncmp(link->name, "wlan", 4) == 0
+		           || strncmp(link->name, "wl", 2) == 0) {
+			if (!wifi)
+				wifi = link;
 		}
 	}
-	closedir(dir);
 
-	if (eth_iface[0]) {
-		len = strlen(eth_iface);
-		if (len < iface_len) {
-			memcpy(iface, eth_iface, len + 1);
-			return true;
-		}
-	}
-	if (wifi_iface[0]) {
-		len = strlen(wifi_iface);
-		if (len < iface_len) {
-			memcpy(iface, wifi_iface, len + 1);
-			return true;
-		}
-	}
-
-	return false;
+	return eth ? eth : wifi;
 }
 
 static void
-collect_interface_addrs(const char *iface, char *ipv4, size_t ipv4_len,
-                        char *ipv6, size_t ipv6_len)
-{
-	struct ifaddrs *ifaddr, *ifa;
-	char            ipv6_global[INET6_ADDRSTRLEN] = "";
-	char            ipv6_link[INET6_ADDRSTRLEN]   = "";
-	int             family;
-	const char     *src;
-
-	if (ipv4 && ipv4_len)
-		ipv4[0] = '\0';
-	if (ipv6 && ipv6_len)
-		ipv6[0] = '\0';
-
-	if (getifaddrs(&ifaddr) == -1)
-		return;
-
-	for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-		if (ifa->ifa_addr == NULL)
-			continue;
-		if (strcmp(ifa->ifa_name, iface) != 0)
-			continue;
-
-		family = ifa->ifa_addr->sa_family;
-
-		if (family == AF_INET && ipv4 && ipv4_len) {
-			struct sockaddr_in *addr
-			        = (struct sockaddr_in *)ifa->ifa_addr;
-			char buf[INET_ADDRSTRLEN] = "";
-			inet_ntop(AF_INET, &addr->sin_addr, buf, sizeof(buf));
-			if (buf[0]) {
-				strncpy(ipv4, buf, ipv4_len - 1);
-				ipv4[ipv4_len - 1] = '\0';
-			}
-		} else if (family == AF_INET6) {
-			struct sockaddr_in6 *addr
-			        = (struct sockaddr_in6 *)ifa->ifa_addr;
-			char buf[INET6_ADDRSTRLEN] = "";
-			inet_ntop(AF_INET6, &addr->sin6_addr, buf, sizeof(buf));
-			if (!buf[0])
-				continue;
-			if (IN6_IS_ADDR_LINKLOCAL(&addr->sin6_addr)) {
-				if (!ipv6_link[0]) {
-					strncpy(ipv6_link, buf,
-					        sizeof(ipv6_link) - 1);
-					ipv6_link[sizeof(ipv6_link) - 1] = '\0';
-				}
-			} else {
-				if (!ipv6_global[0]) {
-					strncpy(ipv6_global, buf,
-					        sizeof(ipv6_global) - 1);
-					ipv6_global[sizeof(ipv6_global) - 1]
-					        = '\0';
-				}
-			}
-		}
-	}
-
-	freeifaddrs(ifaddr);
-
-	if (ipv6 && ipv6_len) {
-		src = ipv6_global[0] ? ipv6_global : ipv6_link;
-		if (src[0]) {
-			strncpy(ipv6, src, ipv6_len - 1);
-			ipv6[ipv6_len - 1] = '\0';
-		}
-	}
-}
-
-static bool
-get_interface_ip(const char *iface, char *ip, size_t ip_len, bool prefer_ipv4)
+pick_ip(const barny_netlink_link_t *link, char *ip, size_t ip_len,
+        bool prefer_ipv4)
 {
-	char ipv4[INET_ADDRSTRLEN]  = "";
-	char ipv6[INET6_ADDRSTRLEN] = "";
-
-	collect_interface_addrs(iface, ipv4, sizeof(ipv4), ipv6, sizeof(ipv6));
+	const char *first  = prefer_ipv4 ? link->ipv4 : link->ipv6;
+	const char *second = prefer_ipv4 ? link->ipv6 : link->ipv4;
 
-	if (prefer_ipv4) {
-		if (ipv4[0]) {
-			strncpy(ip, ipv4, ip_len - 1);
-			ip[ip_len - 1] = '\0';
-			return true;
-		}
-		if (ipv6[0]) {
-			strncpy(ip, ipv6, ip_len - 1);
-			ip[ip_len - 1] = '\0';
-			return true;
-		}
-	} else {
-		if (ipv6[0]) {
-			strncpy(ip, ipv6, ip_len - 1);
-			ip[ip_len - 1] = '\0';
-			return true;
-		}
-		if (ipv4[0]) {
-			strncpy(ip, ipv4, ip_len - 1);
-			ip[ip_len - 1] = '\0';
-			return true;
-		}
-	}
-
-	return false;
-}
-
-static bool
-iface_is_wireless(const char *iface)
-{
-	char path[256];
-	DIR *d;
-
-	if (!iface || !iface[0])
-		return false;
-
-	snprintf(path, sizeof(path), "/sys/class/net/%s/wireless", iface);
-
-	d = opendir(path);
-	if (d) {
-		closedir(d);
-		return true;
-	}
-
-	return false;
+	snprintf(ip, ip_len, "%s", first[0] ? first : second);
 }
 
 static void
-classify_iface(const char *iface, char *out, size_t out_len)
+classify_iface(const char *iface, bool wireless, char *out, size_t out_len)
 {
 	if (!out || out_len == 0)
 		return;
@@ -274,7 +128,7 @@ classify_iface(const char *iface, char *out, size_t out_len)
 		out[out_len - 1] = '\0';
 		return;
 	}
-	if (iface_is_wireless(iface)) {
+	if (wireless) {
 		strncpy(out, "wifi", out_len - 1);
 	} else if (strncmp(iface, "eth", 3) == 0
 	           || strncmp(iface, "en", 2) == 0) {
@@ -285,103 +139,6 @@ classify_iface(const char *iface, char *out, size_t out_len)
 	out[out_len - 1] = '\0';
 }
 
-static void
-read_mac(const char *iface, char *out, size_t out_len)
-{
-	char  path[256];
-	FILE *f;
-
-	if (!out || out_len == 0)
-		return;
-	out[0] = '\0';
-	if (!iface || !iface[0])
-		return;
-
-	snprintf(path, sizeof(path), "/sys/class/net/%s/address", iface);
-
-	f = fopen(path, "r");
-	if (!f)
-		return;
-	if (fgets(out, (int)out_len, f)) {
-		out[strcspn(out, "\n")] = '\0';
-	}
-	fclose(f);
-}
-
-static void
-read_ssid(const char *iface, char *out, size_t out_len)
-{
-	char  cmd[128];
-	FILE *p;
-	char  line[256];
-	char *s;
-	char *val;
-
-	if (!out || out_len == 0)
-		return;
-	out[0] = '\0';
-	if (!iface || !iface[0])
-		return;
-	if (!iface_is_wireless(iface))
-		return;
-
-	snprintf(cmd, sizeof(cmd), "iw dev %s link 2>/dev/null", iface);
-
-	p = popen(cmd, "r");
-	if (!p)
-		return;
-
-	while (fgets(line, sizeof(line), p)) {
-		s = line;
-		while (*s == ' ' || *s == '\t')
-			s++;
-		if (strncmp(s, "SSID:", 5) == 0) {
-			val = s + 5;
-			while (*val == ' ' || *val == '\t')
-				val++;
-			val[strcspn(val, "\r\n")] = '\0';
-			strncpy(out, val, out_len - 1);
-			out[out_len - 1] = '\0';
-			break;
-		}
-	}
-	pclose(p);
-}
-
-static bool
-read_iface_bytes(const char *iface, unsigned long long *rx,
-                 unsigned long long *tx)
-{
-	char  path[256];
-	FILE *f;
-
-	if (!iface || !iface[0])
-		return false;
-
-	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/rx_bytes",
-	         iface);
-	f = fopen(path, "r");
-	if (!f)
-		return false;
-	if (fscanf(f, "%llu", rx) != 1) {
-		fclose(f);
-		return false;
-	}
-	fclose(f);
-
-	snprintf(path, sizeof(path), "/sys/class/net/%s/statistics/tx_bytes",
-	         iface);
-	f = fopen(path, "r");
-	if (!f)
-		return false;
-	if (fscanf(f, "%llu", tx) != 1) {
-		fclose(f);
-		return false;
-	}
-	fclose(f);
-	return true;
-}
-
 static void
 format_speed(double bps, char *out, size_t out_len)
 {
@@ -399,112 +156,128 @@ format_speed(double bps, char *out, size_t out_len)
 	}
 }
 
-static bool
-refresh_popup_data(network_data_t *data)
+/* Reads nothing from the system: the netlink table is already current. The
+   SSID is the only thing asked for, when the interface or its link state
+   changed, and otherwise every SSID_REFRESH_MS in case of a roam; the
+   answer comes back through dispatch and samples again. */
+static void
+network_sample(network_data_t *data, bool links_changed)
 {
-	bool               changed                    = false;
-	char               new_type[16]               = "";
-	char               new_ssid[64]               = "";
-	char               new_ipv4[INET_ADDRSTRLEN]  = "";
-	char               new_ipv6[INET6_ADDRSTRLEN] = "";
-	char               new_mac[32]                = "";
-	bool               iface_mac_stale;
-	bool               iface_ssid_stale;
-	struct timespec    now;
-	long               ssid_age_ms;
-	unsigned long long rx = 0, tx = 0;
-	double             elapsed;
-	double             rx_bps;
-	double             tx_bps;
-	char               rx_str[32];
-	char               tx_str[32];
-
-	classify_iface(data->current_iface, new_type, sizeof(new_type));
-	if (strcmp(new_type, data->iface_type) != 0) {
-		strncpy(data->iface_type, new_type, sizeof(data->iface_type) - 1);
-		data->iface_type[sizeof(data->iface_type) - 1] = '\0';
-		changed                                        = true;
+	barny_config_t             *cfg       = &data->state->config;
+	network_sample_t           *prev      = &data->sample;
+	const char                 *cfg_iface = cfg->network_interface;
+	const barny_netlink_link_t *link;
+	network_sample_t            s;
+	struct timespec             now;
+	long                        ssid_age_ms;
+
+	memset(&s, 0, sizeof(s));
+
+	if (cfg_iface && cfg_iface[0] && strcmp(cfg_iface, "auto") != 0) {
+		strncpy(s.iface, cfg_iface, sizeof(s.iface) - 1);
+		link     = barny_netlink_find(data->nl, cfg_iface);
+		s.online = link && link->up;
+	} else {
+		link     = find_active_link(data->nl);
+		s.online = link != NULL;
+		if (link)
+			snprintf(s.iface, sizeof(s.iface), "%s", link->name);
 	}
 
-	if (data->is_online && data->current_iface[0]) {
-		collect_interface_addrs(data->current_iface, new_ipv4,
-		                        sizeof(new_ipv4), new_ipv6,
-		                        sizeof(new_ipv6));
-
-		iface_mac_stale = strcmp(data->cached_mac_iface,
-		                         data->current_iface)
-		                  != 0;
-		if (iface_mac_stale) {
-			read_mac(data->current_iface, new_mac, sizeof(new_mac));
-			strncpy(data->cached_mac_iface, data->current_iface,
-			        sizeof(data->cached_mac_iface) - 1);
-			data->cached_mac_iface[sizeof(data->cached_mac_iface) - 1]
-			        = '\0';
-		} else {
-			strncpy(new_mac, data->mac, sizeof(new_mac) - 1);
-			new_mac[sizeof(new_mac) - 1] = '\0';
-		}
+	if (s.online && cfg->network_show_ip)
+		pick_ip(link, s.ip, sizeof(s.ip), cfg->network_prefer_ipv4);
+
+	classify_iface(s.iface, link && link->wireless, s.iface_type,
+	               sizeof(s.iface_type));
+
+	if (s.online) {
+		memcpy(s.ipv4, link->ipv4, sizeof(s.ipv4));
+		memcpy(s.ipv6, link->ipv6, sizeof(s.ipv6));
+		snprintf(s.mac, sizeof(s.mac), "%s", link->mac);
 
-		iface_ssid_stale = strcmp(data->cached_ssid_iface,
-		                          data->current_iface)
-		                   != 0;
 		clock_gettime(CLOCK_MONOTONIC, &now);
 		ssid_age_ms = (now.tv_sec - data->last_ssid_fetch.tv_sec) * 1000
 		              + (now.tv_nsec - data->last_ssid_fetch.tv_nsec)
 		                        / 1000000;
-		if (iface_ssid_stale || ssid_age_ms > SSID_REFRESH_MS) {
-			read_ssid(data->current_iface, new_ssid, sizeof(new_ssid));
-			strncpy(data->cached_ssid_iface, data->current_iface,
+		if (!link->wireless) {
+			data->cached_ssid_iface[0] = '\0';
+		} else if (links_changed
+		           || strcmp(data->cached_ssid_iface, s.iface) != 0
+		           || ssid_age_ms > SSID_REFRESH_MS) {
+			barny_netlink_request_ssid(data->nl, link->index);
+			strncpy(data->cached_ssid_iface, s.iface,
 			        sizeof(data->cached_ssid_iface) - 1);
 			data->cached_ssid_iface[sizeof(data->cached_ssid_iface) - 1]
 			        = '\0';
 			data->last_ssid_fetch = now;
-		} else {
-			strncpy(new_ssid, data->ssid, sizeof(new_ssid) - 1);
-			new_ssid[sizeof(new_ssid) - 1] = '\0';
 		}
+		barny_netlink_ssid(data->nl, link->index, s.ssid, sizeof(s.ssid));
+
+		s.have_bytes = link->have_stats;
+		s.rx_bytes   = link->rx_bytes;
+		s.tx_bytes   = link->tx_bytes;
+		s.at         = link->stats_at;
 	} else {
 		data->cached_ssid_iface[0] = '\0';
-		data->cached_mac_iface[0]  = '\0';
 	}
 
-	if (strcmp(new_ipv4, data->ipv4) != 0) {
-		strncpy(data->ipv4, new_ipv4, sizeof(data->ipv4) - 1);
+	*prev = s;
+}
+
+static bool
+publish_popup_data(network_data_t *data, const network_sample_t *s)
+{
+	bool   changed = false;
+	double elapsed;
+	double rx_bps;
+	double tx_bps;
+	char   rx_str[32];
+	char   tx_str[32];
+
+	if (strcmp(s->iface_type, data->iface_type) != 0) {
+		strncpy(data->iface_type, s->iface_type,
+		        sizeof(data->iface_type) - 1);
+		data->iface_type[sizeof(data->iface_type) - 1] = '\0';
+		changed                                        = true;
+	}
+
+	if (strcmp(s->ipv4, data->ipv4) != 0) {
+		strncpy(data->ipv4, s->ipv4, sizeof(data->ipv4) - 1);
 		data->ipv4[sizeof(data->ipv4) - 1] = '\0';
 		changed                            = true;
 	}
-	if (strcmp(new_ipv6, data->ipv6) != 0) {
-		strncpy(data->ipv6, new_ipv6, sizeof(data->ipv6) - 1);
+	if (strcmp(s->ipv6, data->ipv6) != 0) {
+		strncpy(data->ipv6, s->ipv6, sizeof(data->ipv6) - 1);
 		data->ipv6[sizeof(data->ipv6) - 1] = '\0';
 		changed                            = true;
 	}
-	if (strcmp(new_mac, data->mac) != 0) {
-		strncpy(data->mac, new_mac, sizeof(data->mac) - 1);
+	if (strcmp(s->mac, data->mac) != 0) {
+		strncpy(data->mac, s->mac, sizeof(data->mac) - 1);
 		data->mac[sizeof(data->mac) - 1] = '\0';
 		changed                          = true;
 	}
-	if (strcmp(new_ssid, data->ssid) != 0) {
-		strncpy(data->ssid, new_ssid, sizeof(data->ssid) - 1);
+	if (strcmp(s->ssid, data->ssid) != 0) {
+		strncpy(data->ssid, s->ssid, sizeof(data->ssid) - 1);
 		data->ssid[sizeof(data->ssid) - 1] = '\0';
 		changed                            = true;
 	}
 
-	clock_gettime(CLOCK_MONOTONIC, &now);
-
-	if (data->is_online && data->current_iface[0] && read_iface_bytes(data->current_iface, &rx, &tx)) {
+	if (s->have_bytes) {
 		if (data->have_last_sample) {
-			elapsed = (double)(now.tv_sec - data->last_sample.tv_sec)
-			          + (double)(now.tv_nsec
+			elapsed = (double)(s->at.tv_sec - data->last_sample.tv_sec)
+			          + (double)(s->at.tv_nsec
 			                     - data->last_sample.tv_nsec)
 			                    / 1e9;
 			if (elapsed > 0.05) {
 				rx_bps = 0.0;
 				tx_bps = 0.0;
-				if (rx >= data->last_rx_bytes)
-					rx_bps = (double)(rx - data->last_rx_bytes)
+				if (s->rx_bytes >= data->last_rx_bytes)
+					rx_bps = (double)(s->rx_bytes
+					                  - data->last_rx_bytes)
 					         / elapsed;
-				if (tx >= data->last_tx_bytes)
-					tx_bps = (double)(tx - data->last_tx_bytes)
+				if (s->tx_bytes >= data->last_tx_bytes)
+					tx_bps = (double)(s->tx_bytes
+					                  - data->last_tx_bytes)
 					         / elapsed;
 				format_speed(rx_bps, rx_str, sizeof(rx_str));
 				format_speed(tx_bps, tx_str, sizeof(tx_str));
@@ -524,9 +297,9 @@ refresh_popup_data(network_data_t *data)
 				}
 			}
 		}
-		data->last_rx_bytes    = rx;
-		data->last_tx_bytes    = tx;
-		data->last_sample      = now;
+		data->last_rx_bytes    = s->rx_bytes;
+		data->last_tx_bytes    = s->tx_bytes;
+		data->last_sample      = s->at;
 		data->have_last_sample = true;
 	} else {
 		if (data->rx_speed_str[0] != '\0') {
@@ -695,7 +468,6 @@ network_on_hover(barny_module_t *self, bool hovering, int x, int y)
 
 	if (hovering) {
 		if (!data->popup) {
-			refresh_popup_data(data);
 			barny_popup_callbacks_t cb = {
 				.content_height = network_popup_height,
 				.content_width  = network_popup_width,
@@ -740,6 +512,10 @@ network_init(barny_module_t *self, barny_state_t *state)
 
 	strcpy(data->display_str, "offline");
 
+	/* without the socket the module stays offline rather than failing the
+	   bar */
+	data->nl = barny_netlink_open();
+
 	return 0;
 }
 
@@ -762,71 +538,52 @@ network_destroy(barny_module_t *self)
 	if (data->popup_font_desc) {
 		pango_font_description_free(data->popup_font_desc);
 	}
+	barny_netlink_close(data->nl);
 
 	free(data);
 	self->data = NULL;
 }
 
 static void
-network_update(barny_module_t *self)
+network_publish(barny_module_t *self)
 {
-	network_data_t *data      = self->data;
-	barny_config_t *cfg       = &data->state->config;
-	char            iface[32] = "";
-	char            ip[64]    = "";
-	bool            online    = false;
-	const char     *cfg_iface = cfg->network_interface;
-	bool            changed;
-	size_t          iface_len;
-	size_t          ip_len;
-	bool            popup_changed;
-
-	if (cfg_iface && cfg_iface[0] && strcmp(cfg_iface, "auto") != 0) {
-		strncpy(iface, cfg_iface, sizeof(iface) - 1);
-		iface[sizeof(iface) - 1] = '\0';
-
-		if (is_interface_up(iface)) {
-			online = true;
-		}
-	} else {
-		if (find_active_interface(iface, sizeof(iface))) {
-			online = true;
-		}
-	}
-
-	if (online && cfg->network_show_ip) {
-		get_interface_ip(iface, ip, sizeof(ip), cfg->network_prefer_ipv4);
-	}
-
-	changed = (online != data->is_online)
-	          || strcmp(iface, data->current_iface) != 0
-	          || strcmp(ip, data->current_ip) != 0;
+	network_data_t         *data = self->data;
+	barny_config_t         *cfg  = &data->state->config;
+	const network_sample_t *s    = &data->sample;
+	bool                    changed;
+	size_t                  iface_len;
+	size_t                  ip_len;
+	bool                    popup_changed;
+
+	changed = (s->online != data->is_online)
+	          || strcmp(s->iface, data->current_iface) != 0
+	          || strcmp(s->ip, data->current_ip) != 0;
 
 	if (changed) {
-		data->is_online = online;
-		iface_len       = strlen(iface);
-		ip_len          = strlen(ip);
+		data->is_online = s->online;
+		iface_len       = strlen(s->iface);
+		ip_len          = strlen(s->ip);
 		if (iface_len < sizeof(data->current_iface)) {
-			memcpy(data->current_iface, iface, iface_len + 1);
+			memcpy(data->current_iface, s->iface, iface_len + 1);
 		}
 		if (ip_len < sizeof(data->current_ip)) {
-			memcpy(data->current_ip, ip, ip_len + 1);
+			memcpy(data->current_ip, s->ip, ip_len + 1);
 		}
 
-		if (!online) {
+		if (!s->online) {
 			strcpy(data->display_str, "offline");
-		} else if (cfg->network_show_ip && ip[0]) {
+		} else if (cfg->network_show_ip && s->ip[0]) {
 			if (cfg->network_show_interface) {
 				snprintf(data->display_str,
 				         sizeof(data->display_str), "%s: %s",
-				         iface, ip);
+				         s->iface, s->ip);
 			} else {
 				snprintf(data->display_str,
-				         sizeof(data->display_str), "%s", ip);
+				         sizeof(data->display_str), "%s", s->ip);
 			}
 		} else if (cfg->network_show_interface) {
 			snprintf(data->display_str, sizeof(data->display_str),
-			         "%s", iface);
+			         "%s", s->iface);
 		} else {
 			strcpy(data->display_str, "online");
 		}
@@ -836,11 +593,57 @@ network_update(barny_module_t *self)
 		data->have_last_sample = false;
 	}
 
-	popup_changed = refresh_popup_data(data);
+	popup_changed = publish_popup_data(data, s);
 	if (popup_changed && barny_popup_visible(data->popup))
 		barny_popup_redraw(data->popup);
 }
 
+/* The tick asks for fresh counters; they come back through
+   barny_network_dispatch, or through the next tick when the socket is not
+   in the event loop. */
+static void
+network_update(barny_module_t *self)
+{
+	network_data_t *data = self->data;
+	int             changes;
+
+	changes = barny_netlink_dispatch(data->nl);
+	network_sample(data, changes & BARNY_NETLINK_LINKS);
+	network_publish(self);
+	barny_netlink_request_stats(data->nl);
+}
+
+int
+barny_network_fd(barny_module_t *mod)
+{
+	network_data_t *data;
+
+	if (!mod || strcmp(mod->name, "network") != 0)
+		return -1;
+
+	data = mod->data;
+	return barny_netlink_fd(data->nl);
+}
+
+/* link and address changes repaint right away, not on the next tick */
+void
+barny_network_dispatch(barny_module_t *mod)
+{
+	network_data_t *data;
+	int             changes;
+
+	if (!mod || strcmp(mod->name, "network") != 0)
+		return;
+
+	data    = mod->data;
+	changes = barny_netlink_dispatch(data->nl);
+	if (!changes)
+		return;
+
+	network_sample(data, changes & BARNY_NETLINK_LINKS);
+	network_publish(mod);
+}
+
 static void
 network_render(barny_module_t *self, cairo_t *cr, int x, int y, int w, int h)
 {
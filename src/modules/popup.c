@@ -1,12 +1,8 @@
-#include <fcntl.h>
 #include <math.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/mman.h>
-#include <time.h>
-#include <unistd.h>
 
 #include "popup.h"
 #include "util.h"
@@ -58,11 +54,9 @@ struct barny_popup {
 	bool                          configured;
 	struct wl_surface            *surface;
 	struct zwlr_layer_surface_v1 *layer_surface;
-	struct wl_buffer             *buffer;
-	cairo_surface_t              *cairo_surface;
-	cairo_t                      *cr;
-	void                         *shm_data;
-	int                           shm_size;
+	/* sub-allocated from the arena of the output the popup opened on */
+	barny_shm_arena_t            *arena;
+	barny_buffer_t                buf;
 	int                           screen_x;
 	int                           screen_y;
 	int                           current_w;
@@ -102,37 +96,6 @@ popup_compute_height(const barny_popup_t *p)
 	return BARNY_POPUP_PAD_Y * 2 + ch;
 }
 
-static int
-popup_create_shm(int size)
-{
-	static unsigned counter = 0;
-	char            name[64];
-	struct timespec ts;
-	int             fd;
-
-	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0) {
-		ts.tv_sec  = 0;
-		ts.tv_nsec = 0;
-	}
-
-	snprintf(name, sizeof(name), "/barny-popup-%d-%u-%lu",
-	         (int)getpid(), (unsigned)counter++,
-	         (unsigned long)ts.tv_nsec);
-
-	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-	if (fd < 0)
-		return -1;
-
-	if (ftruncate(fd, size) < 0) {
-		shm_unlink(name);
-		close(fd);
-		return -1;
-	}
-
-	shm_unlink(name);
-	return fd;
-}
-
 static void
 popup_teardown_buffer(barny_popup_t *p);
 
@@ -156,7 +119,7 @@ popup_compose(barny_popup_t *p)
 	barny_glass_panel_t panel;
 
 	popup_panel(p, &panel);
-	barny_glass_panel_compose(p->cr, p->state, p->state->pointer_output,
+	barny_glass_panel_compose(p->buf.cr, p->state, p->state->pointer_output,
 	                          &panel, p->content_cache);
 }
 
@@ -975,10 +938,10 @@ barny_glass_panel_step(double *morph, double *vel, uint64_t *last_us,
 static void
 popup_present(barny_popup_t *p, double m)
 {
-	cairo_t            *cr = p->cr;
+	cairo_t            *cr = p->buf.cr;
 	barny_glass_panel_t panel;
 
-	if (!cr || !p->buffer)
+	if (!cr || !p->buf.wl_buffer)
 		return;
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
@@ -993,8 +956,10 @@ popup_present(barny_popup_t *p, double m)
 		popup_compose(p);
 	}
 
-	cairo_surface_flush(p->cairo_surface);
-	wl_surface_attach(p->surface, p->buffer, 0, 0);
+	cairo_surface_flush(p->buf.cairo_surface);
+	wl_surface_attach(p->surface, p->buf.wl_buffer, 0, 0);
+	/* until the release, closing must not trim or reuse its pages */
+	p->buf.busy = true;
 	wl_surface_damage_buffer(p->surface, 0, 0, p->current_w, p->current_h);
 }
 
@@ -1015,6 +980,7 @@ popup_finalize_destroy(barny_popup_t *p)
 	}
 
 	popup_teardown_buffer(p);
+	barny_shm_arena_unref(p->arena);
 
 	if (p->layer_surface) {
 		zwlr_layer_surface_v1_destroy(p->layer_surface);
@@ -1082,7 +1048,7 @@ popup_schedule_frame(barny_popup_t *p)
 static void
 popup_paint(barny_popup_t *p)
 {
-	if (!p->cr || !p->buffer)
+	if (!p->buf.cr || !p->buf.wl_buffer)
 		return;
 
 	popup_present(p, 1.0);
@@ -1092,66 +1058,27 @@ popup_paint(barny_popup_t *p)
 static void
 popup_teardown_buffer(barny_popup_t *p)
 {
-	if (p->cr) {
-		cairo_destroy(p->cr);
-		p->cr = NULL;
-	}
-	if (p->cairo_surface) {
-		cairo_surface_destroy(p->cairo_surface);
-		p->cairo_surface = NULL;
-	}
-	if (p->buffer) {
-		wl_buffer_destroy(p->buffer);
-		p->buffer = NULL;
-	}
-	if (p->shm_data) {
-		munmap(p->shm_data, (size_t)p->shm_size);
-		p->shm_data = NULL;
-	}
-	p->shm_size = 0;
+	barny_buffers_destroy(&p->buf, 1);
 }
 
 static void
 popup_layer_configure(void *userdata, struct zwlr_layer_surface_v1 *surface,
                       uint32_t serial, uint32_t width, uint32_t height)
 {
-	barny_popup_t      *p = userdata;
-	int                 pw, ph, stride, size, fd;
-	struct wl_shm_pool *pool;
+	barny_popup_t *p = userdata;
+	int            pw, ph;
 
 	zwlr_layer_surface_v1_ack_configure(surface, serial);
 
-	if (p->buffer)
+	if (p->buf.wl_buffer)
 		popup_teardown_buffer(p);
 
-	pw     = (int)width > 0 ? (int)width : popup_compute_width(p);
-	ph     = (int)height > 0 ? (int)height
-	                         : popup_compute_height(p) + p->neck_h;
-	stride = pw * 4;
-	size   = stride * ph;
-
-	fd     = popup_create_shm(size);
-	if (fd < 0)
-		return;
+	pw = (int)width > 0 ? (int)width : popup_compute_width(p);
+	ph = (int)height > 0 ? (int)height : popup_compute_height(p) + p->neck_h;
 
-	p->shm_data = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE,
-	                   MAP_SHARED, fd, 0);
-	if (p->shm_data == MAP_FAILED) {
-		close(fd);
-		p->shm_data = NULL;
+	if (barny_buffers_create(&p->buf, 1, p->arena, pw, ph, 1) < 0)
 		return;
-	}
-	p->shm_size = size;
-
-	pool        = wl_shm_create_pool(p->state->shm, fd, size);
-	p->buffer   = wl_shm_pool_create_buffer(pool, 0, pw, ph, stride,
-	                                        WL_SHM_FORMAT_ARGB8888);
-	wl_shm_pool_destroy(pool);
-	close(fd);
 
-	p->cairo_surface = cairo_image_surface_create_for_data(
-	        p->shm_data, CAIRO_FORMAT_ARGB32, pw, ph, stride);
-	p->cr        = cairo_create(p->cairo_surface);
 	p->current_w = pw;
 	p->current_h = ph;
 	p->body_w    = pw;
@@ -1230,12 +1157,14 @@ barny_popup_create(barny_state_t *state, barny_module_t *owner,
 	p->cb      = *cb;
 	p->gap_px  = gap_px;
 	p->neck_h  = gap_px > 0 ? gap_px : 0;
+	p->arena   = barny_shm_arena_ref(barny_output_arena(out));
 
 	pw         = popup_compute_width(p);
 	ph         = popup_compute_height(p) + p->neck_h;
 
 	p->surface = wl_compositor_create_surface(state->compositor);
 	if (!p->surface) {
+		barny_shm_arena_unref(p->arena);
 		free(p);
 		return NULL;
 	}
@@ -1250,6 +1179,7 @@ barny_popup_create(barny_state_t *state, barny_module_t *owner,
 	if (!p->layer_surface) {
 		wl_surface_destroy(p->surface);
 		p->surface = NULL;
+		barny_shm_arena_unref(p->arena);
 		free(p);
 		return NULL;
 	}
@@ -1294,8 +1224,9 @@ barny_popup_destroy(barny_popup_t *p)
 
 	/* the caches carry the visuals through the close morph, so the owner's
 	   callbacks are never touched after this point */
-	if (!p->state->config.popup_animations || !p->configured || !p->buffer
-	    || !p->glass_src || p->anim == POPUP_ANIM_CLOSING) {
+	if (!p->state->config.popup_animations || !p->configured
+	    || !p->buf.wl_buffer || !p->glass_src
+	    || p->anim == POPUP_ANIM_CLOSING) {
 		popup_finalize_destroy(p);
 		return;
 	}
@@ -1320,7 +1251,7 @@ barny_popup_redraw(barny_popup_t *p)
 bool
 barny_popup_visible(const barny_popup_t *p)
 {
-	return p && p->configured && p->buffer != NULL;
+	return p && p->configured && p->buf.wl_buffer != NULL;
 }
 
 void
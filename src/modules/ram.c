@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "barny.h"
+#include "barny_sysfs.h"
 #include "util.h"
 
 typedef struct {
@@ -11,6 +12,7 @@ typedef struct {
 	unsigned long         total_kb;
 	unsigned long         used_kb;
 	PangoFontDescription *font_desc;
+	barny_sysfs_file_t    meminfo;
 } ram_data_t;
 
 static void
@@ -49,23 +51,35 @@ ram_destroy(barny_module_t *self)
 	if (data->font_desc) {
 		pango_font_description_free(data->font_desc);
 	}
+	barny_sysfs_close(&data->meminfo);
 
 	free(data);
 	self->data = NULL;
 }
 
+static unsigned long
+meminfo_kb(const char *buf, const char *key)
+{
+	const char        *v  = barny_scan_field(buf, key);
+	unsigned long long kb = 0;
+
+	if (v)
+		barny_scan_ull(v, &kb);
+
+	return (unsigned long)kb;
+}
+
 static void
 ram_update(barny_module_t *self)
 {
 	ram_data_t     *data;
 	barny_config_t *cfg;
-	FILE           *f;
 	unsigned long   mem_total;
 	unsigned long   mem_free;
 	unsigned long   mem_available;
 	unsigned long   buffers;
 	unsigned long   cached;
-	char            line[256];
+	char            buf[4096];
 	unsigned long   used;
 	const char     *method;
 	unsigned long   free_kb;
@@ -75,32 +89,19 @@ ram_update(barny_module_t *self)
 	char            used_str[16];
 	char            total_str[16];
 
-	data          = self->data;
-	cfg           = &data->state->config;
-	f             = fopen("/proc/meminfo", "r");
-	mem_total     = 0;
-	mem_free      = 0;
-	mem_available = 0;
-	buffers       = 0;
-	cached        = 0;
+	data = self->data;
+	cfg  = &data->state->config;
 
-	if (!f)
+	if (barny_sysfs_read(&data->meminfo, buf, sizeof(buf)) <= 0)
 		return;
 
-	while (fgets(line, sizeof(line), f)) {
-		if (strncmp(line, "MemTotal:", 9) == 0) {
-			sscanf(line, "MemTotal: %lu", &mem_total);
-		} else if (strncmp(line, "MemFree:", 8) == 0) {
-			sscanf(line, "MemFree: %lu", &mem_free);
-		} else if (strncmp(line, "MemAvailable:", 13) == 0) {
-			sscanf(line, "MemAvailable: %lu", &mem_available);
-		} else if (strncmp(line, "Buffers:", 8) == 0) {
-			sscanf(line, "Buffers: %lu", &buffers);
-		} else if (strncmp(line, "Cached:", 7) == 0) {
-			sscanf(line, "Cached: %lu", &cached);
-		}
-	}
-	fclose(f);
+	/* all five are in the first lines of the file, so each lookup stops
+	   early */
+	mem_total     = meminfo_kb(buf, "MemTotal:");
+	mem_free      = meminfo_kb(buf, "MemFree:");
+	mem_available = meminfo_kb(buf, "MemAvailable:");
+	buffers       = meminfo_kb(buf, "Buffers:");
+	cached        = meminfo_kb(buf, "Cached:");
 
 	if (mem_total == 0)
 		return;
@@ -174,6 +175,8 @@ barny_module_ram_create(void)
 		return NULL;
 	}
 
+	barny_sysfs_init(&data->meminfo, "/proc/meminfo");
+
 	mod->name               = "ram";
 	mod->position           = BARNY_POS_RIGHT;
 	mod->init               = ram_init;
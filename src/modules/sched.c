@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "barny.h"
+#include "util.h"
+
+/* Periodic module updates off one timerfd. Every deadline sits on a
+   wall-clock multiple of its module's interval: the clock flips exactly on
+   the second (or minute), and modules sharing an interval -- or with
+   intervals that divide each other -- come due on the same instant and cost
+   one wakeup between them. The timer is armed for the soonest deadline only,
+   and disarmed when no module is periodic, so an idle bar does not wake.
+
+   The timer runs on CLOCK_REALTIME with TFD_TIMER_CANCEL_ON_SET: an absolute
+   realtime timer already fires on time after a suspend, and a clock that is
+   stepped shows up as ECANCELED, at which point everything is refreshed and
+   realigned. Modules without an interval are not scheduled at all; they are
+   updated once at startup and then by whatever event source feeds them.
+   A module with a collector is only handed to the executor here; it
+   publishes whenever that finishes. One-shot timers (a retry) share the
+   heap and the timerfd instead of bringing their own. */
+
+static uint64_t
+wall_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint64_t
+next_boundary(uint64_t now_ms, int interval_ms)
+{
+	return (now_ms / (uint64_t)interval_ms + 1) * (uint64_t)interval_ms;
+}
+
+static void
+heap_swap(barny_deadline_t *a, barny_deadline_t *b)
+{
+	barny_deadline_t t = *a;
+
+	*a = *b;
+	*b = t;
+}
+
+static void
+sift_up(barny_deadline_t *heap, int i)
+{
+	int parent;
+
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (heap[parent].due_ms <= heap[i].due_ms)
+			break;
+		heap_swap(&heap[parent], &heap[i]);
+		i = parent;
+	}
+}
+
+static void
+sift_down(barny_deadline_t *heap, int count, int i)
+{
+	int least;
+	int l;
+	int r;
+
+	for (;;) {
+		least = i;
+		l     = 2 * i + 1;
+		r     = 2 * i + 2;
+		if (l < count && heap[l].due_ms < heap[least].due_ms)
+			least = l;
+		if (r < count && heap[r].due_ms < heap[least].due_ms)
+			least = r;
+		if (least == i)
+			break;
+		heap_swap(&heap[least], &heap[i]);
+		i = least;
+	}
+}
+
+void
+barny_sched_reset(barny_state_t *state, uint64_t now_ms)
+{
+	barny_module_t *mod;
+	int             count = state->deadline_count;
+	int             i;
+
+	/* pending one-shots stay, the modules are laid out afresh */
+	state->deadline_count = 0;
+	for (i = 0; i < count; i++) {
+		if (!state->deadlines[i].fire)
+			continue;
+		state->deadlines[state->deadline_count] = state->deadlines[i];
+		sift_up(state->deadlines, state->deadline_count);
+		state->deadline_count++;
+	}
+
+	for (i = 0; i < state->module_count; i++) {
+		mod = state->modules[i];
+		if (!mod || !mod->update || mod->update_interval_ms <= 0)
+			continue;
+
+		state->deadlines[state->deadline_count].due_ms
+		        = next_boundary(now_ms, mod->update_interval_ms);
+		state->deadlines[state->deadline_count].mod  = mod;
+		state->deadlines[state->deadline_count].fire = NULL;
+		sift_up(state->deadlines, state->deadline_count);
+		state->deadline_count++;
+	}
+}
+
+uint64_t
+barny_sched_run(barny_state_t *state, uint64_t now_ms)
+{
+	barny_deadline_t *top;
+	void              (*fire)(barny_state_t *state);
+
+	while (state->deadline_count > 0
+	       && state->deadlines[0].due_ms <= now_ms) {
+		top = &state->deadlines[0];
+
+		/* off the heap before it runs, so it can re-arm itself */
+		if (top->fire) {
+			fire = top->fire;
+			*top = state->deadlines[--state->deadline_count];
+			sift_down(state->deadlines, state->deadline_count, 0);
+			fire(state);
+			continue;
+		}
+
+		barny_module_refresh(state, top->mod);
+		top->mod->last_update_ms = barny_now_ms();
+
+		/* a module that dropped its interval leaves the schedule */
+		if (top->mod->update_interval_ms <= 0) {
+			*top = state->deadlines[--state->deadline_count];
+		} else {
+			top->due_ms = next_boundary(now_ms,
+			                            top->mod->update_interval_ms);
+		}
+		sift_down(state->deadlines, state->deadline_count, 0);
+	}
+
+	return state->deadline_count > 0 ? state->deadlines[0].due_ms : 0;
+}
+
+static void
+sched_arm(barny_state_t *state, uint64_t due_ms)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	if (due_ms) {
+		its.it_value.tv_sec  = (time_t)(due_ms / 1000);
+		its.it_value.tv_nsec = (long)(due_ms % 1000) * 1000000;
+	}
+
+	if (timerfd_settime(state->timer_fd,
+	                    TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its,
+	                    NULL)
+	    < 0) {
+		fprintf(stderr, "barny: timerfd_settime failed: %s\n",
+		        strerror(errno));
+	}
+}
+
+int
+barny_sched_init(barny_state_t *state)
+{
+	state->timer_fd = timerfd_create(CLOCK_REALTIME,
+	                                 TFD_CLOEXEC | TFD_NONBLOCK);
+	if (state->timer_fd < 0) {
+		fprintf(stderr, "barny: timerfd_create failed: %s\n",
+		        strerror(errno));
+		return -1;
+	}
+
+	barny_sched_reset(state, wall_ms());
+	sched_arm(state, state->deadline_count > 0 ? state->deadlines[0].due_ms
+	                                           : 0);
+
+	return 0;
+}
+
+void
+barny_sched_dispatch(barny_state_t *state)
+{
+	uint64_t expirations;
+	uint64_t now = wall_ms();
+	int      i;
+
+	if (read(state->timer_fd, &expirations, sizeof(expirations)) < 0
+	    && errno == ECANCELED) {
+		/* the wall clock was stepped: every module is due now, and
+		   realigns to the new time from there */
+		barny_debug("wall clock changed, refreshing all modules\n");
+		for (i = 0; i < state->deadline_count; i++)
+			state->deadlines[i].due_ms = now;
+	}
+
+	sched_arm(state, barny_sched_run(state, now));
+}
+
+int
+barny_sched_after(barny_state_t *state, uint64_t delay_ms,
+                  void (*fire)(barny_state_t *state))
+{
+	barny_deadline_t *d;
+	int               timers = 0;
+	int               i;
+
+	for (i = 0; i < state->deadline_count; i++)
+		timers += state->deadlines[i].fire != NULL;
+	if (timers >= BARNY_MAX_TIMERS)
+		return -1;
+
+	d         = &state->deadlines[state->deadline_count];
+	d->due_ms = wall_ms() + delay_ms;
+	d->mod    = NULL;
+	d->fire   = fire;
+	sift_up(state->deadlines, state->deadline_count);
+	state->deadline_count++;
+
+	if (state->timer_fd >= 0)
+		sched_arm(state, state->deadlines[0].due_ms);
+
+	return 0;
+}
+
+void
+barny_sched_cleanup(barny_state_t *state)
+{
+	if (state->timer_fd >= 0) {
+		close(state->timer_fd);
+		state->timer_fd = -1;
+	}
+	state->deadline_count = 0;
+}
@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "barny_sysfs.h"
+
+void
+barny_sysfs_init(barny_sysfs_file_t *file, const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vsnprintf(file->path, sizeof(file->path), fmt, ap);
+	va_end(ap);
+	file->fd = -1;
+}
+
+void
+barny_sysfs_close(barny_sysfs_file_t *file)
+{
+	if (file->fd >= 0) {
+		close(file->fd);
+		file->fd = -1;
+	}
+}
+
+static bool
+sysfs_reopen_errno(int err)
+{
+	return err == ENODEV || err == ESTALE || err == EBADF || err == ENXIO;
+}
+
+ssize_t
+barny_sysfs_read(barny_sysfs_file_t *file, char *buf, size_t size)
+{
+	ssize_t n = -1;
+	int     tries;
+
+	buf[0] = '\0';
+	if (size < 2 || !file->path[0])
+		return -1;
+
+	for (tries = 0; tries < 2; tries++) {
+		if (file->fd < 0) {
+			file->fd = open(file->path, O_RDONLY | O_CLOEXEC);
+			if (file->fd < 0)
+				return -1;
+		}
+
+		n = pread(file->fd, buf, size - 1, 0);
+		if (n >= 0)
+			break;
+
+		/* the attribute belongs to a device that was replaced; a fresh
+		   open finds the new one, or fails and we try next update */
+		if (!sysfs_reopen_errno(errno))
+			return -1;
+		barny_sysfs_close(file);
+	}
+
+	if (n < 0)
+		return -1;
+
+	buf[n] = '\0';
+	return n;
+}
+
+bool
+barny_sysfs_read_ll(barny_sysfs_file_t *file, long long *out)
+{
+	char buf[32];
+
+	if (barny_sysfs_read(file, buf, sizeof(buf)) <= 0)
+		return false;
+
+	return barny_scan_ll(buf, out) != NULL;
+}
+
+ssize_t
+barny_sysfs_read_path(const char *path, char *buf, size_t size)
+{
+	ssize_t n;
+	int     fd;
+
+	buf[0] = '\0';
+	if (size < 2)
+		return -1;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	n = read(fd, buf, size - 1);
+	close(fd);
+	if (n < 0)
+		return -1;
+
+	buf[n] = '\0';
+	return n;
+}
+
+bool
+barny_sysfs_read_path_ll(const char *path, long long *out)
+{
+	char buf[32];
+
+	if (barny_sysfs_read_path(path, buf, sizeof(buf)) <= 0)
+		return false;
+
+	return barny_scan_ll(buf, out) != NULL;
+}
+
+static const char *
+skip_blanks(const char *p)
+{
+	while (*p == ' ' || *p == '\t')
+		p++;
+	return p;
+}
+
+const char *
+barny_scan_ull(const char *p, unsigned long long *out)
+{
+	unsigned long long v = 0;
+
+	p = skip_blanks(p);
+	if (*p < '0' || *p > '9')
+		return NULL;
+
+	while (*p >= '0' && *p <= '9')
+		v = v * 10 + (unsigned long long)(*p++ - '0');
+
+	*out = v;
+	return p;
+}
+
+const char *
+barny_scan_ll(const char *p, long long *out)
+{
+	unsigned long long v;
+	bool               neg;
+
+	p   = skip_blanks(p);
+	neg = *p == '-';
+	if (neg || *p == '+')
+		p++;
+
+	p = barny_scan_ull(p, &v);
+	if (!p)
+		return NULL;
+
+	*out = neg ? -(long long)v : (long long)v;
+	return p;
+}
+
+const char *
+barny_scan_double(const char *p, double *out)
+{
+	unsigned long long whole;
+	double             frac  = 0.0;
+	double             scale = 1.0;
+
+	p = barny_scan_ull(p, &whole);
+	if (!p)
+		return NULL;
+
+	if (*p == '.') {
+		p++;
+		while (*p >= '0' && *p <= '9') {
+			frac  = frac * 10.0 + (*p++ - '0');
+			scale *= 10.0;
+		}
+	}
+
+	*out = (double)whole + frac / scale;
+	return p;
+}
+
+const char *
+barny_scan_field(const char *buf, const char *key)
+{
+	size_t      len = strlen(key);
+	const char *p   = buf;
+
+	while (p && *p) {
+		if (strncmp(p, key, len) == 0)
+			return p + len;
+		p = strchr(p, '\n');
+		if (p)
+			p++;
+	}
+
+	return NULL;
+}
+
+bool
+barny_scan_field_str(const char *buf, const char *key, char *out, size_t size)
+{
+	const char *v = barny_scan_field(buf, key);
+	size_t      len;
+
+	if (!v || size == 0)
+		return false;
+
+	len = strcspn(v, "\n");
+	if (len > size - 1)
+		len = size - 1;
+	memcpy(out, v, len);
+	out[len] = '\0';
+	return true;
+}
@@ -3,8 +3,10 @@
 #include <string.h>
 #include <dirent.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #include "barny.h"
+#include "barny_sysfs.h"
 #include "popup.h"
 
 #define LINE_H            26
@@ -34,24 +36,17 @@ typedef struct {
 	char                  load_str[48];
 	int                   per_core_khz[MAX_PER_CORE_ROWS];
 	int                   per_core_count;
-} sysinfo_data_t;
-
-static int
-read_int_file(const char *path)
-{
-	FILE *f;
-	int   val;
 
-	f = fopen(path, "r");
-	if (!f)
-		return -1;
-
-	if (fscanf(f, "%d", &val) != 1)
-		val = -1;
-	fclose(f);
+	barny_sysfs_file_t    temp_file;
+	barny_sysfs_file_t    uptime_file;
+	barny_sysfs_file_t    loadavg_file;
+	barny_sysfs_file_t    core_files[MAX_PER_CORE_ROWS];
+	int                   core_file_count;
+	bool                  cores_scanned;
 
-	return val;
-}
+	barny_feed_t         *freq_feed;
+	barny_feed_t         *power_feed;
+} sysinfo_data_t;
 
 static void
 detect_core_counts(sysinfo_data_t *data)
@@ -64,7 +59,7 @@ detect_core_counts(sysinfo_data_t *data)
 	struct dirent *entry;
 	int            cpu_id;
 	char           path[256];
-	int            max_freq;
+	long long      max_freq;
 	int            gap;
 	int            threshold;
 	int            i;
@@ -84,11 +79,10 @@ detect_core_counts(sysinfo_data_t *data)
 		snprintf(path, sizeof(path),
 		         "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq",
 		         cpu_id);
-		max_freq = read_int_file(path);
-		if (max_freq < 0)
+		if (!barny_sysfs_read_path_ll(path, &max_freq) || max_freq < 0)
 			continue;
 
-		max_freqs[cpu_count] = max_freq;
+		max_freqs[cpu_count] = (int)max_freq;
 
 		if (max_freq > highest_freq)
 			highest_freq = max_freq;
@@ -113,23 +107,17 @@ detect_core_counts(sysinfo_data_t *data)
 static bool
 try_thermal_zone(char *path, size_t pathlen, int zone, bool strict)
 {
-	char  type_path[256];
-	FILE *f;
-	char  type[64] = "";
-	bool  strong;
-	bool  weak;
+	char type_path[256];
+	char type[64];
+	bool strong;
+	bool weak;
 
 	snprintf(type_path, sizeof(type_path),
 	         "/sys/class/thermal/thermal_zone%d/type", zone);
 
-	f = fopen(type_path, "r");
-	if (!f)
+	if (barny_sysfs_read_path(type_path, type, sizeof(type)) < 0)
 		return false;
-
-	if (fgets(type, sizeof(type), f)) {
-		type[strcspn(type, "\n")] = '\0';
-	}
-	fclose(f);
+	type[strcspn(type, "\n")] = '\0';
 
 	strong = strstr(type, "x86_pkg") || strstr(type, "coretemp")
 	         || strstr(type, "k10temp");
@@ -151,7 +139,7 @@ try_hwmon(char *path, size_t pathlen)
 	DIR           *dir;
 	struct dirent *ent;
 	char           name_path[256];
-	FILE          *f;
+	char           name[64];
 
 	dir = opendir("/sys/class/hwmon");
 	if (!dir)
@@ -167,15 +155,9 @@ try_hwmon(char *path, size_t pathlen)
 		snprintf(name_path, sizeof(name_path), "/sys/class/hwmon/%s/name",
 		         ent->d_name);
 
-		f = fopen(name_path, "r");
-		if (!f)
+		if (barny_sysfs_read_path(name_path, name, sizeof(name)) < 0)
 			continue;
-
-		char name[64] = "";
-		if (fgets(name, sizeof(name), f)) {
-			name[strcspn(name, "\n")] = '\0';
-		}
-		fclose(f);
+		name[strcspn(name, "\n")] = '\0';
 
 		if (strstr(name, "coretemp")
 		    || strstr(name, "k10temp")
@@ -184,9 +166,7 @@ try_hwmon(char *path, size_t pathlen)
 			snprintf(path, pathlen, "/sys/class/hwmon/%s/temp1_input",
 			         ent->d_name);
 
-			f = fopen(path, "r");
-			if (f) {
-				fclose(f);
+			if (access(path, R_OK) == 0) {
 				closedir(dir);
 				return true;
 			}
@@ -247,57 +227,58 @@ find_temp_path(sysinfo_data_t *data, barny_config_t *cfg)
 }
 
 static long
-read_uptime_seconds(void)
+read_uptime_seconds(sysinfo_data_t *data)
 {
-	FILE  *f;
-	double up = 0.0;
+	char   buf[64];
+	double up;
 
-	f         = fopen("/proc/uptime", "r");
-	if (!f)
+	if (barny_sysfs_read(&data->uptime_file, buf, sizeof(buf)) <= 0
+	    || !barny_scan_double(buf, &up))
 		return -1;
 
-	if (fscanf(f, "%lf", &up) != 1) {
-		fclose(f);
-		return -1;
-	}
-	fclose(f);
-
 	return (long)up;
 }
 
 static bool
-read_loadavg(double load[3])
+read_loadavg(sysinfo_data_t *data, double load[3])
 {
-	FILE *f;
-	bool  ok;
+	char        buf[128];
+	const char *p = buf;
+	int         i;
 
-	f = fopen("/proc/loadavg", "r");
-	if (!f)
+	if (barny_sysfs_read(&data->loadavg_file, buf, sizeof(buf)) <= 0)
 		return false;
 
-	ok = (fscanf(f, "%lf %lf %lf", &load[0], &load[1], &load[2]) == 3);
-	fclose(f);
+	for (i = 0; i < 3; i++) {
+		p = barny_scan_double(p, &load[i]);
+		if (!p)
+			return false;
+	}
 
-	return ok;
+	return true;
 }
 
-static int
-read_per_core_freqs(int *out_khz, int max)
+/* The cpu list is walked once; after that each update is a pread per core.
+   A core that goes offline fails its read and is skipped until it is back,
+   which the reopen in barny_sysfs_read picks up on its own. */
+static void
+scan_core_files(sysinfo_data_t *data)
 {
-	DIR           *dir;
-	int            ids[256];
-	int            id_count = 0;
-	struct dirent *entry;
-	int            i;
-	int            key;
-	int            j;
-	int            out = 0;
-	char           path[256];
-	int            khz;
+	DIR                *dir;
+	int                 ids[256];
+	int                 id_count = 0;
+	struct dirent      *entry;
+	barny_sysfs_file_t *file;
+	char                buf[32];
+	int                 i;
+	int                 key;
+	int                 j;
+
+	data->cores_scanned = true;
 
 	dir = opendir("/sys/devices/system/cpu");
 	if (!dir)
-		return 0;
+		return;
 
 	while ((entry = readdir(dir)) != NULL && id_count < 256) {
 		if (strncmp(entry->d_name, "cpu", 3) != 0)
@@ -318,14 +299,35 @@ read_per_core_freqs(int *out_khz, int max)
 		ids[j + 1] = key;
 	}
 
-	for (i = 0; i < id_count && out < max; i++) {
-		snprintf(path, sizeof(path),
-		         "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
-		         ids[i]);
-		khz = read_int_file(path);
-		if (khz < 0)
+	for (i = 0; i < id_count && data->core_file_count < MAX_PER_CORE_ROWS;
+	     i++) {
+		file = &data->core_files[data->core_file_count];
+		barny_sysfs_init(
+		        file,
+		        "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+		        ids[i]);
+		if (barny_sysfs_read(file, buf, sizeof(buf)) <= 0) {
+			barny_sysfs_close(file);
 			continue;
-		out_khz[out++] = khz;
+		}
+		data->core_file_count++;
+	}
+}
+
+static int
+read_per_core_freqs(sysinfo_data_t *data, int *out_khz, int max)
+{
+	long long khz;
+	int       out = 0;
+	int       i;
+
+	if (!data->cores_scanned)
+		scan_core_files(data);
+
+	for (i = 0; i < data->core_file_count && out < max; i++) {
+		if (!barny_sysfs_read_ll(&data->core_files[i], &khz) || khz < 0)
+			continue;
+		out_khz[out++] = (int)khz;
 	}
 
 	return out;
@@ -633,6 +635,11 @@ sysinfo_init(barny_module_t *self, barny_state_t *state)
 
 	detect_core_counts(data);
 	find_temp_path(data, &state->config);
+	if (data->temp_path_found)
+		barny_sysfs_init(&data->temp_file, "%s", data->temp_path);
+
+	data->freq_feed  = barny_feed_open(state, "cpu_freq", self);
+	data->power_feed = barny_feed_open(state, "cpu_power", self);
 
 	return 0;
 }
@@ -641,6 +648,8 @@ static void
 sysinfo_destroy(barny_module_t *self)
 {
 	sysinfo_data_t *data = self->data;
+	int             i;
+
 	if (!data)
 		return;
 
@@ -657,6 +666,15 @@ sysinfo_destroy(barny_module_t *self)
 		pango_font_description_free(data->popup_font_desc);
 	}
 
+	barny_feed_close(data->freq_feed);
+	barny_feed_close(data->power_feed);
+
+	barny_sysfs_close(&data->temp_file);
+	barny_sysfs_close(&data->uptime_file);
+	barny_sysfs_close(&data->loadavg_file);
+	for (i = 0; i < data->core_file_count; i++)
+		barny_sysfs_close(&data->core_files[i]);
+
 	free(data);
 	self->data = NULL;
 }
@@ -666,178 +684,160 @@ sysinfo_update(barny_module_t *self)
 {
 	sysinfo_data_t *data = self->data;
 	barny_config_t *cfg  = &data->state->config;
-	FILE           *f;
 	bool            popup_changed = false;
 	long            up;
+	long long       millicelsius;
 	double          load[3];
+	char            line[64];
+
+	if (barny_feed_read(data->freq_feed, line, sizeof(line)) > 0) {
+		double p_freq = 0, e_freq = 0;
+		bool   hybrid = false;
+		bool   parsed = false;
+
+		if (sscanf(line, "P: %lf E: %lf", &p_freq, &e_freq)
+		    == 2) {
+			hybrid = true;
+			parsed = true;
+		} else if (sscanf(line, "%lf", &p_freq) == 1) {
+			e_freq = 0;
+			parsed = true;
+		}
 
-	f = fopen("/opt/barny/modules/cpu_freq", "r");
-	if (f) {
-		char line[64];
-		if (fgets(line, sizeof(line), f)) {
-			double p_freq = 0, e_freq = 0;
-			bool   hybrid = false;
-			bool   parsed = false;
-
-			if (sscanf(line, "P: %lf E: %lf", &p_freq, &e_freq)
-			    == 2) {
-				hybrid = true;
-				parsed = true;
-			} else if (sscanf(line, "%lf", &p_freq) == 1) {
-				e_freq = 0;
-				parsed = true;
-			}
+		if (parsed
+		    && (p_freq != data->p_freq
+		        || e_freq != data->e_freq)) {
+			data->p_freq = p_freq;
+			data->e_freq = e_freq;
 
-			if (parsed
-			    && (p_freq != data->p_freq
-			        || e_freq != data->e_freq)) {
-				data->p_freq = p_freq;
-				data->e_freq = e_freq;
-
-				if (!hybrid || cfg->sysinfo_freq_combined) {
-					double avg;
-					if (!hybrid) {
-						avg = p_freq;
-					} else {
-						int total = data->p_core_count
-						            + data->e_core_count;
-						avg       = (total > 0) ?
-						                    (p_freq * data->p_core_count
-						                     + e_freq
-						                               * data->e_core_count)
-						                            / total :
-						                    0.0;
-					}
-					if (cfg->sysinfo_freq_show_unit) {
-						const char *fmt
-						        = cfg->sysinfo_freq_unit_space ?
-						                  "%.2f GHz" :
-						                  "%.2fGHz";
-						snprintf(
-						        data->freq_str,
-						        sizeof(data->freq_str),
-						        fmt, avg);
-					} else {
-						snprintf(
-						        data->freq_str,
-						        sizeof(data->freq_str),
-						        "%.2f", avg);
-					}
+			if (!hybrid || cfg->sysinfo_freq_combined) {
+				double avg;
+				if (!hybrid) {
+					avg = p_freq;
 				} else {
-					const char *label_sep
-					        = cfg->sysinfo_freq_label_space ?
-					                  " " :
-					                  "";
-					const char *unit_sep
+					int total = data->p_core_count
+					            + data->e_core_count;
+					avg       = (total > 0) ?
+					                    (p_freq * data->p_core_count
+					                     + e_freq
+					                               * data->e_core_count)
+					                            / total :
+					                    0.0;
+				}
+				if (cfg->sysinfo_freq_show_unit) {
+					const char *fmt
 					        = cfg->sysinfo_freq_unit_space ?
-					                  " " :
-					                  "";
-					const char *unit
-					        = cfg->sysinfo_freq_show_unit ?
-					                  "GHz" :
-					                  "";
-
-					if (cfg->sysinfo_freq_show_unit) {
-						snprintf(
-						        data->freq_str,
-						        sizeof(data->freq_str),
-						        "P:%s%.2f%s%s E:%s%.2f%s%s",
-						        label_sep, p_freq,
-						        unit_sep, unit,
-						        label_sep, e_freq,
-						        unit_sep, unit);
-					} else {
-						snprintf(
-						        data->freq_str,
-						        sizeof(data->freq_str),
-						        "P:%s%.2f E:%s%.2f",
-						        label_sep, p_freq,
-						        label_sep, e_freq);
-					}
+					                  "%.2f GHz" :
+					                  "%.2fGHz";
+					snprintf(
+					        data->freq_str,
+					        sizeof(data->freq_str),
+					        fmt, avg);
+				} else {
+					snprintf(
+					        data->freq_str,
+					        sizeof(data->freq_str),
+					        "%.2f", avg);
+				}
+			} else {
+				const char *label_sep
+				        = cfg->sysinfo_freq_label_space ?
+				                  " " :
+				                  "";
+				const char *unit_sep
+				        = cfg->sysinfo_freq_unit_space ?
+				                  " " :
+				                  "";
+				const char *unit
+				        = cfg->sysinfo_freq_show_unit ?
+				                  "GHz" :
+				                  "";
+
+				if (cfg->sysinfo_freq_show_unit) {
+					snprintf(
+					        data->freq_str,
+					        sizeof(data->freq_str),
+					        "P:%s%.2f%s%s E:%s%.2f%s%s",
+					        label_sep, p_freq,
+					        unit_sep, unit,
+					        label_sep, e_freq,
+					        unit_sep, unit);
+				} else {
+					snprintf(
+					        data->freq_str,
+					        sizeof(data->freq_str),
+					        "P:%s%.2f E:%s%.2f",
+					        label_sep, p_freq,
+					        label_sep, e_freq);
 				}
-				self->dirty = true;
 			}
+			self->dirty = true;
 		}
-		fclose(f);
-	}
-
-	f = fopen("/opt/barny/modules/cpu_power", "r");
-	if (f) {
-		char line[64];
-		if (fgets(line, sizeof(line), f)) {
-			double power;
-			if (sscanf(line, "PWR: %lf", &power) == 1) {
-				if (power != data->power) {
-					data->power = power;
-
-					const char *fmt;
-					if (cfg->sysinfo_power_unit_space) {
-						switch (cfg->sysinfo_power_decimals) {
-						case 1:
-							fmt = "%.1f W";
-							break;
-						case 2:
-							fmt = "%.2f W";
-							break;
-						default:
-							fmt = "%.0f W";
-							break;
-						}
-					} else {
-						switch (cfg->sysinfo_power_decimals) {
-						case 1:
-							fmt = "%.1fW";
-							break;
-						case 2:
-							fmt = "%.2fW";
-							break;
-						default:
-							fmt = "%.0fW";
-							break;
-						}
+	}
+
+	if (barny_feed_read(data->power_feed, line, sizeof(line)) > 0) {
+		double power;
+		if (sscanf(line, "PWR: %lf", &power) == 1) {
+			if (power != data->power) {
+				data->power = power;
+
+				const char *fmt;
+				if (cfg->sysinfo_power_unit_space) {
+					switch (cfg->sysinfo_power_decimals) {
+					case 1:
+						fmt = "%.1f W";
+						break;
+					case 2:
+						fmt = "%.2f W";
+						break;
+					default:
+						fmt = "%.0f W";
+						break;
+					}
+				} else {
+					switch (cfg->sysinfo_power_decimals) {
+					case 1:
+						fmt = "%.1fW";
+						break;
+					case 2:
+						fmt = "%.2fW";
+						break;
+					default:
+						fmt = "%.0fW";
+						break;
 					}
-					snprintf(data->power_str,
-					         sizeof(data->power_str),
-					         fmt,
-					         power);
-					self->dirty = true;
 				}
+				snprintf(data->power_str,
+				         sizeof(data->power_str),
+				         fmt,
+				         power);
+				self->dirty = true;
 			}
 		}
-		fclose(f);
-	}
-
-	if (data->temp_path_found) {
-		f = fopen(data->temp_path, "r");
-		if (f) {
-			int millicelsius = 0;
-			if (fscanf(f, "%d", &millicelsius) == 1) {
-				int celsius = millicelsius / 1000;
-
-				if (celsius != data->current_temp) {
-					data->current_temp = celsius;
-
-					if (cfg->sysinfo_temp_show_unit) {
-						const char *fmt
-						        = cfg->sysinfo_temp_unit_space ?
-						                  "%d C" :
-						                  "%dC";
-						snprintf(data->temp_str,
-						         sizeof(data->temp_str),
-						         fmt, celsius);
-					} else {
-						snprintf(data->temp_str,
-						         sizeof(data->temp_str),
-						         "%d", celsius);
-					}
-					self->dirty = true;
-				}
+	}
+
+	if (data->temp_path_found
+	    && barny_sysfs_read_ll(&data->temp_file, &millicelsius)) {
+		int celsius = (int)(millicelsius / 1000);
+
+		if (celsius != data->current_temp) {
+			data->current_temp = celsius;
+
+			if (cfg->sysinfo_temp_show_unit) {
+				const char *fmt = cfg->sysinfo_temp_unit_space ?
+				                          "%d C" :
+				                          "%dC";
+				snprintf(data->temp_str, sizeof(data->temp_str),
+				         fmt, celsius);
+			} else {
+				snprintf(data->temp_str, sizeof(data->temp_str),
+				         "%d", celsius);
 			}
-			fclose(f);
+			self->dirty = true;
 		}
 	}
 
-	up = read_uptime_seconds();
+	up = read_uptime_seconds(data);
 	if (up >= 0 && up != data->uptime_seconds) {
 		long old_min         = data->uptime_seconds / 60;
 		long new_min         = up / 60;
@@ -849,7 +849,7 @@ sysinfo_update(barny_module_t *self)
 		}
 	}
 
-	if (read_loadavg(load)) {
+	if (read_loadavg(data, load)) {
 		if (load[0] != data->load_avg[0]
 		    || load[1] != data->load_avg[1]
 		    || load[2] != data->load_avg[2]) {
@@ -864,7 +864,8 @@ sysinfo_update(barny_module_t *self)
 
 	if (cfg->sysinfo_popup_per_core) {
 		int  new_freqs[MAX_PER_CORE_ROWS];
-		int  n    = read_per_core_freqs(new_freqs, MAX_PER_CORE_ROWS);
+		int  n    = read_per_core_freqs(data, new_freqs,
+		                                MAX_PER_CORE_ROWS);
 		bool diff = (n != data->per_core_count);
 		int  i;
 
@@ -986,12 +987,16 @@ barny_module_sysinfo_create(void)
 		return NULL;
 	}
 
+	barny_sysfs_init(&data->temp_file, "%s", "");
+	barny_sysfs_init(&data->uptime_file, "/proc/uptime");
+	barny_sysfs_init(&data->loadavg_file, "/proc/loadavg");
+
 	mod->name               = "sysinfo";
 	mod->position           = BARNY_POS_RIGHT;
 	mod->init               = sysinfo_init;
 	mod->destroy            = sysinfo_destroy;
 	mod->update             = sysinfo_update;
-	mod->update_interval_ms = 0;
+	mod->update_interval_ms = 1000;
 	mod->render             = sysinfo_render;
 	mod->on_hover           = sysinfo_on_hover;
 	mod->data               = data;
@@ -38,6 +38,9 @@ tray_destroy(barny_module_t *self)
 	if (!data)
 		return;
 
+	if (data->state && data->state->hover_module == self)
+		data->state->hover_module = NULL;
+
 	free(data);
 	self->data = NULL;
 }
@@ -142,13 +145,8 @@ tray_render(barny_module_t *self, cairo_t *cr, int x, int y, int w, int h)
 	sni_item_t     *item;
 	double          cx;
 	double          cy;
-	int             iw;
-	int             ih;
 	int             pad;
 	int             target;
-	double          scale;
-	double          dx;
-	double          dy;
 
 	data = self->data;
 	cfg  = &data->state->config;
@@ -201,32 +199,12 @@ tray_render(barny_module_t *self, cairo_t *cr, int x, int y, int w, int h)
 		             cfg->tray_icon_bg_r, cfg->tray_icon_bg_g,
 		             cfg->tray_icon_bg_b, cfg->tray_icon_bg_opacity);
 
-		if (item->icon
-		    && cairo_surface_status(item->icon) == CAIRO_STATUS_SUCCESS) {
-			iw = cairo_image_surface_get_width(item->icon);
-			ih = cairo_image_surface_get_height(item->icon);
-			if (iw > 0 && ih > 0) {
-				pad    = 4;
-				target = data->icon_size - pad * 2;
-				if (target < 1)
-					target = 1;
-				scale = (double)target / (iw > ih ? iw : ih);
-
-				dx    = icon_x
-				        + pad
-				        + (target - iw * scale) / 2.0;
-				dy    = icon_y
-				        + pad
-				        + (target - ih * scale) / 2.0;
-
-				cairo_save(cr);
-				cairo_translate(cr, dx, dy);
-				cairo_scale(cr, scale, scale);
-				cairo_set_source_surface(cr, item->icon, 0, 0);
-				cairo_paint_with_alpha(cr, 0.95);
-				cairo_restore(cr);
-			}
-		}
+		pad    = 4;
+		target = data->icon_size - pad * 2;
+		if (target < 1)
+			target = 1;
+		barny_icon_paint(cr, item->icon, item->icon_hash, icon_x + pad,
+		                 icon_y + pad, target, 0.95);
 
 		cairo_restore(cr);
 
@@ -309,6 +287,26 @@ tray_on_click(barny_module_t *self, int button, int x, int y)
 	}
 }
 
+/* The pointer is on its way to an icon: a click that opens a menu is
+   likely next, and the layouts are fetched in the meantime. Once cached
+   they are kept current, so this costs each item one GetLayout. */
+static void
+tray_on_hover(barny_module_t *self, bool hovering, int x, int y)
+{
+	tray_data_t *data = self->data;
+	sni_item_t  *item;
+
+	(void)x;
+	(void)y;
+
+	if (!hovering)
+		return;
+
+	for (item = barny_sni_host_get_items(data->state); item;
+	     item = item->next)
+		barny_sni_item_prefetch_menu(data->state, item);
+}
+
 barny_module_t *
 barny_module_tray_create(void)
 {
@@ -328,6 +326,7 @@ barny_module_tray_create(void)
 	mod->update   = tray_update;
 	mod->render   = tray_render;
 	mod->on_click = tray_on_click;
+	mod->on_hover = tray_on_hover;
 	mod->data     = data;
 	mod->width    = 0;
 	mod->dirty    = true;
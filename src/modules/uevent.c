@@ -0,0 +1,255 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/netlink.h>
+
+#include "uevent.h"
+
+/* the kernel's multicast group; group 2 is udevd re-broadcasting */
+#define UEVENT_KERNEL_GROUP 1
+
+/* "SUBSYSTEM=" and the longest subsystem name matched on */
+#define UEVENT_MATCH_MAX    64
+/* how far into a datagram the filter looks for SUBSYSTEM=, at most */
+#define UEVENT_SCAN_MAX     1024
+#define UEVENT_SCAN_MIN     128
+
+/* "SUBSYSTEM=" and then the value, compared a word at a time where it can */
+static size_t
+match_step(size_t pos, size_t match_len)
+{
+	size_t end = pos < 10 ? 10 : match_len;
+
+	return end - pos >= 4 ? 4 : end - pos >= 2 ? 2 : 1;
+}
+
+/* Classic BPF only jumps forward, so it cannot loop over the datagram
+   looking for SUBSYSTEM=. The program loads each aligned word in the
+   first `scan` bytes and compares it against the four words of "YSTEM=p"
+   an aligned load can land on, one per alignment. A hit remembers where
+   the pair would start and jumps to one tail that compares all of
+   "SUBSYSTEM=<subsystem>\0" from there. The kernel puts SUBSYSTEM third,
+   after ACTION and DEVPATH, so it is a few hundred bytes in.
+
+   Only a datagram known to be about another subsystem is dropped: one
+   whose SUBSYSTEM= lies past the window, or a hit that was not a
+   SUBSYSTEM= pair after all, is let through for the caller to check.
+   Loads past the end of a short datagram drop it, which is what running
+   out of datagram without a match should do. */
+static int
+build_filter(struct sock_filter *insns, const char *subsystem, size_t scan)
+{
+	char     match[UEVENT_MATCH_MAX] = { 0 };
+	uint32_t word;
+	uint16_t size;
+	size_t   match_len;
+	size_t   tail = 0;
+	size_t   accept;
+	size_t   reject;
+	size_t   pos;
+	size_t   step;
+	size_t   n = 0;
+	size_t   i;
+	size_t   j;
+	int      len;
+
+	len = snprintf(match, sizeof(match), "SUBSYSTEM=%s", subsystem);
+	if (len < 0 || (size_t)len + 4 > sizeof(match))
+		return -1;
+	match_len = (size_t)len + 1;
+
+	/* a load per aligned word, then per alignment that can start a pair
+	   a compare, the start and a jump; and the jump past the window */
+	for (i = 0; i < scan; i += 4) {
+		tail++;
+		for (j = 4; j < 8 && j <= i; j++)
+			tail += 3;
+	}
+	tail++;
+	accept = tail;
+	for (pos = 0; pos < match_len; pos += match_step(pos, match_len))
+		accept += 2;
+	reject = accept + 1;
+
+	for (i = 0; i < scan; i += 4) {
+		insns[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+		                                          (uint32_t)i);
+		for (j = 4; j < 8 && j <= i; j++) {
+			memcpy(&word, match + j, 4);
+			insns[n++] = (struct sock_filter)BPF_JUMP(
+			        BPF_JMP | BPF_JEQ | BPF_K, ntohl(word), 0, 2);
+			insns[n++] = (struct sock_filter)BPF_STMT(BPF_LDX | BPF_IMM,
+			                                          (uint32_t)(i - j));
+			insns[n]   = (struct sock_filter)BPF_STMT(
+			        BPF_JMP | BPF_JA, (uint32_t)(tail - n - 1));
+			n++;
+		}
+	}
+	insns[n] = (struct sock_filter)BPF_STMT(BPF_JMP | BPF_JA,
+	                                        (uint32_t)(accept - n - 1));
+	n++;
+
+	/* "SUBSYSTEM=" not there: a stray hit, let it through; the value
+	   not there: another subsystem */
+	for (pos = 0; pos < match_len; pos += step) {
+		step = match_step(pos, match_len);
+		size = step == 4 ? BPF_W : step == 2 ? BPF_H : BPF_B;
+		memcpy(&word, match + pos, 4);
+		word = ntohl(word) >> (32 - 8 * step);
+
+		insns[n++] = (struct sock_filter)BPF_STMT(BPF_LD | size | BPF_IND,
+		                                          (uint32_t)pos);
+		insns[n]   = (struct sock_filter)BPF_JUMP(
+		        BPF_JMP | BPF_JEQ | BPF_K, word, 0,
+		        (uint8_t)((pos < 10 ? accept : reject) - n - 1));
+		n++;
+	}
+	insns[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+	insns[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K, 0);
+
+	return (int)n;
+}
+
+/* The kernel charges a filter against net.core.optmem_max, which can be
+   as low as 20 KiB; a window that does not fit is halved. */
+static int
+attach_filter(int fd, const char *subsystem)
+{
+	static struct sock_filter insns[BPF_MAXINSNS];
+	struct sock_fprog         prog;
+	size_t                    scan;
+	int                       n;
+
+	for (scan = UEVENT_SCAN_MAX; scan >= UEVENT_SCAN_MIN; scan /= 2) {
+		n = build_filter(insns, subsystem, scan);
+		if (n < 0) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+
+		prog = (struct sock_fprog){ .len    = (unsigned short)n,
+			                    .filter = insns };
+		if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+		               sizeof(prog))
+		    == 0)
+			return 0;
+		if (errno != ENOMEM)
+			return -1;
+	}
+
+	return -1;
+}
+
+int
+barny_uevent_open(const char *subsystem)
+{
+	struct sockaddr_nl addr;
+	int                fd;
+
+	fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+	            NETLINK_KOBJECT_UEVENT);
+	if (fd < 0) {
+		fprintf(stderr, "barny: uevent socket: %s\n", strerror(errno));
+		return -1;
+	}
+
+	/* before bind, so nothing unfiltered is queued; without it every
+	   device event on the machine wakes the bar only to be dropped */
+	if (subsystem && attach_filter(fd, subsystem) < 0)
+		fprintf(stderr, "barny: uevent filter: %s\n", strerror(errno));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = UEVENT_KERNEL_GROUP;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "barny: uevent bind: %s\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+bool
+barny_uevent_parse(char *buf, size_t len, barny_uevent_t *ev)
+{
+	char  *head_end;
+	char  *at;
+	size_t head_len;
+
+	memset(ev, 0, sizeof(*ev));
+	buf[len] = '\0';
+
+	head_end = memchr(buf, '\0', len);
+	if (!head_end)
+		return false;
+	at = strchr(buf, '@');
+	if (!at || at == buf)
+		return false;
+
+	*at          = '\0';
+	head_len     = (size_t)(head_end - buf) + 1;
+	ev->action   = buf;
+	ev->devpath  = at + 1;
+	ev->vars     = buf + head_len;
+	ev->vars_len = len - head_len;
+
+	ev->subsystem = barny_uevent_get(ev, "SUBSYSTEM");
+	return ev->subsystem != NULL;
+}
+
+const char *
+barny_uevent_get(const barny_uevent_t *ev, const char *key)
+{
+	size_t      klen = strlen(key);
+	const char *p    = ev->vars;
+	const char *end  = ev->vars + ev->vars_len;
+
+	while (p < end) {
+		if (strncmp(p, key, klen) == 0 && p[klen] == '=')
+			return p + klen + 1;
+		p += strlen(p) + 1;
+	}
+
+	return NULL;
+}
+
+int
+barny_uevent_recv(int fd, char *buf, size_t size, barny_uevent_t *ev)
+{
+	struct sockaddr_nl addr;
+	struct iovec       iov;
+	struct msghdr      msg;
+	ssize_t            n;
+
+	for (;;) {
+		iov = (struct iovec){ .iov_base = buf, .iov_len = size - 1 };
+		msg = (struct msghdr){
+			.msg_name    = &addr,
+			.msg_namelen = sizeof(addr),
+			.msg_iov     = &iov,
+			.msg_iovlen  = 1,
+		};
+
+		n = recvmsg(fd, &msg, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return errno == ENOBUFS ? -1 : 0;
+		}
+		if (n == 0)
+			return 0;
+
+		/* anyone can multicast here; only the kernel speaks for devices */
+		if (addr.nl_pid != 0 || (msg.msg_flags & MSG_TRUNC))
+			continue;
+
+		if (barny_uevent_parse(buf, (size_t)n, ev))
+			return 1;
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef BARNY_UEVENT_H
+#define BARNY_UEVENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Kernel uevents straight off NETLINK_KOBJECT_UEVENT, without libudev. Each
+   datagram is "action@devpath" followed by NUL-separated KEY=VALUE pairs;
+   for power_supply devices those carry the same POWER_SUPPLY_* lines as
+   the device's uevent file, so a change can be applied without reading
+   sysfs at all. */
+
+/* the kernel caps the environment at 2048 bytes, the header comes on top */
+#define BARNY_UEVENT_BUF_SIZE 8192
+
+typedef struct {
+	const char *action;
+	const char *devpath;
+	const char *subsystem;
+	/* KEY=VALUE\0KEY=VALUE\0..., pointing into the receive buffer */
+	const char *vars;
+	size_t      vars_len;
+} barny_uevent_t;
+
+/* A non-blocking socket on the kernel's uevent group, or -1. With a
+   subsystem, a socket filter drops every other subsystem's events in the
+   kernel, before they can wake the bar; the callers still check, since
+   the filter is best effort. */
+int
+barny_uevent_open(const char *subsystem);
+
+/* Receives the next kernel event without blocking, skipping anything that
+   did not come from the kernel or does not parse. Returns 1 with *ev set,
+   0 once the socket is drained, and -1 when the kernel dropped events
+   (the caller should reread whatever it tracks). */
+int
+barny_uevent_recv(int fd, char *buf, size_t size, barny_uevent_t *ev);
+
+/* Splits a raw datagram of len bytes; buf must hold len + 1 bytes. */
+bool
+barny_uevent_parse(char *buf, size_t len, barny_uevent_t *ev);
+
+/* The value of KEY, or NULL. */
+const char *
+barny_uevent_get(const barny_uevent_t *ev, const char *key);
+
+#endif
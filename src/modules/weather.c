@@ -3,11 +3,14 @@
 #include <string.h>
 
 #include "barny.h"
+#include "barny_feed.h"
 #include "popup.h"
 #include "util.h"
 
 #define POPUP_LINE_H 26
-#define WEATHER_FILE "/opt/barny/modules/weather"
+
+/* the helper fetches every few minutes; this is for the file only */
+#define WEATHER_POLL_MS 30000
 
 typedef struct {
 	barny_state_t        *state;
@@ -38,6 +41,7 @@ typedef struct {
 	PangoFontDescription *popup_font_desc;
 
 	barny_popup_t        *popup;
+	barny_feed_t         *feed;
 } weather_data_t;
 
 static inline char *
@@ -63,26 +67,31 @@ weather_reset(weather_data_t *d)
 }
 
 static bool
-weather_parse_file(weather_data_t *d, char *bar_str, size_t bar_str_size)
+weather_parse_feed(weather_data_t *d, char *bar_str, size_t bar_str_size)
 {
-	FILE *f;
-	char  line[256];
+	char  text[BARNY_FEED_TEXT_MAX];
+	char *line;
+	char *next;
 	bool  legacy_first_line;
 
-	f = fopen(WEATHER_FILE, "r");
-	if (!f)
+	if (barny_feed_read(d->feed, text, sizeof(text)) < 0)
 		return false;
 
 	weather_reset(d);
 
 	legacy_first_line = true;
 
-	while (fgets(line, sizeof(line), f)) {
-		char *p = trim(line);
+	for (line = text; line; line = next) {
+		char *p;
 		char *eq;
 		char *key;
 		char *value;
 
+		next = strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+
+		p = trim(line);
 		if (!*p)
 			continue;
 
@@ -141,7 +150,6 @@ weather_parse_file(weather_data_t *d, char *bar_str, size_t bar_str_size)
 			d->have_pressure = true;
 		}
 	}
-	fclose(f);
 
 	if (d->have_temp) {
 		if (d->condition[0])
@@ -383,8 +391,9 @@ weather_init(barny_module_t *self, barny_state_t *state)
 	        state->config.font ? state->config.font : "Sans 11");
 	data->popup_font_desc
 	        = barny_popup_font_from(state->config.font, "Sans 11");
+	data->feed = barny_feed_open(state, "weather", self);
 
-	if (!weather_parse_file(data, data->weather_str,
+	if (!weather_parse_feed(data, data->weather_str,
 	                        sizeof(data->weather_str))) {
 		snprintf(data->weather_str, sizeof(data->weather_str), "--");
 	}
@@ -410,6 +419,7 @@ weather_destroy(barny_module_t *self)
 	if (data->popup_font_desc)
 		pango_font_description_free(data->popup_font_desc);
 
+	barny_feed_close(data->feed);
 	free(data);
 	self->data = NULL;
 }
@@ -421,11 +431,17 @@ weather_update(barny_module_t *self)
 	char            old_bar[128];
 	weather_data_t  prev = *data;
 	bool            popup_changed;
+	bool            ok;
 
 	memcpy(old_bar, data->weather_str, sizeof(old_bar));
 
-	if (!weather_parse_file(data, data->weather_str,
-	                        sizeof(data->weather_str)))
+	ok = weather_parse_feed(data, data->weather_str,
+	                        sizeof(data->weather_str));
+
+	/* a helper pinging through shm needs no poll behind it */
+	self->update_interval_ms = barny_feed_live(data->feed) ? 0
+	                                                       : WEATHER_POLL_MS;
+	if (!ok)
 		return;
 
 	if (strcmp(old_bar, data->weather_str) != 0)
@@ -481,7 +497,7 @@ barny_module_weather_create(void)
 	mod->init               = weather_init;
 	mod->destroy            = weather_destroy;
 	mod->update             = weather_update;
-	mod->update_interval_ms = 30000;
+	mod->update_interval_ms = WEATHER_POLL_MS;
 	mod->render             = weather_render;
 	mod->on_hover           = weather_on_hover;
 	mod->data               = data;
@@ -1,58 +1,50 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <cjson/cJSON.h>
 
 #include "barny.h"
+#include "barny_json.h"
 
 typedef struct {
 	barny_state_t        *state;
 	char                  display_str[512];
 	char                  raw_title[512];
+	/* sway's id for the window raw_title belongs to, 0 for none */
+	long                  focused_id;
 	PangoFontDescription *font_desc;
 } windowtitle_data_t;
 
-static const char *
-find_focused_title(cJSON *node)
+/* The focused window in a tree or subtree. sway marks exactly one node
+   focused, so the first one found is it; a focused workspace or output
+   means no window has focus. */
+static bool
+find_focused(const barny_json_t *node, barny_json_t *out)
 {
-	int         k;
-	cJSON      *arr;
-	cJSON      *child;
-	cJSON      *focused;
-	cJSON      *type;
-	const char *t;
-	cJSON      *name;
-	const char *title;
-
-	if (!node || !cJSON_IsObject(node))
-		return NULL;
+	barny_json_t type;
 
-	focused = cJSON_GetObjectItem(node, "focused");
-	type    = cJSON_GetObjectItem(node, "type");
-	if (focused && cJSON_IsTrue(focused)) {
-		t = type ? type->valuestring : NULL;
-		if (!t || (strcmp(t, "con") == 0 || strcmp(t, "floating_con") == 0)) {
-			name = cJSON_GetObjectItem(node, "name");
-			if (name && cJSON_IsString(name))
-				return name->valuestring;
-		}
-	}
+	if (!barny_json_find(node, "focused", "true", out))
+		return false;
 
-	const char *arr_keys[] = { "nodes", "floating_nodes" };
-	for (k = 0; k < 2; k++) {
-		arr = cJSON_GetObjectItem(node, arr_keys[k]);
-		if (!arr || !cJSON_IsArray(arr))
-			continue;
-
-		cJSON_ArrayForEach(child, arr)
-		{
-			title = find_focused_title(child);
-			if (title)
-				return title;
-		}
-	}
+	barny_json_path(out, "type", &type);
+	return !barny_json_is_string(&type) || barny_json_streq(&type, "con")
+	       || barny_json_streq(&type, "floating_con");
+}
 
-	return NULL;
+static bool
+is_empty_workspace(const barny_json_t *node)
+{
+	barny_json_iter_t it;
+	barny_json_t      arr;
+	barny_json_t      child;
+
+	barny_json_path(node, "nodes", &arr);
+	barny_json_iter(&it, &arr);
+	if (barny_json_next(&it, NULL, &child))
+		return false;
+
+	barny_json_path(node, "floating_nodes", &arr);
+	barny_json_iter(&it, &arr);
+	return !barny_json_next(&it, NULL, &child);
 }
 
 static void
@@ -121,14 +113,94 @@ build_display_string(windowtitle_data_t *data)
 	                       data->raw_title, max_len);
 }
 
+/* Returns whether the title changed; a window without one (null name)
+   shows the empty text, and so does a NULL con. */
+static bool
+set_title(windowtitle_data_t *data, const barny_json_t *con)
+{
+	barny_json_t id   = { 0 };
+	barny_json_t name = { 0 };
+	char         new_title[sizeof(data->raw_title)];
+
+	if (con) {
+		barny_json_path(con, "id", &id);
+		barny_json_path(con, "name", &name);
+	}
+	data->focused_id = barny_json_long(&id, 0);
+	barny_json_string(&name, new_title, sizeof(new_title));
+
+	if (strcmp(new_title, data->raw_title) == 0)
+		return false;
+
+	memcpy(data->raw_title, new_title, sizeof(new_title));
+	build_display_string(data);
+	return true;
+}
+
+/* Window events carry the container they are about, workspace focus events
+   the whole workspace it moved to; neither needs the tree. */
+static bool
+apply_event(windowtitle_data_t *data, uint32_t type, const char *json_str)
+{
+	barny_json_t json;
+	barny_json_t change;
+	barny_json_t node;
+	barny_json_t id;
+	barny_json_t focused;
+	long         con_id;
+
+	if (!barny_json_parse(json_str, &json))
+		return false;
+
+	if (!barny_json_path(&json, "change", &change)
+	    || !barny_json_is_string(&change))
+		return false;
+
+	if (type == BARNY_SWAY_EVENT_WINDOW) {
+		barny_json_path(&json, "container", &node);
+		barny_json_path(&node, "id", &id);
+		if (!barny_json_is_number(&id))
+			return false;
+		con_id = barny_json_long(&id, 0);
+
+		if (barny_json_streq(&change, "focus")
+		    || (barny_json_streq(&change, "title")
+		        && con_id == data->focused_id))
+			return set_title(data, &node);
+		if (barny_json_streq(&change, "close")
+		    && con_id == data->focused_id)
+			return set_title(data, NULL);
+	} else if (type == BARNY_SWAY_EVENT_WORKSPACE
+	           && barny_json_streq(&change, "focus")) {
+		/* an empty workspace gets no window focus event after it */
+		barny_json_path(&json, "current", &node);
+		if (find_focused(&node, &focused))
+			return set_title(data, &focused);
+		if (is_empty_workspace(&node))
+			return set_title(data, NULL);
+	}
+
+	return false;
+}
+
+/* Sets the title from a GET_TREE reply. */
+static bool
+read_tree(windowtitle_data_t *data, const char *reply)
+{
+	barny_json_t tree;
+	barny_json_t focused;
+
+	if (!barny_json_parse(reply, &tree))
+		return false;
+
+	return set_title(data, find_focused(&tree, &focused) ? &focused : NULL);
+}
+
 static int
 windowtitle_init(barny_module_t *self, barny_state_t *state)
 {
 	windowtitle_data_t *data;
-	uint32_t            type;
 	char               *reply;
-	cJSON              *tree;
-	const char         *title;
 
 	data            = self->data;
 	data->state     = state;
@@ -136,21 +208,11 @@ windowtitle_init(barny_module_t *self, barny_state_t *state)
 	data->font_desc = pango_font_description_from_string(
 	        state->config.font ? state->config.font : "Sans 11");
 
-	if (state->sway_ipc_fd >= 0) {
-		barny_sway_ipc_send(state, 4, "");
-		reply = barny_sway_ipc_recv_sync(state, &type, 500);
+	if (state->sway_cmds.fd >= 0) {
+		reply = barny_sway_ipc_request(state, BARNY_SWAY_IPC_GET_TREE, "",
+		                               500);
 		if (reply) {
-			tree = cJSON_Parse(reply);
-			if (tree) {
-				title = find_focused_title(tree);
-				if (title) {
-					strncpy(data->raw_title, title,
-					        sizeof(data->raw_title) - 1);
-					data->raw_title[sizeof(data->raw_title) - 1]
-					        = '\0';
-				}
-				cJSON_Delete(tree);
-			}
+			read_tree(data, reply);
 			free(reply);
 		}
 
@@ -227,40 +289,37 @@ barny_module_windowtitle_create(void)
 	return mod;
 }
 
+/* The full resync, for a fresh connection: events only carry deltas. */
 void
 barny_windowtitle_refresh(barny_module_t *mod)
 {
 	windowtitle_data_t *data;
-	uint32_t            type;
 	char               *reply;
-	cJSON              *tree;
-	const char         *title;
-	const char         *new_title;
 
 	if (!mod || strcmp(mod->name, "windowtitle") != 0)
 		return;
 
 	data = mod->data;
-	if (data->state->sway_ipc_fd < 0)
+	if (data->state->sway_cmds.fd < 0)
 		return;
 
-	barny_sway_ipc_send(data->state, 4, "");
-	reply = barny_sway_ipc_recv_sync(data->state, &type, 50);
+	reply = barny_sway_ipc_request(data->state, BARNY_SWAY_IPC_GET_TREE, "",
+	                               500);
 	if (!reply)
 		return;
 
-	tree = cJSON_Parse(reply);
-	if (tree) {
-		title     = find_focused_title(tree);
-		new_title = title ? title : "";
-		if (strcmp(new_title, data->raw_title) != 0) {
-			strncpy(data->raw_title, new_title,
-			        sizeof(data->raw_title) - 1);
-			data->raw_title[sizeof(data->raw_title) - 1] = '\0';
-			build_display_string(data);
-			mod->dirty = true;
-		}
-		cJSON_Delete(tree);
-	}
+	if (read_tree(data, reply))
+		mod->dirty = true;
 	free(reply);
 }
+
+void
+barny_windowtitle_event(barny_module_t *mod, uint32_t type,
+                        const char *payload)
+{
+	if (!mod || strcmp(mod->name, "windowtitle") != 0)
+		return;
+
+	if (apply_event(mod->data, type, payload))
+		mod->dirty = true;
+}
@@ -2,9 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
-#include <cjson/cJSON.h>
 
 #include "barny.h"
+#include "barny_json.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -13,8 +13,10 @@
 #define MAX_WORKSPACES 10
 
 typedef struct {
+	long  id;
 	int   num;
 	char *name;
+	char  output[32];
 	bool  focused;
 	bool  visible;
 	bool  urgent;
@@ -27,12 +29,55 @@ typedef struct {
 	PangoFontDescription *font_desc;
 } workspace_data_t;
 
+/* Fills info from a GET_WORKSPACES entry or an event's workspace node, in
+   one walk over its members. */
+static void
+read_workspace(workspace_info_t *info, const barny_json_t *ws)
+{
+	barny_json_iter_t it;
+	barny_json_t      key;
+	barny_json_t      val;
+	char              name[256];
+	bool              have_name;
+
+	free(info->name);
+	info->id        = 0;
+	info->num       = 0;
+	info->name      = NULL;
+	info->output[0] = '\0';
+	info->focused   = false;
+	info->visible   = false;
+	info->urgent    = false;
+	have_name       = false;
+
+	barny_json_iter(&it, ws);
+	while (barny_json_next(&it, &key, &val)) {
+		if (barny_json_streq(&key, "id"))
+			info->id = barny_json_long(&val, 0);
+		else if (barny_json_streq(&key, "num"))
+			info->num = (int)barny_json_long(&val, 0);
+		else if (barny_json_streq(&key, "name"))
+			have_name = barny_json_string(&val, name, sizeof(name));
+		else if (barny_json_streq(&key, "output"))
+			barny_json_string(&val, info->output, sizeof(info->output));
+		else if (barny_json_streq(&key, "focused"))
+			info->focused = barny_json_is_true(&val);
+		else if (barny_json_streq(&key, "visible"))
+			info->visible = barny_json_is_true(&val);
+		else if (barny_json_streq(&key, "urgent"))
+			info->urgent = barny_json_is_true(&val);
+	}
+
+	info->name = strdup(have_name ? name : "?");
+}
+
 static void
 parse_workspaces(workspace_data_t *data, const char *json_str)
 {
-	cJSON *json;
-	cJSON *ws;
-	int    i;
+	barny_json_iter_t it;
+	barny_json_t      json;
+	barny_json_t      ws;
+	int               i;
 
 	for (i = 0; i < data->workspace_count; i++) {
 		free(data->workspaces[i].name);
@@ -40,47 +85,173 @@ parse_workspaces(workspace_data_t *data, const char *json_str)
 	}
 	data->workspace_count = 0;
 
-	json                  = cJSON_Parse(json_str);
-	if (!json)
+	if (!barny_json_parse(json_str, &json))
 		return;
 
-	cJSON_ArrayForEach(ws, json)
-	{
-		workspace_info_t *info;
-		cJSON            *num;
-		cJSON            *name;
-		cJSON            *focused;
-		cJSON            *visible;
-		cJSON            *urgent;
+	barny_json_iter(&it, &json);
+	while (data->workspace_count < MAX_WORKSPACES
+	       && barny_json_next(&it, NULL, &ws)) {
+		read_workspace(&data->workspaces[data->workspace_count], &ws);
+		data->workspace_count++;
+	}
+}
+
+static workspace_info_t *
+find_workspace(workspace_data_t *data, long id)
+{
+	int i;
+
+	for (i = 0; i < data->workspace_count; i++) {
+		if (data->workspaces[i].id == id)
+			return &data->workspaces[i];
+	}
+
+	return NULL;
+}
+
+/* sway lists workspaces output by output, numbered ones in order within
+   each; a new one goes where GET_WORKSPACES would have put it. */
+static workspace_info_t *
+insert_workspace(workspace_data_t *data, const barny_json_t *node)
+{
+	workspace_info_t info = { 0 };
+	int              at;
+	int              i;
+
+	if (data->workspace_count >= MAX_WORKSPACES)
+		return NULL;
+
+	/* an event node's focused flag is container focus; the focus event
+	   that follows says which workspace has it */
+	read_workspace(&info, node);
+	info.focused = false;
+	info.visible = false;
 
-		if (data->workspace_count >= MAX_WORKSPACES)
+	at = data->workspace_count;
+	for (i = 0; i < data->workspace_count; i++) {
+		if (strcmp(data->workspaces[i].output, info.output) != 0)
+			continue;
+		at = i + 1;
+		if (info.num >= 0 && (data->workspaces[i].num > info.num
+		                      || data->workspaces[i].num < 0)) {
+			at = i;
 			break;
+		}
+	}
 
-		info          = &data->workspaces[data->workspace_count];
+	memmove(&data->workspaces[at + 1], &data->workspaces[at],
+	        (size_t)(data->workspace_count - at) * sizeof(info));
+	data->workspaces[at] = info;
+	data->workspace_count++;
+	return &data->workspaces[at];
+}
 
-		num           = cJSON_GetObjectItem(ws, "num");
-		name          = cJSON_GetObjectItem(ws, "name");
-		focused       = cJSON_GetObjectItem(ws, "focused");
-		visible       = cJSON_GetObjectItem(ws, "visible");
-		urgent        = cJSON_GetObjectItem(ws, "urgent");
+static void
+remove_workspace(workspace_data_t *data, workspace_info_t *ws)
+{
+	int at = (int)(ws - data->workspaces);
 
-		info->num     = num ? num->valueint : 0;
-		info->name    = name ? strdup(name->valuestring) : strdup("?");
-		info->focused = focused ? cJSON_IsTrue(focused) : false;
-		info->visible = visible ? cJSON_IsTrue(visible) : false;
-		info->urgent  = urgent ? cJSON_IsTrue(urgent) : false;
+	free(ws->name);
+	memmove(ws, ws + 1,
+	        (size_t)(data->workspace_count - at - 1) * sizeof(*ws));
+	data->workspace_count--;
+}
 
-		data->workspace_count++;
+/* Only one workspace per output is visible, and only one has focus. */
+static void
+show_workspace(workspace_data_t *data, workspace_info_t *ws, bool focus)
+{
+	int i;
+
+	for (i = 0; i < data->workspace_count; i++) {
+		if (focus)
+			data->workspaces[i].focused = false;
+		if (strcmp(data->workspaces[i].output, ws->output) == 0)
+			data->workspaces[i].visible = false;
 	}
 
-	cJSON_Delete(json);
+	ws->visible = true;
+	if (focus)
+		ws->focused = true;
+}
+
+/* Applies one workspace event ({"change", "current", "old"}) to the list.
+   Returns whether anything on screen changed. */
+static bool
+apply_workspace_event(workspace_data_t *data, const char *json_str)
+{
+	barny_json_t      json;
+	barny_json_t      change;
+	barny_json_t      current;
+	barny_json_t      id;
+	barny_json_t      urgent;
+	barny_json_t      visible;
+	workspace_info_t *ws;
+	bool              was_focused;
+	bool              was_visible;
+	bool              changed = false;
+
+	if (!barny_json_parse(json_str, &json))
+		return false;
+
+	barny_json_path(&json, "change", &change);
+	barny_json_path(&json, "current", &current);
+	barny_json_path(&current, "id", &id);
+	if (!barny_json_is_string(&change) || !barny_json_is_number(&id))
+		return false;
+
+	ws = find_workspace(data, barny_json_long(&id, 0));
+	barny_json_path(&current, "urgent", &urgent);
+	barny_json_path(&current, "visible", &visible);
+
+	if (barny_json_streq(&change, "init")) {
+		changed = !ws && insert_workspace(data, &current);
+	} else if (barny_json_streq(&change, "empty")) {
+		if (ws) {
+			remove_workspace(data, ws);
+			changed = true;
+		}
+	} else if (barny_json_streq(&change, "focus")) {
+		if (!ws)
+			ws = insert_workspace(data, &current);
+		if (ws) {
+			show_workspace(data, ws, true);
+			ws->urgent = barny_json_is_true(&urgent);
+			changed    = true;
+		}
+	} else if (barny_json_streq(&change, "rename")
+	           || barny_json_streq(&change, "move")) {
+		/* keep what we knew about focus; a move may change what is
+		   visible, so take that from the node when it says */
+		if (ws) {
+			was_focused = ws->focused;
+			was_visible = ws->visible;
+			remove_workspace(data, ws);
+			ws = insert_workspace(data, &current);
+			if (ws) {
+				ws->focused = was_focused;
+				ws->visible = visible.start
+				                      ? barny_json_is_true(&visible)
+				                      : was_visible;
+				if (ws->visible)
+					show_workspace(data, ws, ws->focused);
+				changed = true;
+			}
+		}
+	} else if (barny_json_streq(&change, "urgent")) {
+		if (ws) {
+			changed    = ws->urgent != barny_json_is_true(&urgent);
+			ws->urgent = barny_json_is_true(&urgent);
+		}
+	}
+
+	return changed;
 }
 
 static int
 workspace_init(barny_module_t *self, barny_state_t *state)
 {
 	workspace_data_t *data = self->data;
-	uint32_t          type;
 	char             *reply;
 
 	data->state     = state;
@@ -88,9 +259,10 @@ workspace_init(barny_module_t *self, barny_state_t *state)
 	data->font_desc = pango_font_description_from_string(
 	        state->config.font ? state->config.font : "Sans Bold 10");
 
-	if (state->sway_ipc_fd >= 0) {
-		barny_sway_ipc_send(state, 1, "");
-		reply = barny_sway_ipc_recv_sync(state, &type, 500);
+	if (state->sway_cmds.fd >= 0) {
+		reply = barny_sway_ipc_request(state,
+		                               BARNY_SWAY_IPC_GET_WORKSPACES, "",
+		                               500);
 		if (reply) {
 			parse_workspaces(data, reply);
 			free(reply);
@@ -291,19 +463,15 @@ workspace_click(barny_module_t *self, int button, int click_x, int click_y)
 	rel_x = click_x - base_x;
 
 	for (i = 0; i < data->workspace_count; i++) {
-		int      cx   = x + indicator_size / 2;
-		int      dist = abs(rel_x - cx);
-		char     cmd[256];
-		uint32_t type;
-		char    *reply;
+		int  cx   = x + indicator_size / 2;
+		int  dist = abs(rel_x - cx);
+		char cmd[256];
 
+		/* pipelined: the event loop reads and drops the reply */
 		if (dist < indicator_size / 2) {
 			snprintf(cmd, sizeof(cmd), "workspace number %d",
 			         data->workspaces[i].num);
-			barny_sway_ipc_send(data->state, 0, cmd);
-
-			reply = barny_sway_ipc_recv(data->state, &type);
-			free(reply);
+			barny_sway_ipc_command(data->state, cmd);
 			break;
 		}
 
@@ -337,26 +505,36 @@ barny_module_workspace_create(void)
 	return mod;
 }
 
+/* The full resync, for a fresh connection: events only carry deltas. */
 void
 barny_workspace_refresh(barny_module_t *mod)
 {
 	workspace_data_t *data;
-	uint32_t          type;
 	char             *reply;
 
 	if (!mod || strcmp(mod->name, "workspace") != 0)
 		return;
 
 	data = mod->data;
-	if (data->state->sway_ipc_fd < 0)
+	if (data->state->sway_cmds.fd < 0)
 		return;
 
-	barny_sway_ipc_send(data->state, 1, "");
-
-	reply = barny_sway_ipc_recv_sync(data->state, &type, 10);
+	reply = barny_sway_ipc_request(data->state,
+	                               BARNY_SWAY_IPC_GET_WORKSPACES, "", 500);
 	if (reply) {
 		parse_workspaces(data, reply);
 		free(reply);
 		mod->dirty = true;
 	}
 }
+
+void
+barny_workspace_event(barny_module_t *mod, uint32_t type, const char *payload)
+{
+	if (!mod || strcmp(mod->name, "workspace") != 0)
+		return;
+
+	if (type == BARNY_SWAY_EVENT_WORKSPACE
+	    && apply_workspace_event(mod->data, payload))
+		mod->dirty = true;
+}
@@ -0,0 +1,182 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "barny.h"
+
+#define POOL_MAX_THREADS     16
+/* Two bands per worker: the droplet's rows are not equally expensive (the
+   far rows above and below the pill are plain copies), so finer bands let a
+   worker that drew cheap rows pick up more instead of idling. */
+#define POOL_BANDS_PER_THREAD 2
+
+/* A job is published by bumping gen; every worker wakes for every job, claims
+   bands off next until none are left, then checks out through pending. The
+   main thread only publishes a job once pending has reached zero, so no
+   worker can still be inside the previous job when next is reset -- that is
+   what lets the band counter be a bare fetch-add. */
+struct barny_pool {
+	pthread_t        threads[POOL_MAX_THREADS];
+	int              nthreads;
+
+	_Atomic uint32_t gen;
+	_Atomic uint32_t next;
+	_Atomic uint32_t pending;
+	atomic_bool      quit;
+
+	barny_band_fn    fn;
+	void            *ctx;
+	int              rows;
+	int              nbands;
+};
+
+static void
+futex_wait(_Atomic uint32_t *word, uint32_t val)
+{
+	syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void
+futex_wake(_Atomic uint32_t *word, int n)
+{
+	syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static void
+pool_drain(barny_pool_t *pool)
+{
+	uint32_t b;
+
+	while ((b = atomic_fetch_add(&pool->next, 1)) < (uint32_t)pool->nbands) {
+		int y0 = (int)((long)pool->rows * b / pool->nbands);
+		int y1 = (int)((long)pool->rows * (b + 1) / pool->nbands);
+
+		if (y1 > y0)
+			pool->fn(pool->ctx, y0, y1);
+	}
+}
+
+static void *
+pool_worker(void *arg)
+{
+	barny_pool_t *pool = arg;
+	uint32_t      seen = 0;
+
+	for (;;) {
+		uint32_t gen = atomic_load(&pool->gen);
+
+		/* parked here between frames: no spinning, no timer */
+		if (gen == seen) {
+			futex_wait(&pool->gen, seen);
+			continue;
+		}
+		seen = gen;
+
+		if (atomic_load(&pool->quit))
+			break;
+
+		pool_drain(pool);
+
+		if (atomic_fetch_sub(&pool->pending, 1) == 1)
+			futex_wake(&pool->pending, 1);
+	}
+
+	return NULL;
+}
+
+barny_pool_t *
+barny_pool_create(int threads)
+{
+	barny_pool_t *pool;
+	char          name[16];
+	int           i;
+	int           err;
+
+	if (threads <= 0)
+		return NULL;
+	if (threads > POOL_MAX_THREADS)
+		threads = POOL_MAX_THREADS;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < threads; i++) {
+		err = pthread_create(&pool->threads[i], NULL, pool_worker, pool);
+		if (err != 0) {
+			fprintf(stderr, "barny: render worker %d: %s\n", i,
+			        strerror(err));
+			break;
+		}
+		snprintf(name, sizeof(name), "barny-render%d", i);
+		pthread_setname_np(pool->threads[i], name);
+		pool->nthreads++;
+	}
+
+	if (pool->nthreads == 0) {
+		free(pool);
+		return NULL;
+	}
+
+	printf("barny: %d render worker%s\n", pool->nthreads,
+	       pool->nthreads == 1 ? "" : "s");
+
+	return pool;
+}
+
+void
+barny_pool_destroy(barny_pool_t *pool)
+{
+	int i;
+
+	if (!pool)
+		return;
+
+	atomic_store(&pool->quit, true);
+	atomic_fetch_add(&pool->gen, 1);
+	futex_wake(&pool->gen, INT_MAX);
+
+	for (i = 0; i < pool->nthreads; i++)
+		pthread_join(pool->threads[i], NULL);
+
+	free(pool);
+}
+
+void
+barny_pool_run(barny_pool_t *pool, barny_band_fn fn, void *ctx, int rows)
+{
+	uint32_t left;
+	int      nbands;
+
+	if (rows <= 0)
+		return;
+
+	/* no pool: the caller's thread does it all, as before workers existed */
+	if (!pool) {
+		fn(ctx, 0, rows);
+		return;
+	}
+
+	nbands = pool->nthreads * POOL_BANDS_PER_THREAD;
+	if (nbands > rows)
+		nbands = rows;
+
+	pool->fn     = fn;
+	pool->ctx    = ctx;
+	pool->rows   = rows;
+	pool->nbands = nbands;
+	atomic_store(&pool->next, 0);
+	atomic_store(&pool->pending, (uint32_t)pool->nthreads);
+	atomic_fetch_add(&pool->gen, 1);
+	futex_wake(&pool->gen, INT_MAX);
+
+	while ((left = atomic_load(&pool->pending)) != 0)
+		futex_wait(&pool->pending, left);
+}
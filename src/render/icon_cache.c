@@ -0,0 +1,180 @@
+#include <math.h>
+#include <string.h>
+
+#include "barny.h"
+
+/* Tray icons arrive as raw pixmaps and used to be scaled to fit on every
+   render, in the tray and again in the overflow menu. They change rarely --
+   some applications re-send the very same pixmap every few seconds -- so
+   the scaled copy is kept instead, keyed by what the pixels hash to and the
+   device-pixel size they are drawn at. A repeat of the same icon, on any
+   item, is then a lookup and a plain blit.
+
+   The cache is small and shared by every item; the least recently drawn
+   entry makes way when it is full. */
+
+typedef struct {
+	uint64_t         hash;
+	int              size;
+	uint64_t         used;
+	cairo_surface_t *surface;
+} icon_entry_t;
+
+static icon_entry_t icon_cache[BARNY_ICON_CACHE_SIZE];
+static uint64_t     icon_clock;
+static uint64_t     icon_misses;
+
+uint64_t
+barny_icon_hash(const void *pixels, size_t len, int width, int height)
+{
+	const unsigned char *p = pixels;
+	uint64_t             h = 0xcbf29ce484222325ull;
+	size_t               i;
+
+	/* FNV-1a; the size goes in first, so a reshaped icon never collides
+	   with the one it replaced */
+	h = (h ^ (uint32_t)width) * 0x100000001b3ull;
+	h = (h ^ (uint32_t)height) * 0x100000001b3ull;
+	for (i = 0; i < len; i++)
+		h = (h ^ p[i]) * 0x100000001b3ull;
+
+	/* 0 means "not cacheable" to everyone else */
+	return h ? h : 1;
+}
+
+cairo_surface_t *
+barny_icon_scale_to_fit(cairo_surface_t *src, int size)
+{
+	cairo_surface_t *dst;
+	cairo_t         *cr;
+	int              w = cairo_image_surface_get_width(src);
+	int              h = cairo_image_surface_get_height(src);
+	double           scale;
+	int              dw, dh;
+
+	if (w <= 0 || h <= 0)
+		return NULL;
+
+	if ((w > h ? w : h) == size)
+		return cairo_surface_reference(src);
+
+	scale = (double)size / (w > h ? w : h);
+	dw    = (int)lround(w * scale);
+	dh    = (int)lround(h * scale);
+	if (dw < 1)
+		dw = 1;
+	if (dh < 1)
+		dh = 1;
+
+	dst = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, dw, dh);
+	if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(dst);
+		return NULL;
+	}
+
+	cr = cairo_create(dst);
+	cairo_scale(cr, scale, scale);
+	cairo_set_source_surface(cr, src, 0, 0);
+	/* downscaling by more than half is where the default filter aliases */
+	cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+
+	return dst;
+}
+
+cairo_surface_t *
+barny_icon_cache_get(cairo_surface_t *src, uint64_t hash, int size)
+{
+	icon_entry_t *victim = &icon_cache[0];
+	int           i;
+
+	if (!src || !hash || size <= 0)
+		return NULL;
+
+	for (i = 0; i < BARNY_ICON_CACHE_SIZE; i++) {
+		if (icon_cache[i].surface && icon_cache[i].hash == hash
+		    && icon_cache[i].size == size) {
+			icon_cache[i].used = ++icon_clock;
+			return icon_cache[i].surface;
+		}
+		if (!icon_cache[i].surface
+		    || (victim->surface && icon_cache[i].used < victim->used))
+			victim = &icon_cache[i];
+	}
+
+	icon_misses++;
+	if (victim->surface)
+		cairo_surface_destroy(victim->surface);
+
+	victim->surface = barny_icon_scale_to_fit(src, size);
+	victim->hash    = hash;
+	victim->size    = size;
+	victim->used    = ++icon_clock;
+	return victim->surface;
+}
+
+uint64_t
+barny_icon_cache_misses(void)
+{
+	return icon_misses;
+}
+
+void
+barny_icon_cache_clear(void)
+{
+	int i;
+
+	for (i = 0; i < BARNY_ICON_CACHE_SIZE; i++) {
+		if (icon_cache[i].surface)
+			cairo_surface_destroy(icon_cache[i].surface);
+	}
+	memset(icon_cache, 0, sizeof(icon_cache));
+}
+
+void
+barny_icon_paint(cairo_t *cr, cairo_surface_t *icon, uint64_t hash, double x,
+                 double y, double box, double alpha)
+{
+	cairo_surface_t *scaled;
+	double           dev_x = box;
+	double           dev_y = 0;
+	double           dev;
+	double           scale;
+	int              iw, ih;
+
+	if (!icon || cairo_surface_status(icon) != CAIRO_STATUS_SUCCESS
+	    || box <= 0)
+		return;
+
+	/* the bar's buffers carry the output scale in their matrix */
+	cairo_user_to_device_distance(cr, &dev_x, &dev_y);
+	dev    = hypot(dev_x, dev_y) / box;
+	scaled = barny_icon_cache_get(icon, hash, (int)lround(box * dev));
+
+	cairo_save(cr);
+	if (scaled) {
+		iw = cairo_image_surface_get_width(scaled);
+		ih = cairo_image_surface_get_height(scaled);
+		/* centred on whole device pixels, so the blit stays sharp */
+		cairo_translate(cr,
+		                x + round((box * dev - iw) / 2.0) / dev,
+		                y + round((box * dev - ih) / 2.0) / dev);
+		cairo_scale(cr, 1.0 / dev, 1.0 / dev);
+		cairo_set_source_surface(cr, scaled, 0, 0);
+	} else {
+		iw = cairo_image_surface_get_width(icon);
+		ih = cairo_image_surface_get_height(icon);
+		if (iw <= 0 || ih <= 0) {
+			cairo_restore(cr);
+			return;
+		}
+		scale = box / (iw > ih ? iw : ih);
+		cairo_translate(cr, x + (box - iw * scale) / 2.0,
+		                y + (box - ih * scale) / 2.0);
+		cairo_scale(cr, scale, scale);
+		cairo_set_source_surface(cr, icon, 0, 0);
+	}
+	cairo_paint_with_alpha(cr, alpha);
+	cairo_restore(cr);
+}
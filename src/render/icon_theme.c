@@ -0,0 +1,1211 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef BARNY_RSVG
+#include <librsvg/rsvg.h>
+#endif
+
+#include "barny.h"
+
+/* Tray items that only publish an IconName need it looked up in the icon
+   theme, and a theme is thousands of files across a few dozen directories
+   per size and context, searched theme by theme down the Inherits chain.
+   Walking that for every item is what the placeholder was standing in for.
+
+   So the walk happens once and its result is kept under
+   $XDG_CACHE_HOME/barny as an index: an open-addressed table from icon name
+   to the run of files that provide it (path, pixel size, scalable, which
+   theme in the chain). A warm start maps the file and checks it against the
+   mtime of every directory the walk went through; only a changed directory
+   -- an icon installed, a theme added -- causes another walk.
+
+   None of it happens on the main thread. Lookups, decoding and the first
+   walk all run on one loader thread; finished icons come back over an
+   eventfd, and until then the item shows its placeholder. */
+
+#define ICON_INDEX_MAGIC   "BARNYIC"
+#define ICON_INDEX_VERSION 1
+#define ICON_MAX_THEMES    8
+#define ICON_MAX_DIRS      16
+/* theme/size/context/file, or theme/context/size/file */
+#define ICON_WALK_DEPTH    3
+
+#define ICON_SCALABLE 0x1
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t ndirs;
+	uint32_t nslots; /* a power of two, at most half full */
+	uint32_t ncands;
+	uint32_t strings;
+	uint32_t reserved;
+	uint64_t key;
+} icon_index_header_t;
+
+/* every directory the walk saw, missing ones with a zero mtime */
+typedef struct {
+	uint32_t path;
+	uint32_t reserved;
+	int64_t  mtime_sec;
+	int64_t  mtime_nsec;
+} icon_index_dir_t;
+
+typedef struct {
+	uint32_t hash;
+	uint32_t first;
+	uint32_t count; /* 0: empty slot */
+} icon_index_slot_t;
+
+/* a name's candidates are adjacent, by theme rank and then size */
+typedef struct {
+	uint32_t name;
+	uint32_t path;
+	uint16_t size;
+	uint8_t  flags;
+	uint8_t  rank;
+} icon_index_cand_t;
+
+typedef struct {
+	void                      *base;
+	size_t                     len;
+	bool                       mapped;
+	const icon_index_header_t *hdr;
+	const icon_index_dir_t    *dirs;
+	const icon_index_slot_t   *slots;
+	const icon_index_cand_t   *cands;
+	const char                *strings;
+} icon_index_t;
+
+/* Where to look: the theme chain, the icons directories it lives in, and
+   the flat pixmaps directories after every theme. */
+typedef struct {
+	char *themes[ICON_MAX_THEMES];
+	int   nthemes;
+	char *roots[ICON_MAX_DIRS];
+	int   nroots;
+	char *pixmaps[ICON_MAX_DIRS];
+	int   npixmaps;
+} icon_search_t;
+
+static uint64_t
+fnv1a(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t         i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+static uint32_t
+name_hash(const char *name)
+{
+	uint32_t h = 2166136261u;
+
+	for (; *name; name++)
+		h = (h ^ (uint8_t)*name) * 16777619u;
+
+	return h;
+}
+
+static void
+search_add(char **list, int *count, const char *dir, const char *suffix)
+{
+	char path[PATH_MAX];
+	int  i;
+
+	if (*count == ICON_MAX_DIRS || !dir || !*dir)
+		return;
+	if (snprintf(path, sizeof(path), "%s%s", dir, suffix)
+	    >= (int)sizeof(path))
+		return;
+	for (i = 0; i < *count; i++) {
+		if (strcmp(list[i], path) == 0)
+			return;
+	}
+
+	list[*count] = strdup(path);
+	if (list[*count])
+		(*count)++;
+}
+
+/* The icon theme spec's base directories, in its order. */
+static void
+search_default_dirs(icon_search_t *s)
+{
+	const char *home = getenv("HOME");
+	const char *data = getenv("XDG_DATA_HOME");
+	const char *dirs = getenv("XDG_DATA_DIRS");
+	char        buf[PATH_MAX];
+	char       *dir;
+	char       *save;
+
+	if (data && *data) {
+		search_add(s->roots, &s->nroots, data, "/icons");
+	} else if (home && *home) {
+		snprintf(buf, sizeof(buf), "%s/.local/share", home);
+		search_add(s->roots, &s->nroots, buf, "/icons");
+	}
+	if (home && *home)
+		search_add(s->roots, &s->nroots, home, "/.icons");
+
+	snprintf(buf, sizeof(buf), "%s",
+	         dirs && *dirs ? dirs : "/usr/local/share:/usr/share");
+	for (dir = strtok_r(buf, ":", &save); dir;
+	     dir = strtok_r(NULL, ":", &save)) {
+		search_add(s->roots, &s->nroots, dir, "/icons");
+		search_add(s->pixmaps, &s->npixmaps, dir, "/pixmaps");
+	}
+}
+
+static bool
+search_has_theme(const icon_search_t *s, const char *name)
+{
+	int i;
+
+	for (i = 0; i < s->nthemes; i++) {
+		if (strcmp(s->themes[i], name) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+/* Reads Inherits= from the first index.theme found for themes[i]. */
+static void
+search_inherits(icon_search_t *s, int i)
+{
+	char  path[PATH_MAX];
+	char  line[1024];
+	char *name;
+	char *save;
+	FILE *f = NULL;
+	int   r;
+
+	for (r = 0; r < s->nroots && !f; r++) {
+		snprintf(path, sizeof(path), "%s/%s/index.theme", s->roots[r],
+		         s->themes[i]);
+		f = fopen(path, "re");
+	}
+	if (!f)
+		return;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "Inherits=", 9) != 0)
+			continue;
+		line[strcspn(line, "\r\n")] = '\0';
+		for (name = strtok_r(line + 9, ",", &save); name;
+		     name = strtok_r(NULL, ",", &save)) {
+			name += strspn(name, " \t");
+			if (*name && s->nthemes < ICON_MAX_THEMES - 1
+			    && !search_has_theme(s, name)) {
+				s->themes[s->nthemes] = strdup(name);
+				if (s->themes[s->nthemes])
+					s->nthemes++;
+			}
+		}
+		break;
+	}
+
+	fclose(f);
+}
+
+/* The configured theme, what it inherits (breadth first), and hicolor,
+   which every chain ends in. */
+static void
+search_themes(icon_search_t *s, const char *theme)
+{
+	int i;
+
+	if (theme && *theme) {
+		s->themes[0] = strdup(theme);
+		if (s->themes[0])
+			s->nthemes = 1;
+	}
+	for (i = 0; i < s->nthemes; i++)
+		search_inherits(s, i);
+
+	if (!search_has_theme(s, "hicolor")) {
+		s->themes[s->nthemes] = strdup("hicolor");
+		if (s->themes[s->nthemes])
+			s->nthemes++;
+	}
+}
+
+static void
+search_free(icon_search_t *s)
+{
+	int i;
+
+	for (i = 0; i < s->nthemes; i++)
+		free(s->themes[i]);
+	for (i = 0; i < s->nroots; i++)
+		free(s->roots[i]);
+	for (i = 0; i < s->npixmaps; i++)
+		free(s->pixmaps[i]);
+	memset(s, 0, sizeof(*s));
+}
+
+/* What the index was built from; a different chain needs another walk
+   even where no directory changed. */
+static uint64_t
+search_key(const icon_search_t *s)
+{
+	uint64_t h       = 0xcbf29ce484222325ULL;
+	uint32_t version = ICON_INDEX_VERSION;
+	int      i;
+
+	h = fnv1a(h, &version, sizeof(version));
+	for (i = 0; i < s->nthemes; i++)
+		h = fnv1a(h, s->themes[i], strlen(s->themes[i]) + 1);
+	h = fnv1a(h, "|", 1);
+	for (i = 0; i < s->nroots; i++)
+		h = fnv1a(h, s->roots[i], strlen(s->roots[i]) + 1);
+	h = fnv1a(h, "|", 1);
+	for (i = 0; i < s->npixmaps; i++)
+		h = fnv1a(h, s->pixmaps[i], strlen(s->pixmaps[i]) + 1);
+
+	return h;
+}
+
+/* --- building --- */
+
+typedef struct {
+	char    *name;
+	char    *path;
+	uint16_t size;
+	uint8_t  flags;
+	uint8_t  rank;
+} icon_cand_t;
+
+typedef struct {
+	char           *path;
+	struct timespec mtime;
+} icon_dir_t;
+
+typedef struct {
+	icon_cand_t *cands;
+	size_t       ncands;
+	size_t       cands_cap;
+	icon_dir_t  *dirs;
+	size_t       ndirs;
+	size_t       dirs_cap;
+} icon_builder_t;
+
+static bool
+builder_grow(void **arr, size_t *cap, size_t n, size_t elem)
+{
+	void  *grown;
+	size_t c;
+
+	if (n < *cap)
+		return true;
+
+	c     = *cap ? *cap * 2 : 256;
+	grown = realloc(*arr, c * elem);
+	if (!grown)
+		return false;
+	*arr = grown;
+	*cap = c;
+	return true;
+}
+
+static void
+builder_dir(icon_builder_t *b, const char *path, const struct stat *st)
+{
+	icon_dir_t *d;
+
+	if (!builder_grow((void **)&b->dirs, &b->dirs_cap, b->ndirs,
+	                  sizeof(*b->dirs)))
+		return;
+
+	d        = &b->dirs[b->ndirs];
+	d->path  = strdup(path);
+	d->mtime = st ? st->st_mtim : (struct timespec){ 0 };
+	if (d->path)
+		b->ndirs++;
+}
+
+static void
+builder_file(icon_builder_t *b, const char *dir, const char *file, int size,
+             uint8_t flags, uint8_t rank)
+{
+	const char  *ext = strrchr(file, '.');
+	icon_cand_t *c;
+
+	if (!ext || ext == file
+	    || (strcmp(ext, ".png") != 0 && strcmp(ext, ".svg") != 0))
+		return;
+	if (!builder_grow((void **)&b->cands, &b->cands_cap, b->ncands,
+	                  sizeof(*b->cands)))
+		return;
+
+	c = &b->cands[b->ncands];
+	if (strcmp(ext, ".svg") == 0)
+		flags |= ICON_SCALABLE;
+	c->size  = (uint16_t)(size > 0xffff ? 0xffff : size);
+	c->flags = flags;
+	c->rank  = rank;
+	c->name  = strndup(file, (size_t)(ext - file));
+	if (asprintf(&c->path, "%s/%s", dir, file) < 0)
+		c->path = NULL;
+	if (!c->name || !c->path) {
+		free(c->name);
+		free(c->path);
+		return;
+	}
+	b->ncands++;
+}
+
+/* "48x48", "24x24@2" (an @2 directory holds 48 px icons), "scalable". */
+static void
+dir_size(const char *name, int *size, uint8_t *flags)
+{
+	char *end;
+	long  w;
+	long  h;
+	long  scale = 1;
+
+	if (strcmp(name, "scalable") == 0 || strcmp(name, "symbolic") == 0) {
+		*flags |= ICON_SCALABLE;
+		return;
+	}
+
+	w = strtol(name, &end, 10);
+	if (end == name || *end != 'x')
+		return;
+	h = strtol(end + 1, &end, 10);
+	if (*end == '@')
+		scale = strtol(end + 1, &end, 10);
+	if (*end != '\0' || w <= 0 || w != h || scale <= 0)
+		return;
+
+	*size = (int)(w * scale);
+}
+
+static void
+builder_walk(icon_builder_t *b, const char *dir, int depth, int size,
+             uint8_t flags, uint8_t rank)
+{
+	DIR           *d;
+	struct dirent *e;
+	struct stat    st;
+	char           path[PATH_MAX];
+	bool           is_dir;
+	int            sub_size;
+	uint8_t        sub_flags;
+
+	d = opendir(dir);
+	if (!d || fstat(dirfd(d), &st) < 0) {
+		builder_dir(b, dir, NULL);
+		if (d)
+			closedir(d);
+		return;
+	}
+	builder_dir(b, dir, &st);
+
+	while ((e = readdir(d))) {
+		if (e->d_name[0] == '.')
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name)
+		    >= (int)sizeof(path))
+			continue;
+
+		/* themes are full of symlinked files and directories */
+		is_dir = e->d_type == DT_DIR;
+		if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN)
+			is_dir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+
+		if (!is_dir) {
+			builder_file(b, dir, e->d_name, size, flags, rank);
+		} else if (depth > 0) {
+			sub_size  = size;
+			sub_flags = flags;
+			dir_size(e->d_name, &sub_size, &sub_flags);
+			builder_walk(b, path, depth - 1, sub_size, sub_flags, rank);
+		}
+	}
+
+	closedir(d);
+}
+
+static int
+cand_cmp(const void *pa, const void *pb)
+{
+	const icon_cand_t *a = pa;
+	const icon_cand_t *b = pb;
+	int                c = strcmp(a->name, b->name);
+
+	if (c)
+		return c;
+	if (a->rank != b->rank)
+		return a->rank - b->rank;
+	return a->size - b->size;
+}
+
+static void
+builder_free(icon_builder_t *b)
+{
+	size_t i;
+
+	for (i = 0; i < b->ncands; i++) {
+		free(b->cands[i].name);
+		free(b->cands[i].path);
+	}
+	for (i = 0; i < b->ndirs; i++)
+		free(b->dirs[i].path);
+	free(b->cands);
+	free(b->dirs);
+}
+
+static uint32_t
+put_string(char *strings, size_t *len, const char *s)
+{
+	uint32_t off = (uint32_t)*len;
+	size_t   n   = strlen(s) + 1;
+
+	memcpy(strings + *len, s, n);
+	*len += n;
+	return off;
+}
+
+static void
+index_attach(icon_index_t *idx)
+{
+	const char *p = idx->base;
+
+	idx->hdr     = idx->base;
+	p           += sizeof(icon_index_header_t);
+	idx->dirs    = (const icon_index_dir_t *)p;
+	p           += idx->hdr->ndirs * sizeof(icon_index_dir_t);
+	idx->slots   = (const icon_index_slot_t *)p;
+	p           += idx->hdr->nslots * sizeof(icon_index_slot_t);
+	idx->cands   = (const icon_index_cand_t *)p;
+	p           += idx->hdr->ncands * sizeof(icon_index_cand_t);
+	idx->strings = p;
+}
+
+/* Walks every theme in the chain and lays the index out in one block, the
+   same bytes that go to disk. */
+static bool
+index_build(icon_index_t *idx, const icon_search_t *s, uint64_t key)
+{
+	icon_builder_t       b = { 0 };
+	icon_index_header_t *hdr;
+	icon_index_dir_t    *dirs;
+	icon_index_slot_t   *slots;
+	icon_index_cand_t   *cands;
+	char                *strings;
+	char                 path[PATH_MAX];
+	size_t               str_len;
+	size_t               names;
+	size_t               i, j;
+	uint32_t             nslots;
+	uint32_t             h;
+	uint32_t             slot;
+	int                  t, r;
+
+	for (t = 0; t < s->nthemes; t++) {
+		for (r = 0; r < s->nroots; r++) {
+			snprintf(path, sizeof(path), "%s/%s", s->roots[r],
+			         s->themes[t]);
+			builder_walk(&b, path, ICON_WALK_DEPTH, 0, 0, (uint8_t)t);
+		}
+	}
+	for (r = 0; r < s->npixmaps; r++)
+		builder_walk(&b, s->pixmaps[r], 0, 0, 0, (uint8_t)s->nthemes);
+
+	qsort(b.cands, b.ncands, sizeof(*b.cands), cand_cmp);
+
+	/* names once each, then every path */
+	names   = 0;
+	str_len = 0;
+	for (i = 0; i < b.ncands; i++) {
+		if (i == 0 || strcmp(b.cands[i].name, b.cands[i - 1].name) != 0) {
+			names++;
+			str_len += strlen(b.cands[i].name) + 1;
+		}
+		str_len += strlen(b.cands[i].path) + 1;
+	}
+	for (i = 0; i < b.ndirs; i++)
+		str_len += strlen(b.dirs[i].path) + 1;
+
+	nslots = 16;
+	while (nslots < names * 2)
+		nslots *= 2;
+
+	idx->len  = sizeof(*hdr) + b.ndirs * sizeof(*dirs)
+	            + nslots * sizeof(*slots) + b.ncands * sizeof(*cands)
+	            + str_len;
+	idx->base = calloc(1, idx->len);
+	if (!idx->base) {
+		builder_free(&b);
+		return false;
+	}
+	idx->mapped = false;
+
+	hdr = idx->base;
+	memcpy(hdr->magic, ICON_INDEX_MAGIC, sizeof(ICON_INDEX_MAGIC));
+	hdr->version = ICON_INDEX_VERSION;
+	hdr->ndirs   = (uint32_t)b.ndirs;
+	hdr->nslots  = nslots;
+	hdr->ncands  = (uint32_t)b.ncands;
+	hdr->strings = (uint32_t)str_len;
+	hdr->key     = key;
+	index_attach(idx);
+
+	dirs    = (icon_index_dir_t *)idx->dirs;
+	slots   = (icon_index_slot_t *)idx->slots;
+	cands   = (icon_index_cand_t *)idx->cands;
+	strings = (char *)idx->strings;
+	str_len = 0;
+
+	for (i = 0; i < b.ndirs; i++) {
+		dirs[i].path       = put_string(strings, &str_len, b.dirs[i].path);
+		dirs[i].mtime_sec  = b.dirs[i].mtime.tv_sec;
+		dirs[i].mtime_nsec = b.dirs[i].mtime.tv_nsec;
+	}
+
+	for (i = 0; i < b.ncands; i = j) {
+		cands[i].name = put_string(strings, &str_len, b.cands[i].name);
+		for (j = i; j < b.ncands
+		            && strcmp(b.cands[j].name, b.cands[i].name) == 0;
+		     j++) {
+			cands[j].name  = cands[i].name;
+			cands[j].path  = put_string(strings, &str_len,
+			                            b.cands[j].path);
+			cands[j].size  = b.cands[j].size;
+			cands[j].flags = b.cands[j].flags;
+			cands[j].rank  = b.cands[j].rank;
+		}
+
+		h = name_hash(b.cands[i].name);
+		for (slot = h & (nslots - 1); slots[slot].count;
+		     slot = (slot + 1) & (nslots - 1))
+			;
+		slots[slot].hash  = h;
+		slots[slot].first = (uint32_t)i;
+		slots[slot].count = (uint32_t)(j - i);
+	}
+
+	builder_free(&b);
+	return true;
+}
+
+/* --- the cache file --- */
+
+static bool
+index_cache_path(char *buf, size_t len, bool make_dir)
+{
+	const char *xdg  = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	char        dir[PATH_MAX];
+	int         n;
+
+	if (xdg && *xdg)
+		n = snprintf(dir, sizeof(dir), "%s/barny", xdg);
+	else if (home && *home)
+		n = snprintf(dir, sizeof(dir), "%s/.cache/barny", home);
+	else
+		return false;
+	if (n <= 0 || (size_t)n >= sizeof(dir))
+		return false;
+
+	if (make_dir && mkdir(dir, 0700) < 0 && errno != EEXIST)
+		return false;
+
+	n = snprintf(buf, len, "%s/icon-index.bin", dir);
+	return n > 0 && (size_t)n < len;
+}
+
+static void
+index_close(icon_index_t *idx)
+{
+	if (idx->base) {
+		if (idx->mapped)
+			munmap(idx->base, idx->len);
+		else
+			free(idx->base);
+	}
+	memset(idx, 0, sizeof(*idx));
+}
+
+/* Everything a lookup will follow has to land inside the file. */
+static bool
+index_valid(icon_index_t *idx, uint64_t key)
+{
+	const icon_index_header_t *hdr = idx->base;
+	size_t                     want;
+	uint32_t                   i;
+
+	if (idx->len < sizeof(*hdr)
+	    || memcmp(hdr->magic, ICON_INDEX_MAGIC, sizeof(ICON_INDEX_MAGIC)) != 0
+	    || hdr->version != ICON_INDEX_VERSION || hdr->key != key
+	    || hdr->nslots == 0 || (hdr->nslots & (hdr->nslots - 1)) != 0
+	    || hdr->strings == 0)
+		return false;
+
+	want = sizeof(*hdr) + (size_t)hdr->ndirs * sizeof(icon_index_dir_t)
+	       + (size_t)hdr->nslots * sizeof(icon_index_slot_t)
+	       + (size_t)hdr->ncands * sizeof(icon_index_cand_t) + hdr->strings;
+	if (want != idx->len)
+		return false;
+
+	index_attach(idx);
+	if (idx->strings[hdr->strings - 1] != '\0')
+		return false;
+
+	for (i = 0; i < hdr->ndirs; i++) {
+		if (idx->dirs[i].path >= hdr->strings)
+			return false;
+	}
+	for (i = 0; i < hdr->nslots; i++) {
+		if (idx->slots[i].count
+		    && (idx->slots[i].first >= hdr->ncands
+		        || idx->slots[i].count > hdr->ncands
+		                                      - idx->slots[i].first))
+			return false;
+	}
+	for (i = 0; i < hdr->ncands; i++) {
+		if (idx->cands[i].name >= hdr->strings
+		    || idx->cands[i].path >= hdr->strings)
+			return false;
+	}
+
+	return true;
+}
+
+/* Up to date while no directory the walk saw has changed since. */
+static bool
+index_fresh(const icon_index_t *idx)
+{
+	struct stat st;
+	uint32_t    i;
+	int64_t     sec;
+	int64_t     nsec;
+
+	for (i = 0; i < idx->hdr->ndirs; i++) {
+		sec  = 0;
+		nsec = 0;
+		if (stat(idx->strings + idx->dirs[i].path, &st) == 0) {
+			sec  = st.st_mtim.tv_sec;
+			nsec = st.st_mtim.tv_nsec;
+		}
+		if (sec != idx->dirs[i].mtime_sec
+		    || nsec != idx->dirs[i].mtime_nsec)
+			return false;
+	}
+
+	return true;
+}
+
+static bool
+index_map(icon_index_t *idx, const char *path, uint64_t key)
+{
+	struct stat st;
+	void       *addr;
+	int         fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+	if (fstat(fd, &st) < 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+
+	idx->base   = addr;
+	idx->len    = (size_t)st.st_size;
+	idx->mapped = true;
+	if (!index_valid(idx, key) || !index_fresh(idx)) {
+		index_close(idx);
+		return false;
+	}
+
+	return true;
+}
+
+static void
+index_store(const icon_index_t *idx, const char *path)
+{
+	char        tmp[PATH_MAX];
+	const char *p    = idx->base;
+	size_t      left = idx->len;
+	ssize_t     n;
+	int         fd;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+		return;
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	while (left > 0) {
+		n = write(fd, p, left);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		p    += n;
+		left -= (size_t)n;
+	}
+
+	if (close(fd) < 0 || left > 0 || rename(tmp, path) < 0)
+		unlink(tmp);
+}
+
+/* The cached index when it is still good, a fresh walk (stored for next
+   time) when it is not. cache_path NULL skips the file altogether. */
+static bool
+index_open(icon_index_t *idx, const icon_search_t *s, const char *cache_path)
+{
+	uint64_t key = search_key(s);
+
+	memset(idx, 0, sizeof(*idx));
+	if (cache_path && index_map(idx, cache_path, key))
+		return true;
+
+	if (!index_build(idx, s, key))
+		return false;
+	if (cache_path)
+		index_store(idx, cache_path);
+	return true;
+}
+
+/* The file to draw name from at size pixels: the first theme in the chain
+   that has it, and within that theme the smallest bitmap at least that big,
+   else the scalable version, else the biggest bitmap there is. */
+static const char *
+index_lookup(const icon_index_t *idx, const char *name, int size)
+{
+	const icon_index_slot_t *slot = NULL;
+	const icon_index_cand_t *c;
+	const icon_index_cand_t *above;
+	const icon_index_cand_t *below;
+	const icon_index_cand_t *svg;
+	uint32_t                 mask;
+	uint32_t                 h;
+	uint32_t                 i;
+	uint32_t                 end;
+	uint8_t                  rank;
+
+	if (!idx->base)
+		return NULL;
+
+	h    = name_hash(name);
+	mask = idx->hdr->nslots - 1;
+	for (i = h & mask; idx->slots[i].count; i = (i + 1) & mask) {
+		if (idx->slots[i].hash == h
+		    && strcmp(idx->strings
+		                      + idx->cands[idx->slots[i].first].name,
+		              name)
+		               == 0) {
+			slot = &idx->slots[i];
+			break;
+		}
+	}
+	if (!slot)
+		return NULL;
+
+	end = slot->first + slot->count;
+	for (i = slot->first; i < end;) {
+		rank  = idx->cands[i].rank;
+		above = NULL;
+		below = NULL;
+		svg   = NULL;
+		for (; i < end && idx->cands[i].rank == rank; i++) {
+			c = &idx->cands[i];
+			if (c->flags & ICON_SCALABLE) {
+#ifdef BARNY_RSVG
+				svg = c;
+#endif
+			} else if (c->size >= size) {
+				if (!above)
+					above = c;
+			} else {
+				below = c;
+			}
+		}
+
+		c = above ? above : svg ? svg : below;
+		if (c)
+			return idx->strings + c->path;
+	}
+
+	return NULL;
+}
+
+/* --- loading --- */
+
+#ifdef BARNY_RSVG
+static cairo_surface_t *
+load_svg(const char *path, int size)
+{
+	RsvgHandle      *handle;
+	RsvgRectangle    viewport = { 0, 0, size, size };
+	cairo_surface_t *surface;
+	cairo_t         *cr;
+	GError          *err = NULL;
+	gboolean         ok;
+
+	handle = rsvg_handle_new_from_file(path, &err);
+	if (!handle) {
+		g_clear_error(&err);
+		return NULL;
+	}
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+	cr      = cairo_create(surface);
+	ok      = rsvg_handle_render_document(handle, cr, &viewport, &err);
+	cairo_destroy(cr);
+	g_object_unref(handle);
+	g_clear_error(&err);
+
+	if (!ok || cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	return surface;
+}
+#endif
+
+/* Decoded, and no bigger than size: a theme's 512 px PNG is not kept
+   around to draw at 24. */
+static cairo_surface_t *
+load_icon_file(const char *path, int size)
+{
+	const char      *ext = strrchr(path, '.');
+	cairo_surface_t *surface;
+	cairo_surface_t *fit;
+
+	if (!ext)
+		return NULL;
+
+	if (strcmp(ext, ".png") == 0) {
+		surface = cairo_image_surface_create_from_png(path);
+#ifdef BARNY_RSVG
+	} else if (strcmp(ext, ".svg") == 0) {
+		return load_svg(path, size);
+#endif
+	} else {
+		return NULL;
+	}
+
+	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	if (cairo_image_surface_get_width(surface) > size
+	    || cairo_image_surface_get_height(surface) > size) {
+		fit = barny_icon_scale_to_fit(surface, size);
+		cairo_surface_destroy(surface);
+		surface = fit;
+	}
+
+	return surface;
+}
+
+/* --- the loader thread --- */
+
+typedef struct icon_job icon_job_t;
+
+struct icon_job {
+	char              *name;
+	char              *extra_dir;
+	int                size;
+	barny_icon_done_fn done;
+	void              *userdata;
+	cairo_surface_t   *surface;
+	icon_job_t        *next;
+};
+
+struct barny_icon_theme {
+	pthread_t       thread;
+	int             event_fd;
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	bool            quit;
+
+	icon_job_t     *todo;
+	icon_job_t    **todo_tail;
+	icon_job_t     *busy;
+	icon_job_t     *done;
+	icon_job_t    **done_tail;
+
+	/* the loader thread's alone */
+	char           *theme;
+	icon_index_t    index;
+	bool            index_tried;
+};
+
+static char *
+resolve_icon(barny_icon_theme_t *t, const icon_job_t *job)
+{
+	static const char *const exts[] = { ".png", ".svg" };
+	icon_search_t            s      = { 0 };
+	char                     path[PATH_MAX];
+	char                     cache[PATH_MAX];
+	const char              *found;
+	size_t                   i;
+
+	if (job->name[0] == '/')
+		return strdup(job->name);
+
+	/* an item's own IconThemePath comes before any theme */
+	if (job->extra_dir && job->extra_dir[0]) {
+		for (i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+			snprintf(path, sizeof(path), "%s/%s%s", job->extra_dir,
+			         job->name, exts[i]);
+			if (access(path, R_OK) == 0)
+				return strdup(path);
+		}
+	}
+
+	if (!t->index_tried) {
+		t->index_tried = true;
+		search_default_dirs(&s);
+		search_themes(&s, t->theme);
+		index_open(&t->index, &s,
+		           index_cache_path(cache, sizeof(cache), true) ? cache
+		                                                         : NULL);
+		search_free(&s);
+	}
+
+	found = index_lookup(&t->index, job->name, job->size);
+	return found ? strdup(found) : NULL;
+}
+
+static void *
+icon_theme_worker(void *arg)
+{
+	barny_icon_theme_t *t   = arg;
+	uint64_t            one = 1;
+	icon_job_t         *job;
+	char               *path;
+
+	pthread_mutex_lock(&t->lock);
+	for (;;) {
+		while (!t->quit && !t->todo)
+			pthread_cond_wait(&t->cond, &t->lock);
+		if (t->quit)
+			break;
+
+		job     = t->todo;
+		t->todo = job->next;
+		if (!t->todo)
+			t->todo_tail = &t->todo;
+		t->busy = job;
+		pthread_mutex_unlock(&t->lock);
+
+		path = resolve_icon(t, job);
+		if (path)
+			job->surface = load_icon_file(path, job->size);
+		free(path);
+
+		pthread_mutex_lock(&t->lock);
+		t->busy      = NULL;
+		job->next    = NULL;
+		*t->done_tail = job;
+		t->done_tail  = &job->next;
+		if (write(t->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			fprintf(stderr, "barny: icon loader eventfd write: %s\n",
+			        strerror(errno));
+	}
+	pthread_mutex_unlock(&t->lock);
+
+	return NULL;
+}
+
+barny_icon_theme_t *
+barny_icon_theme_create(const char *theme)
+{
+	barny_icon_theme_t *t;
+	int                 err;
+
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+
+	t->todo_tail = &t->todo;
+	t->done_tail = &t->done;
+	t->theme     = theme ? strdup(theme) : NULL;
+	t->event_fd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (t->event_fd < 0) {
+		fprintf(stderr, "barny: icon loader eventfd: %s\n",
+		        strerror(errno));
+		free(t->theme);
+		free(t);
+		return NULL;
+	}
+
+	pthread_mutex_init(&t->lock, NULL);
+	pthread_cond_init(&t->cond, NULL);
+
+	err = pthread_create(&t->thread, NULL, icon_theme_worker, t);
+	if (err) {
+		fprintf(stderr, "barny: icon loader thread: %s\n", strerror(err));
+		pthread_cond_destroy(&t->cond);
+		pthread_mutex_destroy(&t->lock);
+		close(t->event_fd);
+		free(t->theme);
+		free(t);
+		return NULL;
+	}
+	pthread_setname_np(t->thread, "barny-icons");
+
+	return t;
+}
+
+static void
+free_jobs(icon_job_t *job)
+{
+	icon_job_t *next;
+
+	for (; job; job = next) {
+		next = job->next;
+		if (job->surface)
+			cairo_surface_destroy(job->surface);
+		free(job->name);
+		free(job->extra_dir);
+		free(job);
+	}
+}
+
+void
+barny_icon_theme_destroy(barny_icon_theme_t *t)
+{
+	if (!t)
+		return;
+
+	pthread_mutex_lock(&t->lock);
+	t->quit = true;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+	pthread_join(t->thread, NULL);
+
+	free_jobs(t->todo);
+	free_jobs(t->done);
+	index_close(&t->index);
+	pthread_cond_destroy(&t->cond);
+	pthread_mutex_destroy(&t->lock);
+	close(t->event_fd);
+	free(t->theme);
+	free(t);
+}
+
+int
+barny_icon_theme_fd(const barny_icon_theme_t *t)
+{
+	return t ? t->event_fd : -1;
+}
+
+bool
+barny_icon_theme_load(barny_icon_theme_t *t, const char *name,
+                      const char *extra_dir, int size,
+                      barny_icon_done_fn done, void *userdata)
+{
+	icon_job_t *job;
+
+	if (!t || !name || !name[0] || size <= 0)
+		return false;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return false;
+	job->name      = strdup(name);
+	job->extra_dir = extra_dir ? strdup(extra_dir) : NULL;
+	job->size      = size;
+	job->done      = done;
+	job->userdata  = userdata;
+	if (!job->name) {
+		free_jobs(job);
+		return false;
+	}
+
+	pthread_mutex_lock(&t->lock);
+	*t->todo_tail = job;
+	t->todo_tail  = &job->next;
+	pthread_cond_signal(&t->cond);
+	pthread_mutex_unlock(&t->lock);
+
+	return true;
+}
+
+void
+barny_icon_theme_cancel(barny_icon_theme_t *t, void *userdata)
+{
+	icon_job_t *job;
+
+	if (!t)
+		return;
+
+	/* whatever is queued, loading or loaded still gets finished; it just
+	   goes nowhere */
+	pthread_mutex_lock(&t->lock);
+	for (job = t->todo; job; job = job->next) {
+		if (job->userdata == userdata)
+			job->done = NULL;
+	}
+	if (t->busy && t->busy->userdata == userdata)
+		t->busy->done = NULL;
+	for (job = t->done; job; job = job->next) {
+		if (job->userdata == userdata)
+			job->done = NULL;
+	}
+	pthread_mutex_unlock(&t->lock);
+}
+
+int
+barny_icon_theme_dispatch(barny_icon_theme_t *t)
+{
+	icon_job_t *jobs;
+	icon_job_t *job;
+	uint64_t    count;
+	int         n = 0;
+
+	if (!t)
+		return 0;
+
+	if (read(t->event_fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+		return -1;
+
+	pthread_mutex_lock(&t->lock);
+	jobs         = t->done;
+	t->done      = NULL;
+	t->done_tail = &t->done;
+	pthread_mutex_unlock(&t->lock);
+
+	for (job = jobs; job; job = job->next) {
+		if (!job->done)
+			continue;
+		job->done(job->userdata, job->surface);
+		job->surface = NULL;
+		n++;
+	}
+
+	free_jobs(jobs);
+	return n;
+}
@@ -0,0 +1,106 @@
+#ifndef BARNY_LENS_KERNEL_H
+#define BARNY_LENS_KERNEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BULGE_NECK      16     /* horizontal patch margin for neck fillets */
+#define BULGE_SMIN      9.0    /* metaball neck fillet scale (surface tension) */
+#define BULGE_REFRACT   2.30   /* lens refraction / magnification gain */
+#define BULGE_BIAS      4.0    /* min inward sample so the rim isn't starved */
+#define BULGE_CHROMA    9.0    /* chromatic dispersion at the lens edge (px) */
+#define BULGE_VEIL      0.06   /* frosted brightness lift inside the bubble */
+#define BULGE_VEIL_FADE 7.0    /* px the veil fades in from the bubble edge */
+#define BULGE_RIM_W     5.0    /* inner glow width of the bubble rim */
+#define BULGE_RIM_STR   0.30   /* soft inner glow of the bubble rim */
+#define BULGE_RIM_CORE  0.55   /* crisp bright line at the bubble outline */
+#define BULGE_RIM_CHROMA 0.28  /* vertical colour dispersion of the rim */
+#define BULGE_CORE_W    1.4    /* px the crisp outline reaches past the rim */
+#define BULGE_CHROMA_MIN 0.25  /* px: below this the 3 taps land on one pixel */
+
+#define LENS_FAR_MARGIN  12.0  /* droplet influence radius: beyond it, 1:1 copy */
+
+/* Key light for the droplet specular: from above, slightly left, matching
+   the diagonal sheen of the glass frame. */
+#define SPEC_LX      (-0.30)
+#define SPEC_LY      (-0.954)
+#define SPEC_W       7.0   /* px band the specular hugs inside the rim */
+#define SPEC_P       10.0  /* highlight tightness */
+#define SPEC_GAIN    2.4   /* glass_gleam multiplier */
+#define SPEC_COUNTER 0.22  /* strength of the cool counter-arc */
+
+/* Everything the droplet's shading pass reads, gathered once per patch by
+   build_lens_patch. The pass itself is pure: it reads the three bar caches and
+   the distance field and writes patch rows, so the same job can be handed to
+   the scalar reference in liquid_glass.c or to one of the vector kernels in
+   lens_simd.c. */
+typedef struct {
+	const uint8_t *gdata; /* glass_clean: the strip the lens refracts */
+	int            gstride;
+	int            gsw;
+	int            gsh;
+	const uint8_t *hdata; /* shadow_cache, same frame as bg_cache */
+	int            hstride;
+	const uint8_t *bdata; /* bg_cache */
+	int            bstride;
+	int            bsw;
+	int            bsh;
+	uint8_t       *ddata; /* the patch being written */
+	int            dstride;
+
+	/* merged and droplet-only fields, (pw + 2) x (ph + 2) with a 1 px apron
+	   so the central differences never leave the grid */
+	const float   *df;
+	const float   *ddf;
+	int            gw;
+
+	const double  *pinch; /* gw, per field column */
+	const double  *prm;   /* pw x rgb, interleaved */
+	/* the same two in float, channel-planar, for the vector kernels */
+	const float   *pinch_f;
+	const float   *prm_r;
+	const float   *prm_g;
+	const float   *prm_b;
+
+	int            sox;
+	int            soy;
+	int            pw;
+	int            ph;
+
+	double         cx;
+	double         cyp;
+	double         hh;
+	double         inv_hh;
+	double         edge_h;
+	double         inv_edge_h;
+	double         shad_h;
+	double         inv_shad_h;
+	/* BARNY_FRAME_EDGE_{TOP,BOT}_A, carried here so lens_simd.c can stay
+	   clear of barny.h and the generated wayland headers it pulls in */
+	double         edge_top_a;
+	double         edge_bot_a;
+	double         disp;
+	double         chroma;
+	double         strength;
+	double         spec_g;
+	double         prism;
+	bool           authoritative;
+} barny_lens_job_t;
+
+/* A vector kernel shades patch rows [y0, y1) from column 0 up to the last
+   whole vector and returns where it stopped; the scalar reference finishes the
+   remaining columns. */
+typedef int (*barny_lens_kernel_fn)(const barny_lens_job_t *job, int y0,
+                                    int y1);
+
+#if defined(__x86_64__) || defined(__i386__)
+int
+barny_lens_shade_sse41(const barny_lens_job_t *job, int y0, int y1);
+int
+barny_lens_shade_avx2(const barny_lens_job_t *job, int y0, int y1);
+#elif defined(__aarch64__)
+int
+barny_lens_shade_neon(const barny_lens_job_t *job, int y0, int y1);
+#endif
+
+#endif
@@ -0,0 +1,616 @@
+/* Vector kernels for the droplet's shading pass.
+
+   This file is compiled once per instruction set (see meson.build), each time
+   with one LENS_SIMD_<isa> define and the matching -m flags, so the binary
+   carries every variant and liquid_glass.c picks one at runtime. The kernel
+   body is shared; only the thin vf_/vi_/vm_ layer below differs.
+
+   The scalar loop in liquid_glass.c (lens_shade_rows) is the reference. This
+   port computes in float instead of double and turns every branch into a
+   mask, so it lands within a couple of levels per channel of the reference,
+   which is what tests/test_liquid_glass.c holds it to. Keep the two in step:
+   a change to the lens math goes into both. */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "lens_kernel.h"
+
+#if defined(LENS_SIMD_AVX2)
+
+#include <immintrin.h>
+
+#define LANES        8
+#define LENS_SIMD_FN barny_lens_shade_avx2
+
+typedef __m256  vf;
+typedef __m256i vi;
+typedef __m256  vm;
+
+#define vf_set(a)        _mm256_set1_ps(a)
+#define vf_load(p)       _mm256_loadu_ps(p)
+#define vf_add(a, b)     _mm256_add_ps(a, b)
+#define vf_sub(a, b)     _mm256_sub_ps(a, b)
+#define vf_mul(a, b)     _mm256_mul_ps(a, b)
+#define vf_div(a, b)     _mm256_div_ps(a, b)
+#define vf_min(a, b)     _mm256_min_ps(a, b)
+#define vf_max(a, b)     _mm256_max_ps(a, b)
+#define vf_sqrt(a)       _mm256_sqrt_ps(a)
+#define vf_abs(a)        _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a)
+#define vf_iota()        _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)
+#define vf_lt(a, b)      _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define vf_gt(a, b)      _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define vf_ge(a, b)      _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define vf_sel(m, a, b)  _mm256_blendv_ps(b, a, m)
+#define vf_from(a)       _mm256_cvtepi32_ps(a)
+#define vm_and(a, b)     _mm256_and_ps(a, b)
+#define vm_or(a, b)      _mm256_or_ps(a, b)
+#define vm_andnot(a, b)  _mm256_andnot_ps(b, a) /* a && !b */
+#define vm_any(m)        (_mm256_movemask_ps(m) != 0)
+#define vm_all(m)        (_mm256_movemask_ps(m) == 0xff)
+#define vi_set(a)        _mm256_set1_epi32(a)
+#define vi_load(p)       _mm256_loadu_si256((const __m256i *)(p))
+#define vi_store(p, a)   _mm256_storeu_si256((__m256i *)(p), a)
+#define vi_add(a, b)     _mm256_add_epi32(a, b)
+#define vi_mul(a, b)     _mm256_mullo_epi32(a, b)
+#define vi_min(a, b)     _mm256_min_epi32(a, b)
+#define vi_max(a, b)     _mm256_max_epi32(a, b)
+#define vi_and(a, b)     _mm256_and_si256(a, b)
+#define vi_or(a, b)      _mm256_or_si256(a, b)
+#define vi_srl(a, n)     _mm256_srli_epi32(a, n)
+#define vi_sll(a, n)     _mm256_slli_epi32(a, n)
+#define vi_sel(m, a, b)  _mm256_blendv_epi8(b, a, _mm256_castps_si256(m))
+#define vi_trunc(a)      _mm256_cvttps_epi32(a)
+#define vi_gather(p, i)  _mm256_i32gather_epi32((const int *)(p), i, 4)
+
+#elif defined(LENS_SIMD_SSE41)
+
+#include <smmintrin.h>
+
+#define LANES        4
+#define LENS_SIMD_FN barny_lens_shade_sse41
+
+typedef __m128  vf;
+typedef __m128i vi;
+typedef __m128  vm;
+
+#define vf_set(a)        _mm_set1_ps(a)
+#define vf_load(p)       _mm_loadu_ps(p)
+#define vf_add(a, b)     _mm_add_ps(a, b)
+#define vf_sub(a, b)     _mm_sub_ps(a, b)
+#define vf_mul(a, b)     _mm_mul_ps(a, b)
+#define vf_div(a, b)     _mm_div_ps(a, b)
+#define vf_min(a, b)     _mm_min_ps(a, b)
+#define vf_max(a, b)     _mm_max_ps(a, b)
+#define vf_sqrt(a)       _mm_sqrt_ps(a)
+#define vf_abs(a)        _mm_andnot_ps(_mm_set1_ps(-0.0f), a)
+#define vf_iota()        _mm_setr_ps(0, 1, 2, 3)
+#define vf_lt(a, b)      _mm_cmplt_ps(a, b)
+#define vf_gt(a, b)      _mm_cmpgt_ps(a, b)
+#define vf_ge(a, b)      _mm_cmpge_ps(a, b)
+#define vf_sel(m, a, b)  _mm_blendv_ps(b, a, m)
+#define vf_from(a)       _mm_cvtepi32_ps(a)
+#define vm_and(a, b)     _mm_and_ps(a, b)
+#define vm_or(a, b)      _mm_or_ps(a, b)
+#define vm_andnot(a, b)  _mm_andnot_ps(b, a) /* a && !b */
+#define vm_any(m)        (_mm_movemask_ps(m) != 0)
+#define vm_all(m)        (_mm_movemask_ps(m) == 0xf)
+#define vi_set(a)        _mm_set1_epi32(a)
+#define vi_load(p)       _mm_loadu_si128((const __m128i *)(p))
+#define vi_store(p, a)   _mm_storeu_si128((__m128i *)(p), a)
+#define vi_add(a, b)     _mm_add_epi32(a, b)
+#define vi_mul(a, b)     _mm_mullo_epi32(a, b)
+#define vi_min(a, b)     _mm_min_epi32(a, b)
+#define vi_max(a, b)     _mm_max_epi32(a, b)
+#define vi_and(a, b)     _mm_and_si128(a, b)
+#define vi_or(a, b)      _mm_or_si128(a, b)
+#define vi_srl(a, n)     _mm_srli_epi32(a, n)
+#define vi_sll(a, n)     _mm_slli_epi32(a, n)
+#define vi_sel(m, a, b)  _mm_blendv_epi8(b, a, _mm_castps_si128(m))
+#define vi_trunc(a)      _mm_cvttps_epi32(a)
+#define vi_spill(p, a)   _mm_storeu_si128((__m128i *)(p), a)
+
+#elif defined(LENS_SIMD_NEON)
+
+#include <arm_neon.h>
+
+#define LANES        4
+#define LENS_SIMD_FN barny_lens_shade_neon
+
+typedef float32x4_t vf;
+typedef int32x4_t   vi;
+typedef uint32x4_t  vm;
+
+#define vf_set(a)        vdupq_n_f32(a)
+#define vf_load(p)       vld1q_f32(p)
+#define vf_add(a, b)     vaddq_f32(a, b)
+#define vf_sub(a, b)     vsubq_f32(a, b)
+#define vf_mul(a, b)     vmulq_f32(a, b)
+#define vf_div(a, b)     vdivq_f32(a, b)
+#define vf_min(a, b)     vminq_f32(a, b)
+#define vf_max(a, b)     vmaxq_f32(a, b)
+#define vf_sqrt(a)       vsqrtq_f32(a)
+#define vf_abs(a)        vabsq_f32(a)
+#define vf_iota()        ((vf){0, 1, 2, 3})
+#define vf_lt(a, b)      vcltq_f32(a, b)
+#define vf_gt(a, b)      vcgtq_f32(a, b)
+#define vf_ge(a, b)      vcgeq_f32(a, b)
+#define vf_sel(m, a, b)  vbslq_f32(m, a, b)
+#define vf_from(a)       vcvtq_f32_s32(a)
+#define vm_and(a, b)     vandq_u32(a, b)
+#define vm_or(a, b)      vorrq_u32(a, b)
+#define vm_andnot(a, b)  vbicq_u32(a, b) /* a && !b */
+#define vm_any(m)        (vmaxvq_u32(m) != 0)
+#define vm_all(m)        (vminvq_u32(m) != 0)
+#define vi_set(a)        vdupq_n_s32(a)
+#define vi_load(p)       vreinterpretq_s32_u8(vld1q_u8(p))
+#define vi_store(p, a)   vst1q_u8(p, vreinterpretq_u8_s32(a))
+#define vi_add(a, b)     vaddq_s32(a, b)
+#define vi_mul(a, b)     vmulq_s32(a, b)
+#define vi_min(a, b)     vminq_s32(a, b)
+#define vi_max(a, b)     vmaxq_s32(a, b)
+#define vi_and(a, b)     vandq_s32(a, b)
+#define vi_or(a, b)      vorrq_s32(a, b)
+#define vi_srl(a, n)                                                          \
+	vreinterpretq_s32_u32(vshrq_n_u32(vreinterpretq_u32_s32(a), n))
+#define vi_sll(a, n)     vshlq_n_s32(a, n)
+#define vi_sel(m, a, b)  vbslq_s32(m, a, b)
+#define vi_trunc(a)      vcvtq_s32_f32(a)
+#define vi_spill(p, a)   vst1q_s32(p, a)
+
+#else
+#error "lens_simd.c is built once per ISA with LENS_SIMD_<isa> defined"
+#endif
+
+#ifdef vi_spill
+/* No hardware gather below AVX2: spill the indices and load the four
+   pixels one by one. The taps are still the cheap part of the kernel. */
+static inline vi
+vi_gather(const uint8_t *base, vi idx)
+{
+	int32_t  i[4];
+	uint32_t px[4];
+	int      k;
+
+	vi_spill(i, idx);
+	for (k = 0; k < 4; k++)
+		memcpy(&px[k], base + (size_t)i[k] * 4, 4);
+
+	return vi_load((const uint8_t *)px);
+}
+#endif
+
+/* byte c of each BGRA lane, as float; NEON shifts cannot take a 0 count */
+#define vi_chan0(v)   vf_from(vi_and(v, vi_set(0xff)))
+#define vi_chan(v, c) vf_from(vi_and(vi_srl(v, 8 * (c)), vi_set(0xff)))
+
+/* clamp a to [lo, hi] */
+static inline vf
+vf_clamp(vf a, float lo, float hi)
+{
+	return vf_min(vf_max(a, vf_set(lo)), vf_set(hi));
+}
+
+/* x^10; see spec_pow in liquid_glass.c */
+static inline vf
+vf_spec_pow(vf x)
+{
+	vf x2 = vf_mul(x, x);
+	vf x4 = vf_mul(x2, x2);
+	vf x8 = vf_mul(x4, x4);
+
+	return vf_mul(x8, x2);
+}
+
+static inline vf
+vf_bilerp(vf a, vf b, vf c, vf d, vf fx, vf fy)
+{
+	vf t = vf_add(a, vf_mul(vf_sub(b, a), fx));
+	vf u = vf_add(c, vf_mul(vf_sub(d, c), fx));
+
+	return vf_add(t, vf_mul(vf_sub(u, t), fy));
+}
+
+/* Bilinear tap, one lane per pixel: the vector twin of lens_tap. Coordinates
+   are clamped like the scalar one; the integer corner is clamped once more
+   after truncation because width - 1.001 is not exact in float on a wide
+   strip, and a corner on the last column would read a pixel past it. */
+static inline void
+lens_tap_v(const barny_lens_job_t *job, vf x, vf y, vf out[4])
+{
+	vf wm1 = vf_set((float)(job->gsw - 1));
+	vf hm1 = vf_set((float)(job->gsh - 1));
+	vi s4  = vi_set(job->gstride / 4);
+	vi x0;
+	vi y0;
+	vi i00;
+	vi i10;
+	vi p00;
+	vi p01;
+	vi p10;
+	vi p11;
+	vf fx;
+	vf fy;
+
+	x = vf_max(x, vf_set(0.0f));
+	y = vf_max(y, vf_set(0.0f));
+	x = vf_sel(vf_ge(x, wm1), vf_set((float)(job->gsw - 1.001)), x);
+	y = vf_sel(vf_ge(y, hm1), vf_set((float)(job->gsh - 1.001)), y);
+
+	x0 = vi_max(vi_min(vi_trunc(x), vi_set(job->gsw - 2)), vi_set(0));
+	y0 = vi_max(vi_min(vi_trunc(y), vi_set(job->gsh - 2)), vi_set(0));
+	fx = vf_sub(x, vf_from(x0));
+	fy = vf_sub(y, vf_from(y0));
+
+	i00 = vi_add(vi_mul(y0, s4), x0);
+	i10 = vi_add(i00, s4);
+	p00 = vi_gather(job->gdata, i00);
+	p01 = vi_gather(job->gdata, vi_add(i00, vi_set(1)));
+	p10 = vi_gather(job->gdata, i10);
+	p11 = vi_gather(job->gdata, vi_add(i10, vi_set(1)));
+
+	out[0] = vf_bilerp(vi_chan0(p00), vi_chan0(p01), vi_chan0(p10),
+	                   vi_chan0(p11), fx, fy);
+	out[1] = vf_bilerp(vi_chan(p00, 1), vi_chan(p01, 1), vi_chan(p10, 1),
+	                   vi_chan(p11, 1), fx, fy);
+	out[2] = vf_bilerp(vi_chan(p00, 2), vi_chan(p01, 2), vi_chan(p10, 2),
+	                   vi_chan(p11, 2), fx, fy);
+	out[3] = vf_bilerp(vi_chan(p00, 3), vi_chan(p01, 3), vi_chan(p10, 3),
+	                   vi_chan(p11, 3), fx, fy);
+}
+
+/* LANES pixels of a cache row from column sx; columns off the row, or a
+   missing row, read as transparent like the reference. */
+static inline vi
+lens_row_pixels(const uint8_t *row, int sx, int width)
+{
+	uint32_t px[LANES] = {0};
+	int      i;
+
+	if (!row)
+		return vi_set(0);
+	if (sx >= 0 && sx + LANES <= width)
+		return vi_load(row + (size_t)sx * 4);
+
+	for (i = 0; i < LANES; i++)
+		if (sx + i >= 0 && sx + i < width)
+			memcpy(&px[i], row + (size_t)(sx + i) * 4, 4);
+
+	return vi_load((const uint8_t *)px);
+}
+
+/* (1 - k * t) * w, masked to lanes where t < lim: the frame-edge ramps */
+static inline vf
+lens_edge_ramp(vf t, double lim, double inv_lim, double a, vf w)
+{
+	vf r = vf_sub(vf_set(1.0f), vf_mul(t, vf_set((float)inv_lim)));
+
+	return vf_sel(vf_lt(t, vf_set((float)lim)),
+	              vf_mul(vf_mul(vf_set((float)a), r), w), vf_set(0.0f));
+}
+
+int
+LENS_SIMD_FN(const barny_lens_job_t *job, int y0, int y1)
+{
+	int   pw      = job->pw;
+	int   gw      = job->gw;
+	int   xv      = pw - pw % LANES;
+	bool  auth    = job->authoritative;
+	float str     = (float)job->strength;
+	float spec_g  = (float)job->spec_g;
+	float prism   = (float)job->prism;
+	vf    zero    = vf_set(0.0f);
+	vf    one     = vf_set(1.0f);
+	vf    c255    = vf_set(255.0f);
+	vf    iota    = vf_iota();
+	vf    hh      = vf_set((float)job->hh);
+	vf    inv_hh  = vf_set((float)job->inv_hh);
+	vf    disp    = vf_set((float)job->disp);
+	vf    chroma  = vf_set((float)job->chroma);
+	vf    edge_h  = vf_set((float)job->edge_h);
+	vf    shad_h  = vf_set((float)job->shad_h);
+	int   x;
+	int   y;
+
+	for (y = y0; y < y1; y++) {
+		uint8_t       *drow = job->ddata + (size_t)y * job->dstride;
+		int            sy   = y + job->soy;
+		bool           rin  = sy >= 0 && sy < job->bsh;
+		const uint8_t *brow = rin ? job->bdata + (size_t)sy * job->bstride
+		                          : NULL;
+		const uint8_t *hrow = rin ? job->hdata + (size_t)sy * job->hstride
+		                          : NULL;
+		const float   *dfr  = job->df + (size_t)(y + 1) * gw + 1;
+		const float   *ddr  = job->ddf + (size_t)(y + 1) * gw + 1;
+		double         ly   = y + 0.5;
+		double         tyd  = (ly - job->cyp) * job->inv_hh;
+		vf             gy   = vf_set((float)ly);
+		vf             tr;
+		vf             tb;
+
+		/* per-row rim dispersion: red leans up, blue down */
+		if (tyd < -1.0)
+			tyd = -1.0;
+		if (tyd > 1.0)
+			tyd = 1.0;
+		tr = vf_set((float)(1.0 - BULGE_RIM_CHROMA * tyd));
+		tb = vf_set((float)(1.0 + BULGE_RIM_CHROMA * tyd));
+
+		for (x = 0; x < xv; x += LANES) {
+			int sx  = x + job->sox;
+			vf  d   = vf_load(dfr + x);
+			vf  dd  = vf_load(ddr + x);
+			vf  pin = vf_load(job->pinch_f + x + 1);
+			vm  far = vm_and(vf_gt(dd, vf_set(LENS_FAR_MARGIN)),
+			                 vf_lt(pin, vf_set(0.004f)));
+			vi  fpx = auth ? lens_row_pixels(brow, sx, job->bsw)
+			               : vi_set(0);
+			vi  hpx;
+			vi  out;
+			vf  aa;
+			vf  cpr = zero;
+			vf  cpg = zero;
+			vf  cpb = zero;
+			vf  ap  = zero;
+			vf  inv;
+			vf  outr;
+			vf  outg;
+			vf  outb;
+			vf  outa;
+
+			/* untouched by droplet and pinch: bar cache verbatim */
+			if (vm_all(far)) {
+				vi_store(drow + (size_t)x * 4, fpx);
+				continue;
+			}
+
+			aa  = vf_clamp(vf_sub(vf_set(0.5f), d), 0.0f, 1.0f);
+			hpx = auth ? lens_row_pixels(hrow, sx, job->bsw) : vi_set(0);
+
+			/* Lanes with aa == 0 run through here too: their taps
+			   stay in bounds and every colour term they produce is
+			   scaled by ap = fa * aa = 0, so they need no mask. */
+			if (vm_any(vf_gt(aa, zero))) {
+				vf nnx    = zero;
+				vf nny    = zero;
+				vf dispx  = zero;
+				vf dispy  = zero;
+				vf pedge  = zero;
+				vf facing = zero;
+				vf depth  = vf_sub(zero, d);
+				vf atop   = zero;
+				vf abot   = zero;
+				vf spec   = zero;
+				vf cntr   = zero;
+				vm near   = vf_lt(dd, vf_set(BULGE_CORE_W));
+				vm split;
+				vf cs;
+				vf bx;
+				vf by;
+				vf fr;
+				vf fg;
+				vf fb;
+				vf fa;
+				vf aw;
+				vf veil;
+				vf lit;
+				vf ri;
+				vf core;
+				vf rim;
+				vf p2[4];
+
+				if (vm_any(near)) {
+					vf nx = vf_sub(vf_load(ddr + x + 1),
+					               vf_load(ddr + x - 1));
+					vf ny = vf_sub(vf_load(ddr + x + gw),
+					               vf_load(ddr + x - gw));
+					vf nl = vf_sqrt(vf_add(vf_mul(nx, nx),
+					                       vf_mul(ny, ny)));
+					vm ok = vm_and(near, vf_gt(nl, vf_set(1e-6f)));
+					vm in = vf_lt(dd, zero);
+					vf p  = one;
+					vf q;
+					vf lens;
+					vf off;
+
+					nnx = vf_sel(ok, vf_div(nx, nl), zero);
+					nny = vf_sel(ok, vf_div(ny, nl), zero);
+
+					/* clamped at both ends so lanes outside
+					   the droplet keep sqrt's argument
+					   non-negative; they are masked below */
+					if (job->hh > 0.0)
+						p = vf_clamp(vf_mul(vf_sub(zero, dd),
+						                    inv_hh),
+						             0.0f, 1.0f);
+					q     = vf_sub(one, p);
+					lens  = vf_sqrt(vf_mul(p, vf_add(one, q)));
+					off   = vf_mul(vf_mul(hh, vf_sub(lens, p)),
+					               disp);
+					off   = vf_add(off,
+					               vf_mul(vf_set(BULGE_BIAS), q));
+					dispx = vf_sel(in, vf_mul(nnx, off), zero);
+					dispy = vf_sel(in, vf_mul(nny, off), zero);
+					dispx = vf_sub(zero, dispx);
+					dispy = vf_sub(zero, dispy);
+					pedge = vf_sel(in, vf_mul(q, q), zero);
+
+					facing = vf_add(vf_mul(nnx, vf_set(SPEC_LX)),
+					                vf_mul(nny, vf_set(SPEC_LY)));
+				}
+				cs = vf_mul(chroma, pedge);
+				bx = vf_set((float)(sx + 0.5 - job->cx));
+				bx = vf_add(vf_add(bx, iota), dispx);
+				by = vf_add(gy, dispy);
+
+				split = vf_gt(cs, vf_set(BULGE_CHROMA_MIN));
+				if (vm_any(split)) {
+					vf cse = vf_sel(split, cs, zero);
+					vf ox  = vf_mul(nnx, cse);
+					vf oy  = vf_mul(nny, cse);
+					vf p1[4];
+					vf p3[4];
+
+					lens_tap_v(job, vf_sub(bx, ox), vf_sub(by, oy),
+					           p1);
+					lens_tap_v(job, bx, by, p2);
+					lens_tap_v(job, vf_add(bx, ox), vf_add(by, oy),
+					           p3);
+					fb = vf_div(vf_mul(p3[0], c255), p3[3]);
+					fg = vf_div(vf_mul(p2[1], c255), p2[3]);
+					fr = vf_div(vf_mul(p1[2], c255), p1[3]);
+					fb = vf_sel(vf_gt(p3[3], zero), fb, zero);
+					fg = vf_sel(vf_gt(p2[3], zero), fg, zero);
+					fr = vf_sel(vf_gt(p1[3], zero), fr, zero);
+				} else {
+					vf unp;
+
+					lens_tap_v(job, bx, by, p2);
+					unp = vf_div(c255, p2[3]);
+					unp = vf_sel(vf_gt(p2[3], zero), unp, zero);
+					fb  = vf_mul(p2[0], unp);
+					fg  = vf_mul(p2[1], unp);
+					fr  = vf_mul(p2[2], unp);
+				}
+				fa = vf_mul(p2[3], vf_set(1.0f / 255.0f));
+
+				/* edge relighting along the merged contour */
+				if (vm_any(vm_or(vf_lt(depth, edge_h),
+				                 vf_lt(depth, shad_h)))) {
+					vf mx = vf_sub(vf_load(dfr + x + 1),
+					               vf_load(dfr + x - 1));
+					vf my = vf_sub(vf_load(dfr + x + gw),
+					               vf_load(dfr + x - gw));
+					vf ml = vf_sqrt(vf_add(vf_mul(mx, mx),
+					                       vf_mul(my, my)));
+					vm ok = vf_gt(ml, vf_set(1e-4f));
+					vf mn = vf_div(my, ml);
+					vf wt = vf_max(vf_sub(zero, mn), zero);
+					vf wb = vf_max(mn, zero);
+
+					wt = vf_sel(ok, wt, zero);
+					wb = vf_sel(ok, wb, zero);
+					if (job->edge_h > 0.0)
+						atop = lens_edge_ramp(depth, job->edge_h,
+						                      job->inv_edge_h,
+						                      job->edge_top_a, wt);
+					if (job->shad_h > 0.0)
+						abot = lens_edge_ramp(depth, job->shad_h,
+						                      job->inv_shad_h,
+						                      job->edge_bot_a, wb);
+				}
+
+				/* frosted brightness lift inside the bubble */
+				veil = vf_mul(vf_sub(zero, dd),
+				              vf_set((float)(1.0 / BULGE_VEIL_FADE)));
+				veil = vf_clamp(veil, 0.0f, 1.0f);
+				veil = vf_mul(veil, vf_set((float)BULGE_VEIL * str));
+				aw   = vf_sub(vf_add(veil, atop), vf_mul(veil, atop));
+
+				/* key-lit rim */
+				lit  = vf_max(facing, vf_set(0.15f));
+				lit  = vf_add(vf_set(0.45f), vf_mul(vf_set(0.55f), lit));
+				ri   = vf_mul(dd, vf_set((float)(1.0 / BULGE_RIM_W)));
+				ri   = vf_add(one, ri);
+				ri   = vf_sel(vm_or(vf_lt(ri, zero), vf_gt(dd, zero)),
+				              zero, ri);
+				ri   = vf_mul(ri, ri);
+				core = vf_mul(vf_abs(dd),
+				              vf_set((float)(1.0 / BULGE_CORE_W)));
+				core = vf_max(vf_sub(one, core), zero);
+				rim  = vf_mul(vf_mul(vf_set(BULGE_RIM_CORE), core), lit);
+				rim  = vf_add(vf_mul(vf_set(BULGE_RIM_STR), ri), rim);
+				rim  = vf_min(vf_mul(rim, vf_set(str)), one);
+
+				/* specular arc and its cool counter-arc */
+				if (spec_g > 0.001f) {
+					vm sm = vm_and(vf_lt(dd, zero),
+					               vf_lt(vf_sub(zero, dd),
+					                     vf_set(SPEC_W)));
+
+					if (vm_any(sm)) {
+						vm pos = vf_gt(facing, zero);
+						vf b;
+						vf lift;
+
+						b    = vf_mul(dd, vf_set(1.0f / SPEC_W));
+						b    = vf_add(one, b);
+						b    = vf_mul(vf_mul(b, b),
+						              vf_sub(vf_set(3.0f),
+						                     vf_add(b, b)));
+						lift = vf_spec_pow(vf_abs(facing));
+						lift = vf_mul(vf_mul(vf_set(spec_g), b),
+						              lift);
+						spec = vf_sel(vm_and(sm, pos), lift, zero);
+						cntr = vf_mul(vf_set(SPEC_COUNTER), lift);
+						cntr = vf_sel(vm_andnot(sm, pos), cntr,
+						              zero);
+					}
+				}
+
+				fr = vf_add(vf_mul(fr, vf_sub(one, aw)), vf_mul(c255, aw));
+				fg = vf_add(vf_mul(fg, vf_sub(one, aw)), vf_mul(c255, aw));
+				fb = vf_add(vf_mul(fb, vf_sub(one, aw)), vf_mul(c255, aw));
+				fr = vf_mul(fr, vf_sub(one, abot));
+				fg = vf_mul(fg, vf_sub(one, abot));
+				fb = vf_mul(fb, vf_sub(one, abot));
+				fr = vf_add(fr, vf_mul(vf_add(vf_add(vf_mul(rim, tr), spec),
+				                              vf_mul(cntr, vf_set(0.85f))),
+				                       c255));
+				fg = vf_add(fg, vf_mul(vf_add(vf_add(rim, spec),
+				                              vf_mul(cntr, vf_set(0.92f))),
+				                       c255));
+				fb = vf_add(fb, vf_mul(vf_add(vf_add(vf_mul(rim, tb), spec),
+				                              cntr),
+				                       c255));
+				fr = vf_min(fr, c255);
+				fg = vf_min(fg, c255);
+				fb = vf_min(fb, c255);
+
+				ap  = vf_mul(fa, aa);
+				cpr = vf_mul(fr, ap);
+				cpg = vf_mul(fg, ap);
+				cpb = vf_mul(fb, ap);
+			}
+
+			inv  = vf_sub(one, ap);
+			outb = vf_add(cpb, vf_mul(vi_chan0(hpx), inv));
+			outg = vf_add(cpg, vf_mul(vi_chan(hpx, 1), inv));
+			outr = vf_add(cpr, vf_mul(vi_chan(hpx, 2), inv));
+			outa = vf_add(vf_mul(c255, ap), vf_mul(vi_chan(hpx, 3), inv));
+
+			/* spectral rim; pa is never negative, so adding it to
+			   every lane matches the reference's pa > 0 test */
+			if (prism > 0.001f) {
+				vf t;
+				vf cov;
+				vf pa;
+
+				t   = vf_sub(zero, d);
+				cov = vf_min(t, vf_sub(vf_set(1.6f), t));
+				cov = vf_clamp(vf_add(cov, vf_set(0.5f)), 0.0f, 1.0f);
+				pa  = vf_mul(vf_set(prism), cov);
+				if (!auth)
+					pa = vf_mul(pa, aa);
+				pa   = vf_mul(pa, c255);
+				outr = vf_add(outr, vf_mul(vf_load(job->prm_r + x), pa));
+				outg = vf_add(outg, vf_mul(vf_load(job->prm_g + x), pa));
+				outb = vf_add(outb, vf_mul(vf_load(job->prm_b + x), pa));
+				outa = vf_add(outa, pa);
+			}
+			outa = vf_min(outa, c255);
+			outr = vf_min(outr, outa);
+			outg = vf_min(outg, outa);
+			outb = vf_min(outb, outa);
+
+			out = vi_or(vi_trunc(outb), vi_sll(vi_trunc(outg), 8));
+			out = vi_or(out, vi_sll(vi_trunc(outr), 16));
+			out = vi_or(out, vi_sll(vi_trunc(outa), 24));
+			if (vm_any(far))
+				out = vi_sel(far, fpx, out);
+			vi_store(drow + (size_t)x * 4, out);
+		}
+	}
+
+	return xv;
+}
@@ -7,9 +7,13 @@
 #include <cairo/cairo.h>
 #include <jpeglib.h>
 #include <setjmp.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "barny.h"
 #include "util.h"
+#include "lens_kernel.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -21,20 +25,6 @@
 
 #define BUBBLE_W       172.0
 
-#define BULGE_NECK      16     /* horizontal patch margin for neck fillets */
-#define BULGE_SMIN      9.0    /* metaball neck fillet scale (surface tension) */
-#define BULGE_REFRACT   2.30   /* lens refraction / magnification gain */
-#define BULGE_BIAS      4.0    /* min inward sample so the rim isn't starved */
-#define BULGE_CHROMA    9.0    /* chromatic dispersion at the lens edge (px) */
-#define BULGE_VEIL      0.06   /* frosted brightness lift inside the bubble */
-#define BULGE_VEIL_FADE 7.0    /* px the veil fades in from the bubble edge */
-#define BULGE_RIM_W     5.0    /* inner glow width of the bubble rim */
-#define BULGE_RIM_STR   0.30   /* soft inner glow of the bubble rim */
-#define BULGE_RIM_CORE  0.55   /* crisp bright line at the bubble outline */
-#define BULGE_RIM_CHROMA 0.28  /* vertical colour dispersion of the rim */
-#define BULGE_CORE_W    1.4    /* px the crisp outline reaches past the rim */
-#define BULGE_CHROMA_MIN 0.25  /* px: below this the 3 taps land on one pixel */
-
 #define LENS_SPRING_K    420.0 /* position spring stiffness, s^-2 */
 #define LENS_SPRING_ZETA 0.82  /* underdamped: slight droplet overshoot */
 #define LENS_POP_K       900.0 /* enter/leave pop spring, critically damped */
@@ -49,201 +39,453 @@
 
 #define LENS_PINCH_MAX   5.5   /* px of bar-edge recession under the droplet */
 #define LENS_PINCH_FADE  24.0  /* px over which the pinch dies near corners */
-#define LENS_FAR_MARGIN  12.0  /* droplet influence radius: beyond it, 1:1 copy */
 
 #define PRISM_STOPS  40
 #define PRISM_CYCLES 2.5
 
-/* Key light for the droplet specular: from above, slightly left, matching
-   the diagonal sheen of the glass frame. */
-#define SPEC_LX      (-0.30)
-#define SPEC_LY      (-0.954)
-#define SPEC_W       7.0   /* px band the specular hugs inside the rim */
-#define SPEC_P       10.0  /* highlight tightness */
-#define SPEC_GAIN    2.4   /* glass_gleam multiplier */
-#define SPEC_COUNTER 0.22  /* strength of the cool counter-arc */
-
 static void
 hsv2rgb(double hh, double s, double v, double *r, double *g, double *b);
 
-static void
-stack_blur_line(uint8_t *src, uint8_t *dst, int width, int radius, int *stack)
+/* One BGRA pixel widened to 32-bit lanes, so the stack blur's four running
+   sums per pixel become one vector add. The generic vector extension maps
+   onto SSE2 or NEON without an ISA switch. */
+typedef int32_t  blur_px_t __attribute__((vector_size(16)));
+typedef uint8_t  blur_px8_t __attribute__((vector_size(4)));
+typedef float    blur_pxf_t __attribute__((vector_size(16)));
+
+/* Columns the vertical pass carries at once: 16 pixels, one 64-byte cache
+   line of each row it walks down. */
+#define BLUR_BLOCK 16
+
+/* sum / mul_sum for all four channels without a hardware divide -- four of
+   those per pixel per pass cost more than the blur itself. The sums stay
+   below 255 * mul_sum, exact in float up to radius 255, so a float
+   reciprocal lands within one of the quotient, and the remainder (also
+   exact) nudges it onto the true one. All in float because SSE2 has no
+   32-bit vector multiply. Larger radii divide. */
+typedef struct {
+	float    d;
+	float    inv;
+	uint32_t di;
+	bool     fast;
+} blur_div_t;
+
+static blur_div_t
+blur_div_init(uint32_t d)
 {
-	int div = radius * 2 + 1;
-	int sum_r, sum_g, sum_b, sum_a;
-	int sum_in_r, sum_in_g, sum_in_b, sum_in_a;
-	int sum_out_r, sum_out_g, sum_out_b, sum_out_a;
-	int sp, stack_start;
-	int mul_sum = (radius + 1) * (radius + 1);
-	int i;
-	int x;
-	int idx;
-	int rbs;
-	int px;
+	blur_div_t q;
 
-	if (radius < 1)
-		return;
+	q.di   = d;
+	q.d    = (float)d;
+	q.inv  = 1.0f / (float)d;
+	q.fast = (uint64_t)d * 255 < ((uint64_t)1 << 24);
+
+	return q;
+}
+
+static inline blur_px_t
+blur_load(const uint8_t *p)
+{
+	blur_px8_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return __builtin_convertvector(v, blur_px_t);
+}
+
+/* narrowing store for lanes already in 0..255. The generic conversion (and
+   the generic byte shuffle, without SSSE3) goes lane by lane on x86, a
+   dozen instructions per pixel; two saturating packs do the same. */
+static inline void
+blur_put(uint8_t *p, blur_px_t v)
+{
+#if defined(__SSE2__)
+	__m128i b = _mm_packs_epi32((__m128i)v, (__m128i)v);
+	int32_t w;
+
+	w = _mm_cvtsi128_si32(_mm_packus_epi16(b, b));
+	memcpy(p, &w, sizeof(w));
+#else
+	typedef uint8_t bytes_t __attribute__((vector_size(16)));
+	blur_px8_t      b;
+
+	b = __builtin_shufflevector((bytes_t)v, (bytes_t)v, 0, 4, 8, 12);
+	memcpy(p, &b, sizeof(b));
+#endif
+}
+
+static inline void
+blur_store(uint8_t *p, blur_px_t sum, const blur_div_t *q)
+{
+	blur_px_t  v;
+	blur_pxf_t s;
+	blur_pxf_t t;
+	blur_pxf_t r;
+
+	if (q->fast) {
+		s  = __builtin_convertvector(sum, blur_pxf_t);
+		t  = __builtin_convertvector(
+		        __builtin_convertvector(s * q->inv, blur_px_t), blur_pxf_t);
+		r  = s - t * q->d;
+		/* comparisons yield -1 per true lane */
+		t -= __builtin_convertvector(r >= q->d, blur_pxf_t);
+		t += __builtin_convertvector(r < 0.0f, blur_pxf_t);
+		v  = __builtin_convertvector(t, blur_px_t);
+	} else {
+		v = sum / (int32_t)q->di;
+	}
+	blur_put(p, v);
+}
+
+/* Stack blur along one axis, `lanes` neighbouring pixels at a time. Step i of
+   the line sits at base + i * step and its lanes are the contiguous pixels
+   there: one lane with a 4-byte step is a row, BLUR_BLOCK lanes with a stride
+   step is a strip of columns walked a cache line per row, instead of the old
+   gather of one pixel per row into a column buffer.
 
-	sum_r = sum_g = sum_b = sum_a = 0;
-	sum_in_r = sum_in_g = sum_in_b = sum_in_a = 0;
-	sum_out_r = sum_out_g = sum_out_b = sum_out_a = 0;
+   Works in place: step x is written before x + radius + 1 is read, and only
+   the final step ever reads a position already written -- after its own last
+   output. The per-lane state (sum, sum_in, sum_out) lives in acc, 3 * lanes
+   entries; stack holds (2 * radius + 1) * lanes. */
+static void
+stack_blur_lines(uint8_t *base, size_t step, int len, int lanes, int radius,
+                 const blur_div_t *q, blur_px_t *stack, blur_px_t *acc)
+{
+	int        div     = radius * 2 + 1;
+	blur_px_t *sum     = acc;
+	blur_px_t *sum_in  = acc + lanes;
+	blur_px_t *sum_out = acc + 2 * lanes;
+	int        sp;
+	int        stack_start;
+	int        i;
+	int        l;
+	int        x;
+	int        px;
+
+	for (l = 0; l < lanes; l++)
+		sum[l] = sum_in[l] = sum_out[l] = (blur_px_t){ 0, 0, 0, 0 };
 
 	for (i = -radius; i <= radius; i++) {
-		x                   = i < 0 ? 0 : (i >= width ? width - 1 : i);
-		idx                 = i + radius;
-		stack[idx * 4 + 0]  = src[x * 4 + 0];
-		stack[idx * 4 + 1]  = src[x * 4 + 1];
-		stack[idx * 4 + 2]  = src[x * 4 + 2];
-		stack[idx * 4 + 3]  = src[x * 4 + 3];
-
-		rbs                 = radius + 1 - abs(i);
-		sum_r              += stack[idx * 4 + 0] * rbs;
-		sum_g              += stack[idx * 4 + 1] * rbs;
-		sum_b              += stack[idx * 4 + 2] * rbs;
-		sum_a              += stack[idx * 4 + 3] * rbs;
-
-		if (i > 0) {
-			sum_in_r += stack[idx * 4 + 0];
-			sum_in_g += stack[idx * 4 + 1];
-			sum_in_b += stack[idx * 4 + 2];
-			sum_in_a += stack[idx * 4 + 3];
-		} else {
-			sum_out_r += stack[idx * 4 + 0];
-			sum_out_g += stack[idx * 4 + 1];
-			sum_out_b += stack[idx * 4 + 2];
-			sum_out_a += stack[idx * 4 + 3];
+		const uint8_t *src;
+		blur_px_t     *slot = stack + (size_t)(i + radius) * lanes;
+		int32_t        rbs  = radius + 1 - abs(i);
+
+		x   = i < 0 ? 0 : (i >= len ? len - 1 : i);
+		src = base + (size_t)x * step;
+
+		for (l = 0; l < lanes; l++) {
+			slot[l]  = blur_load(src + l * 4);
+			sum[l]  += slot[l] * rbs;
+			if (i > 0)
+				sum_in[l] += slot[l];
+			else
+				sum_out[l] += slot[l];
 		}
 	}
 
 	sp = radius;
 
-	for (x = 0; x < width; x++) {
-		dst[x * 4 + 0]  = sum_r / mul_sum;
-		dst[x * 4 + 1]  = sum_g / mul_sum;
-		dst[x * 4 + 2]  = sum_b / mul_sum;
-		dst[x * 4 + 3]  = sum_a / mul_sum;
+	for (x = 0; x < len; x++) {
+		uint8_t       *dst = base + (size_t)x * step;
+		const uint8_t *src;
+		blur_px_t     *slot;
 
-		sum_r          -= sum_out_r;
-		sum_g          -= sum_out_g;
-		sum_b          -= sum_out_b;
-		sum_a          -= sum_out_a;
-
-		stack_start     = sp + div - radius;
+		stack_start = sp + div - radius;
 		if (stack_start >= div)
 			stack_start -= div;
+		slot = stack + (size_t)stack_start * lanes;
 
-		sum_out_r -= stack[stack_start * 4 + 0];
-		sum_out_g -= stack[stack_start * 4 + 1];
-		sum_out_b -= stack[stack_start * 4 + 2];
-		sum_out_a -= stack[stack_start * 4 + 3];
-
-		px         = x + radius + 1;
-		if (px >= width)
-			px = width - 1;
+		px   = x + radius + 1;
+		if (px >= len)
+			px = len - 1;
+		src = base + (size_t)px * step;
 
-		stack[stack_start * 4 + 0]  = src[px * 4 + 0];
-		stack[stack_start * 4 + 1]  = src[px * 4 + 1];
-		stack[stack_start * 4 + 2]  = src[px * 4 + 2];
-		stack[stack_start * 4 + 3]  = src[px * 4 + 3];
+		for (l = 0; l < lanes; l++) {
+			blur_store(dst + l * 4, sum[l], q);
 
-		sum_in_r                   += stack[stack_start * 4 + 0];
-		sum_in_g                   += stack[stack_start * 4 + 1];
-		sum_in_b                   += stack[stack_start * 4 + 2];
-		sum_in_a                   += stack[stack_start * 4 + 3];
-
-		sum_r                      += sum_in_r;
-		sum_g                      += sum_in_g;
-		sum_b                      += sum_in_b;
-		sum_a                      += sum_in_a;
+			sum[l]     -= sum_out[l];
+			sum_out[l] -= slot[l];
+			slot[l]     = blur_load(src + l * 4);
+			sum_in[l]  += slot[l];
+			sum[l]     += sum_in[l];
+		}
 
 		sp++;
 		if (sp >= div)
 			sp = 0;
+		slot = stack + (size_t)sp * lanes;
+
+		for (l = 0; l < lanes; l++) {
+			sum_out[l] += slot[l];
+			sum_in[l]  -= slot[l];
+		}
+	}
+}
+
+/* The blur proper, on any premultiplied ARGB32 buffer: the pyramid path runs
+   it on its own downsampled copy, which is not a cairo surface. */
+static void
+blur_pixels(uint8_t *data, int width, int height, size_t stride, int radius)
+{
+	int         div;
+	blur_px_t  *stack;
+	blur_px_t  *acc;
+	blur_div_t  q;
+	int         x;
+	int         y;
+
+	if (radius < 1 || width <= 0 || height <= 0)
+		return;
 
-		sum_out_r += stack[sp * 4 + 0];
-		sum_out_g += stack[sp * 4 + 1];
-		sum_out_b += stack[sp * 4 + 2];
-		sum_out_a += stack[sp * 4 + 3];
+	div    = radius * 2 + 1;
+	stack  = malloc((size_t)div * BLUR_BLOCK * sizeof(*stack));
+	acc    = malloc(3 * BLUR_BLOCK * sizeof(*acc));
+	if (!stack || !acc) {
+		free(stack);
+		free(acc);
+		return;
+	}
+
+	q = blur_div_init((uint32_t)(radius + 1) * (uint32_t)(radius + 1));
+
+	for (y = 0; y < height; y++)
+		stack_blur_lines(data + (size_t)y * stride, 4, width, 1, radius,
+		                 &q, stack, acc);
+
+	for (x = 0; x < width; x += BLUR_BLOCK) {
+		int lanes = width - x < BLUR_BLOCK ? width - x : BLUR_BLOCK;
 
-		sum_in_r  -= stack[sp * 4 + 0];
-		sum_in_g  -= stack[sp * 4 + 1];
-		sum_in_b  -= stack[sp * 4 + 2];
-		sum_in_a  -= stack[sp * 4 + 3];
+		stack_blur_lines(data + (size_t)x * 4, stride, height, lanes,
+		                 radius, &q, stack, acc);
 	}
+
+	free(stack);
+	free(acc);
 }
 
 void
 barny_blur_surface(cairo_surface_t *surface, int radius)
 {
+	if (radius < 1)
+		return;
+
+	cairo_surface_flush(surface);
+
+	blur_pixels(cairo_image_surface_get_data(surface),
+	            cairo_image_surface_get_width(surface),
+	            cairo_image_surface_get_height(surface),
+	            (size_t)cairo_image_surface_get_stride(surface), radius);
+
+	cairo_surface_mark_dirty(surface);
+}
+
+/* The pyramid never shrinks further than 16x: past that the bilinear
+   upsample has too few samples to hide its grid, whatever the radius. */
+#define BLUR_PYRAMID_MAX_LEVELS 4
+
+int
+barny_blur_pyramid_levels(int radius, int quality)
+{
+	int min_radius;
+	int levels = 0;
+
+	if (quality < BARNY_BLUR_QUALITY_MIN)
+		quality = BARNY_BLUR_QUALITY_MIN;
+	if (quality > BARNY_BLUR_QUALITY_MAX)
+		quality = BARNY_BLUR_QUALITY_MAX;
+
+	/* Each level halves the image and the radius with it. Stop while the
+	   radius left to blur with is still wide enough to smooth away the
+	   box-filter steps of the downsample: 2 px at quality 1, 4 at 2, 8 at 3.
+	   Small radii therefore take the full-resolution path untouched. */
+	min_radius = 1 << quality;
+	while (levels < BLUR_PYRAMID_MAX_LEVELS
+	       && (radius >> (levels + 1)) >= min_radius)
+		levels++;
+
+	return levels;
+}
+
+/* Radius to blur the level-`levels` image with. Not just radius >> levels:
+   the stack blur's kernel is a triangle whose variance grows as
+   (r + 1)^2 - 1, so scaling r linearly overshoots at small sizes -- by a
+   third at radius 30 over four. Matching the variance instead keeps the
+   pyramid's result as soft as the full-resolution blur, no softer. */
+static int
+blur_pyramid_radius(int radius, int levels)
+{
+	double f   = (double)(1 << levels);
+	double var = ((double)(radius + 1) * (radius + 1) - 1.0) / (f * f);
+	int    r   = (int)lround(sqrt(var + 1.0) - 1.0);
+
+	return r < 1 ? 1 : r;
+}
+
+/* 2x2 box average of a sw x sh image into dst. May run in place, src ==
+   dst with the same stride: destination pixel (x, y) lands at or before the
+   first source pixel (2x, 2y) it reads, so nothing is overwritten before it
+   has been used. An odd last row or column averages with itself. */
+static void
+blur_halve(const uint8_t *src, size_t sstride, int sw, int sh, uint8_t *dst,
+           size_t dstride)
+{
+	int x;
+	int y;
+
+	for (y = 0; y < (sh + 1) / 2; y++) {
+		const uint8_t *r0 = src + (size_t)(2 * y) * sstride;
+		const uint8_t *r1 = 2 * y + 1 < sh ? r0 + sstride : r0;
+		uint8_t       *d  = dst + (size_t)y * dstride;
+
+		for (x = 0; x < (sw + 1) / 2; x++) {
+			int       x0 = 2 * x * 4;
+			int       x1 = 2 * x + 1 < sw ? x0 + 4 : x0;
+			blur_px_t v;
+
+			v = blur_load(r0 + x0) + blur_load(r0 + x1) + blur_load(r1 + x0)
+			    + blur_load(r1 + x1) + 2;
+			blur_put(d + x * 4, v >> 2);
+		}
+	}
+}
+
+/* Bilinear upsample of the small blurred image back over the full surface,
+   pixel centres aligned. Done separably: each output row first blends its
+   two source rows into a float line the width of the small image, then
+   every output pixel is one lerp along that line. The per-column taps are
+   worked out once rather than per row. */
+static bool
+blur_expand(const uint8_t *src, size_t sstride, int sw, int sh, uint8_t *dst,
+            size_t dstride, int dw, int dh)
+{
+	int        *cx;
+	float      *cf;
+	blur_pxf_t *line;
+	int         x;
+	int         y;
+
+	cx   = malloc((size_t)dw * sizeof(*cx));
+	cf   = malloc((size_t)dw * sizeof(*cf));
+	/* one spare entry repeats the last pixel, so the right edge needs no
+	   clamp of its own */
+	line = malloc((size_t)(sw + 1) * sizeof(*line));
+	if (!cx || !cf || !line) {
+		free(cx);
+		free(cf);
+		free(line);
+		return false;
+	}
+
+	for (x = 0; x < dw; x++) {
+		float fx = ((float)x + 0.5f) * (float)sw / (float)dw - 0.5f;
+
+		if (fx < 0.0f)
+			fx = 0.0f;
+		cx[x] = (int)fx;
+		if (cx[x] > sw - 1)
+			cx[x] = sw - 1;
+		cf[x] = fx - (float)cx[x];
+	}
+
+	for (y = 0; y < dh; y++) {
+		float          fy = ((float)y + 0.5f) * (float)sh / (float)dh - 0.5f;
+		int            iy;
+		float          wy;
+		const uint8_t *r0;
+		const uint8_t *r1;
+		uint8_t       *d = dst + (size_t)y * dstride;
+
+		if (fy < 0.0f)
+			fy = 0.0f;
+		iy = (int)fy;
+		if (iy > sh - 1)
+			iy = sh - 1;
+		wy = fy - (float)iy;
+		r0 = src + (size_t)iy * sstride;
+		r1 = iy < sh - 1 ? r0 + sstride : r0;
+
+		for (x = 0; x < sw; x++) {
+			blur_pxf_t a = __builtin_convertvector(blur_load(r0 + x * 4),
+			                                       blur_pxf_t);
+			blur_pxf_t b = __builtin_convertvector(blur_load(r1 + x * 4),
+			                                       blur_pxf_t);
+
+			line[x] = a + (b - a) * wy;
+		}
+		line[sw] = line[sw - 1];
+
+		for (x = 0; x < dw; x++) {
+			blur_pxf_t a = line[cx[x]];
+			blur_pxf_t v = a + (line[cx[x] + 1] - a) * cf[x] + 0.5f;
+
+			blur_put(d + x * 4, __builtin_convertvector(v, blur_px_t));
+		}
+	}
+
+	free(cx);
+	free(cf);
+	free(line);
+
+	return true;
+}
+
+void
+barny_blur_surface_pyramid(cairo_surface_t *surface, int radius, int quality)
+{
+	int      levels = barny_blur_pyramid_levels(radius, quality);
 	int      width;
 	int      height;
-	int      stride;
+	int      sw;
+	int      sh;
+	size_t   stride;
+	size_t   sstride;
 	uint8_t *data;
-	int      div;
-	int     *stack;
-	uint8_t *temp;
-	uint8_t *col;
-	uint8_t *col_out;
-	uint8_t *row;
-	int      x;
-	int      y;
+	uint8_t *small;
+	int      i;
 
-	if (radius < 1)
+	if (levels == 0) {
+		barny_blur_surface(surface, radius);
 		return;
+	}
 
 	cairo_surface_flush(surface);
 
 	width  = cairo_image_surface_get_width(surface);
 	height = cairo_image_surface_get_height(surface);
-
 	if (width <= 0 || height <= 0)
 		return;
 
-	stride = cairo_image_surface_get_stride(surface);
-	data   = cairo_image_surface_get_data(surface);
-
-	div    = radius * 2 + 1;
-	stack  = malloc(div * sizeof(int) * 4);
-	if (!stack)
-		return;
+	stride  = (size_t)cairo_image_surface_get_stride(surface);
+	data    = cairo_image_surface_get_data(surface);
 
-	temp = malloc(width * 4);
-	if (!temp) {
-		free(stack);
+	/* one buffer holds every level: the first halving is copied out of the
+	   surface, the rest shrink in place within the same stride */
+	sstride = (size_t)((width + 1) / 2) * 4;
+	small   = malloc(sstride * (size_t)((height + 1) / 2));
+	if (!small) {
+		barny_blur_surface(surface, radius);
 		return;
 	}
 
-	for (y = 0; y < height; y++) {
-		row = data + y * stride;
-		memcpy(temp, row, width * 4);
-		stack_blur_line(temp, row, width, radius, stack);
+	blur_halve(data, stride, width, height, small, sstride);
+	sw = (width + 1) / 2;
+	sh = (height + 1) / 2;
+	for (i = 1; i < levels; i++) {
+		blur_halve(small, sstride, sw, sh, small, sstride);
+		sw = (sw + 1) / 2;
+		sh = (sh + 1) / 2;
 	}
 
-	col     = malloc(height * 4);
-	col_out = malloc(height * 4);
+	blur_pixels(small, sw, sh, sstride,
+	            blur_pyramid_radius(radius, levels));
 
-	if (col && col_out) {
-		for (x = 0; x < width; x++) {
-			for (y = 0; y < height; y++) {
-				col[y * 4 + 0] = data[y * stride + x * 4 + 0];
-				col[y * 4 + 1] = data[y * stride + x * 4 + 1];
-				col[y * 4 + 2] = data[y * stride + x * 4 + 2];
-				col[y * 4 + 3] = data[y * stride + x * 4 + 3];
-			}
-			stack_blur_line(col, col_out, height, radius, stack);
-			for (y = 0; y < height; y++) {
-				data[y * stride + x * 4 + 0] = col_out[y * 4 + 0];
-				data[y * stride + x * 4 + 1] = col_out[y * 4 + 1];
-				data[y * stride + x * 4 + 2] = col_out[y * 4 + 2];
-				data[y * stride + x * 4 + 3] = col_out[y * 4 + 3];
-			}
-		}
+	if (!blur_expand(small, sstride, sw, sh, data, stride, width, height)) {
+		free(small);
+		barny_blur_surface(surface, radius);
+		return;
 	}
 
-	free(col);
-	free(col_out);
-	free(temp);
-	free(stack);
+	free(small);
 
 	cairo_surface_mark_dirty(surface);
 }
@@ -855,7 +1097,11 @@ lens_scratch(barny_output_t *output, int pw, int ph)
 
 	output->lens_patch = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, pw,
 	                                                ph);
-	output->lens_field = calloc((size_t)gw * gh * 2, sizeof(float));
+	/* merged + droplet fields, then the float column tables the vector
+	   kernels read */
+	output->lens_field = calloc((size_t)gw * gh * 2 + (size_t)gw
+	                                    + (size_t)pw * 3,
+	                            sizeof(float));
 	output->lens_cols  = calloc((size_t)gw + (size_t)pw * 3,
 	                            sizeof(double));
 
@@ -886,161 +1132,57 @@ barny_output_free_lens_cache(barny_output_t *output)
 	output->lens_patch_h = 0;
 }
 
-/* Render the merged bar+droplet blob into a fully self-contained premultiplied
-   ARGB patch. Coverage comes from the deformed distance field: the bar slab is
-   pinched toward the droplet (surface tension) and smooth-unioned with the
-   pill, so the bar silhouette really recedes around the lens. The interior
-   refracts the clean bar strip (glass_clean); the frame highlight, bottom
-   shadow band and spectral rim are re-derived along the deformed contour; the
-   drop shadow (shadow_cache) shows through wherever the silhouette vacates.
-   In authoritative mode the patch replaces the cached bar pixels wholesale
-   (painted with SOURCE); otherwise it is a plain overlay for the
-   squircle-corner zones the analytic field cannot reproduce.
-
-   The returned surface is owned by the output and reused next frame; the
-   caller must not destroy it. Every pixel is written, so it needs no clear. */
-static cairo_surface_t *
-build_lens_patch(barny_output_t *output, int sox, int soy, int pw, int ph,
-                 double cxp, double cyp, double hw, double hh, double br,
-                 double skew, double bar_top, double bar_bot, double disp,
-                 double chroma, double strength, double pinch_amp,
-                 bool authoritative)
+/* Shade patch rows [y0, y1), columns [x0, x1). This is the reference the
+   vector kernels are held to: they take the leading whole vectors of each row
+   and leave the tail, and every machine without one, to this loop. */
+static void
+lens_shade_rows(const barny_lens_job_t *job, int y0, int y1, int x0, int x1)
 {
-	barny_state_t   *state   = output->state;
-	double           prism   = state->config.glass_prism;
-	double           gleam   = state->config.glass_gleam;
-	double           spec_g  = gleam * SPEC_GAIN * strength;
-	double           cx      = output->pad_left;
-	double           cw      = output->width;
-	double           chh     = bar_bot - bar_top;
-	double           edge_h  = BARNY_FRAME_EDGE_TOP_STOP * chh;
-	double           shad_h  = chh * 0.28 > 10.0 ? 10.0 : chh * 0.28;
-	double           pinch_r = pw / 2.0 - 6.0;
-	int              gw      = pw + 2;
-	int              gh      = ph + 2;
-	cairo_surface_t *dst;
-	uint8_t         *gdata;
-	uint8_t         *hdata;
-	uint8_t         *bdata;
-	uint8_t         *ddata;
-	int              gstride;
-	int              hstride;
-	int              bstride;
-	int              dstride;
-	int              gsw;
-	int              gsh;
-	int              bsw;
-	int              bsh;
-	float           *df;
-	float           *ddf;
-	double          *cols;
-	double          *pinch;
-	double          *prm;
-	/* Denominators fixed for the whole patch. IEEE rules stop the compiler
-	   from folding x/k into x*(1/k) on its own, so each pixel was paying
-	   several ~20-cycle divides for constants. */
-	double           inv_hh;
-	double           inv_edge_h;
-	double           inv_shad_h;
-	int              x;
-	int              y;
-
-	if (!output->glass_clean || !output->shadow_cache || !output->bg_cache)
-		return NULL;
-
-	if (!lens_scratch(output, pw, ph))
-		return NULL;
-
-	dst   = output->lens_patch;
-	df    = output->lens_field;
-	cols  = output->lens_cols;
-	ddf   = df + (size_t)gw * gh;
-	pinch = cols;
-	prm   = cols + gw;
-
-	cairo_surface_flush(dst);
-	cairo_surface_flush(output->glass_clean);
-	cairo_surface_flush(output->shadow_cache);
-	cairo_surface_flush(output->bg_cache);
-	gdata   = cairo_image_surface_get_data(output->glass_clean);
-	gstride = cairo_image_surface_get_stride(output->glass_clean);
-	gsw     = cairo_image_surface_get_width(output->glass_clean);
-	gsh     = cairo_image_surface_get_height(output->glass_clean);
-	hdata   = cairo_image_surface_get_data(output->shadow_cache);
-	hstride = cairo_image_surface_get_stride(output->shadow_cache);
-	bdata   = cairo_image_surface_get_data(output->bg_cache);
-	bstride = cairo_image_surface_get_stride(output->bg_cache);
-	bsw     = cairo_image_surface_get_width(output->bg_cache);
-	bsh     = cairo_image_surface_get_height(output->bg_cache);
-	ddata   = cairo_image_surface_get_data(dst);
-	dstride = cairo_image_surface_get_stride(dst);
-
-	if (!gdata || !hdata || !bdata || !ddata)
-		return NULL;
-
-	inv_hh     = hh > 0.0 ? 1.0 / hh : 0.0;
-	inv_edge_h = edge_h > 0.0 ? 1.0 / edge_h : 0.0;
-	inv_shad_h = shad_h > 0.0 ? 1.0 / shad_h : 0.0;
-
-	prism_stops_init();
-
-	for (x = 0; x < pw; x++) {
-		double pos = ((double)(x + sox) + 0.5 - cx) / cw;
-		double f;
-		int    si;
-
-		if (pos < 0.0)
-			pos = 0.0;
-		if (pos > 1.0)
-			pos = 1.0;
-		f  = pos * PRISM_STOPS;
-		si = (int)f;
-		if (si >= PRISM_STOPS)
-			si = PRISM_STOPS - 1;
-		f             -= si;
-		prm[x * 3 + 0] = prism_stop_r[si]
-		                 + (prism_stop_r[si + 1] - prism_stop_r[si]) * f;
-		prm[x * 3 + 1] = prism_stop_g[si]
-		                 + (prism_stop_g[si + 1] - prism_stop_g[si]) * f;
-		prm[x * 3 + 2] = prism_stop_b[si]
-		                 + (prism_stop_b[si + 1] - prism_stop_b[si]) * f;
-	}
-
-	for (x = 0; x < gw; x++) {
-		double lx = x - 1 + 0.5;
-		double u  = pinch_r > 0.0 ? fabs(lx - cxp) / pinch_r : 1.0;
-		double w  = 0.0;
-
-		if (u < 1.0) {
-			w = 1.0 - u * u;
-			w = w * w;
-		}
-		pinch[x] = pinch_amp * w;
-	}
-
-	for (y = 0; y < gh; y++) {
-		double ly = y - 1 + 0.5;
-
-		for (x = 0; x < gw; x++) {
-			double lx = x - 1 + 0.5 - skew * (ly - cyp);
-			double dd = barny_sd_round_rect(lx - cxp, ly - cyp, hw, hh, br);
-			double db = fmax(bar_top + pinch[x] - ly,
-			                 ly - (bar_bot - pinch[x]));
-
-			ddf[y * gw + x] = (float)dd;
-			df[y * gw + x]  = (float)barny_smin(db, dd, BULGE_SMIN);
-		}
-	}
-
-	for (y = 0; y < ph; y++) {
-		uint8_t *drow = ddata + y * dstride;
-		int      sy   = y + soy;
-		uint8_t *hrow = sy >= 0 && sy < bsh ? hdata + sy * hstride
-		                                    : NULL;
-		uint8_t *brow = sy >= 0 && sy < bsh ? bdata + sy * bstride
-		                                    : NULL;
-
-		for (x = 0; x < pw; x++) {
+	const uint8_t *gdata         = job->gdata;
+	const uint8_t *hdata         = job->hdata;
+	const uint8_t *bdata         = job->bdata;
+	uint8_t       *ddata         = job->ddata;
+	int            gstride       = job->gstride;
+	int            gsw           = job->gsw;
+	int            gsh           = job->gsh;
+	int            hstride       = job->hstride;
+	int            bstride       = job->bstride;
+	int            bsw           = job->bsw;
+	int            bsh           = job->bsh;
+	int            dstride       = job->dstride;
+	const float   *df            = job->df;
+	const float   *ddf           = job->ddf;
+	int            gw            = job->gw;
+	const double  *pinch         = job->pinch;
+	const double  *prm           = job->prm;
+	int            sox           = job->sox;
+	int            soy           = job->soy;
+	double         cx            = job->cx;
+	double         cyp           = job->cyp;
+	double         hh            = job->hh;
+	double         inv_hh        = job->inv_hh;
+	double         edge_h        = job->edge_h;
+	double         inv_edge_h    = job->inv_edge_h;
+	double         shad_h        = job->shad_h;
+	double         inv_shad_h    = job->inv_shad_h;
+	double         disp          = job->disp;
+	double         chroma        = job->chroma;
+	double         strength      = job->strength;
+	double         spec_g        = job->spec_g;
+	double         prism         = job->prism;
+	bool           authoritative = job->authoritative;
+	int            x;
+	int            y;
+
+	for (y = y0; y < y1; y++) {
+		uint8_t       *drow = ddata + y * dstride;
+		int            sy   = y + soy;
+		const uint8_t *hrow = sy >= 0 && sy < bsh ? hdata + sy * hstride
+		                                          : NULL;
+		const uint8_t *brow = sy >= 0 && sy < bsh ? bdata + sy * bstride
+		                                          : NULL;
+
+		for (x = x0; x < x1; x++) {
 			int    gi  = (y + 1) * gw + (x + 1);
 			double d   = df[gi];
 			double dd  = ddf[gi];
@@ -1352,6 +1494,299 @@ build_lens_patch(barny_output_t *output, int sox, int soy, int pw, int ph,
 			drow[x * 4 + 3] = (uint8_t)outa;
 		}
 	}
+}
+
+static barny_lens_kernel_fn lens_kernel;
+static bool                 lens_kernel_ready;
+
+/* Pick the widest vector kernel this CPU runs, once. The kernels are built
+   per ISA (src/render/meson.build), so the choice is a cpuid probe rather
+   than a compile-time flag: one binary serves every machine in the fleet. */
+static barny_lens_kernel_fn
+lens_kernel_pick(void)
+{
+	if (lens_kernel_ready)
+		return lens_kernel;
+	lens_kernel_ready = true;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		lens_kernel = barny_lens_shade_avx2;
+	else if (__builtin_cpu_supports("sse4.1"))
+		lens_kernel = barny_lens_shade_sse41;
+#elif defined(__aarch64__)
+	lens_kernel = barny_lens_shade_neon;
+#endif
+
+	return lens_kernel;
+}
+
+static void
+lens_shade(const barny_lens_job_t *job, int y0, int y1)
+{
+	barny_lens_kernel_fn kernel = lens_kernel_pick();
+	int                  xv     = 0;
+
+	if (kernel)
+		xv = kernel(job, y0, y1);
+	if (xv < job->pw)
+		lens_shade_rows(job, y0, y1, xv, job->pw);
+}
+
+static void
+lens_shade_band(void *ctx, int y0, int y1)
+{
+	lens_shade(ctx, y0, y1);
+}
+
+/* Distance-field prepass inputs. The fields carry a 1 px apron, so rows and
+   columns here are field coordinates, one ahead of the patch's. */
+typedef struct {
+	float        *df;
+	float        *ddf;
+	const double *pinch;
+	int           gw;
+	double        cxp;
+	double        cyp;
+	double        hw;
+	double        hh;
+	double        br;
+	double        skew;
+	double        bar_top;
+	double        bar_bot;
+} lens_field_job_t;
+
+/* Field rows [y0, y1): the droplet pill and the pinched bar slab, merged
+   with a smooth minimum. Rows are independent, so bands can run on any
+   thread. */
+static void
+lens_field_rows(void *ctx, int y0, int y1)
+{
+	const lens_field_job_t *f  = ctx;
+	int                     gw = f->gw;
+	int                     x;
+	int                     y;
+
+	for (y = y0; y < y1; y++) {
+		double ly = y - 1 + 0.5;
+
+		for (x = 0; x < gw; x++) {
+			double lx = x - 1 + 0.5 - f->skew * (ly - f->cyp);
+			double dd = barny_sd_round_rect(lx - f->cxp, ly - f->cyp,
+			                                f->hw, f->hh, f->br);
+			double db = fmax(f->bar_top + f->pinch[x] - ly,
+			                 ly - (f->bar_bot - f->pinch[x]));
+
+			f->ddf[y * gw + x] = (float)dd;
+			f->df[y * gw + x]  = (float)barny_smin(db, dd, BULGE_SMIN);
+		}
+	}
+}
+
+/* Render the merged bar+droplet blob into a fully self-contained premultiplied
+   ARGB patch. Coverage comes from the deformed distance field: the bar slab is
+   pinched toward the droplet (surface tension) and smooth-unioned with the
+   pill, so the bar silhouette really recedes around the lens. The interior
+   refracts the clean bar strip (glass_clean); the frame highlight, bottom
+   shadow band and spectral rim are re-derived along the deformed contour; the
+   drop shadow (shadow_cache) shows through wherever the silhouette vacates.
+   In authoritative mode the patch replaces the cached bar pixels wholesale
+   (painted with SOURCE); otherwise it is a plain overlay for the
+   squircle-corner zones the analytic field cannot reproduce.
+
+   The returned surface is owned by the output and reused next frame; the
+   caller must not destroy it. Every pixel is written, so it needs no clear. */
+static cairo_surface_t *
+build_lens_patch(barny_output_t *output, int sox, int soy, int pw, int ph,
+                 double cxp, double cyp, double hw, double hh, double br,
+                 double skew, double bar_top, double bar_bot, double disp,
+                 double chroma, double strength, double pinch_amp,
+                 bool authoritative)
+{
+	barny_state_t   *state   = output->state;
+	double           prism   = state->config.glass_prism;
+	double           gleam   = state->config.glass_gleam;
+	double           spec_g  = gleam * SPEC_GAIN * strength;
+	double           cx      = output->pad_left;
+	double           cw      = output->width;
+	double           chh     = bar_bot - bar_top;
+	double           edge_h  = BARNY_FRAME_EDGE_TOP_STOP * chh;
+	double           shad_h  = chh * 0.28 > 10.0 ? 10.0 : chh * 0.28;
+	double           pinch_r = pw / 2.0 - 6.0;
+	int              gw      = pw + 2;
+	int              gh      = ph + 2;
+	cairo_surface_t *dst;
+	uint8_t         *gdata;
+	uint8_t         *hdata;
+	uint8_t         *bdata;
+	uint8_t         *ddata;
+	int              gstride;
+	int              hstride;
+	int              bstride;
+	int              dstride;
+	int              gsw;
+	int              gsh;
+	int              bsw;
+	int              bsh;
+	float           *df;
+	float           *ddf;
+	double          *cols;
+	double          *pinch;
+	double          *prm;
+	float           *pinch_f;
+	float           *prm_f;
+	lens_field_job_t field;
+	barny_lens_job_t job;
+	/* Denominators fixed for the whole patch. IEEE rules stop the compiler
+	   from folding x/k into x*(1/k) on its own, so each pixel was paying
+	   several ~20-cycle divides for constants. */
+	double           inv_hh;
+	double           inv_edge_h;
+	double           inv_shad_h;
+	int              x;
+
+	if (!output->glass_clean || !output->shadow_cache || !output->bg_cache)
+		return NULL;
+
+	if (!lens_scratch(output, pw, ph))
+		return NULL;
+
+	dst     = output->lens_patch;
+	df      = output->lens_field;
+	cols    = output->lens_cols;
+	ddf     = df + (size_t)gw * gh;
+	pinch_f = ddf + (size_t)gw * gh;
+	prm_f   = pinch_f + gw;
+	pinch   = cols;
+	prm     = cols + gw;
+
+	cairo_surface_flush(dst);
+	cairo_surface_flush(output->glass_clean);
+	cairo_surface_flush(output->shadow_cache);
+	cairo_surface_flush(output->bg_cache);
+	gdata   = cairo_image_surface_get_data(output->glass_clean);
+	gstride = cairo_image_surface_get_stride(output->glass_clean);
+	gsw     = cairo_image_surface_get_width(output->glass_clean);
+	gsh     = cairo_image_surface_get_height(output->glass_clean);
+	hdata   = cairo_image_surface_get_data(output->shadow_cache);
+	hstride = cairo_image_surface_get_stride(output->shadow_cache);
+	bdata   = cairo_image_surface_get_data(output->bg_cache);
+	bstride = cairo_image_surface_get_stride(output->bg_cache);
+	bsw     = cairo_image_surface_get_width(output->bg_cache);
+	bsh     = cairo_image_surface_get_height(output->bg_cache);
+	ddata   = cairo_image_surface_get_data(dst);
+	dstride = cairo_image_surface_get_stride(dst);
+
+	if (!gdata || !hdata || !bdata || !ddata)
+		return NULL;
+
+	inv_hh     = hh > 0.0 ? 1.0 / hh : 0.0;
+	inv_edge_h = edge_h > 0.0 ? 1.0 / edge_h : 0.0;
+	inv_shad_h = shad_h > 0.0 ? 1.0 / shad_h : 0.0;
+
+	prism_stops_init();
+
+	for (x = 0; x < pw; x++) {
+		double pos = ((double)(x + sox) + 0.5 - cx) / cw;
+		double f;
+		int    si;
+
+		if (pos < 0.0)
+			pos = 0.0;
+		if (pos > 1.0)
+			pos = 1.0;
+		f  = pos * PRISM_STOPS;
+		si = (int)f;
+		if (si >= PRISM_STOPS)
+			si = PRISM_STOPS - 1;
+		f             -= si;
+		prm[x * 3 + 0] = prism_stop_r[si]
+		                 + (prism_stop_r[si + 1] - prism_stop_r[si]) * f;
+		prm[x * 3 + 1] = prism_stop_g[si]
+		                 + (prism_stop_g[si + 1] - prism_stop_g[si]) * f;
+		prm[x * 3 + 2] = prism_stop_b[si]
+		                 + (prism_stop_b[si + 1] - prism_stop_b[si]) * f;
+		prm_f[x]          = (float)prm[x * 3 + 0];
+		prm_f[pw + x]     = (float)prm[x * 3 + 1];
+		prm_f[2 * pw + x] = (float)prm[x * 3 + 2];
+	}
+
+	for (x = 0; x < gw; x++) {
+		double lx = x - 1 + 0.5;
+		double u  = pinch_r > 0.0 ? fabs(lx - cxp) / pinch_r : 1.0;
+		double w  = 0.0;
+
+		if (u < 1.0) {
+			w = 1.0 - u * u;
+			w = w * w;
+		}
+		pinch[x]   = pinch_amp * w;
+		pinch_f[x] = (float)pinch[x];
+	}
+
+	field = (lens_field_job_t){
+		.df      = df,
+		.ddf     = ddf,
+		.pinch   = pinch,
+		.gw      = gw,
+		.cxp     = cxp,
+		.cyp     = cyp,
+		.hw      = hw,
+		.hh      = hh,
+		.br      = br,
+		.skew    = skew,
+		.bar_top = bar_top,
+		.bar_bot = bar_bot,
+	};
+	barny_pool_run(state->render_pool, lens_field_rows, &field, gh);
+
+	job = (barny_lens_job_t){
+		.gdata         = gdata,
+		.gstride       = gstride,
+		.gsw           = gsw,
+		.gsh           = gsh,
+		.hdata         = hdata,
+		.hstride       = hstride,
+		.bdata         = bdata,
+		.bstride       = bstride,
+		.bsw           = bsw,
+		.bsh           = bsh,
+		.ddata         = ddata,
+		.dstride       = dstride,
+		.df            = df,
+		.ddf           = ddf,
+		.gw            = gw,
+		.pinch         = pinch,
+		.prm           = prm,
+		.pinch_f       = pinch_f,
+		.prm_r         = prm_f,
+		.prm_g         = prm_f + pw,
+		.prm_b         = prm_f + 2 * pw,
+		.sox           = sox,
+		.soy           = soy,
+		.pw            = pw,
+		.ph            = ph,
+		.cx            = cx,
+		.cyp           = cyp,
+		.hh            = hh,
+		.inv_hh        = inv_hh,
+		.edge_h        = edge_h,
+		.inv_edge_h    = inv_edge_h,
+		.shad_h        = shad_h,
+		.inv_shad_h    = inv_shad_h,
+		.edge_top_a    = BARNY_FRAME_EDGE_TOP_A,
+		.edge_bot_a    = BARNY_FRAME_EDGE_BOT_A,
+		.disp          = disp,
+		.chroma        = chroma,
+		.strength      = strength,
+		.spec_g        = spec_g,
+		.prism         = prism,
+		.authoritative = authoritative,
+	};
+	/* resolve the kernel here, not in a race between the workers */
+	lens_kernel_pick();
+	barny_pool_run(state->render_pool, lens_shade_band, &job, ph);
 
 	cairo_surface_mark_dirty(dst);
 
@@ -1853,19 +2288,43 @@ jpeg_error_exit(j_common_ptr cinfo)
 	longjmp(err->setjmp_buffer, 1);
 }
 
+/* Rows of a w x h (already scaled) wallpaper the bars can reach. */
+static int
+wallpaper_rows(const barny_wallpaper_geom_t *geom, int w, int h)
+{
+	int keep;
+
+	if (!geom || geom->max_aspect <= 0.0)
+		return h;
+
+	keep = (int)ceil(w * geom->max_aspect) + geom->margin;
+
+	return keep < h ? keep : h;
+}
+
+/* Decode straight into the size and rows the bars use. The DCT scales by
+   M/8 for free, so the smallest factor that still covers the widest output
+   is picked before any pixel is produced, and rows past the bars' reach are
+   never decoded at all -- skipped ahead of them, or simply not read after.
+   An 8K wallpaper on a 1080p bar decodes a quarter of the width and about
+   half the rows, instead of a 130 MB surface that is cropped and dropped. */
 static cairo_surface_t *
-load_jpeg(const char *path)
+load_jpeg(const char *path, barny_wallpaper_geom_t *geom)
 {
 	FILE                         *f;
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr_ext     jerr;
 	int                           width;
 	int                           height;
+	int                           keep;
+	int                           first;
 	int                           row_stride;
-	cairo_surface_t              *surface;
+	cairo_surface_t *volatile     surface = NULL;
 	uint8_t                      *data;
 	int                           cairo_stride;
 	JSAMPARRAY                    buffer;
+	bool                          direct;
+	int                           num;
 	int                           x;
 	int                           y;
 	uint8_t                      *dst_row;
@@ -1882,6 +2341,8 @@ load_jpeg(const char *path)
 	if (setjmp(jerr.setjmp_buffer)) {
 		jpeg_destroy_decompress(&cinfo);
 		fclose(f);
+		if (surface)
+			cairo_surface_destroy(surface);
 		return NULL;
 	}
 
@@ -1889,18 +2350,42 @@ load_jpeg(const char *path)
 	jpeg_stdio_src(&cinfo, f);
 	jpeg_read_header(&cinfo, TRUE);
 
+	/* libjpeg-turbo can write cairo's native-endian ARGB32 itself, which
+	   lets scanlines land in the surface with no conversion pass */
+#if defined(JCS_ALPHA_EXTENSIONS) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	cinfo.out_color_space = JCS_EXT_BGRA;
+	direct                = true;
+#elif defined(JCS_ALPHA_EXTENSIONS)
+	cinfo.out_color_space = JCS_EXT_ARGB;
+	direct                = true;
+#else
 	cinfo.out_color_space = JCS_RGB;
+	direct                = false;
+#endif
+
+	if (geom && geom->min_width > 0) {
+		for (num = 1; num <= 8; num++) {
+			cinfo.scale_num   = num;
+			cinfo.scale_denom = 8;
+			jpeg_calc_output_dimensions(&cinfo);
+			if ((int)cinfo.output_width >= geom->min_width)
+				break;
+		}
+	}
+
 	jpeg_start_decompress(&cinfo);
 
 	width      = cinfo.output_width;
 	height     = cinfo.output_height;
 	row_stride = cinfo.output_width * cinfo.output_components;
+	keep       = wallpaper_rows(geom, width, height);
+	first      = geom && geom->from_bottom ? height - keep : 0;
 
-	surface    = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	surface    = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, keep);
 	if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
-		jpeg_finish_decompress(&cinfo);
 		jpeg_destroy_decompress(&cinfo);
 		fclose(f);
+		cairo_surface_destroy(surface);
 		return NULL;
 	}
 
@@ -1911,11 +2396,23 @@ load_jpeg(const char *path)
 	buffer       = (*cinfo.mem->alloc_sarray)((j_common_ptr)&cinfo, JPOOL_IMAGE,
 	                                          row_stride, 1);
 
-	while (cinfo.output_scanline < cinfo.output_height) {
-		y = cinfo.output_scanline;
+#ifdef LIBJPEG_TURBO_VERSION
+	if (first > 0)
+		jpeg_skip_scanlines(&cinfo, first);
+#endif
+	while ((int)cinfo.output_scanline < first)
 		jpeg_read_scanlines(&cinfo, buffer, 1);
 
+	while ((int)cinfo.output_scanline < first + keep) {
+		y       = cinfo.output_scanline - first;
 		dst_row = data + y * cairo_stride;
+
+		if (direct) {
+			jpeg_read_scanlines(&cinfo, &dst_row, 1);
+			continue;
+		}
+
+		jpeg_read_scanlines(&cinfo, buffer, 1);
 		src_row = buffer[0];
 
 		for (x = 0; x < width; x++) {
@@ -1928,13 +2425,59 @@ load_jpeg(const char *path)
 
 	cairo_surface_mark_dirty(surface);
 
-	jpeg_finish_decompress(&cinfo);
+	if (geom)
+		geom->scale = (double)width / cinfo.image_width;
+	printf("barny: decoded JPEG %ux%u at %dx%d, rows %d-%d\n",
+	       cinfo.image_width, cinfo.image_height, width, height, first,
+	       first + keep);
+
+	/* stopping short of the last row is fine: destroy releases a
+	   decompressor in any state, finish would insist on the rest */
+	if (cinfo.output_scanline == cinfo.output_height)
+		jpeg_finish_decompress(&cinfo);
 	jpeg_destroy_decompress(&cinfo);
 	fclose(f);
 
 	return surface;
 }
 
+/* PNG has no decode-time scaling; at least drop the rows the bars never
+   reach before anything downstream copies or blurs them. */
+static cairo_surface_t *
+crop_wallpaper(cairo_surface_t *surface, barny_wallpaper_geom_t *geom)
+{
+	int              w    = cairo_image_surface_get_width(surface);
+	int              h    = cairo_image_surface_get_height(surface);
+	int              keep = wallpaper_rows(geom, w, h);
+	int              first;
+	cairo_surface_t *cropped;
+	cairo_t         *cr;
+
+	if (geom)
+		geom->scale = 1.0;
+	if (keep >= h)
+		return surface;
+
+	first   = geom->from_bottom ? h - keep : 0;
+	cropped = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, keep);
+	if (cairo_surface_status(cropped) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(cropped);
+		return surface;
+	}
+
+	cr = cairo_create(cropped);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, surface, 0, -first);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	cairo_surface_destroy(surface);
+
+	printf("barny: cropped wallpaper from %dx%d to %dx%d (y-offset=%d)\n", w,
+	       h, w, keep, first);
+
+	return cropped;
+}
+
 static int
 has_extension(const char *path, const char *ext)
 {
@@ -1957,12 +2500,12 @@ has_extension(const char *path, const char *ext)
 }
 
 cairo_surface_t *
-barny_load_wallpaper(const char *path)
+barny_load_wallpaper(const char *path, barny_wallpaper_geom_t *geom)
 {
 	cairo_surface_t *surface = NULL;
 
 	if (has_extension(path, ".jpg") || has_extension(path, ".jpeg")) {
-		surface = load_jpeg(path);
+		surface = load_jpeg(path, geom);
 		if (surface) {
 			printf("barny: loaded JPEG wallpaper: %s\n", path);
 			return surface;
@@ -1972,12 +2515,12 @@ barny_load_wallpaper(const char *path)
 	surface = cairo_image_surface_create_from_png(path);
 	if (cairo_surface_status(surface) == CAIRO_STATUS_SUCCESS) {
 		printf("barny: loaded PNG wallpaper: %s\n", path);
-		return surface;
+		return crop_wallpaper(surface, geom);
 	}
 	cairo_surface_destroy(surface);
 
 	if (!has_extension(path, ".jpg") && !has_extension(path, ".jpeg")) {
-		surface = load_jpeg(path);
+		surface = load_jpeg(path, geom);
 		if (surface) {
 			printf("barny: loaded JPEG wallpaper: %s\n", path);
 			return surface;
@@ -1,7 +1,9 @@
 #include <limits.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "barny.h"
+#include "util.h"
 
 static bool
 is_gap_placeholder(const barny_module_t *mod)
@@ -293,7 +295,7 @@ lens_damage(const barny_output_t *output, bool have_lens, int lx, int ly,
 }
 
 /* A droplet-only frame may repaint just the droplet's strip: the rest of the
-   bar is already correct in the (single, persistent) shm buffer. Anything that
+   bar is carried over from the previous frame's buffer. Anything that
    can change pixels elsewhere -- a dirty module, a rebuilt bar cache, the
    droplet living on another output -- forces the full path. */
 static bool
@@ -310,19 +312,20 @@ lens_partial_ok(barny_output_t *output)
 void
 barny_render_frame(barny_output_t *output)
 {
-	cairo_t       *cr;
-	barny_state_t *state;
-	int            saved_widths[BARNY_MAX_MODULES];
-	bool           width_changed = false;
-	bool           lens_anim;
-	bool           have_lens;
-	bool           partial;
-	int            lx = 0, ly = 0, lw = 0, lh = 0;
-	int            dx = 0, dy = 0, dw = 0, dh = 0;
-	int            i;
-	int            new_w;
-
-	if (!output->configured || !output->cr) {
+	cairo_t        *cr;
+	barny_state_t  *state;
+	barny_buffer_t *buf;
+	int             saved_widths[BARNY_MAX_MODULES];
+	bool            width_changed = false;
+	bool            lens_anim;
+	bool            have_lens;
+	bool            partial;
+	int             lx = 0, ly = 0, lw = 0, lh = 0;
+	int             dx = 0, dy = 0, dw = 0, dh = 0;
+	int             i;
+	int             new_w;
+
+	if (!output->configured || !output->buffers[0].data) {
 		return;
 	}
 
@@ -331,11 +334,19 @@ barny_render_frame(barny_output_t *output)
 		return;
 	}
 
+	/* every buffer is on screen or queued in the compositor; the next
+	   release picks this frame up */
+	buf = barny_buffers_acquire(output->buffers, BARNY_OUTPUT_BUFFERS);
+	if (!buf) {
+		output->redraw_queued = true;
+		return;
+	}
+
 	output->redraw_queued = false;
 
 	lens_anim             = barny_lens_step(output);
 
-	cr                    = output->cr;
+	cr                    = buf->cr;
 	state                 = output->state;
 
 	for (i = 0; i < state->module_count; i++) {
@@ -347,6 +358,10 @@ barny_render_frame(barny_output_t *output)
 	partial = lens_partial_ok(output) && dw > 0 && dh > 0;
 
 	if (partial) {
+		/* the strip is drawn on top of the last frame, which lives in
+		   another buffer whenever the compositor still held this one */
+		barny_buffer_copy_forward(buf, output->front);
+
 		/* Clip first: the clear, the bar-cache blit and the droplet all
 		   land inside the strip, and the modules outside it skip their
 		   text shaping entirely. */
@@ -402,19 +417,29 @@ barny_render_frame(barny_output_t *output)
 
 	barny_output_request_frame(output);
 
-	cairo_surface_flush(output->cairo_surface);
-	wl_surface_attach(output->surface, output->buffer, 0, 0);
-	if (partial) {
-		wl_surface_damage_buffer(output->surface, dx * output->scale,
-		                         dy * output->scale,
-		                         dw * output->scale,
-		                         dh * output->scale);
-	} else {
-		wl_surface_damage_buffer(output->surface, 0, 0,
-		                         output->surf_width * output->scale,
-		                         output->surf_height * output->scale);
+	if (!partial) {
+		dx = 0;
+		dy = 0;
+		dw = output->surf_width;
+		dh = output->surf_height;
 	}
+
+	cairo_surface_flush(buf->cairo_surface);
+	wl_surface_attach(output->surface, buf->wl_buffer, 0, 0);
+	wl_surface_damage_buffer(output->surface, dx * output->scale,
+	                         dy * output->scale, dw * output->scale,
+	                         dh * output->scale);
 	wl_surface_commit(output->surface);
+	barny_buffers_commit(output->buffers, BARNY_OUTPUT_BUFFERS, buf,
+	                     dx * output->scale, dy * output->scale,
+	                     dw * output->scale, dh * output->scale);
+	output->front = buf;
+
+	if (state->start_us) {
+		printf("barny: first frame after %.1f ms\n",
+		       (double)(barny_now_us() - state->start_us) / 1000.0);
+		state->start_us = 0;
+	}
 }
 
 void
@@ -0,0 +1,472 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "barny.h"
+#include "util.h"
+
+/* The startup pipeline -- decode, blur, vibrancy, displacement -- is a pure
+   function of the wallpaper file, a handful of config fields and the output
+   geometry, and it is most of what stands between launch and the first
+   frame. Its result is kept under $XDG_CACHE_HOME/barny as raw ARGB32 rows
+   behind a small header, so a warm start maps the pixels instead of
+   recomputing them and only faults in the pages the bars actually sample.
+
+   One file per key, named after it. A changed wallpaper or setting hashes to
+   a new name, misses, and the store that follows removes every other cache
+   file: there is only ever one wallpaper. */
+
+#define WP_CACHE_MAGIC   "BARNYWP"
+#define WP_CACHE_VERSION 1
+/* pixels start on a page boundary so each surface maps cleanly */
+#define WP_CACHE_DATA    4096
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t count; /* 1: blurred; 2: blurred, then displaced */
+	uint64_t key;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t reserved;
+} wp_cache_header_t;
+
+/* shared by the one or two surfaces carved out of a mapping; the last one
+   destroyed unmaps it */
+typedef struct {
+	void  *addr;
+	size_t len;
+	int    refs;
+} wp_cache_map_t;
+
+static const cairo_user_data_key_t wp_cache_map_key;
+
+static uint64_t
+fnv1a(uint64_t h, const void *data, size_t len)
+{
+	const uint8_t *p = data;
+	size_t         i;
+
+	for (i = 0; i < len; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+
+	return h;
+}
+
+#define HASH_FIELD(h, v) ((h) = fnv1a((h), &(v), sizeof(v)))
+
+/* Everything the pipeline's output depends on. Anything added to the
+   pipeline must be added here, or a stale cache will hide the change. */
+static uint64_t
+wp_cache_key(const barny_config_t *config, const barny_wallpaper_geom_t *geom,
+             const struct stat *st)
+{
+	uint64_t h       = 0xcbf29ce484222325ULL;
+	uint32_t version = WP_CACHE_VERSION;
+
+	HASH_FIELD(h, version);
+	h = fnv1a(h, config->wallpaper_path, strlen(config->wallpaper_path));
+	HASH_FIELD(h, st->st_dev);
+	HASH_FIELD(h, st->st_ino);
+	HASH_FIELD(h, st->st_size);
+	HASH_FIELD(h, st->st_mtim.tv_sec);
+	HASH_FIELD(h, st->st_mtim.tv_nsec);
+
+	HASH_FIELD(h, config->blur_radius);
+	HASH_FIELD(h, config->blur_mode);
+	HASH_FIELD(h, config->blur_quality);
+	HASH_FIELD(h, config->brightness);
+	HASH_FIELD(h, config->refraction_mode);
+	HASH_FIELD(h, config->displacement_scale);
+	HASH_FIELD(h, config->chromatic_aberration);
+	HASH_FIELD(h, config->edge_refraction);
+	HASH_FIELD(h, config->noise_scale);
+	HASH_FIELD(h, config->noise_octaves);
+	HASH_FIELD(h, config->border_radius);
+
+	HASH_FIELD(h, geom->min_width);
+	HASH_FIELD(h, geom->max_aspect);
+	HASH_FIELD(h, geom->margin);
+	HASH_FIELD(h, geom->from_bottom);
+
+	return h;
+}
+
+static bool
+wp_cache_dir(char *buf, size_t len)
+{
+	const char *xdg  = getenv("XDG_CACHE_HOME");
+	const char *home = getenv("HOME");
+	int         n;
+
+	if (xdg && *xdg)
+		n = snprintf(buf, len, "%s/barny", xdg);
+	else if (home && *home)
+		n = snprintf(buf, len, "%s/.cache/barny", home);
+	else
+		return false;
+
+	return n > 0 && (size_t)n < len;
+}
+
+static bool
+wp_cache_path(char *buf, size_t len, uint64_t key)
+{
+	char dir[PATH_MAX];
+	int  n;
+
+	if (!wp_cache_dir(dir, sizeof(dir)))
+		return false;
+
+	n = snprintf(buf, len, "%s/wallpaper-%016llx.bin", dir,
+	             (unsigned long long)key);
+
+	return n > 0 && (size_t)n < len;
+}
+
+static void
+wp_cache_unref(void *data)
+{
+	wp_cache_map_t *map = data;
+
+	if (--map->refs > 0)
+		return;
+
+	munmap(map->addr, map->len);
+	free(map);
+}
+
+static cairo_surface_t *
+wp_cache_surface(wp_cache_map_t *map, const wp_cache_header_t *hdr, int idx)
+{
+	uint8_t         *pixels;
+	cairo_surface_t *s;
+
+	pixels = (uint8_t *)map->addr + WP_CACHE_DATA
+	         + (size_t)idx * hdr->height * hdr->stride;
+	s      = cairo_image_surface_create_for_data(pixels, CAIRO_FORMAT_ARGB32,
+	                                             (int)hdr->width,
+	                                             (int)hdr->height,
+	                                             (int)hdr->stride);
+	if (cairo_surface_status(s) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(s);
+		return NULL;
+	}
+
+	map->refs++;
+	if (cairo_surface_set_user_data(s, &wp_cache_map_key, map,
+	                                wp_cache_unref)
+	    != CAIRO_STATUS_SUCCESS) {
+		map->refs--;
+		cairo_surface_destroy(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/* Maps a cache file into the blurred (and, if stored, displaced) wallpaper.
+   The mapping is private, so anything that later draws into the surfaces
+   gets its own copy of the page rather than rewriting the cache. */
+static bool
+wp_cache_load(barny_state_t *state, uint64_t key)
+{
+	char              path[PATH_MAX];
+	wp_cache_header_t hdr;
+	wp_cache_map_t   *map;
+	struct stat       st;
+	size_t            want;
+	void             *addr;
+	int               fd;
+
+	if (!wp_cache_path(path, sizeof(path), key))
+		return false;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return false;
+
+	if (fstat(fd, &st) < 0
+	    || pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+		close(fd);
+		return false;
+	}
+
+	want = WP_CACHE_DATA + (size_t)hdr.count * hdr.height * hdr.stride;
+	if (memcmp(hdr.magic, WP_CACHE_MAGIC, sizeof(WP_CACHE_MAGIC)) != 0
+	    || hdr.version != WP_CACHE_VERSION || hdr.key != key
+	    || hdr.count < 1 || hdr.count > 2 || hdr.width == 0
+	    || hdr.height == 0
+	    || (int)hdr.stride
+	               != cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32,
+	                                                (int)hdr.width)
+	    || (size_t)st.st_size != want) {
+		/* truncated or from another build: never trust it again */
+		fprintf(stderr, "barny: discarding bad wallpaper cache %s\n", path);
+		close(fd);
+		unlink(path);
+		return false;
+	}
+
+	addr = mmap(NULL, want, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED)
+		return false;
+
+	map = calloc(1, sizeof(*map));
+	if (!map) {
+		munmap(addr, want);
+		return false;
+	}
+	map->addr = addr;
+	map->len  = want;
+	/* held until both surfaces exist, so a failure on the second cannot
+	   unmap the first out from under it */
+	map->refs = 1;
+
+	state->blurred_wallpaper = wp_cache_surface(map, &hdr, 0);
+	if (hdr.count == 2 && state->blurred_wallpaper)
+		state->displaced_wallpaper = wp_cache_surface(map, &hdr, 1);
+
+	if (!state->blurred_wallpaper
+	    || (hdr.count == 2 && !state->displaced_wallpaper)) {
+		if (state->blurred_wallpaper)
+			cairo_surface_destroy(state->blurred_wallpaper);
+		state->blurred_wallpaper = NULL;
+		if (state->displaced_wallpaper)
+			cairo_surface_destroy(state->displaced_wallpaper);
+		state->displaced_wallpaper = NULL;
+	}
+	wp_cache_unref(map);
+
+	return state->blurred_wallpaper != NULL;
+}
+
+static bool
+wp_write_all(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t        n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p   += n;
+		len -= (size_t)n;
+	}
+
+	return true;
+}
+
+/* every other cache file is for a wallpaper or config we no longer use */
+static void
+wp_cache_prune(const char *dir, const char *keep)
+{
+	DIR           *d;
+	struct dirent *e;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((e = readdir(d))) {
+		if (strncmp(e->d_name, "wallpaper-", 10) != 0
+		    || strcmp(e->d_name, keep) == 0)
+			continue;
+		unlinkat(dirfd(d), e->d_name, 0);
+	}
+
+	closedir(d);
+}
+
+/* Written to a temporary name and renamed into place, so a crash or a
+   second instance never leaves a half-written file under the real name. */
+static void
+wp_cache_store(barny_state_t *state, uint64_t key)
+{
+	char              dir[PATH_MAX];
+	char              path[PATH_MAX];
+	char              tmp[PATH_MAX];
+	char              name[64];
+	wp_cache_header_t hdr;
+	cairo_surface_t  *surfs[2];
+	uint8_t           pad[WP_CACHE_DATA - sizeof(hdr)];
+	int               fd;
+	int               i;
+	int               y;
+	bool              ok;
+
+	if (!wp_cache_dir(dir, sizeof(dir))
+	    || !wp_cache_path(path, sizeof(path), key))
+		return;
+
+	/* the parent of dir is usually ~/.cache and exists; one level of
+	   mkdir covers the rest */
+	if (mkdir(dir, 0700) < 0 && errno != EEXIST)
+		return;
+
+	surfs[0] = state->blurred_wallpaper;
+	surfs[1] = state->displaced_wallpaper;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, WP_CACHE_MAGIC, sizeof(WP_CACHE_MAGIC));
+	hdr.version = WP_CACHE_VERSION;
+	hdr.count   = surfs[1] ? 2 : 1;
+	hdr.key     = key;
+	hdr.width   = (uint32_t)cairo_image_surface_get_width(surfs[0]);
+	hdr.height  = (uint32_t)cairo_image_surface_get_height(surfs[0]);
+	hdr.stride  = (uint32_t)cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32,
+	                                                      (int)hdr.width);
+	if (surfs[1]
+	    && (cairo_image_surface_get_width(surfs[1]) != (int)hdr.width
+	        || cairo_image_surface_get_height(surfs[1]) != (int)hdr.height))
+		return;
+
+	snprintf(tmp, sizeof(tmp), "%s/.wallpaper-XXXXXX", dir);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	memset(pad, 0, sizeof(pad));
+	ok = wp_write_all(fd, &hdr, sizeof(hdr))
+	     && wp_write_all(fd, pad, sizeof(pad));
+
+	for (i = 0; ok && i < (int)hdr.count; i++) {
+		const uint8_t *data;
+		int            stride;
+
+		cairo_surface_flush(surfs[i]);
+		data   = cairo_image_surface_get_data(surfs[i]);
+		stride = cairo_image_surface_get_stride(surfs[i]);
+		for (y = 0; ok && y < (int)hdr.height; y++)
+			ok = wp_write_all(fd, data + (size_t)y * stride, hdr.stride);
+	}
+
+	if (close(fd) < 0)
+		ok = false;
+	if (!ok || rename(tmp, path) < 0) {
+		unlink(tmp);
+		return;
+	}
+
+	snprintf(name, sizeof(name), "wallpaper-%016llx.bin",
+	         (unsigned long long)key);
+	wp_cache_prune(dir, name);
+}
+
+void
+barny_wallpaper_prepare(barny_state_t *state)
+{
+	barny_config_t        *config = &state->config;
+	barny_wallpaper_geom_t geom;
+	barny_output_t        *out;
+	cairo_surface_t       *wallpaper;
+	struct stat            st;
+	uint64_t               key     = 0;
+	uint64_t               t_start = barny_now_us();
+	uint64_t               t_blur;
+	double                 aspect;
+	double                 displacement;
+	int                    blur_radius;
+	int                    w;
+	int                    h;
+
+	if (!config->wallpaper_path)
+		return;
+
+	/* the bars only ever sample the wallpaper scaled to an output's width,
+	   so let the loader decode no more than that */
+	memset(&geom, 0, sizeof(geom));
+	geom.margin      = (int)config->blur_radius * 2
+	                   + (int)config->displacement_scale * 2 + 64;
+	geom.from_bottom = !config->position_top;
+	for (out = state->outputs; out; out = out->next) {
+		if (out->width > 0 && out->mode_height > 0) {
+			aspect = (double)out->mode_height / out->width;
+			if (out->width > geom.min_width)
+				geom.min_width = out->width;
+			if (aspect > geom.max_aspect)
+				geom.max_aspect = aspect;
+		}
+	}
+
+	if (config->wallpaper_cache && stat(config->wallpaper_path, &st) == 0) {
+		key = wp_cache_key(config, &geom, &st);
+		if (wp_cache_load(state, key)) {
+			printf("barny: wallpaper ready in %.1f ms (cached %dx%d)\n",
+			       (double)(barny_now_us() - t_start) / 1000.0,
+			       cairo_image_surface_get_width(state->blurred_wallpaper),
+			       cairo_image_surface_get_height(
+			               state->blurred_wallpaper));
+			return;
+		}
+	}
+
+	wallpaper = barny_load_wallpaper(config->wallpaper_path, &geom);
+	if (!wallpaper)
+		return;
+
+	w            = cairo_image_surface_get_width(wallpaper);
+	h            = cairo_image_surface_get_height(wallpaper);
+	/* blur and displacement are configured in wallpaper pixels; keep their
+	   look when the loader decoded at a reduced size */
+	blur_radius  = (int)lround(config->blur_radius * geom.scale);
+	displacement = config->displacement_scale * geom.scale;
+
+	/* blurred in place: nothing reads the sharp wallpaper after this, so
+	   there is no reason to keep a second copy */
+	state->blurred_wallpaper = wallpaper;
+	t_blur                   = barny_now_us();
+	if (config->blur_mode == BARNY_BLUR_PYRAMID) {
+		barny_blur_surface_pyramid(state->blurred_wallpaper, blur_radius,
+		                           config->blur_quality);
+	} else {
+		barny_blur_surface(state->blurred_wallpaper, blur_radius);
+	}
+	t_blur = barny_now_us() - t_blur;
+	barny_apply_vibrancy(state->blurred_wallpaper, 1.35, config->brightness);
+
+	if (config->refraction_mode != BARNY_REFRACT_NONE) {
+		printf("barny: creating liquid glass displacement map...\n");
+		state->displacement_map = barny_create_displacement_map(
+		        w, h, config->refraction_mode, config->border_radius,
+		        config->edge_refraction, config->noise_scale,
+		        config->noise_octaves);
+
+		if (state->displacement_map) {
+			state->displaced_wallpaper = cairo_image_surface_create(
+			        CAIRO_FORMAT_ARGB32, w, h);
+			barny_apply_displacement(state->blurred_wallpaper,
+			                         state->displaced_wallpaper,
+			                         state->displacement_map, displacement,
+			                         config->chromatic_aberration);
+			printf("barny: liquid glass effect applied (mode=%s, scale=%.1f, chromatic=%.1f)\n",
+			       config->refraction_mode == BARNY_REFRACT_LENS ? "lens"
+			                                                     : "liquid",
+			       config->displacement_scale,
+			       config->chromatic_aberration);
+		}
+	}
+
+	if (key)
+		wp_cache_store(state, key);
+
+	printf("barny: wallpaper ready in %.1f ms (blur %s r=%d: %.1f ms)\n",
+	       (double)(barny_now_us() - t_start) / 1000.0,
+	       config->blur_mode == BARNY_BLUR_PYRAMID ? "pyramid" : "full",
+	       blur_radius, (double)t_blur / 1000.0);
+}
@@ -1,6 +1,7 @@
 #include "util.h"
 
 #include <ctype.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -142,6 +143,26 @@ barny_now_us(void)
 	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
 }
 
+void
+barny_debug(const char *fmt, ...)
+{
+	static int enabled = -1;
+	va_list    ap;
+
+	if (enabled < 0) {
+		const char *env = getenv("BARNY_DEBUG");
+
+		enabled = env && *env && strcmp(env, "0") != 0;
+	}
+	if (!enabled)
+		return;
+
+	va_start(ap, fmt);
+	fputs("barny: ", stdout);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
 void
 barny_format_bytes(char *buf, size_t buflen, unsigned long long bytes,
                    int decimals, bool unit_space)
@@ -0,0 +1,216 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "barny.h"
+
+/* A set of shm buffers carved out of an output's arena, used round-robin by
+   a surface. A buffer is busy from the commit that attaches it until the
+   compositor's release; only idle ones are drawn into. Each buffer also
+   remembers the damage of the frames it missed, so a frame that repaints
+   only a strip can first bring the rest of the buffer up to date from the
+   previous one instead of redrawing it. */
+
+static void
+buffer_release(void *data, struct wl_buffer *wl_buffer)
+{
+	barny_buffer_t *buf = data;
+	(void)wl_buffer;
+
+	buf->busy = false;
+	if (buf->release)
+		buf->release(buf->release_data);
+}
+
+static const struct wl_buffer_listener buffer_listener = {
+	.release = buffer_release,
+};
+
+/* The compositor let go of a buffer whose owner was already gone: only now
+   can its block be trimmed and handed out again. */
+static void
+retired_release(void *data)
+{
+	barny_buffer_t *ghost = data;
+
+	wl_buffer_destroy(ghost->wl_buffer);
+	barny_shm_arena_free(ghost->arena, ghost->offset, true);
+	barny_shm_arena_unref(ghost->arena);
+	free(ghost);
+}
+
+/* A buffer still attached keeps its wl_buffer, its block and its pages past
+   its owner. The release comes once the compositor has moved on, which for
+   a popup or menu closing means once its surface is destroyed. */
+static bool
+buffer_retire(barny_buffer_t *buf)
+{
+	barny_buffer_t *ghost;
+
+	if (!buf->wl_buffer || !(ghost = calloc(1, sizeof(*ghost))))
+		return false;
+
+	ghost->wl_buffer    = buf->wl_buffer;
+	ghost->arena        = buf->arena;
+	ghost->offset       = buf->offset;
+	ghost->busy         = true;
+	ghost->release      = retired_release;
+	ghost->release_data = ghost;
+	wl_buffer_set_user_data(ghost->wl_buffer, ghost);
+	return true;
+}
+
+int
+barny_buffers_create(barny_buffer_t *bufs, int count, barny_shm_arena_t *arena,
+                     int width, int height, int scale)
+{
+	int    stride = width * 4;
+	size_t size   = (size_t)stride * height;
+	int    i;
+
+	memset(bufs, 0, sizeof(*bufs) * (size_t)count);
+	if (!arena)
+		return -1;
+
+	for (i = 0; i < count; i++) {
+		barny_buffer_t *buf = &bufs[i];
+
+		buf->data = barny_shm_arena_alloc(arena, size, &buf->offset);
+		if (!buf->data) {
+			barny_buffers_destroy(bufs, count);
+			return -1;
+		}
+		buf->arena   = barny_shm_arena_ref(arena);
+		buf->width   = width;
+		buf->height  = height;
+		buf->stride  = stride;
+		buf->stale_w = width;
+		buf->stale_h = height;
+
+		buf->wl_buffer = barny_shm_arena_buffer(arena, buf->offset, width,
+		                                        height, stride);
+		if (buf->wl_buffer)
+			wl_buffer_add_listener(buf->wl_buffer, &buffer_listener,
+			                       buf);
+
+		buf->cairo_surface = cairo_image_surface_create_for_data(
+		        buf->data, CAIRO_FORMAT_ARGB32, width, height, stride);
+		buf->cr = cairo_create(buf->cairo_surface);
+		if (scale > 1)
+			cairo_scale(buf->cr, scale, scale);
+	}
+
+	return 0;
+}
+
+void
+barny_buffers_destroy(barny_buffer_t *bufs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (bufs[i].cr)
+			cairo_destroy(bufs[i].cr);
+		if (bufs[i].cairo_surface)
+			cairo_surface_destroy(bufs[i].cairo_surface);
+		/* a retired buffer's ghost takes the wl_buffer and arena ref */
+		if (!bufs[i].busy || !buffer_retire(&bufs[i])) {
+			if (bufs[i].wl_buffer)
+				wl_buffer_destroy(bufs[i].wl_buffer);
+			if (bufs[i].arena) {
+				barny_shm_arena_free(bufs[i].arena,
+				                     bufs[i].offset,
+				                     !bufs[i].busy);
+				barny_shm_arena_unref(bufs[i].arena);
+			}
+		}
+		memset(&bufs[i], 0, sizeof(bufs[i]));
+	}
+}
+
+/* Lowest idle slot first: the pages of a slot that is never drawn into are
+   never faulted in, so the spare buffer costs nothing until the compositor
+   actually holds on to two frames at once. */
+barny_buffer_t *
+barny_buffers_acquire(barny_buffer_t *bufs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (bufs[i].data && !bufs[i].busy)
+			return &bufs[i];
+	}
+
+	return NULL;
+}
+
+/* buf was just attached with damage (x, y, w, h); every other buffer is now
+   missing that rect on top of whatever it was missing before */
+void
+barny_buffers_commit(barny_buffer_t *bufs, int count, barny_buffer_t *buf,
+                     int x, int y, int w, int h)
+{
+	barny_buffer_t *b;
+	int             x1;
+	int             y1;
+	int             i;
+
+	buf->busy    = true;
+	buf->stale_x = 0;
+	buf->stale_y = 0;
+	buf->stale_w = 0;
+	buf->stale_h = 0;
+
+	if (w <= 0 || h <= 0)
+		return;
+
+	for (i = 0; i < count; i++) {
+		b = &bufs[i];
+		if (b == buf || !b->data)
+			continue;
+
+		if (b->stale_w <= 0 || b->stale_h <= 0) {
+			b->stale_x = x;
+			b->stale_y = y;
+			b->stale_w = w;
+			b->stale_h = h;
+			continue;
+		}
+
+		x1 = b->stale_x + b->stale_w > x + w ? b->stale_x + b->stale_w
+		                                     : x + w;
+		y1 = b->stale_y + b->stale_h > y + h ? b->stale_y + b->stale_h
+		                                     : y + h;
+		if (x < b->stale_x)
+			b->stale_x = x;
+		if (y < b->stale_y)
+			b->stale_y = y;
+		b->stale_w = x1 - b->stale_x;
+		b->stale_h = y1 - b->stale_y;
+	}
+}
+
+void
+barny_buffer_copy_forward(barny_buffer_t *dst, const barny_buffer_t *src)
+{
+	size_t off;
+	size_t len;
+	int    y;
+
+	if (!src || src == dst || dst->stale_w <= 0 || dst->stale_h <= 0)
+		return;
+
+	cairo_surface_flush(dst->cairo_surface);
+
+	off = (size_t)dst->stale_x * 4;
+	len = (size_t)dst->stale_w * 4;
+	for (y = dst->stale_y; y < dst->stale_y + dst->stale_h; y++) {
+		memcpy(dst->data + (size_t)y * dst->stride + off,
+		       src->data + (size_t)y * src->stride + off, len);
+	}
+
+	cairo_surface_mark_dirty_rectangle(dst->cairo_surface, dst->stale_x,
+	                                   dst->stale_y, dst->stale_w,
+	                                   dst->stale_h);
+	dst->stale_w = 0;
+	dst->stale_h = 0;
+}
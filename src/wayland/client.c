@@ -286,10 +286,10 @@ pointer_axis(void *data, struct wl_pointer *pointer, uint32_t time, uint32_t axi
 	state->touchpad_scroll_accum += px;
 
 	if (state->touchpad_scroll_accum > 30.0) {
-		barny_sway_ipc_send(state, 0, "workspace next");
+		barny_sway_ipc_command(state, "workspace next");
 		state->touchpad_scroll_accum = 0.0;
 	} else if (state->touchpad_scroll_accum < -30.0) {
-		barny_sway_ipc_send(state, 0, "workspace prev");
+		barny_sway_ipc_command(state, "workspace prev");
 		state->touchpad_scroll_accum = 0.0;
 	}
 }
@@ -334,9 +334,9 @@ pointer_axis_discrete(void *data, struct wl_pointer *pointer, uint32_t axis,
 	}
 
 	if (discrete < 0) {
-		barny_sway_ipc_send(state, 0, "workspace prev");
+		barny_sway_ipc_command(state, "workspace prev");
 	} else if (discrete > 0) {
-		barny_sway_ipc_send(state, 0, "workspace next");
+		barny_sway_ipc_command(state, "workspace next");
 	}
 }
 
@@ -1,10 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
-#include <sys/mman.h>
-#include <fcntl.h>
-#include <errno.h>
 
 #include "barny.h"
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
@@ -37,7 +33,7 @@ layer_surface_configure(void *data, struct zwlr_layer_surface_v1 *surface,
 
 	zwlr_layer_surface_v1_ack_configure(surface, serial);
 
-	if ((resized || !output->buffer)
+	if ((resized || !output->buffers[0].data)
 	    && barny_output_create_buffer(output) < 0) {
 		fprintf(stderr, "barny: failed to create buffer\n");
 		return;
@@ -77,6 +73,9 @@ frame_done(void *data, struct wl_callback *callback, uint32_t callback_time)
 	wl_callback_destroy(callback);
 	output->frame_pending = false;
 
+	if (output->state->repaint_scheduled)
+		barny_deferred_flush(output->state);
+
 	if (output->redraw_queued) {
 		barny_render_frame(output);
 		return;
@@ -91,24 +90,6 @@ static const struct wl_callback_listener frame_listener = {
 	.done = frame_done,
 };
 
-static int
-create_shm_file(size_t size)
-{
-	char name[] = "/barny-XXXXXX";
-	int  fd     = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-	if (fd < 0) {
-		return -1;
-	}
-	shm_unlink(name);
-
-	if (ftruncate(fd, size) < 0) {
-		close(fd);
-		return -1;
-	}
-
-	return fd;
-}
-
 int
 barny_output_create_surface(barny_output_t *output)
 {
@@ -213,22 +194,10 @@ barny_output_destroy_surface(barny_output_t *output)
 	}
 	barny_output_free_lens_cache(output);
 	output->lens_dmg_valid = false;
-	if (output->cr) {
-		cairo_destroy(output->cr);
-		output->cr = NULL;
-	}
-	if (output->cairo_surface) {
-		cairo_surface_destroy(output->cairo_surface);
-		output->cairo_surface = NULL;
-	}
-	if (output->buffer) {
-		wl_buffer_destroy(output->buffer);
-		output->buffer = NULL;
-	}
-	if (output->shm_data) {
-		munmap(output->shm_data, output->shm_size);
-		output->shm_data = NULL;
-	}
+	barny_buffers_destroy(output->buffers, BARNY_OUTPUT_BUFFERS);
+	output->front = NULL;
+	barny_shm_arena_unref(output->arena);
+	output->arena = NULL;
 	if (output->layer_surface) {
 		zwlr_layer_surface_v1_destroy(output->layer_surface);
 		output->layer_surface = NULL;
@@ -242,29 +211,25 @@ barny_output_destroy_surface(barny_output_t *output)
 	output->redraw_queued = false;
 }
 
+/* A buffer the compositor let go of while a frame was waiting for one. */
+static void
+output_buffer_released(void *data)
+{
+	barny_output_t *output = data;
+
+	if (output->redraw_queued && !output->frame_pending)
+		barny_render_frame(output);
+}
+
 int
 barny_output_create_buffer(barny_output_t *output)
 {
-	barny_state_t      *state  = output->state;
-	int                 width  = output->surf_width * output->scale;
-	int                 height = output->surf_height * output->scale;
-	int                 stride = width * 4;
-	int                 size   = stride * height;
-	int                 fd;
-	struct wl_shm_pool *pool;
-
-	if (output->cr) {
-		cairo_destroy(output->cr);
-	}
-	if (output->cairo_surface) {
-		cairo_surface_destroy(output->cairo_surface);
-	}
-	if (output->buffer) {
-		wl_buffer_destroy(output->buffer);
-	}
-	if (output->shm_data) {
-		munmap(output->shm_data, output->shm_size);
-	}
+	int width  = output->surf_width * output->scale;
+	int height = output->surf_height * output->scale;
+	int i;
+
+	barny_buffers_destroy(output->buffers, BARNY_OUTPUT_BUFFERS);
+	output->front = NULL;
 
 	if (output->bg_cache) {
 		cairo_surface_destroy(output->bg_cache);
@@ -285,34 +250,20 @@ barny_output_create_buffer(barny_output_t *output)
 	barny_output_free_lens_cache(output);
 	output->lens_dmg_valid = false;
 
-	fd = create_shm_file(size);
-	if (fd < 0) {
-		fprintf(stderr, "barny: failed to create shm file\n");
+	if (barny_buffers_create(output->buffers, BARNY_OUTPUT_BUFFERS,
+	                         barny_output_arena(output), width, height,
+	                         output->scale) < 0) {
+		fprintf(stderr, "barny: failed to allocate bar buffers\n");
 		return -1;
 	}
 
-	output->shm_data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (output->shm_data == MAP_FAILED) {
-		fprintf(stderr, "barny: mmap failed\n");
-		close(fd);
-		return -1;
+	for (i = 0; i < BARNY_OUTPUT_BUFFERS; i++) {
+		output->buffers[i].release      = output_buffer_released;
+		output->buffers[i].release_data = output;
 	}
-	output->shm_size = size;
 
-	pool             = wl_shm_create_pool(state->shm, fd, size);
-	output->buffer   = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
-	                                             WL_SHM_FORMAT_ARGB8888);
-	wl_shm_pool_destroy(pool);
-	close(fd);
-
-	output->cairo_surface = cairo_image_surface_create_for_data(
-	        output->shm_data, CAIRO_FORMAT_ARGB32, width, height, stride);
-	output->cr = cairo_create(output->cairo_surface);
-
-	if (output->scale > 1) {
-		cairo_scale(output->cr, output->scale, output->scale);
+	if (output->scale > 1)
 		wl_surface_set_buffer_scale(output->surface, output->scale);
-	}
 
 	return 0;
 }
@@ -0,0 +1,52 @@
+#include "barny.h"
+
+/* A workspace switch is a burst of sway events, an animated tray icon a
+   stream of NewIcon signals. Drawing or refetching for each of them is
+   work the compositor throws away: only the state at its next frame is
+   ever shown. So a change only notes what it needs, and the work waits
+   for the frame callback; however many arrive before it, they cost one
+   refresh and one frame. */
+
+void
+barny_defer(barny_state_t *state, uint32_t what)
+{
+	barny_output_t *out;
+	bool            waiting;
+
+	state->deferred |= what;
+	if (state->repaint_scheduled) {
+		state->coalesced_events++;
+		return;
+	}
+
+	/* frame callbacks only come after a commit; an empty one asks for
+	   the next frame without changing what is on screen */
+	waiting = false;
+	for (out = state->outputs; out; out = out->next) {
+		if (!out->configured)
+			continue;
+		out->redraw_queued = true;
+		waiting            = true;
+		if (!out->frame_pending) {
+			barny_output_request_frame(out);
+			wl_surface_commit(out->surface);
+		}
+	}
+
+	/* nothing on screen to wait for */
+	state->repaint_scheduled = waiting;
+	if (!waiting)
+		barny_deferred_flush(state);
+}
+
+void
+barny_deferred_flush(barny_state_t *state)
+{
+	uint32_t what = state->deferred;
+
+	state->deferred          = 0;
+	state->repaint_scheduled = false;
+
+	if (what & BARNY_DEFER_TRAY)
+		barny_sni_host_flush(state);
+}
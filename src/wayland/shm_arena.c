@@ -0,0 +1,271 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "barny.h"
+#include "util.h"
+
+/* One memfd per output, shared by the bar's buffers and every popup and menu
+   opened on it. The whole reservation is mapped once up front and the file
+   only grows underneath it, so a grow never moves memory that cairo surfaces
+   already point at; only the part below the file size is ever touched. */
+#define ARENA_RESERVE  ((size_t)1 << 30)
+#define ARENA_ALIGN    ((size_t)4096)
+#define ARENA_MIN_GROW ((size_t)1 << 20)
+
+typedef struct {
+	size_t offset;
+	size_t size;
+} arena_block_t;
+
+struct barny_shm_arena {
+	int                 refs;
+	int                 fd;
+	struct wl_shm      *shm;
+	struct wl_shm_pool *pool;
+	uint8_t            *data;
+	size_t              size;
+	size_t              used;
+	size_t              peak;
+
+	/* off once the filesystem has said it cannot punch holes */
+	bool                trim;
+
+	/* live allocations, sorted by offset */
+	arena_block_t      *blocks;
+	int                 nblocks;
+	int                 cap;
+
+	char                name[32];
+};
+
+barny_shm_arena_t *
+barny_shm_arena_create(struct wl_shm *shm, const char *name)
+{
+	barny_shm_arena_t *a;
+	char               label[48];
+
+	a = calloc(1, sizeof(*a));
+	if (!a)
+		return NULL;
+
+	snprintf(a->name, sizeof(a->name), "%s", name ? name : "?");
+	snprintf(label, sizeof(label), "barny-%s", a->name);
+
+	a->fd = memfd_create(label, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (a->fd < 0) {
+		fprintf(stderr, "barny: memfd_create failed: %s\n",
+		        strerror(errno));
+		free(a);
+		return NULL;
+	}
+
+	/* The compositor maps this too; a shrink under it would SIGBUS it. */
+	fcntl(a->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+
+	a->data = mmap(NULL, ARENA_RESERVE, PROT_READ | PROT_WRITE,
+	               MAP_SHARED | MAP_NORESERVE, a->fd, 0);
+	if (a->data == MAP_FAILED) {
+		fprintf(stderr, "barny: shm arena mmap failed: %s\n",
+		        strerror(errno));
+		close(a->fd);
+		free(a);
+		return NULL;
+	}
+
+	a->shm  = shm;
+	a->refs = 1;
+	a->trim = true;
+
+	return a;
+}
+
+barny_shm_arena_t *
+barny_shm_arena_ref(barny_shm_arena_t *a)
+{
+	if (a)
+		a->refs++;
+	return a;
+}
+
+void
+barny_shm_arena_unref(barny_shm_arena_t *a)
+{
+	if (!a || --a->refs > 0)
+		return;
+
+	barny_debug("shm arena %s: released, peak %zu KiB of %zu KiB\n",
+	            a->name, a->peak / 1024, a->size / 1024);
+
+	if (a->pool)
+		wl_shm_pool_destroy(a->pool);
+	munmap(a->data, ARENA_RESERVE);
+	close(a->fd);
+	free(a->blocks);
+	free(a);
+}
+
+static int
+arena_grow(barny_shm_arena_t *a, size_t need)
+{
+	size_t size = a->size + (a->size / 2 > ARENA_MIN_GROW ? a->size / 2
+	                                                       : ARENA_MIN_GROW);
+
+	if (size < need)
+		size = need;
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (size > ARENA_RESERVE || size > INT32_MAX) {
+		fprintf(stderr, "barny: shm arena %s: %zu KiB exceeds the "
+		                "reservation\n",
+		        a->name, size / 1024);
+		return -1;
+	}
+
+	if (ftruncate(a->fd, (off_t)size) < 0) {
+		fprintf(stderr, "barny: shm arena %s: ftruncate failed: %s\n",
+		        a->name, strerror(errno));
+		return -1;
+	}
+
+	if (a->pool)
+		wl_shm_pool_resize(a->pool, (int32_t)size);
+	else if (a->shm)
+		a->pool = wl_shm_create_pool(a->shm, a->fd, (int32_t)size);
+
+	barny_debug("shm arena %s: grown %zu -> %zu KiB\n", a->name,
+	            a->size / 1024, size / 1024);
+	a->size = size;
+
+	return 0;
+}
+
+uint8_t *
+barny_shm_arena_alloc(barny_shm_arena_t *a, size_t size, size_t *offset)
+{
+	arena_block_t *blocks;
+	size_t         at = 0;
+	int            i;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (size == 0)
+		return NULL;
+
+	/* first fit: popups and menus come and go, the bar's buffers stay, so
+	   the holes a closed menu leaves are reused by the next one */
+	for (i = 0; i < a->nblocks; i++) {
+		if (a->blocks[i].offset - at >= size)
+			break;
+		at = a->blocks[i].offset + a->blocks[i].size;
+	}
+
+	if (at + size > a->size && arena_grow(a, at + size) < 0)
+		return NULL;
+
+	if (a->nblocks == a->cap) {
+		int cap = a->cap ? a->cap * 2 : 8;
+
+		blocks = realloc(a->blocks, sizeof(*blocks) * (size_t)cap);
+		if (!blocks)
+			return NULL;
+		a->blocks = blocks;
+		a->cap    = cap;
+	}
+	memmove(&a->blocks[i + 1], &a->blocks[i],
+	        sizeof(*a->blocks) * (size_t)(a->nblocks - i));
+	a->blocks[i].offset = at;
+	a->blocks[i].size   = size;
+	a->nblocks++;
+
+	a->used += size;
+	if (a->used > a->peak)
+		a->peak = a->used;
+
+	barny_debug("shm arena %s: +%zu KiB at %zu KiB, %zu/%zu KiB in use\n",
+	            a->name, size / 1024, at / 1024, a->used / 1024,
+	            a->size / 1024);
+
+	*offset = at;
+	return a->data + at;
+}
+
+void
+barny_shm_arena_free(barny_shm_arena_t *a, size_t offset, bool released)
+{
+	int i;
+
+	for (i = 0; i < a->nblocks; i++) {
+		if (a->blocks[i].offset == offset)
+			break;
+	}
+	if (i == a->nblocks)
+		return;
+
+	/* The compositor may still be showing these pages: a hole would be
+	   scanned out as zeroes, and so would the next allocation's drawing.
+	   The block stays taken, untouched, until it is freed once released. */
+	if (!released) {
+		barny_debug("shm arena %s: %zu KiB at %zu KiB held until "
+		            "released\n",
+		            a->name, a->blocks[i].size / 1024, offset / 1024);
+		return;
+	}
+
+	/* hand the pages back; a closed full-output menu is tens of MiB that
+	   would otherwise stay resident until the next one reuses them */
+	if (a->trim
+	    && fallocate(a->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	                 (off_t)offset, (off_t)a->blocks[i].size)
+	               < 0) {
+		if (errno == EOPNOTSUPP || errno == ENOSYS) {
+			barny_debug("shm arena %s: no hole punching, pages "
+			            "stay resident until reused\n",
+			            a->name);
+			a->trim = false;
+		} else {
+			fprintf(stderr, "barny: shm arena %s: trim failed: %s\n",
+			        a->name, strerror(errno));
+		}
+	}
+
+	a->used -= a->blocks[i].size;
+	barny_debug("shm arena %s: -%zu KiB at %zu KiB, %zu/%zu KiB in use\n",
+	            a->name, a->blocks[i].size / 1024, offset / 1024,
+	            a->used / 1024, a->size / 1024);
+
+	memmove(&a->blocks[i], &a->blocks[i + 1],
+	        sizeof(*a->blocks) * (size_t)(a->nblocks - i - 1));
+	a->nblocks--;
+}
+
+struct wl_buffer *
+barny_shm_arena_buffer(barny_shm_arena_t *a, size_t offset, int width,
+                       int height, int stride)
+{
+	if (!a->pool)
+		return NULL;
+
+	return wl_shm_pool_create_buffer(a->pool, (int32_t)offset, width, height,
+	                                 stride, WL_SHM_FORMAT_ARGB8888);
+}
+
+void
+barny_shm_arena_stats(const barny_shm_arena_t *a, size_t *size, size_t *used)
+{
+	*size = a->size;
+	*used = a->used;
+}
+
+barny_shm_arena_t *
+barny_output_arena(barny_output_t *output)
+{
+	if (!output->arena)
+		output->arena = barny_shm_arena_create(
+		        output->state->shm, output->name ? output->name : "output");
+
+	return output->arena;
+}
@@ -0,0 +1,278 @@
+#include "test_framework.h"
+#include "barny.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TB_W 64
+#define TB_H 8
+
+/* The pool's bookkeeping without a compositor: plain memory stands in for
+   the shm mapping and a cleared busy flag for wl_buffer.release. */
+static void
+fake_buffers(barny_buffer_t *bufs, int count, uint8_t *mem)
+{
+	int i;
+
+	memset(bufs, 0, sizeof(*bufs) * count);
+	for (i = 0; i < count; i++) {
+		bufs[i].data          = mem + (size_t)TB_W * 4 * TB_H * i;
+		bufs[i].width         = TB_W;
+		bufs[i].height        = TB_H;
+		bufs[i].stride        = TB_W * 4;
+		bufs[i].stale_w       = TB_W;
+		bufs[i].stale_h       = TB_H;
+		bufs[i].cairo_surface = cairo_image_surface_create_for_data(
+		        bufs[i].data, CAIRO_FORMAT_ARGB32, TB_W, TB_H, TB_W * 4);
+	}
+}
+
+static void
+free_buffers(barny_buffer_t *bufs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		cairo_surface_destroy(bufs[i].cairo_surface);
+}
+
+static void
+fill_rect(barny_buffer_t *buf, int x, int y, int w, int h, uint8_t v)
+{
+	int row;
+
+	for (row = y; row < y + h; row++)
+		memset(buf->data + (size_t)row * buf->stride + (size_t)x * 4, v,
+		       (size_t)w * 4);
+}
+
+void
+test_buffer_pool(void)
+{
+	barny_buffer_t bufs[BARNY_OUTPUT_BUFFERS];
+	uint8_t       *mem;
+
+	TEST_SUITE_BEGIN("Buffer Pool");
+
+	mem = calloc(BARNY_OUTPUT_BUFFERS, (size_t)TB_W * 4 * TB_H);
+
+	TEST("acquire hands out the lowest idle buffer")
+	{
+		fake_buffers(bufs, BARNY_OUTPUT_BUFFERS, mem);
+		ASSERT_TRUE(barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS)
+		            == &bufs[0]);
+
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[0], 0, 0,
+		                     TB_W, TB_H);
+		ASSERT_TRUE(barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS)
+		            == &bufs[1]);
+
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[1], 0, 0,
+		                     TB_W, TB_H);
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[2], 0, 0,
+		                     TB_W, TB_H);
+		ASSERT_NULL(barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS));
+
+		bufs[1].busy = false;
+		ASSERT_TRUE(barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS)
+		            == &bufs[1]);
+		free_buffers(bufs, BARNY_OUTPUT_BUFFERS);
+	}
+
+	TEST("a commit leaves its own buffer clean and the others stale")
+	{
+		fake_buffers(bufs, BARNY_OUTPUT_BUFFERS, mem);
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[0], 0, 0,
+		                     TB_W, TB_H);
+		ASSERT_TRUE(bufs[0].busy);
+		ASSERT_EQ_INT(0, bufs[0].stale_w);
+		ASSERT_EQ_INT(TB_W, bufs[1].stale_w);
+
+		/* bufs[1] caught up, then misses two strips */
+		bufs[1].stale_w = 0;
+		bufs[1].stale_h = 0;
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[0], 10, 2,
+		                     8, 3);
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, &bufs[2], 30, 4,
+		                     5, 4);
+		ASSERT_EQ_INT(10, bufs[1].stale_x);
+		ASSERT_EQ_INT(2, bufs[1].stale_y);
+		ASSERT_EQ_INT(25, bufs[1].stale_w);
+		ASSERT_EQ_INT(6, bufs[1].stale_h);
+
+		/* bufs[0] only missed the second */
+		ASSERT_EQ_INT(30, bufs[0].stale_x);
+		ASSERT_EQ_INT(5, bufs[0].stale_w);
+		free_buffers(bufs, BARNY_OUTPUT_BUFFERS);
+	}
+
+	TEST("copy forward plus a strip repaint matches the newest frame")
+	{
+		barny_buffer_t *a;
+		barny_buffer_t *b;
+
+		fake_buffers(bufs, BARNY_OUTPUT_BUFFERS, mem);
+
+		/* frame 1: the whole bar into A, which the compositor keeps */
+		a = barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS);
+		fill_rect(a, 0, 0, TB_W, TB_H, 0x11);
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, a, 0, 0, TB_W,
+		                     TB_H);
+
+		/* frame 2: a strip, drawn into B on top of A's frame */
+		b = barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS);
+		ASSERT_TRUE(b != a);
+		barny_buffer_copy_forward(b, a);
+		fill_rect(b, 20, 1, 10, 5, 0x22);
+		barny_buffers_commit(bufs, BARNY_OUTPUT_BUFFERS, b, 20, 1, 10, 5);
+		a->busy = false;
+
+		/* frame 3: back in A, which only lacks frame 2's strip */
+		ASSERT_TRUE(barny_buffers_acquire(bufs, BARNY_OUTPUT_BUFFERS)
+		            == a);
+		ASSERT_EQ_INT(10, a->stale_w);
+		ASSERT_EQ_INT(5, a->stale_h);
+		barny_buffer_copy_forward(a, b);
+		ASSERT_EQ_INT(0, a->stale_w);
+		ASSERT_EQ_INT(0, memcmp(a->data, b->data, (size_t)TB_W * 4 * TB_H));
+		free_buffers(bufs, BARNY_OUTPUT_BUFFERS);
+	}
+
+	TEST("copy forward from nowhere or from itself is a no-op")
+	{
+		fake_buffers(bufs, BARNY_OUTPUT_BUFFERS, mem);
+		barny_buffer_copy_forward(&bufs[0], NULL);
+		barny_buffer_copy_forward(&bufs[0], &bufs[0]);
+		ASSERT_EQ_INT(TB_W, bufs[0].stale_w);
+		free_buffers(bufs, BARNY_OUTPUT_BUFFERS);
+	}
+
+	free(mem);
+
+	TEST_SUITE_END();
+}
+
+/* No wl_shm here, so the arena is just the memfd and its mapping: enough to
+   check the sub-allocator and that a grow never moves what was handed out. */
+void
+test_shm_arena(void)
+{
+	barny_shm_arena_t *arena;
+	uint8_t           *a;
+	uint8_t           *b;
+	uint8_t           *c;
+	size_t             off_a;
+	size_t             off_b;
+	size_t             off_c;
+	size_t             size;
+	size_t             used;
+
+	TEST_SUITE_BEGIN("Shm Arena");
+
+	arena = barny_shm_arena_create(NULL, "test");
+	ASSERT_NOT_NULL(arena);
+	if (!arena) {
+		TEST_SUITE_END();
+		return;
+	}
+
+	TEST("allocations are page aligned and do not overlap")
+	{
+		a = barny_shm_arena_alloc(arena, 1000, &off_a);
+		b = barny_shm_arena_alloc(arena, 5000, &off_b);
+		ASSERT_NOT_NULL(a);
+		ASSERT_NOT_NULL(b);
+		ASSERT_EQ_INT(0, (int)(off_a % 4096));
+		ASSERT_EQ_INT(0, (int)(off_b % 4096));
+		ASSERT_TRUE(off_b >= off_a + 1000);
+		barny_shm_arena_stats(arena, &size, &used);
+		ASSERT_EQ_INT(4096 + 8192, (int)used);
+		ASSERT_TRUE(size >= used);
+	}
+
+	TEST("a freed hole is reused by the next allocation that fits")
+	{
+		memset(b, 0x5a, 5000);
+		barny_shm_arena_free(arena, off_a, true);
+		c = barny_shm_arena_alloc(arena, 4096, &off_c);
+		ASSERT_TRUE(c == a);
+		ASSERT_EQ_INT((int)off_a, (int)off_c);
+		barny_shm_arena_free(arena, off_c, true);
+	}
+
+	TEST("growing keeps earlier blocks where they were")
+	{
+		size_t before;
+
+		barny_shm_arena_stats(arena, &before, &used);
+		c = barny_shm_arena_alloc(arena, 8u << 20, &off_c);
+		ASSERT_NOT_NULL(c);
+		barny_shm_arena_stats(arena, &size, &used);
+		ASSERT_TRUE(size > before);
+		ASSERT_EQ_INT(0x5a, b[4999]);
+		c[(8u << 20) - 1] = 1;
+		barny_shm_arena_free(arena, off_c, true);
+	}
+
+	TEST("a block still on screen is neither trimmed nor handed out")
+	{
+		uint8_t *d;
+		size_t   off_d;
+
+		c = barny_shm_arena_alloc(arena, 4096, &off_c);
+		memset(c, 0x77, 4096);
+		/* still on screen: the pages have to keep what was drawn */
+		barny_shm_arena_free(arena, off_c, false);
+		ASSERT_EQ_INT(0x77, c[0]);
+		d = barny_shm_arena_alloc(arena, 4096, &off_d);
+		ASSERT_NOT_NULL(d);
+		ASSERT_TRUE(off_d != off_c);
+		barny_shm_arena_free(arena, off_d, true);
+
+		/* the release: memfd punches holes, and a hole reads back as
+		   zeroes */
+		barny_shm_arena_free(arena, off_c, true);
+		ASSERT_EQ_INT(0, c[0]);
+		d = barny_shm_arena_alloc(arena, 4096, &off_d);
+		ASSERT_EQ_INT((int)off_c, (int)off_d);
+		barny_shm_arena_free(arena, off_d, true);
+	}
+
+	TEST("a buffer destroyed while busy keeps its pages")
+	{
+		barny_buffer_t buf;
+		uint8_t       *data;
+		size_t         off;
+
+		ASSERT_EQ_INT(0, barny_buffers_create(&buf, 1, arena, 32, 32, 1));
+		data = buf.data;
+		off  = buf.offset;
+		memset(data, 0x77, (size_t)buf.stride * 32);
+		/* attached by a popup or menu and not yet released */
+		buf.busy = true;
+		barny_buffers_destroy(&buf, 1);
+		ASSERT_EQ_INT(0x77, data[0]);
+		ASSERT_EQ_INT(0x77, data[32 * 32 * 4 - 1]);
+
+		barny_shm_arena_free(arena, off, true);
+		ASSERT_EQ_INT(0, data[0]);
+	}
+
+	TEST("buffers take their memory from the arena and give it back")
+	{
+		barny_buffer_t bufs[2];
+
+		barny_shm_arena_stats(arena, &size, &used);
+		ASSERT_EQ_INT(0, barny_buffers_create(bufs, 2, arena, 100, 10, 1));
+		ASSERT_TRUE(bufs[1].data != bufs[0].data);
+		ASSERT_EQ_INT(400, bufs[0].stride);
+		barny_buffers_destroy(bufs, 2);
+		barny_shm_arena_stats(arena, &size, &size);
+		ASSERT_EQ_INT((int)used, (int)size);
+	}
+
+	barny_shm_arena_free(arena, off_b, true);
+	barny_shm_arena_unref(arena);
+
+	TEST_SUITE_END();
+}
@@ -73,6 +73,23 @@ test_config_defaults(void)
 		ASSERT_EQ_DBL(BARNY_BLUR_RADIUS, config.blur_radius, 0.001);
 	}
 
+	TEST("default blur mode is pyramid at quality 2")
+	{
+		barny_config_t config;
+
+		barny_config_defaults(&config);
+		ASSERT_EQ_INT(BARNY_BLUR_PYRAMID, config.blur_mode);
+		ASSERT_EQ_INT(2, config.blur_quality);
+	}
+
+	TEST("wallpaper cache is on by default")
+	{
+		barny_config_t config;
+
+		barny_config_defaults(&config);
+		ASSERT_TRUE(config.wallpaper_cache);
+	}
+
 	TEST("default brightness is 1.1")
 	{
 		barny_config_t config;
@@ -465,6 +482,42 @@ test_config_load(void)
 		cleanup_temp_config(path);
 	}
 
+	TEST("parses blur_mode full")
+	{
+		barny_config_t config;
+		const char    *path;
+
+		barny_config_defaults(&config);
+		path = create_temp_config("blur_mode = full\n");
+		barny_config_load(&config, path);
+		ASSERT_EQ_INT(BARNY_BLUR_FULL, config.blur_mode);
+		cleanup_temp_config(path);
+	}
+
+	TEST("clamps blur_quality to its range")
+	{
+		barny_config_t config;
+		const char    *path;
+
+		barny_config_defaults(&config);
+		path = create_temp_config("blur_quality = 9\n");
+		barny_config_load(&config, path);
+		ASSERT_EQ_INT(BARNY_BLUR_QUALITY_MAX, config.blur_quality);
+		cleanup_temp_config(path);
+	}
+
+	TEST("parses wallpaper_cache = false")
+	{
+		barny_config_t config;
+		const char    *path;
+
+		barny_config_defaults(&config);
+		path = create_temp_config("wallpaper_cache = false\n");
+		barny_config_load(&config, path);
+		ASSERT_FALSE(config.wallpaper_cache);
+		cleanup_temp_config(path);
+	}
+
 	TEST("parses brightness as float")
 	{
 		barny_config_t config;
@@ -266,3 +266,99 @@ test_parse_int_clamped(void)
 
 	TEST_SUITE_END();
 }
+
+void
+test_config_key_table(void)
+{
+	TEST_SUITE_BEGIN("config key table");
+
+	barny_config_t cfg;
+	barny_config_t copy;
+	char           buf[256];
+	char           again[256];
+	size_t         i;
+
+	TEST("every key finds its own entry")
+	{
+		for (i = 0; i < CONFIG_KEY_COUNT; i++)
+			ASSERT_TRUE(config_key_find(config_keys[i].name)
+			            == &config_keys[i]);
+	}
+
+	TEST("each key holds exactly one slot")
+	{
+		int used = 0;
+
+		for (i = 0; i < CONFIG_HASH_SLOTS; i++)
+			used += config_hash_slot[i] != 0;
+		ASSERT_EQ_INT((int)CONFIG_KEY_COUNT, used);
+	}
+
+	TEST("unknown, partial and miscased keys miss")
+	{
+		ASSERT_NULL(config_key_find(""));
+		ASSERT_NULL(config_key_find("heigh"));
+		ASSERT_NULL(config_key_find("height_"));
+		ASSERT_NULL(config_key_find("Height"));
+		ASSERT_NULL(config_key_find("no_such_key"));
+	}
+
+	TEST("format writes values the parser reads back")
+	{
+		barny_config_defaults(&cfg);
+		parse_line(&cfg, "workspace_names", "one, two");
+		parse_line(&cfg, "tray_icon_bg_color", "#80ff40");
+		parse_line(&cfg, "text_color", "#102030");
+		parse_line(&cfg, "position", "bottom");
+		parse_line(&cfg, "refraction", "liquid");
+		parse_line(&cfg, "font", "Sans 11");
+
+		barny_config_defaults(&copy);
+		for (i = 0; i < CONFIG_KEY_COUNT; i++) {
+			if (barny_config_format_key(&cfg, config_keys[i].name, buf,
+			                            sizeof(buf))
+			    == 0)
+				parse_line(&copy, config_keys[i].name, buf);
+		}
+		for (i = 0; i < CONFIG_KEY_COUNT; i++) {
+			if (barny_config_format_key(&cfg, config_keys[i].name, buf,
+			                            sizeof(buf))
+			    != 0)
+				continue;
+			ASSERT_EQ_INT(0, barny_config_format_key(
+			                         &copy, config_keys[i].name,
+			                         again, sizeof(again)));
+			ASSERT_EQ_STR(buf, again);
+		}
+		ASSERT_EQ_INT(2, copy.workspace_name_count);
+		ASSERT_FALSE(copy.position_top);
+		ASSERT_EQ_INT(BARNY_REFRACT_LIQUID, copy.refraction_mode);
+		ASSERT_TRUE(copy.text_color_set);
+
+		barny_config_cleanup(&copy);
+		barny_config_cleanup(&cfg);
+	}
+
+	TEST("format spells keys the way barny.conf does")
+	{
+		barny_config_defaults(&cfg);
+		ASSERT_EQ_INT(0, barny_config_format_key(&cfg, "position", buf,
+		                                         sizeof(buf)));
+		ASSERT_EQ_STR("top", buf);
+		ASSERT_EQ_INT(0, barny_config_format_key(&cfg, "clock_show_date",
+		                                         buf, sizeof(buf)));
+		ASSERT_EQ_STR("false", buf);
+		ASSERT_EQ_INT(0, barny_config_format_key(
+		                         &cfg, "clock_date_separator", buf,
+		                         sizeof(buf)));
+		ASSERT_EQ_STR("/", buf);
+		ASSERT_EQ_INT(-1, barny_config_format_key(&cfg, "disk_mode", buf,
+		                                          sizeof(buf)));
+		ASSERT_EQ_INT(-1, barny_config_format_key(&cfg, "no_such_key",
+		                                          buf, sizeof(buf)));
+		ASSERT_EQ_INT(-1, barny_config_format_key(&cfg, "height", buf, 2));
+		barny_config_cleanup(&cfg);
+	}
+
+	TEST_SUITE_END();
+}
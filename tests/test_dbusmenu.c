@@ -0,0 +1,523 @@
+#include "../src/dbus/dbusmenu.c"
+
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "test_framework.h"
+#include "util.h"
+
+static int changed_calls = 0;
+
+void
+barny_menu_dbusmenu_changed(barny_state_t *state, barny_dbusmenu_t *menu)
+{
+	(void)state;
+	(void)menu;
+	changed_calls++;
+}
+
+/* A stand-in application on a private peer-to-peer bus: one dbusmenu at
+   /MenuBar, slow to answer GetLayout the way a busy application is, with
+   entries 1 and 4 submenus. Commands written to wake[1] make it change the menu
+   and announce it from its own thread, which owns the server end. */
+#define STAND_IN_NAME  ":1.42"
+#define STAND_IN_PATH  "/MenuBar"
+#define STAND_IN_DELAY 20000
+#define STAND_IN_SUB   1000
+
+typedef struct {
+	sd_bus         *bus;
+	int             fds[2];
+	int             wake[2];
+	pthread_t       thread;
+	pthread_mutex_t lock;
+
+	/* the menu */
+	uint32_t        revision;
+	int             items;
+	int             sub_items;
+	int             more_items;
+	bool            renamed;
+
+	/* a LayoutUpdated put off until after the next reply, the way
+	   libdbusmenu announces from idle */
+	int             held_parent;
+
+	/* GetLayout calls seen, under lock */
+	int             calls;
+	int             root_calls;
+	int             last_parent;
+} stand_in_t;
+
+static void
+stand_in_node(stand_in_t *srv, sd_bus_message *m, int id)
+{
+	char label[32];
+	int  first = id == 0 ? 1 : id * STAND_IN_SUB;
+	int  count = id == 0   ? srv->items
+	             : id == 1 ? srv->sub_items
+	             : id == 4 ? srv->more_items
+	                       : 0;
+	int  i;
+
+	sd_bus_message_open_container(m, 'r', "ia{sv}av");
+	sd_bus_message_append(m, "i", id);
+
+	sd_bus_message_open_container(m, 'a', "{sv}");
+	if (id != 0) {
+		snprintf(label, sizeof(label), "_Entry %d", id);
+		sd_bus_message_append(m, "{sv}", "label", "s",
+		                      id == 3 && srv->renamed ? "Renamed" : label);
+	}
+	if (id == 1 || id == 4)
+		sd_bus_message_append(m, "{sv}", "children-display", "s",
+		                      "submenu");
+	if (id == 2)
+		sd_bus_message_append(m, "{sv}", "enabled", "b", 0);
+	sd_bus_message_close_container(m);
+
+	sd_bus_message_open_container(m, 'a', "v");
+	for (i = 0; i < count; i++) {
+		sd_bus_message_open_container(m, 'v', "(ia{sv}av)");
+		stand_in_node(srv, m, first + i);
+		sd_bus_message_close_container(m);
+	}
+	sd_bus_message_close_container(m);
+
+	sd_bus_message_close_container(m);
+}
+
+static sd_bus_message *
+stand_in_signal(stand_in_t *srv, const char *member);
+
+static int
+stand_in_method(sd_bus_message *m, void *userdata, sd_bus_error *ret_error)
+{
+	stand_in_t     *srv   = userdata;
+	sd_bus_message *reply = NULL;
+	int             parent;
+	int             depth;
+
+	(void)ret_error;
+
+	if (!sd_bus_message_is_method_call(m, DBUSMENU_INTERFACE, "GetLayout"))
+		return 0;
+	if (sd_bus_message_read(m, "ii", &parent, &depth) < 0)
+		return 0;
+
+	pthread_mutex_lock(&srv->lock);
+	srv->calls++;
+	if (parent == 0)
+		srv->root_calls++;
+	srv->last_parent = parent;
+	pthread_mutex_unlock(&srv->lock);
+
+	usleep(STAND_IN_DELAY);
+
+	sd_bus_message_new_method_return(m, &reply);
+	sd_bus_message_append(reply, "u", srv->revision);
+	stand_in_node(srv, reply, parent);
+	sd_bus_send(srv->bus, reply, NULL);
+	sd_bus_message_unref(reply);
+
+	if (srv->held_parent) {
+		reply = stand_in_signal(srv, "LayoutUpdated");
+		sd_bus_message_append(reply, "ui", srv->revision,
+		                      srv->held_parent);
+		sd_bus_send(srv->bus, reply, NULL);
+		sd_bus_message_unref(reply);
+		srv->held_parent = 0;
+	}
+	return 1;
+}
+
+static sd_bus_message *
+stand_in_signal(stand_in_t *srv, const char *member)
+{
+	sd_bus_message *m = NULL;
+
+	sd_bus_message_new_signal(srv->bus, &m, STAND_IN_PATH,
+	                          DBUSMENU_INTERFACE, member);
+	/* nothing on a peer connection fills the sender in */
+	sd_bus_message_set_sender(m, STAND_IN_NAME);
+	return m;
+}
+
+static void
+stand_in_command(stand_in_t *srv, char cmd)
+{
+	sd_bus_message *m;
+
+	switch (cmd) {
+	case 'l':
+		/* the submenu grows */
+		srv->sub_items += 10;
+		m = stand_in_signal(srv, "LayoutUpdated");
+		sd_bus_message_append(m, "ui", ++srv->revision, 1);
+		break;
+	case 'm':
+		/* both submenus change under one revision; the second is
+		   announced once the first one's subtree has gone out */
+		srv->sub_items   += 10;
+		srv->more_items  += 5;
+		srv->held_parent  = 4;
+		m = stand_in_signal(srv, "LayoutUpdated");
+		sd_bus_message_append(m, "ui", ++srv->revision, 1);
+		break;
+	case 'r':
+		/* a new top-level entry */
+		srv->items++;
+		m = stand_in_signal(srv, "LayoutUpdated");
+		sd_bus_message_append(m, "ui", ++srv->revision, 0);
+		break;
+	case 'o':
+		/* the revision of the first whole layout, long since fetched */
+		m = stand_in_signal(srv, "LayoutUpdated");
+		sd_bus_message_append(m, "ui", 1, 1);
+		break;
+	case 'p':
+		srv->renamed = true;
+		m = stand_in_signal(srv, "ItemsPropertiesUpdated");
+		sd_bus_message_append(m, "a(ia{sv})a(ias)", 1, 3, 1, "label",
+		                      "s", "Renamed", 1, 2, 1, "enabled");
+		break;
+	default:
+		return;
+	}
+
+	sd_bus_send(srv->bus, m, NULL);
+	sd_bus_message_unref(m);
+}
+
+static void *
+stand_in_run(void *arg)
+{
+	stand_in_t   *srv = arg;
+	struct pollfd pfd[2];
+	char          cmd;
+	int           r;
+
+	for (;;) {
+		while ((r = sd_bus_process(srv->bus, NULL)) > 0)
+			;
+		if (r < 0)
+			break;
+
+		pfd[0].fd     = sd_bus_get_fd(srv->bus);
+		pfd[0].events = (short)sd_bus_get_events(srv->bus);
+		pfd[1].fd     = srv->wake[0];
+		pfd[1].events = POLLIN;
+		if (poll(pfd, 2, 1000) < 0)
+			break;
+		if (!(pfd[1].revents & POLLIN))
+			continue;
+		if (read(srv->wake[0], &cmd, 1) != 1 || cmd == 'q')
+			break;
+		stand_in_command(srv, cmd);
+	}
+
+	sd_bus_flush_close_unref(srv->bus);
+	return NULL;
+}
+
+static bool
+stand_in_start(stand_in_t *srv, barny_state_t *state)
+{
+	sd_id128_t id = { .qwords = { 0x62617272, 0x6e79 } };
+
+	memset(srv, 0, sizeof(*srv));
+	srv->revision   = 1;
+	srv->items      = 400;
+	srv->sub_items  = 50;
+	srv->more_items = 5;
+	pthread_mutex_init(&srv->lock, NULL);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, srv->fds) < 0
+	    || pipe(srv->wake) < 0)
+		return false;
+
+	if (sd_bus_new(&srv->bus) < 0
+	    || sd_bus_set_fd(srv->bus, srv->fds[0], srv->fds[0]) < 0
+	    || sd_bus_set_server(srv->bus, 1, id) < 0
+	    || sd_bus_add_object(srv->bus, NULL, STAND_IN_PATH, stand_in_method,
+	                         srv)
+	               < 0
+	    || sd_bus_start(srv->bus) < 0)
+		return false;
+
+	if (sd_bus_new(&state->dbus) < 0
+	    || sd_bus_set_fd(state->dbus, srv->fds[1], srv->fds[1]) < 0
+	    || sd_bus_start(state->dbus) < 0)
+		return false;
+
+	return pthread_create(&srv->thread, NULL, stand_in_run, srv) == 0;
+}
+
+static void
+stand_in_send(stand_in_t *srv, char cmd)
+{
+	if (write(srv->wake[1], &cmd, 1) != 1)
+		return;
+}
+
+static void
+stand_in_stop(stand_in_t *srv, barny_state_t *state)
+{
+	stand_in_send(srv, 'q');
+	pthread_join(srv->thread, NULL);
+	state->dbus = sd_bus_flush_close_unref(state->dbus);
+	close(srv->wake[0]);
+	close(srv->wake[1]);
+	pthread_mutex_destroy(&srv->lock);
+}
+
+static int
+stand_in_calls(stand_in_t *srv, int *root_calls)
+{
+	int calls;
+
+	pthread_mutex_lock(&srv->lock);
+	calls = srv->calls;
+	if (root_calls)
+		*root_calls = srv->root_calls;
+	pthread_mutex_unlock(&srv->lock);
+	return calls;
+}
+
+/* Runs the client's side of the bus until the cache has changed want
+   times in all, as the main loop would. */
+static bool
+pump_changes(barny_state_t *state, int want)
+{
+	uint64_t end = barny_now_us() + 2000000;
+	int      r;
+
+	while (changed_calls < want && barny_now_us() < end) {
+		r = sd_bus_process(state->dbus, NULL);
+		if (r < 0)
+			return false;
+		if (r == 0)
+			sd_bus_wait(state->dbus, 10000);
+	}
+
+	return changed_calls >= want;
+}
+
+static barny_menu_item_t *
+child_with_id(barny_menu_item_t *parent, int id)
+{
+	int i;
+
+	for (i = 0; i < parent->child_count; i++) {
+		if (parent->children[i].id == id)
+			return &parent->children[i];
+	}
+
+	return NULL;
+}
+
+void
+test_dbusmenu_cache(void)
+{
+	barny_state_t      state;
+	stand_in_t         srv;
+	sni_item_t         item;
+	barny_menu_item_t *root = NULL;
+	bool               up;
+
+	TEST_SUITE_BEGIN("dbusmenu cache against a stand-in application");
+
+	memset(&state, 0, sizeof(state));
+	memset(&item, 0, sizeof(item));
+	item.service      = STAND_IN_NAME;
+	item.object_path  = "/StatusNotifierItem";
+	item.menu_path    = STAND_IN_PATH;
+	item.props_loaded = true;
+	changed_calls     = 0;
+	up                = stand_in_start(&srv, &state);
+
+	TEST("hovering fetches the layout without waiting for it")
+	{
+		uint64_t t0;
+		uint64_t us;
+		int      root_calls;
+
+		ASSERT_TRUE(up);
+		t0 = barny_now_us();
+		barny_sni_item_prefetch_menu(&state, &item);
+		us = barny_now_us() - t0;
+		ASSERT_NOT_NULL(item.dbusmenu);
+		ASSERT_NULL(barny_dbusmenu_cached(item.dbusmenu));
+		ASSERT_TRUE(us < STAND_IN_DELAY);
+
+		ASSERT_TRUE(pump_changes(&state, 1));
+		root = barny_dbusmenu_cached(item.dbusmenu);
+		ASSERT_NOT_NULL(root);
+		ASSERT_EQ_INT(400, root->child_count);
+		ASSERT_EQ_STR("Entry 1", root->children[0].label);
+		ASSERT_TRUE(root->children[0].has_submenu);
+		ASSERT_EQ_INT(50, root->children[0].child_count);
+		ASSERT_FALSE(root->children[1].enabled);
+		ASSERT_EQ_INT(1, stand_in_calls(&srv, &root_calls));
+		ASSERT_EQ_INT(1, root_calls);
+
+		/* a second hover has nothing left to fetch */
+		barny_sni_item_prefetch_menu(&state, &item);
+		ASSERT_NULL(item.dbusmenu->layout_call);
+	}
+
+	TEST("a click after the hover opens from the cache")
+	{
+		barny_dbusmenu_t  *cold;
+		barny_menu_item_t *layout;
+		sni_item_t         other;
+		uint64_t           t0;
+		uint64_t           warm_us;
+		uint64_t           cold_us;
+		int                calls;
+
+		ASSERT_NOT_NULL(root);
+		calls = stand_in_calls(&srv, NULL);
+
+		/* click to a layout ready to lay out: all that stands between
+		   the click and the menu's first frame on our side */
+		t0      = barny_now_us();
+		layout  = barny_dbusmenu_layout(
+		        barny_sni_item_dbusmenu(&state, &item));
+		warm_us = barny_now_us() - t0;
+		ASSERT_TRUE(layout == root);
+		ASSERT_EQ_INT(calls, stand_in_calls(&srv, NULL));
+
+		/* the same click on an item nobody hovered */
+		other          = item;
+		other.dbusmenu = NULL;
+		t0             = barny_now_us();
+		cold           = barny_sni_item_dbusmenu(&state, &other);
+		layout         = barny_dbusmenu_layout(cold);
+		cold_us        = barny_now_us() - t0;
+		ASSERT_NOT_NULL(layout);
+		ASSERT_EQ_INT(400, layout->child_count);
+		ASSERT_EQ_INT(calls + 1, stand_in_calls(&srv, NULL));
+		ASSERT_TRUE(cold_us >= STAND_IN_DELAY);
+		ASSERT_TRUE(warm_us < cold_us);
+		barny_dbusmenu_destroy(cold);
+
+		printf("\n         click to layout: %.3f ms cached, %.1f ms "
+		       "fetched ... ",
+		       (double)warm_us / 1000.0, (double)cold_us / 1000.0);
+	}
+
+	TEST("LayoutUpdated refetches only the node that changed")
+	{
+		barny_menu_item_t *sub;
+		char              *last_label;
+		int                changes = changed_calls;
+		int                calls;
+		int                root_calls;
+		int                after;
+
+		ASSERT_NOT_NULL(root);
+		calls      = stand_in_calls(&srv, &root_calls);
+		sub        = &root->children[0];
+		last_label = root->children[399].label;
+
+		stand_in_send(&srv, 'l');
+		ASSERT_TRUE(pump_changes(&state, changes + 1));
+
+		ASSERT_EQ_INT(calls + 1, stand_in_calls(&srv, &after));
+		ASSERT_EQ_INT(root_calls, after);
+		ASSERT_EQ_INT(1, srv.last_parent);
+		/* the submenu node is where it was, with new children */
+		ASSERT_TRUE(&root->children[0] == sub);
+		ASSERT_EQ_INT(60, sub->child_count);
+		ASSERT_EQ_STR("Entry 1", sub->label);
+		ASSERT_TRUE(root->children[399].label == last_label);
+		ASSERT_TRUE(barny_dbusmenu_cached(item.dbusmenu) == root);
+	}
+
+	TEST("ItemsPropertiesUpdated patches entries with no fetch")
+	{
+		int changes = changed_calls;
+		int calls   = stand_in_calls(&srv, NULL);
+
+		stand_in_send(&srv, 'p');
+		ASSERT_TRUE(pump_changes(&state, changes + 1));
+
+		ASSERT_EQ_INT(calls, stand_in_calls(&srv, NULL));
+		ASSERT_EQ_STR("Renamed", child_with_id(root, 3)->label);
+		/* enabled was removed, so it is back to its default */
+		ASSERT_TRUE(child_with_id(root, 2)->enabled);
+	}
+
+	TEST("an announced revision already held is not fetched")
+	{
+		int changes = changed_calls;
+		int calls   = stand_in_calls(&srv, NULL);
+
+		/* signals arrive in order: once the second has been handled,
+		   so has the first */
+		stand_in_send(&srv, 'o');
+		stand_in_send(&srv, 'p');
+		ASSERT_TRUE(pump_changes(&state, changes + 1));
+		ASSERT_EQ_INT(calls, stand_in_calls(&srv, NULL));
+	}
+
+	TEST("LayoutUpdated of the root refetches the whole tree in place")
+	{
+		int changes = changed_calls;
+		int root_calls;
+		int after;
+
+		stand_in_calls(&srv, &root_calls);
+		stand_in_send(&srv, 'r');
+		ASSERT_TRUE(pump_changes(&state, changes + 1));
+
+		stand_in_calls(&srv, &after);
+		ASSERT_EQ_INT(root_calls + 1, after);
+		ASSERT_TRUE(barny_dbusmenu_cached(item.dbusmenu) == root);
+		ASSERT_EQ_INT(401, root->child_count);
+		ASSERT_EQ_INT(60, root->children[0].child_count);
+		ASSERT_EQ_STR("Renamed", child_with_id(root, 3)->label);
+	}
+
+	TEST("a subtree reply does not hide another subtree's change")
+	{
+		barny_menu_item_t *more;
+		int                changes = changed_calls;
+		int                calls   = stand_in_calls(&srv, NULL);
+
+		/* entry 1's reply carries the revision entry 4 changed under,
+		   and entry 4's LayoutUpdated only comes after it */
+		stand_in_send(&srv, 'm');
+		ASSERT_TRUE(pump_changes(&state, changes + 2));
+
+		ASSERT_EQ_INT(calls + 2, stand_in_calls(&srv, NULL));
+		ASSERT_EQ_INT(4, srv.last_parent);
+		more = child_with_id(root, 4);
+		ASSERT_NOT_NULL(more);
+		if (more)
+			ASSERT_EQ_INT(10, more->child_count);
+	}
+
+	TEST("destroying the cache tells an open menu")
+	{
+		int changes = changed_calls;
+
+		barny_dbusmenu_destroy(item.dbusmenu);
+		item.dbusmenu = NULL;
+		ASSERT_EQ_INT(changes + 1, changed_calls);
+	}
+
+	if (up)
+		stand_in_stop(&srv, &state);
+
+	TEST_SUITE_END();
+}
+
+TEST_MAIN_BEGIN()
+
+RUN_SUITE(test_dbusmenu_cache);
+
+TEST_MAIN_END()
@@ -0,0 +1,87 @@
+#include "test_framework.h"
+#include "barny.h"
+
+#include <stdint.h>
+
+/* The scaled tray icon cache on plain image surfaces; no output or
+   compositor is involved. */
+static cairo_surface_t *
+solid_icon(int w, int h, uint32_t argb)
+{
+	cairo_surface_t *s = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+	uint32_t        *px;
+	int              i;
+
+	px = (uint32_t *)cairo_image_surface_get_data(s);
+	for (i = 0; i < w * h; i++)
+		px[i] = argb;
+	cairo_surface_mark_dirty(s);
+	return s;
+}
+
+void
+test_icon_cache(void)
+{
+	cairo_surface_t *icon;
+	cairo_surface_t *scaled;
+	uint32_t         pixels[16 * 16];
+	uint64_t         hash;
+	uint64_t         misses;
+	int              i;
+
+	TEST_SUITE_BEGIN("Tray Icon Cache");
+
+	barny_icon_cache_clear();
+	icon = solid_icon(16, 8, 0xff336699);
+	for (i = 0; i < 16 * 16; i++)
+		pixels[i] = 0xff000000u | (uint32_t)i;
+
+	TEST("the hash follows the pixels and the shape")
+	{
+		hash = barny_icon_hash(pixels, sizeof(pixels), 16, 16);
+		ASSERT_TRUE(hash != 0);
+		ASSERT_TRUE(hash == barny_icon_hash(pixels, sizeof(pixels), 16, 16));
+		ASSERT_TRUE(hash != barny_icon_hash(pixels, sizeof(pixels), 32, 8));
+		pixels[100] ^= 1;
+		ASSERT_TRUE(hash != barny_icon_hash(pixels, sizeof(pixels), 16, 16));
+	}
+
+	TEST("icons are scaled once per size and fit the box")
+	{
+		misses = barny_icon_cache_misses();
+		scaled = barny_icon_cache_get(icon, 42, 32);
+		ASSERT_NOT_NULL(scaled);
+		ASSERT_EQ_INT(32, cairo_image_surface_get_width(scaled));
+		ASSERT_EQ_INT(16, cairo_image_surface_get_height(scaled));
+		ASSERT_TRUE(scaled == barny_icon_cache_get(icon, 42, 32));
+		ASSERT_EQ_INT(1, (int)(barny_icon_cache_misses() - misses));
+
+		/* another output scale is another entry */
+		scaled = barny_icon_cache_get(icon, 42, 64);
+		ASSERT_EQ_INT(64, cairo_image_surface_get_width(scaled));
+		ASSERT_EQ_INT(2, (int)(barny_icon_cache_misses() - misses));
+		ASSERT_NULL(barny_icon_cache_get(icon, 0, 32));
+	}
+
+	TEST("the least recently drawn entry is the one evicted")
+	{
+		barny_icon_cache_clear();
+		for (i = 1; i <= BARNY_ICON_CACHE_SIZE; i++)
+			barny_icon_cache_get(icon, (uint64_t)i, 16);
+		/* keep 1 warm; 2 is now the oldest */
+		barny_icon_cache_get(icon, 1, 16);
+
+		misses = barny_icon_cache_misses();
+		barny_icon_cache_get(icon, 1000, 16);
+		barny_icon_cache_get(icon, 1, 16);
+		barny_icon_cache_get(icon, 3, 16);
+		ASSERT_EQ_INT(1, (int)(barny_icon_cache_misses() - misses));
+		barny_icon_cache_get(icon, 2, 16);
+		ASSERT_EQ_INT(2, (int)(barny_icon_cache_misses() - misses));
+	}
+
+	barny_icon_cache_clear();
+	cairo_surface_destroy(icon);
+
+	TEST_SUITE_END();
+}
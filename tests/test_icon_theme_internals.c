@@ -0,0 +1,241 @@
+#include "../src/render/icon_theme.c"
+
+#include <ftw.h>
+
+#include "test_framework.h"
+
+static char icon_root[64];
+
+static void
+icon_touch(const char *rel)
+{
+	char  path[PATH_MAX];
+	char *slash;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", icon_root, rel);
+	for (slash = strchr(path + strlen(icon_root) + 1, '/'); slash;
+	     slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(path, 0700);
+		*slash = '/';
+	}
+
+	f = fopen(path, "w");
+	if (f) {
+		if (strstr(rel, "index.theme"))
+			fputs("[Icon Theme]\nName=Mine\nInherits=hicolor\n", f);
+		fclose(f);
+	}
+}
+
+/* A directory's mtime moved well clear of the one the index recorded;
+   a file created within the same clock tick might not do that itself. */
+static void
+icon_bump_mtime(const char *rel)
+{
+	char            path[PATH_MAX];
+	struct timespec times[2];
+
+	snprintf(path, sizeof(path), "%s/%s", icon_root, rel);
+	clock_gettime(CLOCK_REALTIME, &times[0]);
+	times[0].tv_sec += 10;
+	times[1]         = times[0];
+	utimensat(AT_FDCWD, path, times, 0);
+}
+
+static int
+icon_remove(const char *path, const struct stat *st, int flag,
+            struct FTW *ftw)
+{
+	(void)st;
+	(void)flag;
+	(void)ftw;
+	remove(path);
+	return 0;
+}
+
+static void
+icon_search(icon_search_t *s, const char *theme)
+{
+	char path[PATH_MAX];
+
+	memset(s, 0, sizeof(*s));
+	snprintf(path, sizeof(path), "%s/icons", icon_root);
+	search_add(s->roots, &s->nroots, path, "");
+	snprintf(path, sizeof(path), "%s/pixmaps", icon_root);
+	search_add(s->pixmaps, &s->npixmaps, path, "");
+	search_themes(s, theme);
+}
+
+static bool
+icon_found(const icon_index_t *idx, const char *name, int size,
+           const char *rel)
+{
+	const char *found = index_lookup(idx, name, size);
+	char        want[PATH_MAX];
+
+	snprintf(want, sizeof(want), "%s/%s", icon_root, rel);
+	return found && strcmp(found, want) == 0;
+}
+
+void
+test_icon_theme_index(void)
+{
+	icon_search_t s;
+	icon_index_t  idx;
+	char          cache[PATH_MAX];
+
+	TEST_SUITE_BEGIN("Icon Theme Index");
+
+	snprintf(icon_root, sizeof(icon_root), "/tmp/barny-icons-XXXXXX");
+	if (!mkdtemp(icon_root))
+		icon_root[0] = '\0';
+	icon_touch("icons/hicolor/16x16/apps/foo.png");
+	icon_touch("icons/hicolor/48x48/apps/foo.png");
+	icon_touch("icons/hicolor/scalable/apps/bar.svg");
+	icon_touch("icons/mytheme/index.theme");
+	icon_touch("icons/mytheme/32x32/apps/foo.png");
+	icon_touch("icons/mytheme/32x32/apps/notes.txt");
+	icon_touch("pixmaps/baz.png");
+	snprintf(cache, sizeof(cache), "%s/icon-index.bin", icon_root);
+
+	TEST("the chain follows Inherits and ends in hicolor")
+	{
+		icon_search(&s, "mytheme");
+		ASSERT_EQ_INT(2, s.nthemes);
+		ASSERT_EQ_STR("mytheme", s.themes[0]);
+		ASSERT_EQ_STR("hicolor", s.themes[1]);
+		search_free(&s);
+
+		icon_search(&s, NULL);
+		ASSERT_EQ_INT(1, s.nthemes);
+		ASSERT_EQ_STR("hicolor", s.themes[0]);
+		search_free(&s);
+	}
+
+	TEST("dir_size reads plain, scaled and scalable directories")
+	{
+		int     size  = 0;
+		uint8_t flags = 0;
+
+		dir_size("48x48", &size, &flags);
+		ASSERT_EQ_INT(48, size);
+		dir_size("24x24@2", &size, &flags);
+		ASSERT_EQ_INT(48, size);
+		size = 7;
+		dir_size("apps", &size, &flags);
+		ASSERT_EQ_INT(7, size);
+		ASSERT_EQ_INT(0, flags);
+		dir_size("scalable", &size, &flags);
+		ASSERT_EQ_INT(ICON_SCALABLE, flags);
+	}
+
+	TEST("the theme wins over what it inherits")
+	{
+		icon_search(&s, "mytheme");
+		ASSERT_TRUE(index_open(&idx, &s, NULL));
+		ASSERT_FALSE(idx.mapped);
+		/* hicolor has a closer 16 and 48, mytheme still comes first */
+		ASSERT_TRUE(icon_found(&idx, "foo", 16,
+		                       "icons/mytheme/32x32/apps/foo.png"));
+		ASSERT_TRUE(icon_found(&idx, "foo", 64,
+		                       "icons/mytheme/32x32/apps/foo.png"));
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("within a theme the smallest size that is big enough")
+	{
+		icon_search(&s, NULL);
+		ASSERT_TRUE(index_open(&idx, &s, NULL));
+		ASSERT_TRUE(icon_found(&idx, "foo", 16,
+		                       "icons/hicolor/16x16/apps/foo.png"));
+		ASSERT_TRUE(icon_found(&idx, "foo", 24,
+		                       "icons/hicolor/48x48/apps/foo.png"));
+		ASSERT_TRUE(icon_found(&idx, "foo", 96,
+		                       "icons/hicolor/48x48/apps/foo.png"));
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("pixmaps come after every theme, other files not at all")
+	{
+		icon_search(&s, "mytheme");
+		ASSERT_TRUE(index_open(&idx, &s, NULL));
+		ASSERT_TRUE(icon_found(&idx, "baz", 24, "pixmaps/baz.png"));
+		ASSERT_NULL(index_lookup(&idx, "notes", 24));
+		ASSERT_NULL(index_lookup(&idx, "missing", 24));
+#ifdef BARNY_RSVG
+		ASSERT_TRUE(icon_found(&idx, "bar", 24,
+		                       "icons/hicolor/scalable/apps/bar.svg"));
+#else
+		/* nothing could draw it */
+		ASSERT_NULL(index_lookup(&idx, "bar", 24));
+#endif
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("a second open maps the stored index")
+	{
+		icon_search(&s, "mytheme");
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_FALSE(idx.mapped);
+		index_close(&idx);
+
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_TRUE(idx.mapped);
+		ASSERT_TRUE(icon_found(&idx, "foo", 24,
+		                       "icons/mytheme/32x32/apps/foo.png"));
+		ASSERT_TRUE(icon_found(&idx, "baz", 24, "pixmaps/baz.png"));
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("a changed directory rebuilds the index")
+	{
+		icon_touch("icons/hicolor/48x48/apps/qux.png");
+		icon_bump_mtime("icons/hicolor/48x48/apps");
+
+		icon_search(&s, "mytheme");
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_FALSE(idx.mapped);
+		ASSERT_TRUE(icon_found(&idx, "qux", 24,
+		                       "icons/hicolor/48x48/apps/qux.png"));
+		index_close(&idx);
+
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_TRUE(idx.mapped);
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("another theme chain does not reuse the stored index")
+	{
+		icon_search(&s, NULL);
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_FALSE(idx.mapped);
+		ASSERT_TRUE(icon_found(&idx, "foo", 16,
+		                       "icons/hicolor/16x16/apps/foo.png"));
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	TEST("a truncated index is rebuilt")
+	{
+		icon_search(&s, NULL);
+		ASSERT_EQ_INT(0, truncate(cache, 20));
+		ASSERT_TRUE(index_open(&idx, &s, cache));
+		ASSERT_FALSE(idx.mapped);
+		ASSERT_TRUE(icon_found(&idx, "foo", 16,
+		                       "icons/hicolor/16x16/apps/foo.png"));
+		index_close(&idx);
+		search_free(&s);
+	}
+
+	if (icon_root[0])
+		nftw(icon_root, icon_remove, 8, FTW_DEPTH | FTW_PHYS);
+
+	TEST_SUITE_END();
+}
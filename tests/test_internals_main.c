@@ -8,6 +8,8 @@ extern void
 test_parse_bool(void);
 extern void
 test_parse_int_clamped(void);
+extern void
+test_config_key_table(void);
 
 extern void
 test_build_time_string(void);
@@ -28,12 +30,20 @@ test_is_physical_interface(void);
 extern void
 test_parse_workspaces(void);
 extern void
+test_apply_workspace_event(void);
+extern void
 test_get_workspace_label(void);
 extern void
 test_is_square_shape(void);
 extern void
 test_workspace_click_uses_module_rect(void);
 
+extern void
+test_defer_coalesces_until_frame(void);
+
+extern void
+test_icon_theme_index(void);
+
 extern void
 test_tray_update_width_and_dirty(void);
 extern void
@@ -46,6 +56,7 @@ RUN_SUITE(test_parse_hex_color);
 RUN_SUITE(test_trim);
 RUN_SUITE(test_parse_bool);
 RUN_SUITE(test_parse_int_clamped);
+RUN_SUITE(test_config_key_table);
 
 printf("\n--- Clock Internal Functions ---\n");
 RUN_SUITE(test_build_time_string);
@@ -63,10 +74,17 @@ RUN_SUITE(test_is_physical_interface);
 
 printf("\n--- Workspace Internal Functions ---\n");
 RUN_SUITE(test_parse_workspaces);
+RUN_SUITE(test_apply_workspace_event);
 RUN_SUITE(test_get_workspace_label);
 RUN_SUITE(test_is_square_shape);
 RUN_SUITE(test_workspace_click_uses_module_rect);
 
+printf("\n--- Repaint Internal Functions ---\n");
+RUN_SUITE(test_defer_coalesces_until_frame);
+
+printf("\n--- Icon Theme Internal Functions ---\n");
+RUN_SUITE(test_icon_theme_index);
+
 printf("\n--- Tray Internal Functions ---\n");
 RUN_SUITE(test_tray_update_width_and_dirty);
 RUN_SUITE(test_tray_click_handling);
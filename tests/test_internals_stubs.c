@@ -9,28 +9,22 @@ barny_render_frame(barny_output_t *output)
 }
 
 int
-barny_sway_ipc_send(barny_state_t *state, uint32_t type, const char *payload)
+barny_sway_ipc_command(barny_state_t *state, const char *command)
 {
 	(void)state;
-	(void)type;
-	(void)payload;
+	(void)command;
 	return 0;
 }
 
 char *
-barny_sway_ipc_recv(barny_state_t *state, uint32_t *type)
+barny_sway_ipc_request(barny_state_t *state, uint32_t type, const char *payload,
+                       int timeout_ms)
 {
 	(void)state;
-	if (type)
-		*type = 0;
-	return strdup("[]");
-}
-
-char *
-barny_sway_ipc_recv_sync(barny_state_t *state, uint32_t *type, int timeout_ms)
-{
+	(void)type;
+	(void)payload;
 	(void)timeout_ms;
-	return barny_sway_ipc_recv(state, type);
+	return strdup("[]");
 }
 
 int
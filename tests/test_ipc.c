@@ -1,6 +1,10 @@
 #include "test_framework.h"
 #include "barny.h"
+#include "util.h"
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdint.h>
@@ -47,6 +51,119 @@ close_pair(int fds[2])
 	close(fds[1]);
 }
 
+/* a whole frame into buf; returns its size */
+static size_t
+frame(char *buf, uint32_t type, const char *payload, uint32_t len)
+{
+	memcpy(buf, SWAY_IPC_MAGIC, 6);
+	memcpy(buf + 6, &len, 4);
+	memcpy(buf + 10, &type, 4);
+	memcpy(buf + SWAY_IPC_HEADER_SIZE, payload, len);
+	return SWAY_IPC_HEADER_SIZE + len;
+}
+
+/* A stand-in for sway on a real socket: the first connection gets a flood
+   of window events, the second answers each request with its sequence
+   number, in order, until the client hangs up. */
+typedef struct {
+	char      path[108];
+	int       listen_fd;
+	int       events;
+	pthread_t thread;
+} stand_in_t;
+
+#define STAND_IN_CHUNK 4093
+
+static void *
+stand_in_run(void *arg)
+{
+	stand_in_t *srv = arg;
+	char       *out;
+	char        header[SWAY_IPC_HEADER_SIZE];
+	char        payload[512];
+	char        reply[64];
+	size_t      used;
+	size_t      off;
+	size_t      n;
+	uint32_t    len;
+	uint32_t    type;
+	int         ev_fd;
+	int         cmd_fd;
+	int         seq;
+	int         i;
+
+	ev_fd  = accept(srv->listen_fd, NULL, NULL);
+	cmd_fd = accept(srv->listen_fd, NULL, NULL);
+
+	/* odd-sized writes, so headers and payloads land split across reads */
+	out  = malloc(1 << 20);
+	used = 0;
+	for (i = 0; i < srv->events; i++) {
+		len   = (uint32_t)snprintf(payload, sizeof(payload),
+		                           "{\"change\":\"title\",\"container\":"
+		                           "{\"id\":%d,\"name\":\"window %*d\"}}",
+		                           i, i % 200, i);
+		used += frame(out + used, BARNY_SWAY_EVENT_WINDOW, payload, len);
+		if (used > (1 << 20) - 1024 || i == srv->events - 1) {
+			for (off = 0; off < used; off += n) {
+				n = used - off < STAND_IN_CHUNK ? used - off
+				                                : STAND_IN_CHUNK;
+				if (write_full(ev_fd, out + off, n) < 0)
+					break;
+			}
+			used = 0;
+		}
+	}
+	free(out);
+
+	for (seq = 0;; seq++) {
+		if (read_full(cmd_fd, header, sizeof(header)) < 0)
+			break;
+		memcpy(&len, header + 6, 4);
+		memcpy(&type, header + 10, 4);
+		if (len >= sizeof(payload) || read_full(cmd_fd, payload, len) < 0)
+			break;
+
+		len = (uint32_t)snprintf(reply, sizeof(reply), "{\"seq\":%d}", seq);
+		n   = frame(payload, type, reply, len);
+		if (write_full(cmd_fd, payload, n) < 0)
+			break;
+	}
+
+	close(ev_fd);
+	close(cmd_fd);
+	return NULL;
+}
+
+static bool
+stand_in_start(stand_in_t *srv, int events)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	snprintf(srv->path, sizeof(srv->path), "/tmp/barny-test-sway-%d.sock",
+	         (int)getpid());
+	unlink(srv->path);
+	srv->events    = events;
+	srv->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	memcpy(addr.sun_path, srv->path, strlen(srv->path) + 1);
+	if (srv->listen_fd < 0
+	    || bind(srv->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0
+	    || listen(srv->listen_fd, 2) < 0)
+		return false;
+
+	setenv("SWAYSOCK", srv->path, 1);
+	return pthread_create(&srv->thread, NULL, stand_in_run, srv) == 0;
+}
+
+static void
+stand_in_stop(stand_in_t *srv, barny_state_t *state)
+{
+	barny_sway_ipc_cleanup(state);
+	pthread_join(srv->thread, NULL);
+	close(srv->listen_fd);
+	unlink(srv->path);
+}
+
 void
 test_ipc_send_framing(void)
 {
@@ -54,26 +171,26 @@ test_ipc_send_framing(void)
 
 	TEST("writes magic, length, type, and payload")
 	{
-		barny_state_t state;
-		const char   *payload;
-		uint32_t      type;
-		uint8_t       header[SWAY_IPC_HEADER_SIZE];
-		uint32_t      len;
-		uint32_t      got_type;
-		char          buf[16] = { 0 };
-		int           fds[2];
+		barny_sway_conn_t conn;
+		const char       *payload;
+		uint32_t          type;
+		uint8_t           header[SWAY_IPC_HEADER_SIZE];
+		uint32_t          len;
+		uint32_t          got_type;
+		char              buf[16] = { 0 };
+		int               fds[2];
 
 		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
 
-		memset(&state, 0, sizeof(state));
-		state.sway_ipc_fd = fds[0];
+		barny_sway_conn_init(&conn);
+		conn.fd  = fds[0];
 
-		payload           = "hello";
-		type              = 42;
-		len               = 0;
-		got_type          = 0;
+		payload  = "hello";
+		type     = 42;
+		len      = 0;
+		got_type = 0;
 
-		ASSERT_EQ_INT(0, barny_sway_ipc_send(&state, type, payload));
+		ASSERT_EQ_INT(0, barny_sway_ipc_send(&conn, type, payload));
 
 		ASSERT_EQ_INT(0, read_full(fds[1], header, sizeof(header)));
 
@@ -98,101 +215,274 @@ test_ipc_send_framing(void)
 void
 test_ipc_recv_framing(void)
 {
-	TEST_SUITE_BEGIN("sway_ipc_recv");
+	TEST_SUITE_BEGIN("sway_ipc_fill/next");
 
 	TEST("reads header and payload")
 	{
-		barny_state_t state;
-		const char   *payload;
-		uint32_t      type;
-		uint32_t      len;
-		uint8_t       header[SWAY_IPC_HEADER_SIZE];
-		uint32_t      out_type;
-		char         *out;
-		int           fds[2];
+		barny_sway_conn_t conn;
+		char              raw[64];
+		uint32_t          out_type;
+		uint32_t          out_len;
+		char             *out;
+		int               fds[2];
 
 		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
+
+		ASSERT_EQ_INT(0, write_full(fds[1], raw, frame(raw, 7, "world", 5)));
+
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(1, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+		ASSERT_EQ_INT(7, (int)out_type);
+		ASSERT_EQ_INT(5, (int)out_len);
+		ASSERT_EQ_STR("world", out);
+		ASSERT_EQ_INT(0, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+		ASSERT_EQ_INT(0, barny_sway_ipc_fill(&conn));
+
+		barny_sway_conn_close(&conn);
+		close(fds[1]);
+	}
 
-		memset(&state, 0, sizeof(state));
-		state.sway_ipc_fd = fds[0];
-
-		payload           = "world";
-		type              = 7;
-		len               = (uint32_t)strlen(payload);
-		out_type          = 0;
+	TEST("handles zero-length payload")
+	{
+		barny_sway_conn_t conn;
+		char              raw[64];
+		uint32_t          out_type;
+		uint32_t          out_len;
+		char             *out;
+		int               fds[2];
 
-		memcpy(header, SWAY_IPC_MAGIC, 6);
-		memcpy(header + 6, &len, 4);
-		memcpy(header + 10, &type, 4);
+		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
 
-		ASSERT_EQ_INT(0, write_full(fds[1], header, sizeof(header)));
-		ASSERT_EQ_INT(0, write_full(fds[1], payload, len));
+		ASSERT_EQ_INT(0, write_full(fds[1], raw, frame(raw, 9, "", 0)));
 
-		out = barny_sway_ipc_recv(&state, &out_type);
-		ASSERT_NOT_NULL(out);
-		ASSERT_EQ_INT((int)type, (int)out_type);
-		ASSERT_EQ_STR(payload, out);
-		free(out);
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(1, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+		ASSERT_EQ_INT(9, (int)out_type);
+		ASSERT_EQ_STR("", out);
 
-		close_pair(fds);
+		barny_sway_conn_close(&conn);
+		close(fds[1]);
 	}
 
-	TEST("handles zero-length payload")
+	TEST("waits for a split header and payload without blocking")
 	{
-		barny_state_t state;
-		uint32_t      type;
-		uint32_t      len;
-		uint8_t       header[SWAY_IPC_HEADER_SIZE];
-		uint32_t      out_type;
-		char         *out;
-		int           fds[2];
+		barny_sway_conn_t conn;
+		char              raw[128];
+		size_t            n;
+		uint32_t          out_type;
+		uint32_t          out_len;
+		char             *out;
+		int               fds[2];
 
 		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
+
+		/* two frames back to back, delivered in three pieces */
+		n  = frame(raw, 1, "first", 5);
+		n += frame(raw + n, 2, "second", 6);
+
+		ASSERT_EQ_INT(0, write_full(fds[1], raw, 5));
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(0, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+
+		ASSERT_EQ_INT(0, write_full(fds[1], raw + 5, 20));
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(1, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+		ASSERT_EQ_STR("first", out);
+		ASSERT_EQ_INT(0, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+
+		ASSERT_EQ_INT(0, write_full(fds[1], raw + 25, n - 25));
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(1, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                     &out_len));
+		ASSERT_EQ_INT(2, (int)out_type);
+		ASSERT_EQ_STR("second", out);
+
+		barny_sway_conn_close(&conn);
+		close(fds[1]);
+	}
 
-		memset(&state, 0, sizeof(state));
-		state.sway_ipc_fd = fds[0];
+	TEST("grows for a message larger than the buffer")
+	{
+		barny_sway_conn_t conn;
+		char             *raw;
+		char             *big;
+		size_t            n;
+		size_t            off;
+		uint32_t          out_type;
+		uint32_t          out_len;
+		char             *out;
+		int               got;
+		int               fds[2];
+
+		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
+
+		big = malloc(300000);
+		raw = malloc(300000 + SWAY_IPC_HEADER_SIZE);
+		memset(big, 'x', 300000);
+		n   = frame(raw, 4, big, 300000);
+
+		got = 0;
+		for (off = 0; off < n && !got; off += 16384) {
+			ASSERT_EQ_INT(0, write_full(fds[1], raw + off,
+			                            n - off < 16384 ? n - off
+			                                            : 16384));
+			while (barny_sway_ipc_fill(&conn) > 0)
+				;
+			got = barny_sway_ipc_next(&conn, &out_type, &out,
+			                          &out_len);
+		}
+		ASSERT_EQ_INT(1, got);
+		ASSERT_EQ_INT(300000, (int)out_len);
+		ASSERT_EQ_INT(300000, (int)strlen(out));
+
+		free(big);
+		free(raw);
+		barny_sway_conn_close(&conn);
+		close(fds[1]);
+	}
 
-		type              = 9;
-		len               = 0;
-		out_type          = 0;
+	TEST("rejects invalid magic")
+	{
+		barny_sway_conn_t conn;
+		uint8_t           header[SWAY_IPC_HEADER_SIZE];
+		uint32_t          out_type;
+		uint32_t          out_len;
+		char             *out;
+		int               fds[2];
 
-		memcpy(header, SWAY_IPC_MAGIC, 6);
-		memcpy(header + 6, &len, 4);
-		memcpy(header + 10, &type, 4);
+		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
 
+		memset(header, 0, sizeof(header));
+		memcpy(header, "badmgc", 6);
 		ASSERT_EQ_INT(0, write_full(fds[1], header, sizeof(header)));
 
-		out = barny_sway_ipc_recv(&state, &out_type);
-		ASSERT_NOT_NULL(out);
-		ASSERT_EQ_INT((int)type, (int)out_type);
-		ASSERT_EQ_STR("", out);
-		free(out);
+		ASSERT_EQ_INT(1, barny_sway_ipc_fill(&conn));
+		ASSERT_EQ_INT(-1, barny_sway_ipc_next(&conn, &out_type, &out,
+		                                      &out_len));
 
-		close_pair(fds);
+		barny_sway_conn_close(&conn);
+		close(fds[1]);
 	}
 
-	TEST("rejects invalid magic")
+	TEST("reports the peer hanging up")
 	{
-		barny_state_t state;
-		uint8_t       header[SWAY_IPC_HEADER_SIZE];
-		uint32_t      out_type;
-		char         *out;
-		int           fds[2];
+		barny_sway_conn_t conn;
+		int               fds[2];
 
 		ASSERT_EQ_INT(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+		barny_sway_conn_init(&conn);
+		conn.fd = fds[0];
+
+		close(fds[1]);
+		ASSERT_EQ_INT(-1, barny_sway_ipc_fill(&conn));
+
+		barny_sway_conn_close(&conn);
+	}
+
+	TEST_SUITE_END();
+}
+
+void
+test_ipc_stand_in_server(void)
+{
+	TEST_SUITE_BEGIN("sway_ipc against a stand-in server");
+
+	TEST("pipelined requests get their replies in order")
+	{
+		barny_state_t state;
+		stand_in_t    srv;
+		char         *reply;
+		int           i;
 
 		memset(&state, 0, sizeof(state));
-		state.sway_ipc_fd = fds[0];
-		out_type          = 0;
+		ASSERT_TRUE(stand_in_start(&srv, 0));
+		ASSERT_EQ_INT(0, barny_sway_ipc_init(&state));
+		ASSERT_TRUE(state.sway_events.fd != state.sway_cmds.fd);
+
+		/* five commands in flight; the request's reply is the sixth */
+		for (i = 0; i < 5; i++)
+			ASSERT_EQ_INT(0, barny_sway_ipc_command(&state,
+			                                        "workspace next"));
+		ASSERT_EQ_INT(5, state.sway_cmds.waiting_count);
+
+		reply = barny_sway_ipc_request(&state, BARNY_SWAY_IPC_GET_TREE,
+		                               "", 2000);
+		ASSERT_NOT_NULL(reply);
+		ASSERT_EQ_STR("{\"seq\":5}", reply);
+		ASSERT_EQ_INT(0, state.sway_cmds.waiting_count);
+		free(reply);
+
+		ASSERT_EQ_INT(0, barny_sway_ipc_command(&state, "workspace prev"));
+		reply = barny_sway_ipc_request(&state,
+		                               BARNY_SWAY_IPC_GET_WORKSPACES, "",
+		                               2000);
+		ASSERT_NOT_NULL(reply);
+		ASSERT_EQ_STR("{\"seq\":7}", reply);
+		free(reply);
+
+		stand_in_stop(&srv, &state);
+	}
 
-		memset(header, 0, sizeof(header));
-		memcpy(header, "badmgc", 6);
-		ASSERT_EQ_INT(0, write_full(fds[1], header, sizeof(header)));
+	TEST("an event flood is framed without blocking")
+	{
+		barny_state_t state;
+		stand_in_t    srv;
+		struct pollfd pfd;
+		uint64_t      t0;
+		uint64_t      us;
+		uint32_t      type;
+		uint32_t      len;
+		char         *payload;
+		char          want[32];
+		int           total = 200000;
+		int           got   = 0;
+		int           bad   = 0;
 
-		out = barny_sway_ipc_recv(&state, &out_type);
-		ASSERT_NULL(out);
+		memset(&state, 0, sizeof(state));
+		ASSERT_TRUE(stand_in_start(&srv, total));
+		ASSERT_EQ_INT(0, barny_sway_ipc_init(&state));
+
+		t0  = barny_now_us();
+		pfd = (struct pollfd){ .fd = state.sway_events.fd, .events = POLLIN };
+		while (got < total && poll(&pfd, 1, 2000) == 1) {
+			if (barny_sway_ipc_fill(&state.sway_events) < 0)
+				break;
+			while (barny_sway_ipc_next(&state.sway_events, &type,
+			                           &payload, &len)
+			       > 0) {
+				snprintf(want, sizeof(want), "{\"id\":%d,", got);
+				if (type != BARNY_SWAY_EVENT_WINDOW
+				    || !strstr(payload, want)
+				    || payload[len - 1] != '}')
+					bad++;
+				got++;
+			}
+		}
+		us = barny_now_us() - t0;
 
-		close_pair(fds);
+		ASSERT_EQ_INT(total, got);
+		ASSERT_EQ_INT(0, bad);
+		printf("\n         %d events in %.1f ms, %.0f events/s ... ", got,
+		       (double)us / 1000.0,
+		       us ? (double)got * 1e6 / (double)us : 0.0);
+
+		stand_in_stop(&srv, &state);
 	}
 
 	TEST_SUITE_END();
@@ -202,5 +492,6 @@ TEST_MAIN_BEGIN()
 
 RUN_SUITE(test_ipc_send_framing);
 RUN_SUITE(test_ipc_recv_framing);
+RUN_SUITE(test_ipc_stand_in_server);
 
 TEST_MAIN_END()
@@ -1,6 +1,9 @@
 #include "test_framework.h"
 #include "barny.h"
 #include <cairo/cairo.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../src/render/liquid_glass.c"
 
@@ -283,6 +286,49 @@ test_displacement_map(void)
 	TEST_SUITE_END();
 }
 
+/* Direct form of the stack blur: a triangular kernel of weight r + 1 - |i|
+   with the edge pixel repeated past the border, divided by (r + 1)^2 and
+   truncated, rows first and then columns of the row result. Slow, but with
+   nothing clever in it to share a bug with the strip blur. */
+static void
+blur_reference(uint8_t *data, int w, int h, int stride, int r)
+{
+	uint8_t *tmp = malloc((size_t)h * stride);
+	int      div = (r + 1) * (r + 1);
+	int      x;
+	int      y;
+	int      c;
+	int      i;
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			for (c = 0; c < 4; c++) {
+				int sum = 0;
+
+				for (i = -r; i <= r; i++) {
+					int sx = x + i < 0 ? 0 : (x + i >= w ? w - 1 : x + i);
+
+					sum += data[y * stride + sx * 4 + c] * (r + 1 - abs(i));
+				}
+				tmp[y * stride + x * 4 + c] = (uint8_t)(sum / div);
+			}
+
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			for (c = 0; c < 4; c++) {
+				int sum = 0;
+
+				for (i = -r; i <= r; i++) {
+					int sy = y + i < 0 ? 0 : (y + i >= h ? h - 1 : y + i);
+
+					sum += tmp[sy * stride + x * 4 + c] * (r + 1 - abs(i));
+				}
+				data[y * stride + x * 4 + c] = (uint8_t)(sum / div);
+			}
+
+	free(tmp);
+}
+
 void
 test_blur_surface(void)
 {
@@ -365,6 +411,158 @@ test_blur_surface(void)
 		cairo_surface_destroy(surface);
 	}
 
+	/* widths straddle the 16-column strips, and one surface is narrower than
+	   a strip; radii include one longer than the surface is tall */
+	TEST("strip blur matches the direct kernel byte for byte")
+	{
+		static const int dims[][2]  = {{1, 1}, {7, 5}, {16, 16}, {37, 23},
+		                               {70, 41}};
+		static const int radii[]    = {1, 2, 5, 12, 30};
+		unsigned         seed       = 12345;
+		int              mismatches = 0;
+		size_t           d;
+		size_t           r;
+
+		for (d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+			for (r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+				int              w = dims[d][0];
+				int              h = dims[d][1];
+				cairo_surface_t *surface;
+				uint8_t         *data;
+				uint8_t         *want;
+				int              stride;
+				int              i;
+
+				surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w,
+				                                     h);
+				cairo_surface_flush(surface);
+				data   = cairo_image_surface_get_data(surface);
+				stride = cairo_image_surface_get_stride(surface);
+				for (i = 0; i < h * stride; i++) {
+					seed    = seed * 1103515245u + 12345u;
+					data[i] = (uint8_t)(seed >> 16);
+				}
+				cairo_surface_mark_dirty(surface);
+
+				want = malloc((size_t)h * stride);
+				memcpy(want, data, (size_t)h * stride);
+				blur_reference(want, w, h, stride, radii[r]);
+
+				barny_blur_surface(surface, radii[r]);
+				cairo_surface_flush(surface);
+				data = cairo_image_surface_get_data(surface);
+				for (i = 0; i < h * stride; i++)
+					if (i % stride < w * 4 && data[i] != want[i])
+						mismatches++;
+
+				free(want);
+				cairo_surface_destroy(surface);
+			}
+		}
+
+		ASSERT_EQ_INT(0, mismatches);
+	}
+
+	TEST("blur leaves a uniform surface unchanged")
+	{
+		cairo_surface_t *surface;
+		cairo_t         *cr;
+		uint8_t         *data;
+		int              stride;
+		int              changed = 0;
+		int              x;
+		int              y;
+
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 53, 29);
+		cr      = cairo_create(surface);
+		cairo_set_source_rgba(cr, 0.2, 0.6, 0.8, 1);
+		cairo_paint(cr);
+		cairo_destroy(cr);
+
+		barny_blur_surface(surface, 30);
+
+		cairo_surface_flush(surface);
+		data   = cairo_image_surface_get_data(surface);
+		stride = cairo_image_surface_get_stride(surface);
+		for (y = 0; y < 29; y++)
+			for (x = 0; x < 53 * 4; x++)
+				if (data[y * stride + x] != data[x])
+					changed++;
+
+		ASSERT_EQ_INT(0, changed);
+		ASSERT_EQ_INT(255, data[3]);
+		cairo_surface_destroy(surface);
+	}
+
+	TEST("pyramid blur keeps small radii at full resolution")
+	{
+		ASSERT_EQ_INT(0, barny_blur_pyramid_levels(2, 2));
+		ASSERT_EQ_INT(0, barny_blur_pyramid_levels(5, 2));
+		ASSERT_TRUE(barny_blur_pyramid_levels(30, 1)
+		            >= barny_blur_pyramid_levels(30, 2));
+		ASSERT_TRUE(barny_blur_pyramid_levels(30, 2)
+		            >= barny_blur_pyramid_levels(30, 3));
+		ASSERT_EQ_INT(4, barny_blur_pyramid_levels(1000, 1));
+		/* out-of-range quality is clamped, not trusted */
+		ASSERT_EQ_INT(barny_blur_pyramid_levels(30, 1),
+		              barny_blur_pyramid_levels(30, -5));
+	}
+
+	/* Smooth content blurred through the pyramid lands within a few levels
+	   of the full-resolution blur; the odd size makes every halving round
+	   up and the upsample stretch by a non-integer factor. */
+	TEST("pyramid blur stays close to the full blur")
+	{
+		cairo_surface_t *full;
+		cairo_surface_t *pyr;
+		uint8_t         *df;
+		uint8_t         *dp;
+		int              stride;
+		int              w = 301;
+		int              h = 157;
+		long             total = 0;
+		int              x;
+		int              y;
+
+		full   = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+		pyr    = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+		cairo_surface_flush(full);
+		cairo_surface_flush(pyr);
+		df     = cairo_image_surface_get_data(full);
+		dp     = cairo_image_surface_get_data(pyr);
+		stride = cairo_image_surface_get_stride(full);
+		for (y = 0; y < h; y++) {
+			for (x = 0; x < w; x++) {
+				uint8_t *p = df + y * stride + x * 4;
+
+				p[0] = (uint8_t)(128 + 100 * sin(x * 0.05));
+				p[1] = (uint8_t)(128 + 100 * cos(y * 0.07));
+				p[2] = (uint8_t)((x + y) / 2);
+				p[3] = 255;
+			}
+		}
+		memcpy(dp, df, (size_t)h * stride);
+		cairo_surface_mark_dirty(full);
+		cairo_surface_mark_dirty(pyr);
+
+		barny_blur_surface(full, 30);
+		barny_blur_surface_pyramid(pyr, 30, 2);
+
+		cairo_surface_flush(full);
+		cairo_surface_flush(pyr);
+		df = cairo_image_surface_get_data(full);
+		dp = cairo_image_surface_get_data(pyr);
+		for (y = 0; y < h; y++)
+			for (x = 0; x < w * 4; x++)
+				total += abs(df[y * stride + x] - dp[y * stride + x]);
+
+		ASSERT_TRUE(total < (long)w * h * 4 * 3);
+		/* opaque stays opaque through both resamples */
+		ASSERT_EQ_INT(255, dp[(h / 2) * stride + (w / 2) * 4 + 3]);
+		cairo_surface_destroy(full);
+		cairo_surface_destroy(pyr);
+	}
+
 	TEST_SUITE_END();
 }
 
@@ -644,6 +842,301 @@ test_file_extension(void)
 	TEST_SUITE_END();
 }
 
+/* A w x h JPEG whose red channel ramps down the rows and green across the
+   columns, so a decoded pixel says where in the file it came from. */
+static const char *
+write_test_jpeg(int w, int h)
+{
+	static char                 path[64];
+	struct jpeg_compress_struct c;
+	struct jpeg_error_mgr       e;
+	FILE                       *f;
+	uint8_t                    *row;
+	JSAMPROW                    rp;
+	int                         x;
+
+	snprintf(path, sizeof(path), "/tmp/barny_test_wp_%d.jpg", getpid());
+	f = fopen(path, "wb");
+	if (!f)
+		return NULL;
+
+	c.err = jpeg_std_error(&e);
+	jpeg_create_compress(&c);
+	jpeg_stdio_dest(&c, f);
+	c.image_width      = w;
+	c.image_height     = h;
+	c.input_components = 3;
+	c.in_color_space   = JCS_RGB;
+	jpeg_set_defaults(&c);
+	jpeg_set_quality(&c, 95, TRUE);
+	jpeg_start_compress(&c, TRUE);
+
+	row = malloc((size_t)w * 3);
+	rp  = row;
+	while ((int)c.next_scanline < h) {
+		for (x = 0; x < w; x++) {
+			row[x * 3 + 0] = (uint8_t)(c.next_scanline * 255 / (h - 1));
+			row[x * 3 + 1] = (uint8_t)(x * 255 / (w - 1));
+			row[x * 3 + 2] = 128;
+		}
+		jpeg_write_scanlines(&c, &rp, 1);
+	}
+	free(row);
+
+	jpeg_finish_compress(&c);
+	jpeg_destroy_compress(&c);
+	fclose(f);
+
+	return path;
+}
+
+void
+test_wallpaper_load(void)
+{
+	TEST_SUITE_BEGIN("Wallpaper Loading");
+
+	TEST("without geometry the JPEG decodes at full size")
+	{
+		const char      *path = write_test_jpeg(640, 400);
+		cairo_surface_t *s;
+
+		ASSERT_NOT_NULL(path);
+		s = barny_load_wallpaper(path, NULL);
+		ASSERT_NOT_NULL(s);
+		ASSERT_EQ_INT(640, cairo_image_surface_get_width(s));
+		ASSERT_EQ_INT(400, cairo_image_surface_get_height(s));
+		cairo_surface_destroy(s);
+		unlink(path);
+	}
+
+	TEST("JPEG decodes at the smallest size covering the output")
+	{
+		const char            *path = write_test_jpeg(1280, 720);
+		barny_wallpaper_geom_t geom = {0};
+		cairo_surface_t       *s;
+
+		geom.min_width  = 300;
+		geom.max_aspect = 720.0 / 1280.0;
+		s               = barny_load_wallpaper(path, &geom);
+		ASSERT_NOT_NULL(s);
+		/* 2/8 gives 320, the first M/8 step not narrower than 300 */
+		ASSERT_EQ_INT(320, cairo_image_surface_get_width(s));
+		ASSERT_EQ_INT(180, cairo_image_surface_get_height(s));
+		ASSERT_IN_RANGE(geom.scale, 0.249, 0.251);
+		cairo_surface_destroy(s);
+		unlink(path);
+	}
+
+	/* a portrait wallpaper under a landscape output: only the band the
+	   bars reach is decoded, taken from the end the bar sits at */
+	TEST("JPEG rows are cut at the bar's edge")
+	{
+		const char            *path = write_test_jpeg(400, 1600);
+		barny_wallpaper_geom_t geom = {0};
+		cairo_surface_t       *s;
+		uint8_t               *d;
+		int                    h;
+
+		geom.min_width  = 400;
+		geom.max_aspect = 0.5;
+		geom.margin     = 20;
+		s               = barny_load_wallpaper(path, &geom);
+		ASSERT_NOT_NULL(s);
+		h = cairo_image_surface_get_height(s);
+		ASSERT_EQ_INT(220, h);
+		cairo_surface_flush(s);
+		d = cairo_image_surface_get_data(s);
+		ASSERT_TRUE(d[2] < 8);
+		ASSERT_EQ_INT(255, d[3]);
+		cairo_surface_destroy(s);
+
+		geom.from_bottom = true;
+		s                = barny_load_wallpaper(path, &geom);
+		ASSERT_NOT_NULL(s);
+		ASSERT_EQ_INT(220, cairo_image_surface_get_height(s));
+		cairo_surface_flush(s);
+		d = cairo_image_surface_get_data(s);
+		/* first kept row is file row 1380 of 1600 */
+		ASSERT_IN_RANGE(d[2], 215, 225);
+		ASSERT_TRUE(d[(h - 1) * cairo_image_surface_get_stride(s) + 2] > 248);
+		cairo_surface_destroy(s);
+		unlink(path);
+	}
+
+	TEST("PNG wallpaper is cropped to the same rows")
+	{
+		char                   path[64];
+		barny_wallpaper_geom_t geom = {0};
+		cairo_surface_t       *src;
+		cairo_surface_t       *s;
+
+		snprintf(path, sizeof(path), "/tmp/barny_test_wp_%d.png", getpid());
+		src = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 200, 500);
+		ASSERT_EQ_INT(CAIRO_STATUS_SUCCESS,
+		              cairo_surface_write_to_png(src, path));
+		cairo_surface_destroy(src);
+
+		geom.min_width  = 200;
+		geom.max_aspect = 0.25;
+		geom.margin     = 10;
+		s               = barny_load_wallpaper(path, &geom);
+		ASSERT_NOT_NULL(s);
+		ASSERT_EQ_INT(200, cairo_image_surface_get_width(s));
+		ASSERT_EQ_INT(60, cairo_image_surface_get_height(s));
+		ASSERT_IN_RANGE(geom.scale, 0.999, 1.001);
+		cairo_surface_destroy(s);
+		unlink(path);
+	}
+
+	TEST_SUITE_END();
+}
+
+static void
+wp_cache_reset(barny_state_t *state)
+{
+	if (state->blurred_wallpaper)
+		cairo_surface_destroy(state->blurred_wallpaper);
+	if (state->displaced_wallpaper)
+		cairo_surface_destroy(state->displaced_wallpaper);
+	if (state->displacement_map)
+		cairo_surface_destroy(state->displacement_map);
+	state->blurred_wallpaper   = NULL;
+	state->displaced_wallpaper = NULL;
+	state->displacement_map    = NULL;
+}
+
+/* cache files in dir, and the name of the last one seen */
+static int
+wp_cache_files(const char *dir, char *name, size_t len)
+{
+	DIR           *d = opendir(dir);
+	struct dirent *e;
+	int            n = 0;
+
+	if (!d)
+		return 0;
+	while ((e = readdir(d))) {
+		if (strncmp(e->d_name, "wallpaper-", 10) != 0)
+			continue;
+		snprintf(name, len, "%s", e->d_name);
+		n++;
+	}
+	closedir(d);
+
+	return n;
+}
+
+void
+test_wallpaper_cache(void)
+{
+	char          root[64];
+	char          dir[96];
+	char          name[64];
+	char          first[64];
+	char          file[192];
+	barny_state_t state;
+	const char   *path;
+	uint8_t      *blurred  = NULL;
+	uint8_t      *displaced = NULL;
+	size_t        size      = 0;
+
+	TEST_SUITE_BEGIN("Wallpaper Cache");
+
+	snprintf(root, sizeof(root), "/tmp/barny_test_cache_%d", getpid());
+	snprintf(dir, sizeof(dir), "%s/barny", root);
+	mkdir(root, 0700);
+	setenv("XDG_CACHE_HOME", root, 1);
+
+	memset(&state, 0, sizeof(state));
+	barny_config_defaults(&state.config);
+	path                       = write_test_jpeg(320, 200);
+	state.config.wallpaper_path = strdup(path);
+	state.config.blur_radius    = 12;
+
+	TEST("cold start computes the pipeline and stores it")
+	{
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.blurred_wallpaper);
+		ASSERT_NOT_NULL(state.displaced_wallpaper);
+		ASSERT_EQ_INT(1, wp_cache_files(dir, first, sizeof(first)));
+
+		cairo_surface_flush(state.blurred_wallpaper);
+		cairo_surface_flush(state.displaced_wallpaper);
+		size = (size_t)cairo_image_surface_get_stride(state.blurred_wallpaper)
+		       * cairo_image_surface_get_height(state.blurred_wallpaper);
+		blurred   = malloc(size);
+		displaced = malloc(size);
+		memcpy(blurred, cairo_image_surface_get_data(state.blurred_wallpaper),
+		       size);
+		memcpy(displaced,
+		       cairo_image_surface_get_data(state.displaced_wallpaper), size);
+		wp_cache_reset(&state);
+	}
+
+	TEST("warm start maps back the same pixels")
+	{
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.blurred_wallpaper);
+		ASSERT_NOT_NULL(state.displaced_wallpaper);
+		/* nothing was recomputed */
+		ASSERT_NULL(state.displacement_map);
+		ASSERT_EQ_INT(0, memcmp(blurred,
+		                        cairo_image_surface_get_data(
+		                                state.blurred_wallpaper),
+		                        size));
+		ASSERT_EQ_INT(0, memcmp(displaced,
+		                        cairo_image_surface_get_data(
+		                                state.displaced_wallpaper),
+		                        size));
+		wp_cache_reset(&state);
+	}
+
+	TEST("a pipeline setting change replaces the cache file")
+	{
+		state.config.brightness = 1.3;
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.displacement_map);
+		ASSERT_EQ_INT(1, wp_cache_files(dir, name, sizeof(name)));
+		ASSERT_TRUE(strcmp(first, name) != 0);
+		wp_cache_reset(&state);
+	}
+
+	TEST("a truncated cache file is discarded and rebuilt")
+	{
+		snprintf(file, sizeof(file), "%s/%s", dir, name);
+		ASSERT_EQ_INT(0, truncate(file, 100));
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.blurred_wallpaper);
+		ASSERT_NOT_NULL(state.displacement_map);
+		wp_cache_reset(&state);
+
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.blurred_wallpaper);
+		ASSERT_NULL(state.displacement_map);
+		wp_cache_reset(&state);
+	}
+
+	TEST("wallpaper_cache = false neither reads nor writes")
+	{
+		unlink(file);
+		state.config.wallpaper_cache = false;
+		barny_wallpaper_prepare(&state);
+		ASSERT_NOT_NULL(state.blurred_wallpaper);
+		ASSERT_EQ_INT(0, wp_cache_files(dir, name, sizeof(name)));
+		wp_cache_reset(&state);
+	}
+
+	free(blurred);
+	free(displaced);
+	unlink(path);
+	rmdir(dir);
+	rmdir(root);
+	unsetenv("XDG_CACHE_HOME");
+	barny_config_cleanup(&state.config);
+
+	TEST_SUITE_END();
+}
+
 #define LENS_BAR_W  800
 #define LENS_BAR_H  47
 #define LENS_PAD_L  8
@@ -812,3 +1305,221 @@ test_lens_partial_redraw(void)
 
 	TEST_SUITE_END();
 }
+
+/* largest per-channel difference between two same-sized surfaces */
+static int
+lens_maxdiff(cairo_surface_t *a, cairo_surface_t *b)
+{
+	int      h      = cairo_image_surface_get_height(a);
+	int      stride = cairo_image_surface_get_stride(a);
+	uint8_t *da;
+	uint8_t *db;
+	int      i;
+	int      m = 0;
+
+	cairo_surface_flush(a);
+	cairo_surface_flush(b);
+	da = cairo_image_surface_get_data(a);
+	db = cairo_image_surface_get_data(b);
+
+	for (i = 0; i < h * stride; i++) {
+		int d = abs(da[i] - db[i]);
+
+		if (d > m)
+			m = d;
+	}
+
+	return m;
+}
+
+/* The vector kernels compute in float and as masks where the scalar loop
+   branches in double, so they may round a level away from it -- but never
+   more than that, anywhere on the droplet. Positions cover the authoritative
+   stretch, the corner overlay zones and a stretched (moving) droplet. */
+void
+test_lens_simd_matches_scalar(void)
+{
+	static const double  xs[] = {40.0, 120.0, 300.0, 411.3, 690.0, 790.0};
+	barny_state_t        state;
+	barny_output_t       out;
+	barny_lens_kernel_fn kernels[3];
+	const char          *names[3];
+	int                  nk = 0;
+	int                  worst[3];
+	int                  k;
+	size_t               i;
+	int                  v;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.1")) {
+		names[nk]     = "sse4.1 kernel within 2 levels of scalar";
+		kernels[nk++] = barny_lens_shade_sse41;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		names[nk]     = "avx2 kernel within 2 levels of scalar";
+		kernels[nk++] = barny_lens_shade_avx2;
+	}
+#elif defined(__aarch64__)
+	names[nk]     = "neon kernel within 2 levels of scalar";
+	kernels[nk++] = barny_lens_shade_neon;
+#endif
+
+	TEST_SUITE_BEGIN("Lens SIMD Kernels");
+
+	lens_setup(&state, &out);
+
+	for (k = 0; k < nk; k++)
+		worst[k] = 0;
+
+	for (i = 0; i < sizeof(xs) / sizeof(xs[0]); i++) {
+		for (v = 0; v < 2; v++) {
+			cairo_surface_t *ref = lens_target(&out);
+
+			state.lens_vx     = v ? 400.0 : 0.0;
+			lens_kernel       = NULL;
+			lens_kernel_ready = true;
+			lens_draw(&out, ref, xs[i], NULL);
+
+			for (k = 0; k < nk; k++) {
+				cairo_surface_t *vec = lens_target(&out);
+				int              d;
+
+				lens_kernel = kernels[k];
+				lens_draw(&out, vec, xs[i], NULL);
+				d = lens_maxdiff(ref, vec);
+				if (d > worst[k])
+					worst[k] = d;
+				cairo_surface_destroy(vec);
+			}
+			cairo_surface_destroy(ref);
+		}
+	}
+
+	/* back to cpuid dispatch for whatever runs next */
+	lens_kernel_ready = false;
+	state.lens_vx     = 0.0;
+
+	if (nk == 0)
+		printf("  (no vector kernel on this CPU; scalar path only)\n");
+
+	for (k = 0; k < nk; k++) {
+		TEST(names[k])
+		{
+			ASSERT_IN_RANGE(worst[k], 0, 2);
+		}
+	}
+
+	barny_output_free_lens_cache(&out);
+	if (out.bg_cache)
+		cairo_surface_destroy(out.bg_cache);
+	if (out.lens_map)
+		cairo_surface_destroy(out.lens_map);
+	if (out.shadow_cache)
+		cairo_surface_destroy(out.shadow_cache);
+	if (out.glass_clean)
+		cairo_surface_destroy(out.glass_clean);
+
+	TEST_SUITE_END();
+}
+
+typedef struct {
+	int hits[256];
+} pool_rows_t;
+
+static void
+pool_mark_rows(void *ctx, int y0, int y1)
+{
+	pool_rows_t *r = ctx;
+	int          y;
+
+	for (y = y0; y < y1; y++)
+		__atomic_fetch_add(&r->hits[y], 1, __ATOMIC_RELAXED);
+}
+
+/* The droplet is drawn in row bands by the render pool. Every row must be
+   drawn exactly once per job, across back-to-back jobs (the frame loop runs
+   two per patch), and the banded droplet must match the inline one exactly:
+   each band runs the same kernels over the same rows. */
+void
+test_render_pool(void)
+{
+	barny_state_t    state;
+	barny_output_t   out;
+	barny_pool_t    *pool;
+	pool_rows_t      rows;
+	cairo_surface_t *inl;
+	cairo_surface_t *banded;
+	int              job;
+	int              y;
+	int              bad;
+
+	TEST_SUITE_BEGIN("Render Pool");
+
+	TEST("zero threads keeps the inline path")
+	{
+		ASSERT_NULL(barny_pool_create(0));
+	}
+
+	pool = barny_pool_create(3);
+
+	TEST("pool starts")
+	{
+		ASSERT_NOT_NULL(pool);
+	}
+
+	TEST("every row drawn exactly once, job after job")
+	{
+		bad = 0;
+		for (job = 0; job < 200; job++) {
+			int n = 1 + job % 256;
+
+			memset(&rows, 0, sizeof(rows));
+			barny_pool_run(pool, pool_mark_rows, &rows, n);
+			for (y = 0; y < 256; y++)
+				if (rows.hits[y] != (y < n ? 1 : 0))
+					bad++;
+		}
+		ASSERT_EQ_INT(0, bad);
+	}
+
+	TEST("NULL pool runs the whole range on the caller")
+	{
+		memset(&rows, 0, sizeof(rows));
+		barny_pool_run(NULL, pool_mark_rows, &rows, 59);
+		bad = 0;
+		for (y = 0; y < 256; y++)
+			if (rows.hits[y] != (y < 59 ? 1 : 0))
+				bad++;
+		ASSERT_EQ_INT(0, bad);
+	}
+
+	lens_setup(&state, &out);
+	inl    = lens_target(&out);
+	banded = lens_target(&out);
+
+	lens_draw(&out, inl, 300.0, NULL);
+	state.render_pool = pool;
+	lens_draw(&out, banded, 300.0, NULL);
+	state.render_pool = NULL;
+
+	TEST("banded droplet matches the inline one byte for byte")
+	{
+		ASSERT_EQ_INT(0, lens_diff(inl, banded));
+	}
+
+	cairo_surface_destroy(inl);
+	cairo_surface_destroy(banded);
+	barny_pool_destroy(pool);
+	barny_output_free_lens_cache(&out);
+	if (out.bg_cache)
+		cairo_surface_destroy(out.bg_cache);
+	if (out.lens_map)
+		cairo_surface_destroy(out.lens_map);
+	if (out.shadow_cache)
+		cairo_surface_destroy(out.shadow_cache);
+	if (out.glass_clean)
+		cairo_surface_destroy(out.glass_clean);
+
+	TEST_SUITE_END();
+}
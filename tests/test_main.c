@@ -24,7 +24,21 @@ test_apply_displacement(void);
 extern void
 test_file_extension(void);
 extern void
+test_wallpaper_load(void);
+extern void
+test_wallpaper_cache(void);
+extern void
 test_lens_partial_redraw(void);
+extern void
+test_lens_simd_matches_scalar(void);
+extern void
+test_render_pool(void);
+extern void
+test_buffer_pool(void);
+extern void
+test_shm_arena(void);
+extern void
+test_icon_cache(void);
 
 extern void
 test_module_register(void);
@@ -37,6 +51,18 @@ test_module_positions(void);
 extern void
 test_module_data(void);
 extern void
+test_module_sched(void);
+extern void
+test_module_executor(void);
+extern void
+test_helper_feeds(void);
+extern void
+test_sysfs_reader(void);
+extern void
+test_uevent_socket(void);
+extern void
+test_json_extractor(void);
+extern void
 test_module_layout_basics(void);
 extern void
 test_module_layout_parsing_and_ops(void);
@@ -84,7 +110,14 @@ RUN_SUITE(test_blur_surface);
 RUN_SUITE(test_brightness);
 RUN_SUITE(test_apply_displacement);
 RUN_SUITE(test_file_extension);
+RUN_SUITE(test_wallpaper_load);
+RUN_SUITE(test_wallpaper_cache);
 RUN_SUITE(test_lens_partial_redraw);
+RUN_SUITE(test_lens_simd_matches_scalar);
+RUN_SUITE(test_render_pool);
+RUN_SUITE(test_buffer_pool);
+RUN_SUITE(test_shm_arena);
+RUN_SUITE(test_icon_cache);
 
 printf("\n--- Module System Tests ---\n");
 RUN_SUITE(test_module_register);
@@ -92,6 +125,12 @@ RUN_SUITE(test_module_lifecycle);
 RUN_SUITE(test_module_factories);
 RUN_SUITE(test_module_positions);
 RUN_SUITE(test_module_data);
+RUN_SUITE(test_module_sched);
+RUN_SUITE(test_module_executor);
+RUN_SUITE(test_helper_feeds);
+RUN_SUITE(test_sysfs_reader);
+RUN_SUITE(test_uevent_socket);
+RUN_SUITE(test_json_extractor);
 RUN_SUITE(test_module_layout_basics);
 RUN_SUITE(test_module_layout_parsing_and_ops);
 RUN_SUITE(test_module_layout_runtime_apply);
@@ -1,6 +1,22 @@
 #include "test_framework.h"
 #include "barny.h"
+#include "barny_feed.h"
+#include "barny_json.h"
+#include "barny_sysfs.h"
+#include "util.h"
+#include "src/modules/helpers/common/helper_feed.h"
+#include "src/modules/uevent.h"
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/netlink.h>
 
 static int mock_init_called    = 0;
 static int mock_destroy_called = 0;
@@ -481,3 +497,889 @@ test_module_data(void)
 
 	TEST_SUITE_END();
 }
+
+static int one_shot_fired = 0;
+
+/* re-arms itself once, the way a retry backs off */
+static void
+one_shot_fire(barny_state_t *state)
+{
+	if (one_shot_fired++ == 0)
+		barny_sched_after(state, 2000, one_shot_fire);
+}
+
+/* Times here are made up wall-clock milliseconds; only the arithmetic of the
+   heap is under test, the timerfd never gets involved. */
+void
+test_module_sched(void)
+{
+	TEST_SUITE_BEGIN("Module Scheduler");
+
+	TEST("deadlines land on the next boundary of each interval")
+	{
+		barny_state_t   state;
+		barny_module_t *fast;
+		barny_module_t *slow;
+		barny_module_t *event;
+
+		state                    = (barny_state_t){ 0 };
+		fast                     = create_mock_module("fast", BARNY_POS_LEFT);
+		slow                     = create_mock_module("slow", BARNY_POS_LEFT);
+		event                    = create_mock_module("event", BARNY_POS_LEFT);
+		fast->update_interval_ms = 1000;
+		slow->update_interval_ms = 5000;
+
+		barny_module_register(&state, fast);
+		barny_module_register(&state, slow);
+		barny_module_register(&state, event);
+		barny_sched_reset(&state, 12345);
+
+		ASSERT_EQ_INT(2, state.deadline_count);
+		ASSERT_EQ_INT(13000, (int)state.deadlines[0].due_ms);
+		ASSERT_TRUE(state.deadlines[0].mod == fast);
+		ASSERT_EQ_INT(15000, (int)state.deadlines[1].due_ms);
+
+		free(fast);
+		free(slow);
+		free(event);
+	}
+
+	TEST("only what is due runs, and modules on a shared boundary share it")
+	{
+		barny_state_t   state;
+		barny_module_t *fast;
+		barny_module_t *slow;
+
+		reset_mock_counters();
+		state                    = (barny_state_t){ 0 };
+		fast                     = create_mock_module("fast", BARNY_POS_LEFT);
+		slow                     = create_mock_module("slow", BARNY_POS_LEFT);
+		fast->update_interval_ms = 1000;
+		slow->update_interval_ms = 5000;
+
+		barny_module_register(&state, fast);
+		barny_module_register(&state, slow);
+		barny_sched_reset(&state, 12345);
+
+		ASSERT_EQ_INT(13000, (int)barny_sched_run(&state, 12999));
+		ASSERT_EQ_INT(0, mock_update_called);
+
+		ASSERT_EQ_INT(14000, (int)barny_sched_run(&state, 13000));
+		ASSERT_EQ_INT(1, mock_update_called);
+
+		barny_sched_run(&state, 14000);
+		ASSERT_EQ_INT(16000, (int)barny_sched_run(&state, 15000));
+		ASSERT_EQ_INT(4, mock_update_called);
+		ASSERT_EQ_INT(16000, (int)state.deadlines[0].due_ms);
+
+		free(fast);
+		free(slow);
+	}
+
+	TEST("a late wakeup runs a module once and realigns it")
+	{
+		barny_state_t   state;
+		barny_module_t *fast;
+
+		reset_mock_counters();
+		state                    = (barny_state_t){ 0 };
+		fast                     = create_mock_module("fast", BARNY_POS_LEFT);
+		fast->update_interval_ms = 1000;
+
+		barny_module_register(&state, fast);
+		barny_sched_reset(&state, 0);
+
+		ASSERT_EQ_INT(8000, (int)barny_sched_run(&state, 7400));
+		ASSERT_EQ_INT(1, mock_update_called);
+
+		free(fast);
+	}
+
+	TEST("nothing periodic means nothing to wake up for")
+	{
+		barny_state_t   state;
+		barny_module_t *event;
+
+		reset_mock_counters();
+		state = (barny_state_t){ 0 };
+		event = create_mock_module("event", BARNY_POS_LEFT);
+
+		barny_module_register(&state, event);
+		barny_sched_reset(&state, 12345);
+
+		ASSERT_EQ_INT(0, state.deadline_count);
+		ASSERT_EQ_INT(0, (int)barny_sched_run(&state, 99999));
+		ASSERT_EQ_INT(0, mock_update_called);
+
+		free(event);
+	}
+
+	TEST("a module that drops its interval leaves the schedule")
+	{
+		barny_state_t   state;
+		barny_module_t *fast;
+
+		state                    = (barny_state_t){ 0 };
+		fast                     = create_mock_module("fast", BARNY_POS_LEFT);
+		fast->update_interval_ms = 1000;
+
+		barny_module_register(&state, fast);
+		barny_sched_reset(&state, 0);
+		fast->update_interval_ms = 0;
+
+		ASSERT_EQ_INT(0, (int)barny_sched_run(&state, 1000));
+		ASSERT_EQ_INT(0, state.deadline_count);
+
+		free(fast);
+	}
+
+	TEST("a one-shot runs once, survives a reset and can re-arm itself")
+	{
+		barny_state_t   state;
+		barny_module_t *fast;
+		uint64_t        due;
+
+		reset_mock_counters();
+		one_shot_fired           = 0;
+		state                    = (barny_state_t){ .timer_fd = -1 };
+		fast                     = create_mock_module("fast", BARNY_POS_LEFT);
+		fast->update_interval_ms = 1000;
+
+		/* one-shots are due on the real clock, far past these times */
+		barny_module_register(&state, fast);
+		ASSERT_EQ_INT(0, barny_sched_after(&state, 1000, one_shot_fire));
+		barny_sched_reset(&state, 0);
+		ASSERT_EQ_INT(2, state.deadline_count);
+
+		ASSERT_EQ_INT(2000, (int)barny_sched_run(&state, 1000));
+		ASSERT_EQ_INT(0, one_shot_fired);
+
+		due = state.deadlines[1].due_ms;
+		barny_sched_run(&state, due);
+		ASSERT_EQ_INT(1, one_shot_fired);
+		ASSERT_EQ_INT(2, state.deadline_count);
+
+		barny_sched_run(&state, due + 60000);
+		ASSERT_EQ_INT(2, one_shot_fired);
+		ASSERT_EQ_INT(1, state.deadline_count);
+		ASSERT_TRUE(state.deadlines[0].mod == fast);
+
+		free(fast);
+	}
+
+	TEST_SUITE_END();
+}
+
+static pthread_t collect_thread;
+static pthread_t publish_thread;
+static sem_t     collect_gate;
+static int       collect_calls;
+static int       collect_started;
+
+static void
+gated_collect(barny_module_t *self)
+{
+	(void)self;
+	collect_thread = pthread_self();
+	__atomic_add_fetch(&collect_started, 1, __ATOMIC_SEQ_CST);
+	sem_wait(&collect_gate);
+	collect_calls++;
+}
+
+static void
+record_publish(barny_module_t *self)
+{
+	publish_thread = pthread_self();
+	self->dirty    = true;
+}
+
+static bool
+wait_collected(barny_executor_t *ex)
+{
+	struct pollfd pfd = { .fd = barny_executor_fd(ex), .events = POLLIN };
+
+	return poll(&pfd, 1, 2000) == 1;
+}
+
+void
+test_module_executor(void)
+{
+	TEST_SUITE_BEGIN("Module Executor");
+
+	TEST("collect runs on a worker and update back on the caller")
+	{
+		barny_state_t   state;
+		barny_module_t *mod;
+
+		sem_init(&collect_gate, 0, 1);
+		collect_calls  = 0;
+		state          = (barny_state_t){ 0 };
+		state.executor = barny_executor_create(1);
+		mod            = create_mock_module("slow", BARNY_POS_RIGHT);
+		mod->collect   = gated_collect;
+		mod->update    = record_publish;
+
+		ASSERT_NOT_NULL(state.executor);
+		barny_module_refresh(&state, mod);
+		ASSERT_TRUE(mod->collecting);
+		ASSERT_FALSE(mod->dirty);
+
+		ASSERT_TRUE(wait_collected(state.executor));
+		ASSERT_EQ_INT(1, barny_executor_dispatch(state.executor));
+		ASSERT_EQ_INT(1, collect_calls);
+		ASSERT_FALSE(mod->collecting);
+		ASSERT_TRUE(mod->dirty);
+		ASSERT_FALSE(pthread_equal(collect_thread, pthread_self()));
+		ASSERT_TRUE(pthread_equal(publish_thread, pthread_self()));
+
+		barny_executor_destroy(state.executor);
+		sem_destroy(&collect_gate);
+		free(mod);
+	}
+
+	TEST("a module still collecting is not queued again")
+	{
+		barny_executor_t *ex;
+		barny_module_t   *mod;
+
+		sem_init(&collect_gate, 0, 0);
+		collect_calls = 0;
+		ex            = barny_executor_create(2);
+		mod           = create_mock_module("stuck", BARNY_POS_RIGHT);
+		mod->collect  = gated_collect;
+		mod->update   = record_publish;
+
+		ASSERT_TRUE(barny_executor_submit(ex, mod));
+		ASSERT_FALSE(barny_executor_submit(ex, mod));
+
+		sem_post(&collect_gate);
+		ASSERT_TRUE(wait_collected(ex));
+		ASSERT_EQ_INT(1, barny_executor_dispatch(ex));
+		ASSERT_EQ_INT(1, collect_calls);
+		ASSERT_TRUE(barny_executor_submit(ex, mod));
+
+		sem_post(&collect_gate);
+		barny_executor_destroy(ex);
+		sem_destroy(&collect_gate);
+		free(mod);
+	}
+
+	TEST("a hung collector does not hold up destroy")
+	{
+		barny_executor_t *ex;
+		barny_module_t   *mod;
+		uint64_t          t0;
+
+		sem_init(&collect_gate, 0, 0);
+		collect_calls   = 0;
+		collect_started = 0;
+		ex              = barny_executor_create(1);
+		mod             = create_mock_module("nfs", BARNY_POS_RIGHT);
+		mod->collect    = gated_collect;
+		mod->update     = record_publish;
+
+		ASSERT_TRUE(barny_executor_submit(ex, mod));
+		while (__atomic_load_n(&collect_started, __ATOMIC_SEQ_CST) == 0)
+			usleep(1000);
+		t0 = barny_now_us();
+		ASSERT_FALSE(barny_executor_destroy(ex));
+		ASSERT_TRUE(barny_now_us() - t0 < 2000000);
+
+		/* let the abandoned worker finish before its module goes */
+		sem_post(&collect_gate);
+		while (__atomic_load_n(&collect_calls, __ATOMIC_SEQ_CST) == 0)
+			usleep(1000);
+		usleep(10000);
+		sem_destroy(&collect_gate);
+		free(mod);
+	}
+
+	TEST("without an executor both halves run inline")
+	{
+		barny_state_t   state;
+		barny_module_t *mod;
+
+		sem_init(&collect_gate, 0, 1);
+		collect_calls = 0;
+		state         = (barny_state_t){ 0 };
+		mod           = create_mock_module("inline", BARNY_POS_RIGHT);
+		mod->collect  = gated_collect;
+		mod->update   = record_publish;
+
+		barny_module_refresh(&state, mod);
+		ASSERT_EQ_INT(1, collect_calls);
+		ASSERT_TRUE(mod->dirty);
+		ASSERT_FALSE(mod->collecting);
+
+		sem_destroy(&collect_gate);
+		free(mod);
+	}
+
+	TEST_SUITE_END();
+}
+
+/* Both ends of a feed in one process: the helper side writes through the
+   real shm record and socket, with names unique to this run so a bar on the
+   same machine is not disturbed. */
+static char feed_dir[64];
+
+static void
+feed_env_setup(void)
+{
+	char sock[64];
+
+	snprintf(feed_dir, sizeof(feed_dir), "/tmp/barny-feed-test-XXXXXX");
+	if (!mkdtemp(feed_dir))
+		feed_dir[0] = '\0';
+	snprintf(sock, sizeof(sock), "barny-feed-test-%d", (int)getpid());
+	setenv("BARNY_FEED_DIR", feed_dir, 1);
+	setenv("BARNY_FEED_SOCKET", sock, 1);
+}
+
+static void
+feed_env_remove(const char *name)
+{
+	char path[256];
+
+	barny_feed_shm_name(path, sizeof(path), name);
+	shm_unlink(path);
+	barny_feed_file_path(path, sizeof(path), name);
+	unlink(path);
+}
+
+static bool
+wait_feed(barny_state_t *state)
+{
+	struct pollfd pfd = { .fd = state->feed_fd, .events = POLLIN };
+
+	return poll(&pfd, 1, 2000) == 1;
+}
+
+void
+test_helper_feeds(void)
+{
+	TEST_SUITE_BEGIN("Helper Feeds");
+
+	feed_env_setup();
+
+	TEST("published text reads back from shm, and the file on request")
+	{
+		helper_feed_t *helper;
+		barny_feed_t  *feed;
+		char           name[BARNY_FEED_NAME_MAX];
+		char           buf[64];
+		char           path[256];
+		FILE          *f;
+
+		snprintf(name, sizeof(name), "test-freq-%d", (int)getpid());
+		helper = helper_feed_open(name);
+		feed   = barny_feed_open(NULL, name, NULL);
+		ASSERT_NOT_NULL(helper);
+		ASSERT_NOT_NULL(feed);
+
+		/* created but never written: nothing to read anywhere */
+		ASSERT_EQ_INT(-1, barny_feed_read(feed, buf, sizeof(buf)));
+
+		ASSERT_TRUE(helper_feed_publish(helper, "3.20\n"));
+		ASSERT_EQ_INT(5, barny_feed_read(feed, buf, sizeof(buf)));
+		ASSERT_EQ_STR("3.20\n", buf);
+
+		/* the record is enough; no file unless asked for */
+		barny_feed_file_path(path, sizeof(path), name);
+		ASSERT_EQ_INT(-1, access(path, F_OK));
+
+		helper_feed_set_files(true);
+		ASSERT_FALSE(helper_feed_publish(helper, "3.20\n"));
+		ASSERT_TRUE(helper_feed_publish(helper, "1.10\n"));
+		ASSERT_EQ_INT(5, barny_feed_read(feed, buf, sizeof(buf)));
+		ASSERT_EQ_STR("1.10\n", buf);
+
+		/* for scripts */
+		f = fopen(path, "r");
+		ASSERT_NOT_NULL(f);
+		if (f) {
+			ASSERT_NOT_NULL(fgets(buf, sizeof(buf), f));
+			ASSERT_EQ_STR("1.10\n", buf);
+			fclose(f);
+		}
+		helper_feed_set_files(false);
+
+		barny_feed_close(feed);
+		helper_feed_close(helper);
+		feed_env_remove(name);
+	}
+
+	TEST("a file without a record is read as before")
+	{
+		barny_feed_t *feed;
+		char          name[BARNY_FEED_NAME_MAX];
+		char          buf[64];
+		char          path[256];
+		FILE         *f;
+
+		snprintf(name, sizeof(name), "test-script-%d", (int)getpid());
+		barny_feed_file_path(path, sizeof(path), name);
+		f = fopen(path, "w");
+		ASSERT_NOT_NULL(f);
+		fputs("42.0\n", f);
+		fclose(f);
+
+		feed = barny_feed_open(NULL, name, NULL);
+		ASSERT_EQ_INT(5, barny_feed_read(feed, buf, sizeof(buf)));
+		ASSERT_EQ_STR("42.0\n", buf);
+
+		barny_feed_close(feed);
+		feed_env_remove(name);
+	}
+
+	TEST("a ping refreshes the owning module once")
+	{
+		barny_state_t   state;
+		barny_module_t *mod;
+		helper_feed_t  *a;
+		helper_feed_t  *b;
+		barny_feed_t   *fa;
+		barny_feed_t   *fb;
+		char            name_a[BARNY_FEED_NAME_MAX];
+		char            name_b[BARNY_FEED_NAME_MAX];
+
+		state = (barny_state_t){ 0 };
+		ASSERT_EQ_INT(0, barny_feed_listen(&state));
+
+		snprintf(name_a, sizeof(name_a), "test-btc-%d", (int)getpid());
+		snprintf(name_b, sizeof(name_b), "test-eth-%d", (int)getpid());
+		mod = create_mock_module("crypto", BARNY_POS_RIGHT);
+		fa  = barny_feed_open(&state, name_a, mod);
+		fb  = barny_feed_open(&state, name_b, mod);
+		a   = helper_feed_open(name_a);
+		b   = helper_feed_open(name_b);
+
+		mock_update_called = 0;
+		ASSERT_TRUE(helper_feed_publish(a, "60000\n"));
+		ASSERT_TRUE(helper_feed_publish(b, "3000\n"));
+		ASSERT_TRUE(wait_feed(&state));
+		usleep(10000);
+		barny_feed_dispatch(&state);
+		ASSERT_EQ_INT(1, mock_update_called);
+
+		barny_feed_close(fa);
+		barny_feed_close(fb);
+		ASSERT_NULL(state.feeds);
+		helper_feed_close(a);
+		helper_feed_close(b);
+		feed_env_remove(name_a);
+		feed_env_remove(name_b);
+		barny_feed_cleanup(&state);
+		free(mod);
+	}
+
+	TEST("a record read over a bound socket needs no poll")
+	{
+		barny_state_t  state;
+		helper_feed_t *helper;
+		barny_feed_t  *bound;
+		barny_feed_t  *unbound;
+		char           name[BARNY_FEED_NAME_MAX];
+		char           buf[64];
+
+		state = (barny_state_t){ 0 };
+		ASSERT_EQ_INT(0, barny_feed_listen(&state));
+
+		snprintf(name, sizeof(name), "test-live-%d", (int)getpid());
+		bound = barny_feed_open(&state, name, NULL);
+		ASSERT_FALSE(barny_feed_live(bound));
+
+		/* the helper starts after the bar; its first ping maps it */
+		helper = helper_feed_open(name);
+		ASSERT_TRUE(helper_feed_publish(helper, "7\n"));
+		ASSERT_TRUE(wait_feed(&state));
+		barny_feed_dispatch(&state);
+		ASSERT_EQ_INT(2, barny_feed_read(bound, buf, sizeof(buf)));
+		ASSERT_TRUE(barny_feed_live(bound));
+
+		/* no socket: nothing would ping it */
+		unbound = barny_feed_open(NULL, name, NULL);
+		ASSERT_EQ_INT(2, barny_feed_read(unbound, buf, sizeof(buf)));
+		ASSERT_FALSE(barny_feed_live(unbound));
+
+		barny_feed_close(unbound);
+		barny_feed_close(bound);
+		helper_feed_close(helper);
+		feed_env_remove(name);
+		barny_feed_cleanup(&state);
+	}
+
+	rmdir(feed_dir);
+	unsetenv("BARNY_FEED_DIR");
+	unsetenv("BARNY_FEED_SOCKET");
+
+	TEST_SUITE_END();
+}
+
+static void
+write_text(const char *path, const char *text)
+{
+	FILE *f = fopen(path, "w");
+
+	if (f) {
+		fputs(text, f);
+		fclose(f);
+	}
+}
+
+void
+test_sysfs_reader(void)
+{
+	TEST_SUITE_BEGIN("Sysfs Reader");
+
+	TEST("integer and decimal scanners stop after the number")
+	{
+		long long          ll  = 0;
+		unsigned long long ull = 0;
+		double             d   = 0.0;
+		const char        *p;
+
+		p = barny_scan_ll("  -42000\n", &ll);
+		ASSERT_NOT_NULL(p);
+		ASSERT_EQ_INT(-42000, (int)ll);
+		ASSERT_EQ_INT('\n', *p);
+
+		ASSERT_NOT_NULL(barny_scan_ull("18446744073709551615", &ull));
+		ASSERT_TRUE(ull == 18446744073709551615ULL);
+
+		p = barny_scan_double("0.52 0.58 0.59 1/389 12345\n", &d);
+		ASSERT_NOT_NULL(p);
+		ASSERT_TRUE(fabs(d - 0.52) < 1e-9);
+		p = barny_scan_double(p, &d);
+		ASSERT_TRUE(fabs(d - 0.58) < 1e-9);
+
+		ll = 7;
+		ASSERT_NULL(barny_scan_ll("abc", &ll));
+		ASSERT_NULL(barny_scan_ll("-", &ll));
+		ASSERT_EQ_INT(7, (int)ll);
+	}
+
+	TEST("field scanner matches whole keys at line starts")
+	{
+		const char *meminfo = "MemTotal:       16314040 kB\n"
+		                      "MemFree:         1234567 kB\n"
+		                      "MemAvailable:    9876543 kB\n"
+		                      "Cached:          4000000 kB\n"
+		                      "SwapCached:            0 kB\n";
+		const char *uevent  = "POWER_SUPPLY_NAME=BAT0\n"
+		                      "POWER_SUPPLY_STATUS=Discharging\n"
+		                      "POWER_SUPPLY_CAPACITY=87\n";
+		unsigned long long kb = 0;
+		char               status[16];
+
+		ASSERT_NOT_NULL(
+		        barny_scan_ull(barny_scan_field(meminfo, "MemAvailable:"),
+		                       &kb));
+		ASSERT_TRUE(kb == 9876543ULL);
+		ASSERT_NOT_NULL(
+		        barny_scan_ull(barny_scan_field(meminfo, "Cached:"), &kb));
+		ASSERT_TRUE(kb == 4000000ULL);
+		ASSERT_NULL(barny_scan_field(meminfo, "Buffers:"));
+
+		ASSERT_TRUE(barny_scan_field_str(uevent, "POWER_SUPPLY_STATUS=",
+		                                 status, sizeof(status)));
+		ASSERT_EQ_STR("Discharging", status);
+		ASSERT_TRUE(barny_scan_field_str(uevent, "POWER_SUPPLY_STATUS=",
+		                                 status, 5));
+		ASSERT_EQ_STR("Disc", status);
+	}
+
+	TEST("a cached file keeps its fd and sees rewrites")
+	{
+		barny_sysfs_file_t file;
+		char               path[] = "/tmp/barny-sysfs-test-XXXXXX";
+		long long          v      = 0;
+		int                fd;
+		int                first_fd;
+
+		fd = mkstemp(path);
+		ASSERT_TRUE(fd >= 0);
+		close(fd);
+
+		write_text(path, "1200000\n");
+		barny_sysfs_init(&file, "%s", path);
+		ASSERT_EQ_INT(-1, file.fd);
+		ASSERT_TRUE(barny_sysfs_read_ll(&file, &v));
+		ASSERT_EQ_INT(1200000, (int)v);
+		first_fd = file.fd;
+		ASSERT_TRUE(first_fd >= 0);
+
+		/* truncated in place, like an attribute regenerating */
+		write_text(path, "800000\n");
+		ASSERT_TRUE(barny_sysfs_read_ll(&file, &v));
+		ASSERT_EQ_INT(800000, (int)v);
+		ASSERT_EQ_INT(first_fd, file.fd);
+
+		barny_sysfs_close(&file);
+		ASSERT_EQ_INT(-1, file.fd);
+		unlink(path);
+	}
+
+	TEST("a missing file fails until it appears")
+	{
+		barny_sysfs_file_t file;
+		char               path[64];
+		char               buf[32];
+
+		snprintf(path, sizeof(path), "/tmp/barny-sysfs-missing-%d",
+		         (int)getpid());
+		unlink(path);
+
+		barny_sysfs_init(&file, "%s", path);
+		ASSERT_EQ_INT(-1, (int)barny_sysfs_read(&file, buf, sizeof(buf)));
+		ASSERT_EQ_STR("", buf);
+
+		write_text(path, "up\n");
+		ASSERT_EQ_INT(3, (int)barny_sysfs_read(&file, buf, sizeof(buf)));
+		ASSERT_EQ_STR("up\n", buf);
+
+		barny_sysfs_close(&file);
+		unlink(path);
+	}
+
+	TEST("procfs regenerates on every pread")
+	{
+		barny_sysfs_file_t file;
+		char               buf[128];
+		const char        *p = buf;
+		double             load;
+		int                i;
+
+		barny_sysfs_init(&file, "/proc/loadavg");
+		for (i = 0; i < 2; i++) {
+			ASSERT_TRUE(barny_sysfs_read(&file, buf, sizeof(buf)) > 0);
+			p = barny_scan_double(buf, &load);
+			ASSERT_NOT_NULL(p);
+			ASSERT_NOT_NULL(barny_scan_double(p, &load));
+		}
+		barny_sysfs_close(&file);
+	}
+
+	TEST_SUITE_END();
+}
+
+void
+test_uevent_socket(void)
+{
+	TEST_SUITE_BEGIN("Uevent Socket");
+
+	TEST("uevent payload splits into header and variables")
+	{
+		static const char raw[]
+		        = "change@/devices/LNXSYSTM:00/PNP0C0A:00/power_supply/BAT0\0"
+		          "ACTION=change\0"
+		          "SUBSYSTEM=power_supply\0"
+		          "POWER_SUPPLY_NAME=BAT0\0"
+		          "POWER_SUPPLY_STATUS=Not charging\0"
+		          "POWER_SUPPLY_CAPACITY=80";
+		char           buf[sizeof(raw) + 1];
+		barny_uevent_t ev;
+
+		memcpy(buf, raw, sizeof(raw));
+		ASSERT_TRUE(barny_uevent_parse(buf, sizeof(raw) - 1, &ev));
+		ASSERT_EQ_STR("change", ev.action);
+		ASSERT_EQ_STR("/devices/LNXSYSTM:00/PNP0C0A:00/power_supply/BAT0",
+		              ev.devpath);
+		ASSERT_EQ_STR("power_supply", ev.subsystem);
+		ASSERT_EQ_STR("Not charging",
+		              barny_uevent_get(&ev, "POWER_SUPPLY_STATUS"));
+		/* the last variable has no NUL of its own */
+		ASSERT_EQ_STR("80", barny_uevent_get(&ev, "POWER_SUPPLY_CAPACITY"));
+		/* keys match whole, not by prefix */
+		ASSERT_NULL(barny_uevent_get(&ev, "POWER_SUPPLY"));
+
+		memcpy(buf, "libudev\0\xfe\xed", 10);
+		ASSERT_FALSE(barny_uevent_parse(buf, 10, &ev));
+	}
+
+	TEST("the socket filter drops other subsystems in the kernel")
+	{
+		/* LNXSYSTM is a near miss for the filter's word compares */
+		static const char  ac[]  = "change@/devices/LNXSYSTM:00/ACPI0003:00/"
+		                           "power_supply/AC\0"
+		                           "ACTION=change\0"
+		                           "DEVPATH=/devices/LNXSYSTM:00/ACPI0003:00/"
+		                           "power_supply/AC\0"
+		                           "SUBSYSTEM=power_supply\0"
+		                           "POWER_SUPPLY_ONLINE=1";
+		static const char  mem[] = "change@/devices/virtual/mem/null\0"
+		                           "ACTION=change\0"
+		                           "DEVPATH=/devices/virtual/mem/null\0"
+		                           "SUBSYSTEM=mem\0"
+		                           "DEVNAME=null";
+		/* the subsystem name is matched whole */
+		static const char  pre[] = "change@/x\0ACTION=change\0DEVPATH=/x\0"
+		                           "SUBSYSTEM=power_supply_x\0";
+		struct sockaddr_nl to    = { .nl_family = AF_NETLINK,
+		                             .nl_groups = 1 };
+		char               buf[BARNY_UEVENT_BUF_SIZE];
+		ssize_t            n;
+		int                fd;
+		int                tx;
+
+		fd = barny_uevent_open("power_supply");
+		ASSERT_TRUE(fd >= 0);
+
+		/* multicasting on the uevent group takes CAP_NET_ADMIN; as
+		   anyone else there is nothing to send through the filter */
+		tx = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+		            NETLINK_KOBJECT_UEVENT);
+		if (tx >= 0
+		    && sendto(tx, mem, sizeof(mem) - 1, 0, (struct sockaddr *)&to,
+		              sizeof(to))
+		               > 0) {
+			sendto(tx, pre, sizeof(pre) - 1, 0, (struct sockaddr *)&to,
+			       sizeof(to));
+			sendto(tx, ac, sizeof(ac) - 1, 0, (struct sockaddr *)&to,
+			       sizeof(to));
+
+			/* only the AC event was queued, and nothing after it */
+			n = recv(fd, buf, sizeof(buf), 0);
+			ASSERT_EQ_INT((int)sizeof(ac) - 1, (int)n);
+			ASSERT_TRUE(memcmp(buf, ac, sizeof(ac) - 1) == 0);
+			ASSERT_TRUE(recv(fd, buf, sizeof(buf), 0) < 0);
+		}
+		if (tx >= 0)
+			close(tx);
+		close(fd);
+	}
+
+	TEST_SUITE_END();
+}
+
+void
+test_json_extractor(void)
+{
+	TEST_SUITE_BEGIN("JSON Extractor");
+
+	TEST("path queries reach into objects and arrays")
+	{
+		const char  *text = "[ { \"num\": 1, \"name\": \"1: web\", "
+		                    "\"rect\": { \"x\": 0, \"y\": -30 }, "
+		                    "\"focused\": true, \"urgent\": false }, "
+		                    "{\"num\":2,\"name\":\"2\",\"focused\":false} ]";
+		barny_json_t root;
+		barny_json_t v;
+		char         buf[32];
+
+		ASSERT_TRUE(barny_json_parse(text, &root));
+		ASSERT_TRUE(barny_json_is_array(&root));
+
+		ASSERT_TRUE(barny_json_path(&root, "0.num", &v));
+		ASSERT_EQ_INT(1, (int)barny_json_long(&v, 0));
+		ASSERT_TRUE(barny_json_path(&root, "0.rect.y", &v));
+		ASSERT_EQ_INT(-30, (int)barny_json_long(&v, 0));
+		ASSERT_TRUE(barny_json_path(&root, "0.focused", &v));
+		ASSERT_TRUE(barny_json_is_true(&v));
+		ASSERT_TRUE(barny_json_path(&root, "0.urgent", &v));
+		ASSERT_FALSE(barny_json_is_true(&v));
+
+		ASSERT_TRUE(barny_json_path(&root, "1.name", &v));
+		ASSERT_TRUE(barny_json_streq(&v, "2"));
+		ASSERT_TRUE(barny_json_path(&root, "0.name", &v));
+		ASSERT_TRUE(barny_json_string(&v, buf, sizeof(buf)));
+		ASSERT_EQ_STR("1: web", buf);
+
+		ASSERT_FALSE(barny_json_path(&root, "2.num", &v));
+		ASSERT_NULL(v.start);
+		ASSERT_FALSE(barny_json_path(&root, "0.output", &v));
+		ASSERT_FALSE(barny_json_path(&root, "0.num.x", &v));
+		ASSERT_EQ_INT(7, (int)barny_json_long(&v, 7));
+	}
+
+	TEST("skipped values may hide brackets and quotes in strings")
+	{
+		const char  *text = "{\"name\": \"a } ] \\\" [ {\", "
+		                    "\"nodes\": [[{\"x\": \"]\"}], {}], \"id\": 9}";
+		barny_json_t root;
+		barny_json_t v;
+
+		ASSERT_TRUE(barny_json_parse(text, &root));
+		ASSERT_TRUE(barny_json_path(&root, "id", &v));
+		ASSERT_EQ_INT(9, (int)barny_json_long(&v, 0));
+		ASSERT_TRUE(barny_json_path(&root, "nodes.0.0.x", &v));
+		ASSERT_TRUE(barny_json_streq(&v, "]"));
+	}
+
+	TEST("find stops at the first object with a matching member")
+	{
+		const char  *text = "{\"id\": 1, \"focused\": false, \"nodes\": ["
+		                    "{\"id\": 2, \"name\": \"\\\"focused\\\": true\", "
+		                    "\"marks\": [\"focused\", true]}, "
+		                    "{\"id\": 3, \"nodes\": [{\"id\": 4, "
+		                    "\"rect\": {\"x\": 0}, \"focused\": true}]}]}";
+		barny_json_t root;
+		barny_json_t node;
+		barny_json_t v;
+
+		ASSERT_TRUE(barny_json_parse(text, &root));
+		ASSERT_TRUE(barny_json_find(&root, "focused", "true", &node));
+		ASSERT_TRUE(barny_json_path(&node, "id", &v));
+		ASSERT_EQ_INT(4, (int)barny_json_long(&v, 0));
+		ASSERT_TRUE(*(node.end - 1) == '}');
+
+		ASSERT_FALSE(barny_json_find(&root, "urgent", "true", &node));
+		ASSERT_NULL(node.start);
+		ASSERT_TRUE(barny_json_find(&root, "focused", "false", &node));
+		ASSERT_TRUE(node.start == root.start);
+	}
+
+	TEST("strings unescape and truncate on character boundaries")
+	{
+		const char  *text = "[\"a\\/b\\n\\u00e9\\ud83d\\ude00\", "
+		                    "\"\xc3\xa9\xc3\xa9\", null, 12]";
+		barny_json_t root;
+		barny_json_t v;
+		char         buf[16];
+
+		ASSERT_TRUE(barny_json_parse(text, &root));
+		ASSERT_TRUE(barny_json_path(&root, "0", &v));
+		ASSERT_TRUE(barny_json_string(&v, buf, sizeof(buf)));
+		ASSERT_EQ_STR("a/b\n\xc3\xa9\xf0\x9f\x98\x80", buf);
+		ASSERT_TRUE(barny_json_string(&v, buf, 8));
+		ASSERT_EQ_STR("a/b\n\xc3\xa9", buf);
+
+		ASSERT_TRUE(barny_json_path(&root, "1", &v));
+		ASSERT_TRUE(barny_json_string(&v, buf, 4));
+		ASSERT_EQ_STR("\xc3\xa9", buf);
+
+		ASSERT_TRUE(barny_json_path(&root, "2", &v));
+		ASSERT_FALSE(barny_json_string(&v, buf, sizeof(buf)));
+		ASSERT_EQ_STR("", buf);
+		ASSERT_TRUE(barny_json_path(&root, "3", &v));
+		ASSERT_TRUE(barny_json_is_number(&v));
+		ASSERT_EQ_INT(12, (int)barny_json_long(&v, 0));
+	}
+
+	TEST("truncated or malformed text stops the walk")
+	{
+		barny_json_iter_t it;
+		barny_json_t      root;
+		barny_json_t      key;
+		barny_json_t      v;
+		int               n;
+
+		ASSERT_FALSE(barny_json_parse("{\"change\": \"focus\", \"cur", &root));
+		ASSERT_FALSE(barny_json_parse("", &root));
+		ASSERT_FALSE(barny_json_parse("[\"open", &root));
+
+		ASSERT_TRUE(barny_json_parse("{\"a\": 1, \"b\" 2, \"c\": 3}", &root));
+		n = 0;
+		barny_json_iter(&it, &root);
+		while (barny_json_next(&it, &key, &v))
+			n++;
+		ASSERT_EQ_INT(1, n);
+		ASSERT_FALSE(barny_json_next(&it, &key, &v));
+
+		ASSERT_TRUE(barny_json_parse("\"not a container\"", &root));
+		barny_json_iter(&it, &root);
+		ASSERT_FALSE(barny_json_next(&it, NULL, &v));
+	}
+
+	TEST_SUITE_END();
+}
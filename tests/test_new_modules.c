@@ -1,5 +1,8 @@
 #include "test_framework.h"
 #include "barny.h"
+#include "src/modules/netlink.h"
+#include "util.h"
+#include <poll.h>
 #include <unistd.h>
 #include <sys/stat.h>
 
@@ -205,7 +208,7 @@ test_disk_module_behavior(void)
 
 		mod = barny_module_disk_create();
 		mod->init(mod, &state);
-		mod->update(mod);
+		barny_module_refresh(&state, mod);
 
 		ASSERT_TRUE(mod->dirty);
 
@@ -226,7 +229,7 @@ test_disk_module_behavior(void)
 
 		mod                    = barny_module_disk_create();
 		mod->init(mod, &state);
-		mod->update(mod);
+		barny_module_refresh(&state, mod);
 
 		ASSERT_TRUE(mod->dirty);
 
@@ -462,7 +465,7 @@ test_network_module_behavior(void)
 
 		mod = barny_module_network_create();
 		mod->init(mod, &state);
-		mod->update(mod);
+		barny_module_refresh(&state, mod);
 
 		ASSERT_NOT_NULL(mod);
 
@@ -483,7 +486,7 @@ test_network_module_behavior(void)
 
 		mod                            = barny_module_network_create();
 		mod->init(mod, &state);
-		mod->update(mod);
+		barny_module_refresh(&state, mod);
 
 		ASSERT_NOT_NULL(mod);
 
@@ -505,7 +508,7 @@ test_network_module_behavior(void)
 
 		mod                            = barny_module_network_create();
 		mod->init(mod, &state);
-		mod->update(mod);
+		barny_module_refresh(&state, mod);
 
 		ASSERT_NOT_NULL(mod);
 
@@ -516,6 +519,62 @@ test_network_module_behavior(void)
 		free(mod);
 	}
 
+	TEST("netlink table holds loopback and its counters")
+	{
+		barny_netlink_t            *nl;
+		const barny_netlink_link_t *lo;
+		struct pollfd               pfd;
+		int                         changes = 0;
+
+		nl = barny_netlink_open();
+		ASSERT_NOT_NULL(nl);
+
+		lo = barny_netlink_find(nl, "lo");
+		ASSERT_NOT_NULL(lo);
+		ASSERT_FALSE(lo->wireless);
+		ASSERT_EQ_STR("127.0.0.1", lo->ipv4);
+
+		/* the dump answers on the socket the event loop would watch */
+		barny_netlink_request_stats(nl);
+		pfd = (struct pollfd){ .fd = barny_netlink_fd(nl), .events = POLLIN };
+		while (!(changes & BARNY_NETLINK_STATS) && poll(&pfd, 1, 1000) == 1)
+			changes |= barny_netlink_dispatch(nl);
+		ASSERT_TRUE(changes & BARNY_NETLINK_STATS);
+		lo = barny_netlink_find(nl, "lo");
+		ASSERT_TRUE(lo->have_stats);
+
+		ASSERT_NULL(barny_netlink_find(nl, "nonexistent99"));
+		barny_netlink_close(nl);
+	}
+
+	TEST("an SSID request does not wait for its reply")
+	{
+		barny_netlink_t            *nl;
+		const barny_netlink_link_t *lo;
+		struct pollfd               pfd;
+		uint64_t                    t0;
+		char                        ssid[64];
+		int                         i;
+
+		nl = barny_netlink_open();
+		ASSERT_NOT_NULL(nl);
+		lo = barny_netlink_find(nl, "lo");
+		ASSERT_NOT_NULL(lo);
+
+		t0 = barny_now_ms();
+		barny_netlink_request_ssid(nl, lo->index);
+		ASSERT_TRUE(barny_now_ms() - t0 < 50);
+
+		/* the family lookup and the interface request both answer on
+		   the polled fd; lo is no wireless link either way */
+		pfd = (struct pollfd){ .fd = barny_netlink_fd(nl), .events = POLLIN };
+		for (i = 0; i < 4 && poll(&pfd, 1, 200) == 1; i++)
+			barny_netlink_dispatch(nl);
+		ASSERT_FALSE(barny_netlink_ssid(nl, lo->index, ssid, sizeof(ssid)));
+		ASSERT_EQ_STR("", ssid);
+		barny_netlink_close(nl);
+	}
+
 	TEST_SUITE_END();
 }
 
@@ -773,7 +832,7 @@ test_module_destroy_safety(void)
 	{
 		barny_module_t *mod = barny_module_workspace_create();
 
-		state.sway_ipc_fd   = -1;
+		state.sway_cmds.fd = -1;
 		mod->init(mod, &state);
 		mod->update(mod);
 		if (mod->destroy)
@@ -930,9 +989,9 @@ test_module_null_font(void)
 		barny_module_t *mod;
 		int             result;
 
-		mod               = barny_module_workspace_create();
-		state.sway_ipc_fd = -1;
-		result            = mod->init(mod, &state);
+		mod                = barny_module_workspace_create();
+		state.sway_cmds.fd = -1;
+		result             = mod->init(mod, &state);
 		ASSERT_EQ_INT(0, result);
 		if (mod->destroy)
 			mod->destroy(mod);
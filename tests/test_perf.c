@@ -1,15 +1,26 @@
 #include "barny.h"
+#include "barny_json.h"
+#include "barny_sysfs.h"
 #include "../src/modules/popup.h"
 
 #include <cairo.h>
+#include <cjson/cJSON.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #define BAR_W 1920
 #define BAR_H 47
 
+#ifndef BARNY_FIXTURES_DIR
+#define BARNY_FIXTURES_DIR "tests/fixtures"
+#endif
+
 static double
 now_ns(void)
 {
@@ -105,6 +116,49 @@ bench_module(const char *name, barny_module_t *(*create)(void), int update_iters
 	free(mod);
 }
 
+/* A module with a collector only reads what collect left behind in update,
+   so bench_module alone misses where it touches the system. This runs both
+   back to back, as barny_module_refresh does without an executor. */
+static void
+bench_module_collect(const char *name, barny_module_t *(*create)(void),
+                     int iters)
+{
+	barny_state_t   state;
+	barny_module_t *mod;
+	double          t0;
+	double          t1;
+	char            label[64];
+	int             i;
+
+	state = (barny_state_t){ 0 };
+	barny_config_defaults(&state.config);
+
+	mod = create();
+	if (!mod || !mod->init || mod->init(mod, &state) != 0 || !mod->collect
+	    || !mod->update) {
+		printf("  %-32s SKIP (no collector)\n", name);
+		if (mod && mod->destroy)
+			mod->destroy(mod);
+		barny_config_cleanup(&state.config);
+		free(mod);
+		return;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		mod->collect(mod);
+		mod->update(mod);
+	}
+	t1 = now_ns();
+	snprintf(label, sizeof(label), "%s collect+update", name);
+	report(label, iters, t1 - t0);
+
+	if (mod->destroy)
+		mod->destroy(mod);
+	barny_config_cleanup(&state.config);
+	free(mod);
+}
+
 static void
 bench_config_parse(int iters)
 {
@@ -151,6 +205,63 @@ bench_config_parse(int iters)
 	unlink(path);
 }
 
+/* A config as long as a heavily commented one gets: every line still
+   has to find its key, so this is where key dispatch shows up. */
+static void
+bench_config_parse_large(int iters)
+{
+	static const char *const lines[] = {
+		"height = 47",
+		"position = bottom",
+		"font = \"Iosevka 11\"",
+		"text_color = #e0e0e0",
+		"blur_mode = pyramid",
+		"refraction = liquid",
+		"glass_gleam = 0.3",
+		"workspace_names = 1, 2, 3, 4, 5",
+		"sysinfo_freq_decimals = 1",
+		"sysinfo_temp_unit_space = false",
+		"crypto_currency_symbol = \"$\"",
+		"tray_icon_bg_color = #202020",
+		"tray_icon_bg_opacity = 0.4",
+		"clock_date_separator = -",
+		"network_popup_show_mac = true",
+		"ram_used_method = available",
+		"windowtitle_empty_text = \"desktop\"",
+		"weather_popup_show_feels_like = false",
+		"unknown_key = ignored",
+	};
+	const char *path;
+	FILE       *f;
+	double      t0;
+	double      t1;
+	int         i;
+
+	path = "/tmp/barny_perf_config_large.conf";
+	f    = fopen(path, "w");
+	if (!f)
+		return;
+	for (i = 0; i < 500; i++) {
+		if (i % 10 == 0)
+			fprintf(f, "# section %d\n", i / 10);
+		else
+			fprintf(f, "%s\n",
+			        lines[i % (sizeof(lines) / sizeof(lines[0]))]);
+	}
+	fclose(f);
+
+	t0 = now_ns();
+	for (i = 0; i < iters; i++) {
+		barny_config_t cfg;
+		barny_config_defaults(&cfg);
+		barny_config_load(&cfg, path);
+		barny_config_cleanup(&cfg);
+	}
+	t1 = now_ns();
+	report("config load (500 lines)", iters, t1 - t0);
+	unlink(path);
+}
+
 static void
 bench_text_measure(int iters)
 {
@@ -184,6 +295,398 @@ bench_text_measure(int iters)
 	pango_font_description_free(fd);
 }
 
+/* The wallpaper blur runs once per output at startup and again on every
+   wallpaper reload, over the whole output; the sizes are the common panel
+   resolutions plus 8K wallpapers, the radii span the range people actually
+   configure, and each runs through both blur modes. */
+static void
+bench_blur(void)
+{
+	static const int dims[][2] = {
+		{ 1920, 1080 },
+		{ 2560, 1440 },
+		{ 3840, 2160 },
+		{ 7680, 4320 },
+	};
+	static const int radii[] = { 2, 5, 12, 30 };
+	char             label[64];
+	size_t           d;
+	size_t           r;
+
+	for (d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+		cairo_surface_t *surf;
+		unsigned char   *data;
+		int              stride;
+		int              y;
+		int              x;
+
+		surf = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, dims[d][0],
+		                                  dims[d][1]);
+		if (cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+			cairo_surface_destroy(surf);
+			continue;
+		}
+
+		/* something with texture, so the sums are not all one value */
+		cairo_surface_flush(surf);
+		data   = cairo_image_surface_get_data(surf);
+		stride = cairo_image_surface_get_stride(surf);
+		for (y = 0; y < dims[d][1]; y++)
+			for (x = 0; x < dims[d][0] * 4; x++)
+				data[y * stride + x] = (unsigned char)((x * 7) ^ (y * 13));
+		cairo_surface_mark_dirty(surf);
+
+		for (r = 0; r < sizeof(radii) / sizeof(radii[0]); r++) {
+			int    iters = dims[d][0] >= 3840 ? 3 : 5;
+			double t0;
+			double t1;
+			int    i;
+
+			t0 = now_ns();
+			for (i = 0; i < iters; i++)
+				barny_blur_surface(surf, radii[r]);
+			t1 = now_ns();
+			snprintf(label, sizeof(label), "blur %dx%d r%d", dims[d][0],
+			         dims[d][1], radii[r]);
+			report(label, iters, t1 - t0);
+
+			t0 = now_ns();
+			for (i = 0; i < iters; i++)
+				barny_blur_surface_pyramid(surf, radii[r], 2);
+			t1 = now_ns();
+			snprintf(label, sizeof(label), "blur pyramid %dx%d r%d",
+			         dims[d][0], dims[d][1], radii[r]);
+			report(label, iters, t1 - t0);
+		}
+
+		cairo_surface_destroy(surf);
+	}
+}
+
+/* remove the wallpaper cache files under dir so the next run is cold */
+static void
+clear_wallpaper_cache(const char *dir)
+{
+	char           path[256];
+	DIR           *d;
+	struct dirent *e;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	while ((e = readdir(d))) {
+		if (e->d_name[0] == '.')
+			continue;
+		snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+		unlink(path);
+	}
+	closedir(d);
+}
+
+static void
+drop_wallpaper(barny_state_t *state)
+{
+	if (state->blurred_wallpaper)
+		cairo_surface_destroy(state->blurred_wallpaper);
+	if (state->displaced_wallpaper)
+		cairo_surface_destroy(state->displaced_wallpaper);
+	if (state->displacement_map)
+		cairo_surface_destroy(state->displacement_map);
+	state->blurred_wallpaper   = NULL;
+	state->displaced_wallpaper = NULL;
+	state->displacement_map    = NULL;
+}
+
+/* Everything barny does to the wallpaper before its first frame: decode,
+   blur, vibrancy and the glass displacement on a cold start, versus mapping
+   the result back from $XDG_CACHE_HOME/barny on a warm one. The pipeline's
+   own chatter goes to /dev/null while it is timed. */
+static void
+bench_wallpaper_cache(void)
+{
+	static const int dims[][2] = {
+		{ 1920, 1080 },
+		{ 3840, 2160 },
+	};
+	char             root[64];
+	char             dir[96];
+	char             path[96];
+	char             label[64];
+	barny_state_t    state;
+	size_t           d;
+	int              saved;
+	int              null;
+
+	snprintf(root, sizeof(root), "/tmp/barny_perf_cache_%d", getpid());
+	snprintf(dir, sizeof(dir), "%s/barny", root);
+	snprintf(path, sizeof(path), "/tmp/barny_perf_wp_%d.png", getpid());
+	mkdir(root, 0700);
+	setenv("XDG_CACHE_HOME", root, 1);
+
+	memset(&state, 0, sizeof(state));
+	barny_config_defaults(&state.config);
+	state.config.wallpaper_path = strdup(path);
+	state.config.blur_radius    = 30;
+
+	fflush(stdout);
+	saved = dup(STDOUT_FILENO);
+	null  = open("/dev/null", O_WRONLY);
+
+	for (d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+		cairo_surface_t *surf;
+		unsigned char   *data;
+		int              stride;
+		int              iters;
+		double           cold;
+		double           warm;
+		double           t0;
+		int              y;
+		int              x;
+		int              i;
+
+		surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, dims[d][0],
+		                                  dims[d][1]);
+		cairo_surface_flush(surf);
+		data   = cairo_image_surface_get_data(surf);
+		stride = cairo_image_surface_get_stride(surf);
+		for (y = 0; y < dims[d][1]; y++)
+			for (x = 0; x < dims[d][0] * 4; x++)
+				data[y * stride + x] = (unsigned char)((x * 7) ^ (y * 13));
+		cairo_surface_mark_dirty(surf);
+		cairo_surface_write_to_png(surf, path);
+		cairo_surface_destroy(surf);
+
+		iters = 3;
+		cold  = 0;
+		warm  = 0;
+		for (i = 0; i < iters; i++) {
+			clear_wallpaper_cache(dir);
+			fflush(stdout);
+			dup2(null, STDOUT_FILENO);
+			t0 = now_ns();
+			barny_wallpaper_prepare(&state);
+			cold += now_ns() - t0;
+			drop_wallpaper(&state);
+
+			t0 = now_ns();
+			barny_wallpaper_prepare(&state);
+			warm += now_ns() - t0;
+			drop_wallpaper(&state);
+			fflush(stdout);
+			dup2(saved, STDOUT_FILENO);
+		}
+
+		snprintf(label, sizeof(label), "wallpaper cold %dx%d", dims[d][0],
+		         dims[d][1]);
+		report(label, iters, cold);
+		snprintf(label, sizeof(label), "wallpaper warm %dx%d", dims[d][0],
+		         dims[d][1]);
+		report(label, iters, warm);
+	}
+
+	close(null);
+	close(saved);
+	clear_wallpaper_cache(dir);
+	rmdir(dir);
+	rmdir(root);
+	unlink(path);
+	unsetenv("XDG_CACHE_HOME");
+	barny_config_cleanup(&state.config);
+}
+
+#define BENCH_MAX_FILES 64
+
+/* The files one module reads on every tick */
+typedef struct {
+	const char *module;
+	char        paths[BENCH_MAX_FILES][BARNY_SYSFS_PATH_MAX];
+	int         count;
+} bench_file_set_t;
+
+static void
+bench_file_add(bench_file_set_t *set, const char *path)
+{
+	if (set->count < BENCH_MAX_FILES && access(path, R_OK) == 0)
+		snprintf(set->paths[set->count++], BARNY_SYSFS_PATH_MAX, "%s",
+		         path);
+}
+
+/* Each module's per-tick file reads the way they were done before the
+   cached-fd port (fopen, fgets every line, fclose, for every file) and the
+   way the module does them now (one pread per cached fd). Network reads
+   the counters of lo, standing in for whatever interface is up; files
+   missing on this machine are left out, and a module with none is
+   skipped. */
+static void
+bench_sysfs_reads(int iters)
+{
+	static bench_file_set_t   sets[4];
+	static barny_sysfs_file_t files[BENCH_MAX_FILES];
+	bench_file_set_t         *set;
+	char                      buf[4096];
+	char                      path[BARNY_SYSFS_PATH_MAX];
+	char                      label[64];
+	FILE                     *f;
+	double                    t0;
+	double                    t1;
+	long                      cpus;
+	size_t                    s;
+	int                       i;
+	int                       j;
+
+	memset(sets, 0, sizeof(sets));
+
+	sets[0].module = "sysinfo";
+	bench_file_add(&sets[0], "/proc/uptime");
+	bench_file_add(&sets[0], "/proc/loadavg");
+	bench_file_add(&sets[0], "/sys/class/thermal/thermal_zone0/temp");
+	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	for (j = 0; j < cpus; j++) {
+		snprintf(path, sizeof(path),
+		         "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq",
+		         j);
+		bench_file_add(&sets[0], path);
+	}
+
+	sets[1].module = "ram";
+	bench_file_add(&sets[1], "/proc/meminfo");
+
+	sets[2].module = "battery";
+	bench_file_add(&sets[2], "/sys/class/power_supply/BAT0/uevent");
+
+	sets[3].module = "network";
+	bench_file_add(&sets[3], "/sys/class/net/lo/statistics/rx_bytes");
+	bench_file_add(&sets[3], "/sys/class/net/lo/statistics/tx_bytes");
+
+	for (s = 0; s < sizeof(sets) / sizeof(sets[0]); s++) {
+		set = &sets[s];
+		if (set->count == 0) {
+			printf("  %-32s SKIP (no files)\n", set->module);
+			continue;
+		}
+
+		t0 = now_ns();
+		for (i = 0; i < iters; i++) {
+			for (j = 0; j < set->count; j++) {
+				f = fopen(set->paths[j], "r");
+				if (!f)
+					continue;
+				while (fgets(buf, sizeof(buf), f))
+					;
+				fclose(f);
+			}
+		}
+		t1 = now_ns();
+		snprintf(label, sizeof(label), "%s stdio, %d file%s", set->module,
+		         set->count, set->count == 1 ? "" : "s");
+		report(label, iters, t1 - t0);
+
+		for (j = 0; j < set->count; j++)
+			barny_sysfs_init(&files[j], "%s", set->paths[j]);
+		t0 = now_ns();
+		for (i = 0; i < iters; i++)
+			for (j = 0; j < set->count; j++)
+				barny_sysfs_read(&files[j], buf, sizeof(buf));
+		t1 = now_ns();
+		for (j = 0; j < set->count; j++)
+			barny_sysfs_close(&files[j]);
+		snprintf(label, sizeof(label), "%s pread, %d file%s", set->module,
+		         set->count, set->count == 1 ? "" : "s");
+		report(label, iters, t1 - t0);
+	}
+}
+
+/* The focused window's name out of a GET_TREE reply, the way windowtitle
+   used to get it (a cJSON DOM, then a walk) and the way it does now. */
+static cJSON *
+dom_focused(cJSON *node)
+{
+	static const char *const keys[] = { "nodes", "floating_nodes" };
+	cJSON                   *child;
+	cJSON                   *found;
+	int                      k;
+
+	if (cJSON_IsTrue(cJSON_GetObjectItem(node, "focused")))
+		return node;
+	for (k = 0; k < 2; k++) {
+		cJSON_ArrayForEach(child, cJSON_GetObjectItem(node, keys[k]))
+		{
+			found = dom_focused(child);
+			if (found)
+				return found;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+bench_sway_tree(int iters)
+{
+	const char  *path = BARNY_FIXTURES_DIR "/sway_get_tree.json";
+	barny_json_t tree;
+	barny_json_t node;
+	barny_json_t name;
+	char         title[512];
+	char         dom_title[512];
+	char        *text;
+	cJSON       *dom;
+	cJSON       *found;
+	FILE        *f;
+	long         len;
+	double       t0;
+	double       t1;
+	int          i;
+
+	f = fopen(path, "r");
+	if (!f) {
+		printf("  %-32s (no %s)\n", "sway GET_TREE", path);
+		return;
+	}
+	fseek(f, 0, SEEK_END);
+	len  = ftell(f);
+	rewind(f);
+	text = malloc((size_t)len + 1);
+	if (!text || fread(text, 1, (size_t)len, f) != (size_t)len) {
+		free(text);
+		fclose(f);
+		return;
+	}
+	text[len] = '\0';
+	fclose(f);
+
+	dom_title[0] = '\0';
+	t0           = now_ns();
+	for (i = 0; i < iters; i++) {
+		dom   = cJSON_Parse(text);
+		found = dom_focused(dom);
+		if (found && cJSON_IsString(cJSON_GetObjectItem(found, "name")))
+			snprintf(dom_title, sizeof(dom_title), "%s",
+			         cJSON_GetObjectItem(found, "name")->valuestring);
+		cJSON_Delete(dom);
+	}
+	t1 = now_ns();
+	report("GET_TREE focused (cJSON)", iters, t1 - t0);
+	printf("  %-32s %8.1f MB/s\n", "",
+	       (double)len * iters / ((t1 - t0) / 1e9) / 1e6);
+
+	title[0] = '\0';
+	t0       = now_ns();
+	for (i = 0; i < iters; i++) {
+		if (barny_json_parse(text, &tree)
+		    && barny_json_find(&tree, "focused", "true", &node)
+		    && barny_json_path(&node, "name", &name))
+			barny_json_string(&name, title, sizeof(title));
+	}
+	t1 = now_ns();
+	report("GET_TREE focused (barny_json)", iters, t1 - t0);
+	printf("  %-32s %8.1f MB/s  (%.0f KB, same title: %s)\n", "",
+	       (double)len * iters / ((t1 - t0) / 1e9) / 1e6,
+	       (double)len / 1024.0, strcmp(title, dom_title) == 0 ? "yes" : "NO");
+
+	free(text);
+}
+
 int
 main(void)
 {
@@ -191,6 +694,7 @@ main(void)
 	printf("(informational, no pass/fail thresholds)\n\n");
 
 	bench_config_parse(2000);
+	bench_config_parse_large(200);
 	bench_text_measure(5000);
 
 	{
@@ -220,11 +724,26 @@ main(void)
 	bench_module("weather", barny_module_weather_create, 500, 1000);
 	bench_module("crypto", barny_module_crypto_create, 500, 1000);
 	bench_module("workspace", barny_module_workspace_create, 200, 500);
+	bench_module_collect("disk", barny_module_disk_create, 200);
+
+	printf("\n");
+	bench_sysfs_reads(2000);
+
+	printf("\n");
+	bench_sway_tree(50);
+
+	printf("\n");
+	bench_blur();
+
+	printf("\n");
+	bench_wallpaper_cache();
 
 	printf("\n=== budget guidance ===\n");
 	printf("  bar refresh ~1Hz; aim:\n");
 	printf("    sum(update) per tick    < 5 ms  (=> <0.5%% of one core)\n");
 	printf("    each render             < 1 ms\n");
 	printf("    config load             < 5 ms\n");
+	printf("    wallpaper blur (1080p)  < 50 ms (startup only)\n");
+	printf("    cached wallpaper        < 1 ms  (warm startup)\n");
 	return 0;
 }
@@ -0,0 +1,101 @@
+#include "test_framework.h"
+#include "barny.h"
+#include <string.h>
+
+static int test_tray_flushes   = 0;
+static int test_frame_requests = 0;
+
+static void
+test_sni_host_flush(barny_state_t *state)
+{
+	(void)state;
+	test_tray_flushes++;
+}
+
+static void
+test_output_request_frame(barny_output_t *output)
+{
+	output->frame_pending = true;
+	test_frame_requests++;
+}
+
+#define barny_sni_host_flush       test_sni_host_flush
+#define barny_output_request_frame test_output_request_frame
+
+#include "../src/wayland/repaint.c"
+
+#undef barny_sni_host_flush
+#undef barny_output_request_frame
+
+void
+test_defer_coalesces_until_frame(void)
+{
+	TEST_SUITE_BEGIN("barny_defer");
+
+	TEST("with nothing on screen the work runs at once")
+	{
+		barny_state_t state;
+
+		memset(&state, 0, sizeof(state));
+		test_tray_flushes = 0;
+
+		barny_defer(&state, BARNY_DEFER_TRAY);
+		ASSERT_EQ_INT(1, test_tray_flushes);
+		ASSERT_FALSE(state.repaint_scheduled);
+		ASSERT_EQ_INT(0, (int)state.deferred);
+		ASSERT_EQ_INT(0, (int)state.coalesced_events);
+	}
+
+	TEST("a burst before the frame callback refreshes once")
+	{
+		barny_state_t  state;
+		barny_output_t out;
+		int            i;
+
+		memset(&state, 0, sizeof(state));
+		memset(&out, 0, sizeof(out));
+		out.configured = true;
+		/* a frame already on its way, so nothing needs committing */
+		out.frame_pending   = true;
+		state.outputs       = &out;
+		test_tray_flushes   = 0;
+		test_frame_requests = 0;
+
+		barny_defer(&state, 0);
+		ASSERT_TRUE(state.repaint_scheduled);
+		ASSERT_TRUE(out.redraw_queued);
+		for (i = 0; i < 40; i++)
+			barny_defer(&state, i % 2 ? BARNY_DEFER_TRAY : 0);
+		ASSERT_EQ_INT(40, (int)state.coalesced_events);
+		ASSERT_EQ_INT(0, test_tray_flushes);
+		ASSERT_EQ_INT(0, test_frame_requests);
+
+		/* the callback */
+		barny_deferred_flush(&state);
+		ASSERT_EQ_INT(1, test_tray_flushes);
+		ASSERT_FALSE(state.repaint_scheduled);
+		ASSERT_EQ_INT(0, (int)state.deferred);
+
+		/* the next change starts a new round */
+		barny_defer(&state, 0);
+		ASSERT_TRUE(state.repaint_scheduled);
+		ASSERT_EQ_INT(40, (int)state.coalesced_events);
+	}
+
+	TEST("unconfigured outputs are not waited for")
+	{
+		barny_state_t  state;
+		barny_output_t out;
+
+		memset(&state, 0, sizeof(state));
+		memset(&out, 0, sizeof(out));
+		state.outputs     = &out;
+		test_tray_flushes = 0;
+
+		barny_defer(&state, BARNY_DEFER_TRAY);
+		ASSERT_EQ_INT(1, test_tray_flushes);
+		ASSERT_FALSE(out.redraw_queued);
+	}
+
+	TEST_SUITE_END();
+}
@@ -9,6 +9,7 @@ static sni_item_t *last_item       = NULL;
 static int         last_x          = 0;
 static int         last_y          = 0;
 static int         overflow_calls  = 0;
+static int         prefetch_calls  = 0;
 
 sni_item_t *
 barny_sni_host_get_items(barny_state_t *state)
@@ -46,6 +47,14 @@ barny_sni_item_is_menu(barny_state_t *state, sni_item_t *item)
 	return false;
 }
 
+void
+barny_sni_item_prefetch_menu(barny_state_t *state, sni_item_t *item)
+{
+	(void)state;
+	(void)item;
+	prefetch_calls++;
+}
+
 char *
 barny_sni_item_menu_path(barny_state_t *state, sni_item_t *item)
 {
@@ -86,6 +95,7 @@ reset_tray_mocks(void)
 	last_x          = 0;
 	last_y          = 0;
 	overflow_calls  = 0;
+	prefetch_calls  = 0;
 	test_items      = NULL;
 }
 
@@ -262,5 +272,16 @@ test_tray_click_handling(void)
 		state.config.tray_overflow = false;
 	}
 
+	TEST("hovering the tray prefetches every item's menu")
+	{
+		reset_tray_mocks();
+		test_items = &item1;
+		tray_on_hover(&mod, true, base_x + 5, 10);
+		ASSERT_EQ_INT(2, prefetch_calls);
+		tray_on_hover(&mod, false, 0, 0);
+		ASSERT_EQ_INT(2, prefetch_calls);
+		ASSERT_EQ_INT(0, activate_calls);
+	}
+
 	TEST_SUITE_END();
 }
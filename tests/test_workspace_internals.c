@@ -34,20 +34,18 @@ test_sway_ipc_send(barny_state_t *state, uint32_t type, const char *payload)
 }
 
 static char *
-test_sway_ipc_recv(barny_state_t *state, uint32_t *type)
+test_sway_ipc_request(barny_state_t *state, uint32_t type, const char *payload,
+                      int timeout_ms)
 {
-	(void)state;
-	if (type) {
-		*type = 0;
-	}
-	return strdup("ok");
+	(void)timeout_ms;
+	test_sway_ipc_send(state, type, payload);
+	return strdup("[]");
 }
 
-static char *
-test_sway_ipc_recv_sync(barny_state_t *state, uint32_t *type, int timeout_ms)
+static int
+test_sway_ipc_command(barny_state_t *state, const char *command)
 {
-	(void)timeout_ms;
-	return test_sway_ipc_recv(state, type);
+	return test_sway_ipc_send(state, BARNY_SWAY_IPC_COMMAND, command);
 }
 
 static int
@@ -58,16 +56,14 @@ test_sway_ipc_subscribe(barny_state_t *state, const char *events)
 	return 0;
 }
 
-#define barny_sway_ipc_send      test_sway_ipc_send
-#define barny_sway_ipc_recv      test_sway_ipc_recv
-#define barny_sway_ipc_recv_sync test_sway_ipc_recv_sync
+#define barny_sway_ipc_command   test_sway_ipc_command
+#define barny_sway_ipc_request   test_sway_ipc_request
 #define barny_sway_ipc_subscribe test_sway_ipc_subscribe
 
 #include "../src/modules/workspace.c"
 
-#undef barny_sway_ipc_send
-#undef barny_sway_ipc_recv
-#undef barny_sway_ipc_recv_sync
+#undef barny_sway_ipc_command
+#undef barny_sway_ipc_request
 #undef barny_sway_ipc_subscribe
 
 void
@@ -176,6 +172,94 @@ test_parse_workspaces(void)
 	TEST_SUITE_END();
 }
 
+void
+test_apply_workspace_event(void)
+{
+	TEST_SUITE_BEGIN("apply_workspace_event");
+
+	workspace_data_t data;
+	int              i;
+
+	memset(&data, 0, sizeof(data));
+	parse_workspaces(
+	        &data,
+	        "["
+	        "{\"id\": 10, \"num\": 1, \"name\": \"1\", \"output\": \"eDP-1\", \"focused\": true, \"visible\": true},"
+	        "{\"id\": 11, \"num\": 3, \"name\": \"3\", \"output\": \"eDP-1\"},"
+	        "{\"id\": 20, \"num\": 5, \"name\": \"5\", \"output\": \"DP-2\", \"visible\": true}"
+	        "]");
+
+	TEST("init slots a new workspace in by number on its output")
+	{
+		ASSERT_TRUE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"init\", \"current\": {\"id\": 12, \"num\": 2, \"name\": \"2\", \"output\": \"eDP-1\", \"focused\": true}}"));
+		ASSERT_EQ_INT(4, data.workspace_count);
+		ASSERT_EQ_INT(2, data.workspaces[1].num);
+		ASSERT_EQ_INT(3, data.workspaces[2].num);
+		/* focus arrives with its own event */
+		ASSERT_FALSE(data.workspaces[1].focused);
+		ASSERT_TRUE(data.workspaces[0].focused);
+	}
+
+	TEST("focus moves focus and visibility on the same output only")
+	{
+		ASSERT_TRUE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"focus\", \"current\": {\"id\": 12, \"num\": 2, \"output\": \"eDP-1\"}, \"old\": {\"id\": 10}}"));
+		ASSERT_FALSE(data.workspaces[0].focused);
+		ASSERT_FALSE(data.workspaces[0].visible);
+		ASSERT_TRUE(data.workspaces[1].focused);
+		ASSERT_TRUE(data.workspaces[1].visible);
+		ASSERT_TRUE(data.workspaces[3].visible);
+	}
+
+	TEST("urgent and rename update in place")
+	{
+		ASSERT_TRUE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"urgent\", \"current\": {\"id\": 20, \"urgent\": true}}"));
+		ASSERT_TRUE(data.workspaces[3].urgent);
+		ASSERT_FALSE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"urgent\", \"current\": {\"id\": 20, \"urgent\": true}}"));
+
+		ASSERT_TRUE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"rename\", \"current\": {\"id\": 12, \"num\": 2, \"name\": \"2:web\", \"output\": \"eDP-1\"}}"));
+		ASSERT_EQ_STR("2:web", data.workspaces[1].name);
+		ASSERT_TRUE(data.workspaces[1].focused);
+	}
+
+	TEST("empty removes the workspace")
+	{
+		ASSERT_TRUE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"empty\", \"current\": {\"id\": 10}}"));
+		ASSERT_EQ_INT(3, data.workspace_count);
+		ASSERT_EQ_INT(2, data.workspaces[0].num);
+		ASSERT_FALSE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"empty\", \"current\": {\"id\": 10}}"));
+	}
+
+	TEST("ignores unknown changes and broken payloads")
+	{
+		ASSERT_FALSE(apply_workspace_event(
+		        &data,
+		        "{\"change\": \"reload\", \"current\": {\"id\": 12}}"));
+		ASSERT_FALSE(apply_workspace_event(&data, "{\"change\": \"focus\"}"));
+		ASSERT_FALSE(apply_workspace_event(&data, "not json"));
+		ASSERT_EQ_INT(3, data.workspace_count);
+	}
+
+	for (i = 0; i < data.workspace_count; i++) {
+		free(data.workspaces[i].name);
+	}
+
+	TEST_SUITE_END();
+}
+
 void
 test_get_workspace_label(void)
 {